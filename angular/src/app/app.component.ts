@@ -1,5 +1,8 @@
-import { Component, OnInit, VERSION } from '@angular/core';
+import { Component, OnInit, OnDestroy, VERSION } from '@angular/core';
 import { HttpClient, HttpParams  } from '@angular/common/http';
+import { Subscription } from 'rxjs';
+import { retry } from 'rxjs/operators';
+import { webSocket, WebSocketSubject } from 'rxjs/webSocket';
 import { ToastrService } from 'ngx-toastr';
 
 @Component({
@@ -7,7 +10,7 @@ import { ToastrService } from 'ngx-toastr';
   templateUrl: './app.component.html',
   styleUrls: ['./app.component.scss']
 })
-export class AppComponent implements OnInit {
+export class AppComponent implements OnInit, OnDestroy {
     constructor(
         private http: HttpClient,
         private toastrService: ToastrService,
@@ -15,6 +18,7 @@ export class AppComponent implements OnInit {
     
     public version = '0.0.1';
     public gpio_list = [ 32, 33, 25, 26 ];
+    public gpio_active: { [gpio: number]: boolean } = {};
     public app_info: any = {
         name: '?',
         version: '?',
@@ -25,15 +29,24 @@ export class AppComponent implements OnInit {
         elapse: '?',
     };
 
+    private ws: WebSocketSubject<any>;
+    private ws_subscription: Subscription;
+    private ws_open = false;
+    private cmd_id = 0;
+
     ngOnInit() {
         this.updateAppInfo();
+        this.connectWebSocket();
+    }
+
+    ngOnDestroy() {
+        this.ws_subscription.unsubscribe();
     }
 
     updateAppInfo() {
         this.http.get('/status/').subscribe(
             json => {
-                this.app_info = json;
-                this.app_info.angular = VERSION.full;
+                this.setAppInfo(json);
             },
             error => {
                 // ignore
@@ -41,17 +54,71 @@ export class AppComponent implements OnInit {
         );
     }
 
+    setAppInfo(json) {
+        this.app_info = json;
+        this.app_info.angular = VERSION.full;
+    }
+
+    // NOTE: GPIO の状態やステータスはサーバから通知される．切断されたら繋ぎ直す
+    connectWebSocket() {
+        const scheme = (location.protocol == 'https:') ? 'wss:' : 'ws:';
+
+        this.ws = webSocket({
+            url: scheme + '//' + location.host + '/ws',
+            openObserver: {
+                next: () => {
+                    this.ws_open = true;
+                    this.ws.next({ type: 'status' });
+                }
+            },
+            closeObserver: {
+                next: () => {
+                    this.ws_open = false;
+                }
+            },
+        });
+        this.ws_subscription = this.ws.pipe(retry({ delay: 3000 })).subscribe(
+            msg => this.onMessage(msg)
+        );
+    }
+
+    onMessage(msg) {
+        switch (msg['type']) {
+        case 'status':
+            this.setAppInfo(msg['status']);
+            break;
+        case 'state':
+        case 'pulse_done':
+            for (const gpio of msg['gpio']) {
+                this.gpio_active[gpio] = msg['active'];
+            }
+            break;
+        case 'result':
+            this.showResult(msg['status'] == 'OK');
+            break;
+        }
+    }
+
+    showResult(success) {
+        if (success) {
+            this.toastrService.success('正常に制御できました．', '成功');
+        } else {
+            this.toastrService.error('制御に失敗しました．', '失敗');
+        }
+    }
+
     buttonClick(gpio) {
+        if (this.ws_open) {
+            this.ws.next({ type: 'push', id: ++this.cmd_id, gpio: gpio });
+            return;
+        }
+        // NOTE: WebSocket が使えない間は HTTP で送る
         this.http.get('/api/gpio/push/' + gpio).subscribe(
             json => {
-                if (json["status"] == "OK") {
-                    this.toastrService.success('正常に制御できました．', '成功');
-                } else {
-                    this.toastrService.error('制御に失敗しました．', '失敗');
-                }
+                this.showResult(json["status"] == "OK");
             },
             error => {
-                this.toastrService.error('制御に失敗しました．', '失敗');
+                this.showResult(false);
             }
         );
     }
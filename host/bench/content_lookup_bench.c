@@ -0,0 +1,173 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// NOTE: static な content_find() と生成された content_list をそのまま測るため，http_task.c を取り込む
+#include "http_task.c"
+
+// NOTE: 静的コンテンツの検索 1 回あたりのコストを，生成した表の完全一致 (bsearch) と
+// 以前の strstr() による線形走査 (最後に一致したものを採る) で比べる．
+// 実際の表に加えて，アセット数を増やした仮の表でも測り，件数に対する伸びを見る
+//
+// Usage: content_lookup_bench [DURATION_SEC]
+
+#define DEFAULT_DURATION_SEC    1
+#define CHECK_INTERVAL          4096    // 時刻を読む間隔 (回)
+#define SYNTH_PATH_SIZE         32
+
+static const size_t synth_size_list[] = { 32, 128, 512 };
+
+typedef const static_content_t *(*lookup_t)(const static_content_t *list, size_t count, const char *uri);
+
+static const static_content_t *lookup_bsearch(const static_content_t *list, size_t count, const char *uri)
+{
+    const static_content_t *content;
+    char path[64];
+    size_t len;
+
+    if (list == content_list) {
+        return content_find(uri);
+    }
+    // NOTE: 仮の表は content_find() と同じ手順で引く
+    uri += strlen(APP_PATH);
+    if (*uri == '/') {
+        uri++;
+    }
+    len = strcspn(uri, "?#");
+    if (len >= sizeof(path)) {
+        return NULL;
+    }
+    memcpy(path, uri, len);
+    path[len] = '\0';
+    content = bsearch(path, list, count, sizeof(list[0]), content_cmp);
+    return (content != NULL) ? content : &(list[0]);
+}
+
+// NOTE: 以前の http_handle_app の走査
+static const static_content_t *lookup_strstr(const static_content_t *list, size_t count, const char *uri)
+{
+    const static_content_t *content = NULL;
+
+    for (size_t i = 0; i < count; i++) {
+        if (strstr(uri, list[i].path) != NULL) {
+            content = &(list[i]);
+        }
+    }
+    return (content != NULL) ? content : &(list[0]);
+}
+
+// NOTE: 表のすべてのパスと，クエリ付き・存在しないパスを引く
+static char **uri_list_make(const static_content_t *list, size_t count, size_t *uri_count)
+{
+    char **uri_list = malloc(sizeof(char *) * (count * 2 + 2));
+    size_t n = 0;
+
+    if (uri_list == NULL) {
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (asprintf(&(uri_list[n++]), APP_PATH "/%s", list[i].path) < 0 ||
+            asprintf(&(uri_list[n++]), APP_PATH "/%s?v=" PROJECT_VER, list[i].path) < 0) {
+            exit(1);
+        }
+    }
+    uri_list[n++] = strdup(APP_PATH "/");
+    uri_list[n++] = strdup(APP_PATH "/settings/wifi");
+    *uri_count = n;
+
+    return uri_list;
+}
+
+static double lookup_rate(lookup_t lookup, const static_content_t *list, size_t count, double duration_sec)
+{
+    char **uri_list;
+    size_t uri_count;
+    uint64_t lookups = 0;
+    uintptr_t sink = 0;
+    int64_t start, deadline, now;
+
+    uri_list = uri_list_make(list, count, &uri_count);
+
+    start = esp_timer_get_time();
+    deadline = start + (int64_t)(duration_sec * 1000000);
+    do {
+        for (uint32_t i = 0; i < CHECK_INTERVAL; i++) {
+            sink += (uintptr_t)lookup(list, count, uri_list[i % uri_count]);
+        }
+        lookups += CHECK_INTERVAL;
+        now = esp_timer_get_time();
+    } while (now < deadline);
+    __asm__ volatile("" : : "r"(sink));
+
+    for (size_t i = 0; i < uri_count; i++) {
+        free(uri_list[i]);
+    }
+    free(uri_list);
+
+    return lookups / ((now - start) / 1e6);
+}
+
+static int synth_cmp(const void *a, const void *b)
+{
+    return strcmp(((const static_content_t *)a)->path, ((const static_content_t *)b)->path);
+}
+
+// NOTE: 実際の表の名前に連番を付けて件数を増やし，生成時と同じくパスで並べる
+static static_content_t *synth_list_make(size_t count, char **path_buf_out)
+{
+    static_content_t *list = calloc(count, sizeof(static_content_t));
+    char *path_buf = malloc(count * SYNTH_PATH_SIZE);
+
+    if ((list == NULL) || (path_buf == NULL)) {
+        exit(1);
+    }
+    for (size_t i = 0; i < count; i++) {
+        char *path = path_buf + i * SYNTH_PATH_SIZE;
+
+        snprintf(path, SYNTH_PATH_SIZE, "%zu-%s", i, content_list[i % ARRAY_SIZE_OF(content_list)].path);
+        list[i] = content_list[i % ARRAY_SIZE_OF(content_list)];
+        list[i].path = path;
+    }
+    qsort(list, count, sizeof(static_content_t), synth_cmp);
+    *path_buf_out = path_buf;
+
+    return list;
+}
+
+static void bench(const char *name, const static_content_t *list, size_t count, double duration_sec)
+{
+    double bsearch_rate = lookup_rate(lookup_bsearch, list, count, duration_sec);
+    double strstr_rate = lookup_rate(lookup_strstr, list, count, duration_sec);
+
+    printf("%-10s %5zu entries  bsearch %12.0f/s  strstr %12.0f/s  x%.1f\n",
+           name, count, bsearch_rate, strstr_rate, bsearch_rate / strstr_rate);
+}
+
+int main(int argc, char *argv[])
+{
+    double duration_sec = (argc > 1) ? atof(argv[1]) : DEFAULT_DURATION_SEC;
+
+    // NOTE: 部分文字列の名前で取り違えないことも確かめる
+    for (size_t i = 0; i < ARRAY_SIZE_OF(content_list); i++) {
+        char uri[80];
+
+        snprintf(uri, sizeof(uri), APP_PATH "/%s?v=1", content_list[i].path);
+        if (content_find(uri) != &(content_list[i])) {
+            printf("content_find(\"%s\") returned the wrong entry\n", uri);
+            return 1;
+        }
+    }
+
+    printf("lookups/sec, %.1f s each\n", duration_sec);
+    bench("content", content_list, ARRAY_SIZE_OF(content_list), duration_sec);
+    for (size_t i = 0; i < ARRAY_SIZE_OF(synth_size_list); i++) {
+        char *path_buf;
+        static_content_t *list = synth_list_make(synth_size_list[i], &path_buf);
+
+        bench("synthetic", list, synth_size_list[i], duration_sec);
+        free(path_buf);
+        free(list);
+    }
+
+    return 0;
+}
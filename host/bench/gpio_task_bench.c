@@ -0,0 +1,160 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "gpio_task.h"
+#include "host_port.h"
+
+// NOTE: gpio_task の実行部 (キュー → gpio_ctrl_task → エッジ → タイマーで終了) の
+// コマンド処理数と，投入からエッジまでの遅延を測る．
+// ピンごとのレート制限は rate_limit_nop.c で外し，実行部だけを測る．
+// 各ピンは前のパルスの終了を待ってから次を投入する (パルス中の指示はまとめられるため)
+//
+// Usage: gpio_task_bench [DURATION_SEC] [WIDTH_US]
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define DEFAULT_DURATION_SEC    2
+#define DEFAULT_WIDTH_US        100
+#define END_TIMEOUT_US          1000000
+#define LATENCY_MAX             (1 << 22)
+
+static const uint8_t pin_list[] = { 25, 26, 32, 33 };
+
+static pthread_mutex_t bench_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t bench_cond;
+static uint64_t busy_mask = 0;
+static int64_t push_time[64];
+static uint32_t *latency_list;
+static uint32_t latency_count = 0;
+
+// NOTE: gpio_ctrl_task と esp_timer のタスクから呼ばれる
+static void bench_listener(const gpio_task_event_t *event)
+{
+    int64_t now = esp_timer_get_time();
+
+    pthread_mutex_lock(&bench_lock);
+    if (event->type == GPIO_TASK_EVENT_START) {
+        for (uint32_t i = 0; i < 64; i++) {
+            if ((event->mask & (1ULL << i)) && (latency_count < LATENCY_MAX)) {
+                latency_list[latency_count++] = (uint32_t)(now - push_time[i]);
+            }
+        }
+    } else {
+        busy_mask &= ~event->mask;
+        pthread_cond_broadcast(&bench_cond);
+    }
+    pthread_mutex_unlock(&bench_lock);
+}
+
+// NOTE: 前のパルスが終わるまで待つ．終わらなければ false
+static bool pin_wait(uint8_t gpio_num)
+{
+    uint64_t bit = 1ULL << gpio_num;
+    struct timespec deadline;
+    bool done = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += END_TIMEOUT_US / 1000000;
+
+    pthread_mutex_lock(&bench_lock);
+    while (busy_mask & bit) {
+        if (pthread_cond_timedwait(&bench_cond, &bench_lock, &deadline) != 0) {
+            busy_mask &= ~bit;
+            done = false;
+            break;
+        }
+    }
+    busy_mask |= bit;
+    push_time[gpio_num] = esp_timer_get_time();
+    pthread_mutex_unlock(&bench_lock);
+
+    return done;
+}
+
+static void pin_done(uint8_t gpio_num)
+{
+    pthread_mutex_lock(&bench_lock);
+    busy_mask &= ~(1ULL << gpio_num);
+    pthread_mutex_unlock(&bench_lock);
+}
+
+static int compare_uint32(const void *a, const void *b)
+{
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+
+    return (x > y) - (x < y);
+}
+
+static uint32_t percentile(uint32_t p)
+{
+    if (latency_count == 0) {
+        return 0;
+    }
+    return latency_list[((uint64_t)latency_count * p / 100 < latency_count) ?
+                        (uint64_t)latency_count * p / 100 : latency_count - 1];
+}
+
+int main(int argc, char *argv[])
+{
+    double duration_sec = (argc > 1) ? atof(argv[1]) : DEFAULT_DURATION_SEC;
+    uint32_t width_us = (argc > 2) ? strtoul(argv[2], NULL, 10) : DEFAULT_WIDTH_US;
+    uint32_t pushed = 0, rejected = 0, lost = 0;
+    uint32_t retry_after_ms;
+    gpio_task_stat_t stat;
+    int64_t start, deadline, elapsed;
+    esp_err_t ret;
+
+    latency_list = malloc(LATENCY_MAX * sizeof(uint32_t));
+    if (latency_list == NULL) {
+        return 1;
+    }
+    host_cond_init(&bench_cond);
+
+    gpio_task_start();
+    ESP_ERROR_CHECK(gpio_task_add_listener(bench_listener));
+
+    start = esp_timer_get_time();
+    deadline = start + (int64_t)(duration_sec * 1000000);
+    while (esp_timer_get_time() < deadline) {
+        for (uint32_t i = 0; i < ARRAY_SIZE_OF(pin_list); i++) {
+            if (!pin_wait(pin_list[i])) {
+                lost++;
+            }
+            ret = gpio_task_push(pin_list[i], width_us, &retry_after_ms);
+            if (ret != ESP_OK) {
+                pin_done(pin_list[i]);
+                rejected++;
+                continue;
+            }
+            pushed++;
+        }
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(pin_list); i++) {
+        if (!pin_wait(pin_list[i])) {
+            lost++;
+        }
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    pthread_mutex_lock(&bench_lock);
+    qsort(latency_list, latency_count, sizeof(uint32_t), compare_uint32);
+    gpio_task_get_stat(&stat);
+
+    printf("gpio_task: %u pins, width %u us, %.1f s\n",
+           (unsigned int)ARRAY_SIZE_OF(pin_list), width_us, elapsed / 1e6);
+    printf("commands   %10u (%.0f/s), rejected %u, coalesced %u, lost %u\n",
+           pushed, pushed / (elapsed / 1e6), rejected, stat.coalesced, lost);
+    printf("push->edge p50 %u us, p99 %u us, max %u us\n",
+           percentile(50), percentile(99), latency_count ? latency_list[latency_count - 1] : 0);
+    printf("gpio_task  latency_p99_us %u, latency_max_us %u, pulse_error_max_us %u\n",
+           stat.latency_p99_us, stat.latency_max_us, stat.pulse_error_max_us);
+    pthread_mutex_unlock(&bench_lock);
+
+    return (lost == 0) ? 0 : 1;
+}
@@ -0,0 +1,19 @@
+#include "rate_limit.h"
+
+// NOTE: ベンチマーク用．rate_limit.c の代わりにリンクして，常に受け付ける
+
+void rate_limit_init(rate_limit_t *limit, uint32_t rate_per_sec, uint32_t burst)
+{
+    limit->interval_us = 0;
+    limit->burst_us = 0;
+    limit->tat = 0;
+}
+
+uint32_t rate_limit_wait_ms(const rate_limit_t *limit, int64_t now)
+{
+    return 0;
+}
+
+void rate_limit_take(rate_limit_t *limit, int64_t now)
+{
+}
@@ -0,0 +1,82 @@
+#!/usr/bin/env python3
+#
+# Generate placeholder web contents (FILE.br and FILE.gz) for the host build,
+# used when the Angular app has not been built. The Brotli variant is written
+# as uncompressed meta-blocks so that no Brotli encoder is needed.
+#
+# Usage: gen_assets.py OUTPUT_DIR NAME...
+
+import gzip
+import os
+import sys
+
+PLACEHOLDER = {
+    '.html': '<!DOCTYPE html>\n<html><head><title>esp32-wifi-io</title></head>\n'
+             '<body><p>Host build placeholder. Build angular/ for the real app.</p></body></html>\n',
+    '.js': '/* Host build placeholder. */\n',
+    '.css': '/* Host build placeholder. */\n',
+}
+
+BROTLI_BLOCK_MAX = 1 << 16
+
+
+class BitWriter:
+    def __init__(self):
+        self.data = bytearray()
+        self.bit = 0
+
+    def write(self, value, width):
+        for i in range(width):
+            if self.bit == 0:
+                self.data.append(0)
+            self.data[-1] |= ((value >> i) & 1) << self.bit
+            self.bit = (self.bit + 1) % 8
+
+    def align(self):
+        self.bit = 0
+
+
+def brotli_stored(data):
+    writer = BitWriter()
+    # NOTE: WBITS = 16 (1 bit の 0)
+    writer.write(0, 1)
+    for start in range(0, len(data), BROTLI_BLOCK_MAX):
+        block = data[start:start + BROTLI_BLOCK_MAX]
+        writer.write(0, 1)                  # ISLAST
+        writer.write(0, 2)                  # MNIBBLES = 4
+        writer.write(len(block) - 1, 16)    # MLEN - 1
+        writer.write(1, 1)                  # ISUNCOMPRESSED
+        writer.align()
+        writer.data += block
+    writer.write(1, 1)                      # ISLAST
+    writer.write(1, 1)                      # ISLASTEMPTY
+    return bytes(writer.data)
+
+
+def placeholder(name):
+    ext = os.path.splitext(name)[1]
+    if ext in PLACEHOLDER:
+        return PLACEHOLDER[ext].encode()
+    # NOTE: favicon.ico などはただのバイト列でよい
+    return bytes(range(256))
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write('Usage: gen_assets.py OUTPUT_DIR NAME...\n')
+        return 1
+
+    out_dir = argv[0]
+    os.makedirs(out_dir, exist_ok=True)
+    for name in argv[1:]:
+        data = placeholder(name)
+        with open(os.path.join(out_dir, name + '.gz'), 'wb') as f:
+            f.write(gzip.compress(data, compresslevel=9, mtime=0))
+        with open(os.path.join(out_dir, name + '.br'), 'wb') as f:
+            f.write(brotli_stored(data))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <stddef.h>
+
+// NOTE: cJSON のうち main/ が使う解析側の API だけを同じ名前で実装する
+
+#define cJSON_Invalid   (0)
+#define cJSON_False     (1 << 0)
+#define cJSON_True      (1 << 1)
+#define cJSON_NULL      (1 << 2)
+#define cJSON_Number    (1 << 3)
+#define cJSON_String    (1 << 4)
+#define cJSON_Array     (1 << 5)
+#define cJSON_Object    (1 << 6)
+
+typedef struct cJSON {
+    struct cJSON *next;
+    struct cJSON *prev;
+    struct cJSON *child;
+    int type;
+    char *valuestring;
+    int valueint;
+    double valuedouble;
+    char *string;
+} cJSON;
+
+typedef int cJSON_bool;
+
+cJSON *cJSON_Parse(const char *value);
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length);
+void cJSON_Delete(cJSON *item);
+int cJSON_GetArraySize(const cJSON *array);
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index);
+cJSON *cJSON_GetObjectItem(const cJSON *const object, const char *const string);
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *const object, const char *const string);
+cJSON_bool cJSON_IsNumber(const cJSON *const item);
+cJSON_bool cJSON_IsString(const cJSON *const item);
+cJSON_bool cJSON_IsArray(const cJSON *const item);
+cJSON_bool cJSON_IsObject(const cJSON *const item);
+cJSON_bool cJSON_IsBool(const cJSON *const item);
+cJSON_bool cJSON_IsNull(const cJSON *const item);
+
+#define cJSON_ArrayForEach(element, array) \
+    for (element = (array != NULL) ? (array)->child : NULL; element != NULL; element = element->next)
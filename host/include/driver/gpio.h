@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+
+typedef int gpio_num_t;
+
+#define GPIO_NUM_MAX            40
+
+// NOTE: ESP32 の SOC_GPIO_VALID_GPIO_MASK と同じく 20, 24, 28-31 は存在しない
+#define SOC_GPIO_VALID_GPIO_MASK        (0xFFFFFFFFFFULL & ~(0ULL | (1ULL << 20) | (1ULL << 24) | \
+                                                             (1ULL << 28) | (1ULL << 29) | \
+                                                             (1ULL << 30) | (1ULL << 31)))
+#define SOC_GPIO_VALID_OUTPUT_GPIO_MASK (SOC_GPIO_VALID_GPIO_MASK & ~(0ULL | (0x3FULL << 34)))
+
+#define GPIO_IS_VALID_GPIO(gpio_num) \
+    (((gpio_num) >= 0) && ((gpio_num) < GPIO_NUM_MAX) && \
+     (((1ULL << (gpio_num)) & SOC_GPIO_VALID_GPIO_MASK) != 0))
+#define GPIO_IS_VALID_OUTPUT_GPIO(gpio_num) \
+    (((gpio_num) >= 0) && ((gpio_num) < GPIO_NUM_MAX) && \
+     (((1ULL << (gpio_num)) & SOC_GPIO_VALID_OUTPUT_GPIO_MASK) != 0))
+
+typedef enum {
+    GPIO_INTR_DISABLE = 0,
+    GPIO_INTR_POSEDGE = 1,
+    GPIO_INTR_NEGEDGE = 2,
+    GPIO_INTR_ANYEDGE = 3,
+    GPIO_INTR_LOW_LEVEL = 4,
+    GPIO_INTR_HIGH_LEVEL = 5,
+    GPIO_INTR_MAX,
+} gpio_int_type_t;
+
+#define GPIO_PIN_INTR_DISABLE   GPIO_INTR_DISABLE
+#define GPIO_PIN_INTR_POSEDGE   GPIO_INTR_POSEDGE
+#define GPIO_PIN_INTR_NEGEDGE   GPIO_INTR_NEGEDGE
+#define GPIO_PIN_INTR_ANYEDGE   GPIO_INTR_ANYEDGE
+
+typedef enum {
+    GPIO_MODE_DISABLE = 0,
+    GPIO_MODE_INPUT = 1,
+    GPIO_MODE_OUTPUT = 2,
+    GPIO_MODE_OUTPUT_OD = 6,
+    GPIO_MODE_INPUT_OUTPUT_OD = 7,
+    GPIO_MODE_INPUT_OUTPUT = 3,
+} gpio_mode_t;
+
+typedef enum {
+    GPIO_PULLUP_DISABLE = 0x0,
+    GPIO_PULLUP_ENABLE = 0x1,
+} gpio_pullup_t;
+
+typedef enum {
+    GPIO_PULLDOWN_DISABLE = 0x0,
+    GPIO_PULLDOWN_ENABLE = 0x1,
+} gpio_pulldown_t;
+
+typedef struct {
+    uint64_t pin_bit_mask;
+    gpio_mode_t mode;
+    gpio_pullup_t pull_up_en;
+    gpio_pulldown_t pull_down_en;
+    gpio_int_type_t intr_type;
+} gpio_config_t;
+
+typedef void (*gpio_isr_t)(void *);
+
+#define ESP_INTR_FLAG_IRAM      (1 << 10)
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig);
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level);
+int gpio_get_level(gpio_num_t gpio_num);
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type);
+esp_err_t gpio_install_isr_service(int intr_alloc_flags);
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args);
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num);
+
+// NOTE: ホスト専用．入力ピンのレベルを変え，割り込みが有効なら ISR を呼ぶ
+void gpio_host_set_input(gpio_num_t gpio_num, uint32_t level);
@@ -0,0 +1,7 @@
+#pragma once
+
+// NOTE: ホストでは配置先の指定に意味がないので，すべて空にする
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
+#define RTC_NOINIT_ATTR
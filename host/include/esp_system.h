@@ -0,0 +1,22 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "esp_err.h"
+#include "esp_attr.h"
+
+typedef enum {
+    ESP_MAC_WIFI_STA,
+    ESP_MAC_WIFI_SOFTAP,
+    ESP_MAC_BT,
+    ESP_MAC_ETH,
+} esp_mac_type_t;
+
+void esp_restart(void);
+uint32_t esp_random(void);
+uint32_t esp_get_free_heap_size(void);
+uint32_t esp_get_minimum_free_heap_size(void);
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type);
+
+// NOTE: ホスト専用．esp_restart() が呼ばれた回数 (ホストでは再起動せずに数えるだけ)
+uint32_t esp_host_restart_count(void);
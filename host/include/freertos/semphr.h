@@ -0,0 +1,23 @@
+#pragma once
+
+#include "freertos/queue.h"
+
+// NOTE: セマフォは要素の大きさが 0 のキューとして実現する (FreeRTOS と同じ)
+typedef QueueHandle_t SemaphoreHandle_t;
+
+SemaphoreHandle_t xSemaphoreCreateBinary(void);
+SemaphoreHandle_t xSemaphoreCreateMutex(void);
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount);
+
+#define vSemaphoreCreateBinary(xSemaphore) do {         \
+        (xSemaphore) = xSemaphoreCreateBinary();        \
+        if ((xSemaphore) != NULL) {                     \
+            xSemaphoreGive(xSemaphore);                 \
+        }                                               \
+    } while (0)
+
+#define xSemaphoreTake(xSemaphore, xBlockTime)  xQueueReceive(xSemaphore, NULL, xBlockTime)
+#define xSemaphoreGive(xSemaphore)              xQueueSend(xSemaphore, NULL, 0)
+#define xSemaphoreGiveFromISR(xSemaphore, pxHigherPriorityTaskWoken) \
+    xQueueSendFromISR(xSemaphore, NULL, pxHigherPriorityTaskWoken)
+#define vSemaphoreDelete(xSemaphore)            vQueueDelete(xSemaphore)
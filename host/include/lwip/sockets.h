@@ -0,0 +1,8 @@
+#pragma once
+
+// NOTE: lwIP の BSD ソケット API はホストのものをそのまま使う
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <stdint.h>
+
+// NOTE: ESP32 の GPIO レジスタのうち，main/ が触るものだけを同じ名前で並べる．
+// ホストではただのメモリなので，w1ts/w1tc に書いても out/enable は変わらない．
+// 書き込まれた値はテストから直接読める
+typedef union {
+    struct {
+        uint32_t data: 8;
+        uint32_t reserved8: 24;
+    };
+    uint32_t val;
+} gpio_reg1_t;
+
+typedef volatile struct gpio_dev_s {
+    uint32_t bt_select;
+    uint32_t out;
+    uint32_t out_w1ts;
+    uint32_t out_w1tc;
+    gpio_reg1_t out1;
+    gpio_reg1_t out1_w1ts;
+    gpio_reg1_t out1_w1tc;
+    uint32_t sdio_select;
+    uint32_t enable;
+    uint32_t enable_w1ts;
+    uint32_t enable_w1tc;
+    gpio_reg1_t enable1;
+    gpio_reg1_t enable1_w1ts;
+    gpio_reg1_t enable1_w1tc;
+    uint32_t strap;
+    uint32_t in;
+    gpio_reg1_t in1;
+} gpio_dev_t;
+
+extern gpio_dev_t GPIO;
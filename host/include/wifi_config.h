@@ -0,0 +1,2 @@
+// NOTE: ホスト用の wifi_config.h．WIFI_SSID を定義しないので，設定の保存は行わない．
+// MQTT_BROKER_URI と UDP_CMD_ENABLE は host/Makefile で定義する (port/mqtt_client.c は接続しない)
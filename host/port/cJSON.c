@@ -0,0 +1,440 @@
+#include <ctype.h>
+#include <stdbool.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include "cJSON.h"
+
+// NOTE: cJSON と同じ木構造を作る再帰下降の解析器．
+// 入れ子の深さは cJSON と同じく CJSON_NESTING_LIMIT までに制限する
+
+#define CJSON_NESTING_LIMIT 1000
+
+typedef struct parser {
+    const char *p;
+    const char *end;
+    int depth;
+} parser_t;
+
+static cJSON *parse_value(parser_t *parser);
+
+static void skip_space(parser_t *parser)
+{
+    while ((parser->p < parser->end) && isspace((unsigned char)*parser->p)) {
+        parser->p++;
+    }
+}
+
+static bool match(parser_t *parser, const char *literal)
+{
+    size_t len = strlen(literal);
+
+    if (((size_t)(parser->end - parser->p) < len) || (strncmp(parser->p, literal, len) != 0)) {
+        return false;
+    }
+    parser->p += len;
+    return true;
+}
+
+static cJSON *item_new(int type)
+{
+    cJSON *item = calloc(1, sizeof(cJSON));
+
+    if (item != NULL) {
+        item->type = type;
+    }
+    return item;
+}
+
+static int hex4(const char *p)
+{
+    int value = 0;
+
+    for (int i = 0; i < 4; i++) {
+        int c = p[i];
+        value <<= 4;
+        if ((c >= '0') && (c <= '9')) {
+            value |= c - '0';
+        } else if ((c >= 'a') && (c <= 'f')) {
+            value |= c - 'a' + 10;
+        } else if ((c >= 'A') && (c <= 'F')) {
+            value |= c - 'A' + 10;
+        } else {
+            return -1;
+        }
+    }
+    return value;
+}
+
+static char *utf8_put(char *out, unsigned long cp)
+{
+    if (cp < 0x80) {
+        *out++ = cp;
+    } else if (cp < 0x800) {
+        *out++ = 0xC0 | (cp >> 6);
+        *out++ = 0x80 | (cp & 0x3F);
+    } else if (cp < 0x10000) {
+        *out++ = 0xE0 | (cp >> 12);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    } else {
+        *out++ = 0xF0 | (cp >> 18);
+        *out++ = 0x80 | ((cp >> 12) & 0x3F);
+        *out++ = 0x80 | ((cp >> 6) & 0x3F);
+        *out++ = 0x80 | (cp & 0x3F);
+    }
+    return out;
+}
+
+// NOTE: 開きの '"' の直後から読み，閉じの '"' の次に進める
+static char *parse_string(parser_t *parser)
+{
+    const char *start = parser->p;
+    const char *q = start;
+    char *str, *out;
+    int hi, lo;
+
+    while ((q < parser->end) && (*q != '"')) {
+        if (*q == '\\') {
+            q++;
+        }
+        q++;
+    }
+    if (q >= parser->end) {
+        return NULL;
+    }
+    // NOTE: エスケープを解くと短くなるだけなので，元の長さで確保すれば足りる
+    str = malloc(q - start + 1);
+    if (str == NULL) {
+        return NULL;
+    }
+    out = str;
+    for (const char *p = start; p < q; p++) {
+        if ((unsigned char)*p < 0x20) {
+            free(str);
+            return NULL;
+        }
+        if (*p != '\\') {
+            *out++ = *p;
+            continue;
+        }
+        p++;
+        switch (*p) {
+        case '"': case '\\': case '/':
+            *out++ = *p;
+            break;
+        case 'b':
+            *out++ = '\b';
+            break;
+        case 'f':
+            *out++ = '\f';
+            break;
+        case 'n':
+            *out++ = '\n';
+            break;
+        case 'r':
+            *out++ = '\r';
+            break;
+        case 't':
+            *out++ = '\t';
+            break;
+        case 'u':
+            if (((q - p) < 5) || ((hi = hex4(p + 1)) < 0)) {
+                free(str);
+                return NULL;
+            }
+            p += 4;
+            if ((hi >= 0xD800) && (hi <= 0xDBFF)) {
+                if (((q - p) < 7) || (p[1] != '\\') || (p[2] != 'u') ||
+                    ((lo = hex4(p + 3)) < 0) || (lo < 0xDC00) || (lo > 0xDFFF)) {
+                    free(str);
+                    return NULL;
+                }
+                p += 6;
+                out = utf8_put(out, 0x10000 + (((unsigned long)hi & 0x3FF) << 10) + (lo & 0x3FF));
+            } else {
+                out = utf8_put(out, hi);
+            }
+            break;
+        default:
+            free(str);
+            return NULL;
+        }
+    }
+    *out = '\0';
+    parser->p = q + 1;
+
+    return str;
+}
+
+static cJSON *parse_number(parser_t *parser)
+{
+    char buf[64];
+    size_t len = 0;
+    char *end;
+    cJSON *item;
+    double value;
+
+    while ((parser->p + len < parser->end) && (len < sizeof(buf) - 1) &&
+           (strchr("+-0123456789.eE", parser->p[len]) != NULL)) {
+        len++;
+    }
+    memcpy(buf, parser->p, len);
+    buf[len] = '\0';
+    value = strtod(buf, &end);
+    if ((end == buf) || (len == 0)) {
+        return NULL;
+    }
+    parser->p += end - buf;
+
+    item = item_new(cJSON_Number);
+    if (item == NULL) {
+        return NULL;
+    }
+    item->valuedouble = value;
+    // NOTE: cJSON と同じく int の範囲に飽和させる
+    if (value >= INT_MAX) {
+        item->valueint = INT_MAX;
+    } else if (value <= (double)INT_MIN) {
+        item->valueint = INT_MIN;
+    } else {
+        item->valueint = (int)value;
+    }
+    return item;
+}
+
+static cJSON *parse_container(parser_t *parser, bool is_object)
+{
+    cJSON *item = item_new(is_object ? cJSON_Object : cJSON_Array);
+    cJSON *tail = NULL;
+    cJSON *child;
+    char *name;
+    char close = is_object ? '}' : ']';
+
+    if (item == NULL) {
+        return NULL;
+    }
+    if (++parser->depth > CJSON_NESTING_LIMIT) {
+        goto error;
+    }
+    skip_space(parser);
+    if ((parser->p < parser->end) && (*parser->p == close)) {
+        parser->p++;
+        parser->depth--;
+        return item;
+    }
+    while (true) {
+        name = NULL;
+        skip_space(parser);
+        if (is_object) {
+            if ((parser->p >= parser->end) || (*parser->p != '"')) {
+                goto error;
+            }
+            parser->p++;
+            name = parse_string(parser);
+            if (name == NULL) {
+                goto error;
+            }
+            skip_space(parser);
+            if ((parser->p >= parser->end) || (*parser->p != ':')) {
+                free(name);
+                goto error;
+            }
+            parser->p++;
+        }
+        child = parse_value(parser);
+        if (child == NULL) {
+            free(name);
+            goto error;
+        }
+        child->string = name;
+        if (tail == NULL) {
+            item->child = child;
+        } else {
+            tail->next = child;
+            child->prev = tail;
+        }
+        tail = child;
+
+        skip_space(parser);
+        if (parser->p >= parser->end) {
+            goto error;
+        }
+        if (*parser->p == ',') {
+            parser->p++;
+            continue;
+        }
+        if (*parser->p == close) {
+            parser->p++;
+            break;
+        }
+        goto error;
+    }
+    parser->depth--;
+    return item;
+
+error:
+    cJSON_Delete(item);
+    return NULL;
+}
+
+static cJSON *parse_value(parser_t *parser)
+{
+    cJSON *item;
+
+    skip_space(parser);
+    if (parser->p >= parser->end) {
+        return NULL;
+    }
+    switch (*parser->p) {
+    case '{':
+        parser->p++;
+        return parse_container(parser, true);
+    case '[':
+        parser->p++;
+        return parse_container(parser, false);
+    case '"':
+        parser->p++;
+        item = item_new(cJSON_String);
+        if (item != NULL) {
+            item->valuestring = parse_string(parser);
+            if (item->valuestring == NULL) {
+                cJSON_Delete(item);
+                return NULL;
+            }
+        }
+        return item;
+    default:
+        break;
+    }
+    if (match(parser, "null")) {
+        return item_new(cJSON_NULL);
+    }
+    if (match(parser, "true")) {
+        item = item_new(cJSON_True);
+        if (item != NULL) {
+            item->valueint = 1;
+        }
+        return item;
+    }
+    if (match(parser, "false")) {
+        return item_new(cJSON_False);
+    }
+    return parse_number(parser);
+}
+
+cJSON *cJSON_ParseWithLength(const char *value, size_t buffer_length)
+{
+    parser_t parser = { value, value + buffer_length, 0 };
+    cJSON *item;
+
+    if (value == NULL) {
+        return NULL;
+    }
+    item = parse_value(&parser);
+    if (item == NULL) {
+        return NULL;
+    }
+    // NOTE: 末尾の NUL は許す (cJSON は NUL 終端の文字列を読む)
+    skip_space(&parser);
+    if ((parser.p < parser.end) && (*parser.p != '\0')) {
+        cJSON_Delete(item);
+        return NULL;
+    }
+    return item;
+}
+
+cJSON *cJSON_Parse(const char *value)
+{
+    return (value == NULL) ? NULL : cJSON_ParseWithLength(value, strlen(value));
+}
+
+void cJSON_Delete(cJSON *item)
+{
+    cJSON *next;
+
+    while (item != NULL) {
+        next = item->next;
+        cJSON_Delete(item->child);
+        free(item->valuestring);
+        free(item->string);
+        free(item);
+        item = next;
+    }
+}
+
+int cJSON_GetArraySize(const cJSON *array)
+{
+    int size = 0;
+
+    for (const cJSON *child = (array != NULL) ? array->child : NULL; child != NULL; child = child->next) {
+        size++;
+    }
+    return size;
+}
+
+cJSON *cJSON_GetArrayItem(const cJSON *array, int index)
+{
+    cJSON *child = (array != NULL) ? array->child : NULL;
+
+    while ((child != NULL) && (index-- > 0)) {
+        child = child->next;
+    }
+    return (index < 0) ? NULL : child;
+}
+
+static cJSON *object_find(const cJSON *object, const char *string, bool case_sensitive)
+{
+    if ((object == NULL) || (string == NULL)) {
+        return NULL;
+    }
+    for (cJSON *child = object->child; child != NULL; child = child->next) {
+        if ((child->string != NULL) &&
+            ((case_sensitive ? strcmp(child->string, string) : strcasecmp(child->string, string)) == 0)) {
+            return child;
+        }
+    }
+    return NULL;
+}
+
+cJSON *cJSON_GetObjectItem(const cJSON *const object, const char *const string)
+{
+    return object_find(object, string, false);
+}
+
+cJSON *cJSON_GetObjectItemCaseSensitive(const cJSON *const object, const char *const string)
+{
+    return object_find(object, string, true);
+}
+
+cJSON_bool cJSON_IsNumber(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & 0xFF) == cJSON_Number);
+}
+
+cJSON_bool cJSON_IsString(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & 0xFF) == cJSON_String);
+}
+
+cJSON_bool cJSON_IsArray(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & 0xFF) == cJSON_Array);
+}
+
+cJSON_bool cJSON_IsObject(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & 0xFF) == cJSON_Object);
+}
+
+cJSON_bool cJSON_IsBool(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & (cJSON_True | cJSON_False)) != 0);
+}
+
+cJSON_bool cJSON_IsNull(const cJSON *const item)
+{
+    return (item != NULL) && ((item->type & 0xFF) == cJSON_NULL);
+}
@@ -0,0 +1,1422 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <openssl/evp.h>
+#include <openssl/sha.h>
+
+#include "esp_http_server.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+
+// NOTE: IDF 4.2 の esp_http_server の振る舞いのうち，このアプリが頼っているものを再現する．
+// - サーバごとに 1 つのタスクが，待ち受け，クライアント，制御用のソケットを select() で見る
+// - URI は登録順に照合し，最初に一致したものを使う．一致しなければ 404/405 を返して切断する
+// - ハンドラが ESP_OK 以外を返したら切断する．ESP_OK なら読み残したボディを捨てて接続を保つ
+// - httpd_queue_work() の関数はサーバのタスクで実行する (制御用ソケットの代わりにパイプを使う)
+// - 接続数が max_open_sockets に達したら，lru_purge_enable なら最も古い接続を切る
+
+static const char *TAG = "httpd";
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define SESS_BUF_SIZE       (HTTPD_MAX_URI_LEN + HTTPD_MAX_REQ_HDR_LEN + 64)
+#define REQ_HDR_MAX         (HTTPD_MAX_REQ_HDR_LEN / 4)
+#define RESP_HEAD_SIZE      1024
+#define PURGE_BUF_LEN       32      // CONFIG_HTTPD_PURGE_BUF_LEN
+#define PORT_OFFSET_DEFAULT 10000
+#define WS_GUID             "258EAFA5-E914-47DA-95CA-C5AB0DC85B11"
+#define WS_FIN_BIT          0x80
+#define WS_MASK_BIT         0x80
+#define WS_OPCODE_BITS      0x0F
+#define WS_LENGTH_BITS      0x7F
+
+typedef struct httpd_data httpd_data_t;
+
+typedef struct resp_hdr {
+    const char *field;
+    const char *value;
+} resp_hdr_t;
+
+typedef struct req_hdr {
+    const char *field;
+    const char *value;
+} req_hdr_t;
+
+typedef struct sock_db {
+    int fd;
+    uint32_t id;
+    uint64_t lru_counter;
+    void *ctx;
+    httpd_free_ctx_fn_t free_ctx;
+    bool ws_handshake_done;
+    bool ws_control_frames;
+    esp_err_t (*ws_handler)(httpd_req_t *r);
+    void *ws_user_ctx;
+    // NOTE: 受信済みで未処理のデータは buf[pending_off] から pending_len バイト
+    char buf[SESS_BUF_SIZE + 1];
+    size_t pending_off;
+    size_t pending_len;
+    bool faulted;       // 障害を入れた後は，カーネルに残っているデータも受信させない
+} sock_db_t;
+
+typedef struct req_aux {
+    sock_db_t *sd;
+    size_t remaining_len;
+    req_hdr_t req_hdrs[REQ_HDR_MAX];
+    uint32_t req_hdrs_count;
+    const char *status;
+    const char *content_type;
+    bool first_chunk_sent;
+    resp_hdr_t *resp_hdrs;
+    uint32_t resp_hdrs_count;
+    bool ws_handshake_detect;
+    httpd_ws_type_t ws_type;
+    bool ws_final;
+    bool ws_masked;
+    uint8_t ws_len7;
+} req_aux_t;
+
+typedef struct httpd_work {
+    httpd_work_fn_t fn;
+    void *arg;
+} httpd_work_t;
+
+typedef struct sess_close_arg {
+    httpd_data_t *hd;
+    uint32_t id;
+} sess_close_arg_t;
+
+struct httpd_data {
+    httpd_config_t config;
+    int listen_fd;
+    int ctrl_fd[2];
+    sock_db_t **sd_list;
+    httpd_uri_t *uri_list;
+    uint64_t lru_counter;
+    uint32_t sess_id_next;
+    httpd_req_t req;
+    req_aux_t aux;
+    bool stop;
+    SemaphoreHandle_t exit_sem;
+};
+
+static pthread_mutex_t fault_lock = PTHREAD_MUTEX_INITIALIZER;
+static size_t fault_after_bytes = 0;
+static size_t fault_recv_bytes = 0;
+
+uint16_t httpd_host_port(uint16_t server_port)
+{
+    const char *offset_str = getenv("ESP_HOST_PORT_OFFSET");
+
+    return server_port + ((offset_str != NULL) ? atoi(offset_str) : PORT_OFFSET_DEFAULT);
+}
+
+void httpd_host_set_recv_fault(size_t after_bytes)
+{
+    pthread_mutex_lock(&fault_lock);
+    fault_after_bytes = after_bytes;
+    fault_recv_bytes = 0;
+    pthread_mutex_unlock(&fault_lock);
+}
+
+// NOTE: 受信したボディの累計が設定値に達したら，そこで切って接続を落とす．1 回で解除する
+static int fault_apply(sock_db_t *sd, int recv_len)
+{
+    bool fire = false;
+
+    pthread_mutex_lock(&fault_lock);
+    if (fault_after_bytes != 0) {
+        if ((fault_recv_bytes + recv_len) >= fault_after_bytes) {
+            recv_len = fault_after_bytes - fault_recv_bytes;
+            fault_after_bytes = 0;
+            fire = true;
+        } else {
+            fault_recv_bytes += recv_len;
+        }
+    }
+    pthread_mutex_unlock(&fault_lock);
+
+    if (fire) {
+        ESP_LOGW(TAG, "Injected receive fault on fd=%d.", sd->fd);
+        shutdown(sd->fd, SHUT_RDWR);
+        sd->faulted = true;
+        if (recv_len == 0) {
+            return HTTPD_SOCK_ERR_FAIL;
+        }
+    }
+    return recv_len;
+}
+
+//////////////////////////////////////////////////////////////////////
+// ソケット
+static int sock_err(void)
+{
+    if ((errno == EAGAIN) || (errno == EWOULDBLOCK)) {
+        return HTTPD_SOCK_ERR_TIMEOUT;
+    }
+    return HTTPD_SOCK_ERR_FAIL;
+}
+
+static int sess_recv(sock_db_t *sd, char *buf, size_t buf_len)
+{
+    size_t len;
+    ssize_t ret;
+
+    if (sd->pending_len != 0) {
+        len = (buf_len < sd->pending_len) ? buf_len : sd->pending_len;
+        memcpy(buf, sd->buf + sd->pending_off, len);
+        sd->pending_off += len;
+        sd->pending_len -= len;
+        return len;
+    }
+    ret = recv(sd->fd, buf, buf_len, 0);
+    if (ret < 0) {
+        return sock_err();
+    }
+    return ret;
+}
+
+static esp_err_t sess_recv_all(sock_db_t *sd, void *buf, size_t buf_len)
+{
+    size_t done = 0;
+    int ret;
+
+    while (done < buf_len) {
+        ret = sess_recv(sd, (char *)buf + done, buf_len - done);
+        if (ret <= 0) {
+            return ESP_FAIL;
+        }
+        done += ret;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t sock_send_all(int fd, const void *buf, size_t buf_len)
+{
+    size_t done = 0;
+    ssize_t ret;
+
+    while (done < buf_len) {
+        ret = send(fd, (const char *)buf + done, buf_len - done, MSG_NOSIGNAL);
+        if (ret <= 0) {
+            return ESP_ERR_HTTPD_RESP_SEND;
+        }
+        done += ret;
+    }
+    return ESP_OK;
+}
+
+static sock_db_t *sess_get(httpd_data_t *hd, int fd)
+{
+    for (uint32_t i = 0; i < hd->config.max_open_sockets; i++) {
+        if ((hd->sd_list[i] != NULL) && (hd->sd_list[i]->fd == fd)) {
+            return hd->sd_list[i];
+        }
+    }
+    return NULL;
+}
+
+static void sess_free_ctx(sock_db_t *sd)
+{
+    if (sd->ctx == NULL) {
+        return;
+    }
+    if (sd->free_ctx != NULL) {
+        sd->free_ctx(sd->ctx);
+    } else {
+        free(sd->ctx);
+    }
+    sd->ctx = NULL;
+}
+
+static void sess_close(httpd_data_t *hd, uint32_t i)
+{
+    sock_db_t *sd = hd->sd_list[i];
+
+    hd->sd_list[i] = NULL;
+    sess_free_ctx(sd);
+    if (hd->config.close_fn != NULL) {
+        hd->config.close_fn(hd, sd->fd);
+    } else {
+        close(sd->fd);
+    }
+    free(sd);
+}
+
+static void sess_close_lru(httpd_data_t *hd)
+{
+    uint32_t lru = 0;
+
+    for (uint32_t i = 1; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd_list[i]->lru_counter < hd->sd_list[lru]->lru_counter) {
+            lru = i;
+        }
+    }
+    ESP_LOGD(TAG, "Purge the least recently used session fd=%d.", hd->sd_list[lru]->fd);
+    sess_close(hd, lru);
+}
+
+static void sess_accept(httpd_data_t *hd)
+{
+    struct timeval tv;
+    sock_db_t *sd;
+    uint32_t i;
+    int fd;
+    int flag = 1;
+
+    for (i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd_list[i] == NULL) {
+            break;
+        }
+    }
+    if (i == hd->config.max_open_sockets) {
+        sess_close_lru(hd);
+        return sess_accept(hd);
+    }
+
+    fd = accept(hd->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+    tv.tv_sec = hd->config.recv_wait_timeout;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    tv.tv_sec = hd->config.send_wait_timeout;
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+    // NOTE: ループバックでは遅延 ACK と Nagle が噛み合って 40ms 待たされ，計測にならない
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+
+    sd = calloc(1, sizeof(sock_db_t));
+    if (sd == NULL) {
+        close(fd);
+        return;
+    }
+    sd->fd = fd;
+    sd->id = hd->sess_id_next++;
+    sd->lru_counter = ++hd->lru_counter;
+    if ((hd->config.open_fn != NULL) && (hd->config.open_fn(hd, fd) != ESP_OK)) {
+        close(fd);
+        free(sd);
+        return;
+    }
+    hd->sd_list[i] = sd;
+}
+
+//////////////////////////////////////////////////////////////////////
+// リクエストの解析
+static httpd_method_t method_parse(const char *str, bool *valid)
+{
+    static const struct {
+        const char *name;
+        httpd_method_t method;
+    } method_list[] = {
+        { "DELETE", HTTP_DELETE },
+        { "GET",    HTTP_GET },
+        { "HEAD",   HTTP_HEAD },
+        { "POST",   HTTP_POST },
+        { "PUT",    HTTP_PUT },
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(method_list); i++) {
+        if (strcmp(str, method_list[i].name) == 0) {
+            *valid = true;
+            return method_list[i].method;
+        }
+    }
+    *valid = false;
+    return HTTP_GET;
+}
+
+static const char *req_hdr_find(req_aux_t *ra, const char *field)
+{
+    for (uint32_t i = 0; i < ra->req_hdrs_count; i++) {
+        if (strcasecmp(ra->req_hdrs[i].field, field) == 0) {
+            return ra->req_hdrs[i].value;
+        }
+    }
+    return NULL;
+}
+
+static void req_init(httpd_data_t *hd, sock_db_t *sd)
+{
+    httpd_req_t *r = &(hd->req);
+    req_aux_t *ra = &(hd->aux);
+    resp_hdr_t *resp_hdrs = ra->resp_hdrs;
+
+    memset(r, 0, sizeof(httpd_req_t));
+    memset(ra, 0, sizeof(req_aux_t));
+    ra->resp_hdrs = resp_hdrs;
+    ra->sd = sd;
+    ra->status = "200 OK";
+    ra->content_type = "text/html";
+
+    r->handle = hd;
+    r->aux = ra;
+    r->sess_ctx = sd->ctx;
+    r->free_ctx = sd->free_ctx;
+    r->ignore_sess_ctx_changes = false;
+}
+
+// NOTE: ヘッダの終わりまで受信する．戻り値はヘッダ (終端の空行を含む) の長さ．
+// 受信済みのデータは buf の先頭に詰めてから，続きを読み足す
+static int req_recv_head(sock_db_t *sd, httpd_err_code_t *err)
+{
+    size_t len;
+    char *end;
+    ssize_t ret;
+
+    memmove(sd->buf, sd->buf + sd->pending_off, sd->pending_len);
+    sd->pending_off = 0;
+    len = sd->pending_len;
+    sd->pending_len = 0;
+
+    while (true) {
+        sd->buf[len] = '\0';
+        end = strstr(sd->buf, "\r\n\r\n");
+        if (end != NULL) {
+            sd->pending_off = end + 4 - sd->buf;
+            sd->pending_len = len - sd->pending_off;
+            return sd->pending_off;
+        }
+        if (len == SESS_BUF_SIZE) {
+            *err = (strstr(sd->buf, "\r\n") == NULL) ? HTTPD_414_URI_TOO_LONG : HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+            return -1;
+        }
+        ret = recv(sd->fd, sd->buf + len, SESS_BUF_SIZE - len, 0);
+        if (ret == 0) {
+            *err = HTTPD_ERR_CODE_MAX;
+            return -1;
+        }
+        if (ret < 0) {
+            *err = ((len != 0) && (sock_err() == HTTPD_SOCK_ERR_TIMEOUT)) ?
+                HTTPD_408_REQ_TIMEOUT : HTTPD_ERR_CODE_MAX;
+            return -1;
+        }
+        len += ret;
+    }
+}
+
+static httpd_err_code_t req_parse(httpd_data_t *hd, sock_db_t *sd, size_t head_len)
+{
+    httpd_req_t *r = &(hd->req);
+    req_aux_t *ra = &(hd->aux);
+    char *line = sd->buf;
+    char *next, *method_str, *uri_str, *version_str, *colon;
+    const char *value;
+    char *end;
+    bool valid;
+
+    sd->buf[head_len - 2] = '\0';
+
+    next = strstr(line, "\r\n");
+    *next = '\0';
+    method_str = strtok_r(line, " ", &end);
+    uri_str = strtok_r(NULL, " ", &end);
+    version_str = strtok_r(NULL, " ", &end);
+    if ((method_str == NULL) || (uri_str == NULL) || (version_str == NULL)) {
+        return HTTPD_400_BAD_REQUEST;
+    }
+    if (strncmp(version_str, "HTTP/1.", 7) != 0) {
+        return HTTPD_505_VERSION_NOT_SUPPORTED;
+    }
+    r->method = method_parse(method_str, &valid);
+    if (!valid) {
+        return HTTPD_501_METHOD_NOT_IMPLEMENTED;
+    }
+    if (strlen(uri_str) > HTTPD_MAX_URI_LEN) {
+        return HTTPD_414_URI_TOO_LONG;
+    }
+    strcpy((char *)r->uri, uri_str);
+
+    line = next + 2;
+    if (strlen(line) > HTTPD_MAX_REQ_HDR_LEN) {
+        return HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE;
+    }
+    while (*line != '\0') {
+        next = strstr(line, "\r\n");
+        if (next != NULL) {
+            *next = '\0';
+        }
+        colon = strchr(line, ':');
+        if ((colon == NULL) || (ra->req_hdrs_count == ARRAY_SIZE_OF(ra->req_hdrs))) {
+            return HTTPD_400_BAD_REQUEST;
+        }
+        *colon = '\0';
+        value = colon + 1;
+        while ((*value == ' ') || (*value == '\t')) {
+            value++;
+        }
+        ra->req_hdrs[ra->req_hdrs_count].field = line;
+        ra->req_hdrs[ra->req_hdrs_count].value = value;
+        ra->req_hdrs_count++;
+        if (next == NULL) {
+            break;
+        }
+        line = next + 2;
+    }
+
+    value = req_hdr_find(ra, "Transfer-Encoding");
+    if ((value != NULL) && (strcasestr(value, "chunked") != NULL)) {
+        return HTTPD_411_LENGTH_REQUIRED;
+    }
+    value = req_hdr_find(ra, "Content-Length");
+    if (value != NULL) {
+        r->content_len = strtoul(value, &end, 10);
+        if ((end == value) || (*end != '\0')) {
+            return HTTPD_400_BAD_REQUEST;
+        }
+    }
+    ra->remaining_len = r->content_len;
+
+    value = req_hdr_find(ra, "Upgrade");
+    ra->ws_handshake_detect = (r->method == HTTP_GET) && (value != NULL) &&
+        (strcasecmp(value, "websocket") == 0) && (req_hdr_find(ra, "Sec-WebSocket-Key") != NULL);
+
+    return HTTPD_ERR_CODE_MAX;
+}
+
+static httpd_uri_t *uri_find(httpd_data_t *hd, const char *uri, int method, httpd_err_code_t *err)
+{
+    size_t uri_len = strcspn(uri, "?");
+    httpd_uri_t *handler;
+    bool match;
+
+    *err = HTTPD_404_NOT_FOUND;
+    for (uint32_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        handler = &(hd->uri_list[i]);
+        if (handler->uri == NULL) {
+            break;
+        }
+        if (hd->config.uri_match_fn != NULL) {
+            match = hd->config.uri_match_fn(handler->uri, uri, uri_len);
+        } else {
+            match = (strlen(handler->uri) == uri_len) && (strncmp(handler->uri, uri, uri_len) == 0);
+        }
+        if (!match) {
+            continue;
+        }
+        if (handler->method == method) {
+            return handler;
+        }
+        *err = HTTPD_405_METHOD_NOT_ALLOWED;
+    }
+    return NULL;
+}
+
+// NOTE: ハンドラが読み残したボディを捨て，セッションのコンテキストの変更を反映する
+static esp_err_t req_delete(httpd_data_t *hd, esp_err_t ret)
+{
+    httpd_req_t *r = &(hd->req);
+    req_aux_t *ra = &(hd->aux);
+    sock_db_t *sd = ra->sd;
+    char dummy[PURGE_BUF_LEN];
+    int recv_len;
+
+    if (!r->ignore_sess_ctx_changes && (sd->ctx != r->sess_ctx)) {
+        sess_free_ctx(sd);
+        sd->ctx = r->sess_ctx;
+    }
+    sd->free_ctx = r->free_ctx;
+
+    while ((ret == ESP_OK) && (ra->remaining_len != 0)) {
+        recv_len = httpd_req_recv(r, dummy, sizeof(dummy));
+        if (recv_len <= 0) {
+            ret = ESP_FAIL;
+        }
+    }
+    return ret;
+}
+
+//////////////////////////////////////////////////////////////////////
+// WebSocket
+static esp_err_t ws_respond_handshake(httpd_req_t *r)
+{
+    req_aux_t *ra = r->aux;
+    const char *key = req_hdr_find(ra, "Sec-WebSocket-Key");
+    char key_buf[128];
+    unsigned char digest[SHA_DIGEST_LENGTH];
+    char accept[64];
+    char resp[256];
+    int len;
+
+    snprintf(key_buf, sizeof(key_buf), "%s%s", key, WS_GUID);
+    SHA1((const unsigned char *)key_buf, strlen(key_buf), digest);
+    EVP_EncodeBlock((unsigned char *)accept, digest, sizeof(digest));
+
+    len = snprintf(resp, sizeof(resp),
+                   "HTTP/1.1 101 Switching Protocols\r\n"
+                   "Upgrade: websocket\r\n"
+                   "Connection: Upgrade\r\n"
+                   "Sec-WebSocket-Accept: %s\r\n\r\n", accept);
+
+    return sock_send_all(ra->sd->fd, resp, len);
+}
+
+static esp_err_t ws_send(int fd, httpd_ws_frame_t *frame)
+{
+    uint8_t head[10];
+    size_t head_len;
+
+    head[0] = ((!frame->fragmented || frame->final) ? WS_FIN_BIT : 0) | (frame->type & WS_OPCODE_BITS);
+    if (frame->len < 126) {
+        head[1] = frame->len;
+        head_len = 2;
+    } else if (frame->len <= UINT16_MAX) {
+        head[1] = 126;
+        head[2] = frame->len >> 8;
+        head[3] = frame->len;
+        head_len = 4;
+    } else {
+        head[1] = 127;
+        for (uint32_t i = 0; i < 8; i++) {
+            head[2 + i] = (uint64_t)frame->len >> (8 * (7 - i));
+        }
+        head_len = 10;
+    }
+    if (sock_send_all(fd, head, head_len) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if ((frame->len != 0) && (sock_send_all(fd, frame->payload, frame->len) != ESP_OK)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_recv_frame(httpd_req_t *req, httpd_ws_frame_t *frame, size_t max_len)
+{
+    req_aux_t *ra;
+    uint8_t ext[8];
+    uint8_t mask[4];
+    uint64_t len;
+
+    if ((req == NULL) || (frame == NULL) || (req->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ra = req->aux;
+    if (!ra->sd->ws_handshake_done) {
+        return ESP_ERR_INVALID_STATE;
+    }
+
+    frame->type = ra->ws_type;
+    frame->final = ra->ws_final;
+    len = ra->ws_len7;
+    if (len == 126) {
+        if (sess_recv_all(ra->sd, ext, 2) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        len = ((uint64_t)ext[0] << 8) | ext[1];
+    } else if (len == 127) {
+        if (sess_recv_all(ra->sd, ext, 8) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        len = 0;
+        for (uint32_t i = 0; i < 8; i++) {
+            len = (len << 8) | ext[i];
+        }
+    }
+    if (ra->ws_masked && (sess_recv_all(ra->sd, mask, sizeof(mask)) != ESP_OK)) {
+        return ESP_FAIL;
+    }
+    frame->len = len;
+    if (len > max_len) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    if ((len != 0) && (sess_recv_all(ra->sd, frame->payload, len) != ESP_OK)) {
+        return ESP_FAIL;
+    }
+    if (ra->ws_masked) {
+        for (size_t i = 0; i < len; i++) {
+            frame->payload[i] ^= mask[i % 4];
+        }
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_ws_send_frame(httpd_req_t *req, httpd_ws_frame_t *frame)
+{
+    if ((req == NULL) || (frame == NULL) || (req->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ws_send(((req_aux_t *)req->aux)->sd->fd, frame);
+}
+
+esp_err_t httpd_ws_send_frame_async(httpd_handle_t hd, int fd, httpd_ws_frame_t *frame)
+{
+    if ((hd == NULL) || (frame == NULL) || (sess_get(hd, fd) == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ws_send(fd, frame);
+}
+
+httpd_ws_client_info_t httpd_ws_get_fd_info(httpd_handle_t hd, int fd)
+{
+    sock_db_t *sd = (hd != NULL) ? sess_get(hd, fd) : NULL;
+
+    if (sd == NULL) {
+        return HTTPD_WS_CLIENT_INVALID;
+    }
+    return sd->ws_handshake_done ? HTTPD_WS_CLIENT_WEBSOCKET : HTTPD_WS_CLIENT_HTTP;
+}
+
+// NOTE: IDF と同じく，ハンドラが制御フレームを扱わないなら CLOSE と PING にはサーバが応える
+static esp_err_t ws_process_control(httpd_req_t *req, bool *handled)
+{
+    req_aux_t *ra = req->aux;
+    httpd_ws_frame_t frame;
+    uint8_t buf[128];
+
+    *handled = false;
+    if (ra->sd->ws_control_frames ||
+        ((ra->ws_type != HTTPD_WS_TYPE_CLOSE) && (ra->ws_type != HTTPD_WS_TYPE_PING) &&
+         (ra->ws_type != HTTPD_WS_TYPE_PONG))) {
+        return ESP_OK;
+    }
+    *handled = true;
+
+    memset(&frame, 0, sizeof(frame));
+    frame.payload = buf;
+    if (httpd_ws_recv_frame(req, &frame, sizeof(buf)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (ra->ws_type == HTTPD_WS_TYPE_CLOSE) {
+        frame.len = 0;
+        frame.type = HTTPD_WS_TYPE_CLOSE;
+        httpd_ws_send_frame(req, &frame);
+        return ESP_FAIL;
+    }
+    if (ra->ws_type == HTTPD_WS_TYPE_PING) {
+        frame.type = HTTPD_WS_TYPE_PONG;
+        return httpd_ws_send_frame(req, &frame);
+    }
+    return ESP_OK;
+}
+
+static esp_err_t ws_process(httpd_data_t *hd, sock_db_t *sd)
+{
+    httpd_req_t *r = &(hd->req);
+    req_aux_t *ra = &(hd->aux);
+    uint8_t head[2];
+    bool handled;
+    esp_err_t ret;
+
+    req_init(hd, sd);
+    if (sess_recv_all(sd, head, sizeof(head)) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    // NOTE: IDF と同じく，フレームの受信では method を設定しない (HTTP_GET ならハンドシェイク)
+    r->method = 0;
+    ra->ws_final = (head[0] & WS_FIN_BIT) != 0;
+    ra->ws_type = head[0] & WS_OPCODE_BITS;
+    ra->ws_masked = (head[1] & WS_MASK_BIT) != 0;
+    ra->ws_len7 = head[1] & WS_LENGTH_BITS;
+
+    ret = ws_process_control(r, &handled);
+    if (handled) {
+        return ret;
+    }
+    r->user_ctx = sd->ws_user_ctx;
+    ret = sd->ws_handler(r);
+
+    return req_delete(hd, ret);
+}
+
+//////////////////////////////////////////////////////////////////////
+// サーバ
+static esp_err_t sess_process(httpd_data_t *hd, sock_db_t *sd)
+{
+    httpd_req_t *r = &(hd->req);
+    req_aux_t *ra = &(hd->aux);
+    httpd_err_code_t err = HTTPD_ERR_CODE_MAX;
+    httpd_uri_t *handler;
+    int head_len;
+    esp_err_t ret;
+
+    sd->lru_counter = ++hd->lru_counter;
+    if (sd->ws_handshake_done) {
+        return ws_process(hd, sd);
+    }
+
+    req_init(hd, sd);
+    head_len = req_recv_head(sd, &err);
+    if (head_len < 0) {
+        if (err != HTTPD_ERR_CODE_MAX) {
+            httpd_resp_send_err(r, err, NULL);
+        }
+        return ESP_FAIL;
+    }
+    err = req_parse(hd, sd, head_len);
+    if (err != HTTPD_ERR_CODE_MAX) {
+        httpd_resp_send_err(r, err, NULL);
+        return ESP_FAIL;
+    }
+
+    handler = uri_find(hd, r->uri, r->method, &err);
+    if (handler == NULL) {
+        ESP_LOGW(TAG, "URI '%s' not found.", r->uri);
+        httpd_resp_send_err(r, err, NULL);
+        return ESP_FAIL;
+    }
+    if (handler->is_websocket && ra->ws_handshake_detect) {
+        if (ws_respond_handshake(r) != ESP_OK) {
+            return ESP_FAIL;
+        }
+        sd->ws_handshake_done = true;
+        sd->ws_handler = handler->handler;
+        sd->ws_control_frames = handler->handle_ws_control_frames;
+        sd->ws_user_ctx = handler->user_ctx;
+    }
+    r->user_ctx = handler->user_ctx;
+    ret = handler->handler(r);
+
+    return req_delete(hd, ret);
+}
+
+static void ctrl_process(httpd_data_t *hd)
+{
+    httpd_work_t work;
+
+    while (read(hd->ctrl_fd[0], &work, sizeof(work)) == sizeof(work)) {
+        if (work.fn == NULL) {
+            hd->stop = true;
+            continue;
+        }
+        work.fn(work.arg);
+    }
+}
+
+static void httpd_server(void *param)
+{
+    httpd_data_t *hd = param;
+    struct timeval zero = { 0, 0 };
+    fd_set read_set;
+    bool has_pending;
+    bool has_space;
+    int max_fd;
+    sock_db_t *sd;
+
+    while (!hd->stop) {
+        FD_ZERO(&read_set);
+        FD_SET(hd->ctrl_fd[0], &read_set);
+        max_fd = hd->ctrl_fd[0];
+        has_pending = false;
+        has_space = hd->config.lru_purge_enable;
+        for (uint32_t i = 0; i < hd->config.max_open_sockets; i++) {
+            sd = hd->sd_list[i];
+            if (sd == NULL) {
+                has_space = true;
+                continue;
+            }
+            FD_SET(sd->fd, &read_set);
+            max_fd = (sd->fd > max_fd) ? sd->fd : max_fd;
+            has_pending |= (sd->pending_len != 0);
+        }
+        // NOTE: 空きが無ければ，新しい接続は backlog で待たせる
+        if (has_space) {
+            FD_SET(hd->listen_fd, &read_set);
+            max_fd = (hd->listen_fd > max_fd) ? hd->listen_fd : max_fd;
+        }
+
+        if (select(max_fd + 1, &read_set, NULL, NULL, has_pending ? &zero : NULL) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ESP_LOGE(TAG, "select() failed: %s", strerror(errno));
+            break;
+        }
+        if (FD_ISSET(hd->ctrl_fd[0], &read_set)) {
+            ctrl_process(hd);
+            if (hd->stop) {
+                break;
+            }
+        }
+        for (uint32_t i = 0; i < hd->config.max_open_sockets; i++) {
+            sd = hd->sd_list[i];
+            // NOTE: ctrl_process() で閉じられて，同じ fd が再利用されることは無い (accept はこの後)
+            if ((sd == NULL) || (!FD_ISSET(sd->fd, &read_set) && (sd->pending_len == 0))) {
+                continue;
+            }
+            if (sess_process(hd, sd) != ESP_OK) {
+                sess_close(hd, i);
+            }
+        }
+        if (has_space && FD_ISSET(hd->listen_fd, &read_set)) {
+            sess_accept(hd);
+        }
+    }
+
+    xSemaphoreGive(hd->exit_sem);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t listen_start(httpd_data_t *hd)
+{
+    struct sockaddr_in6 addr;
+    uint16_t port = httpd_host_port(hd->config.server_port);
+    int flag = 1;
+    int v6only = 0;
+
+    // NOTE: 実機と同じく IPv6 のデュアルスタックで待ち受ける (getpeername() が sockaddr_in6 を返す)
+    hd->listen_fd = socket(AF_INET6, SOCK_STREAM, 0);
+    if (hd->listen_fd < 0) {
+        return ESP_FAIL;
+    }
+    setsockopt(hd->listen_fd, SOL_SOCKET, SO_REUSEADDR, &flag, sizeof(flag));
+    setsockopt(hd->listen_fd, IPPROTO_IPV6, IPV6_V6ONLY, &v6only, sizeof(v6only));
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin6_family = AF_INET6;
+    addr.sin6_addr = in6addr_any;
+    addr.sin6_port = htons(port);
+    if ((bind(hd->listen_fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) ||
+        (listen(hd->listen_fd, hd->config.backlog_conn) != 0)) {
+        ESP_LOGE(TAG, "Failed to listen on port %u: %s", port, strerror(errno));
+        close(hd->listen_fd);
+        return ESP_FAIL;
+    }
+    ESP_LOGI(TAG, "Started server on port %u (port %u on the device).", port, hd->config.server_port);
+
+    return ESP_OK;
+}
+
+static void httpd_data_free(httpd_data_t *hd)
+{
+    for (uint32_t i = 0; i < hd->config.max_uri_handlers; i++) {
+        free((char *)hd->uri_list[i].uri);
+    }
+    if (hd->exit_sem != NULL) {
+        vSemaphoreDelete(hd->exit_sem);
+    }
+    free(hd->uri_list);
+    free(hd->sd_list);
+    free(hd->aux.resp_hdrs);
+    free(hd);
+}
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config)
+{
+    httpd_data_t *hd;
+
+    if ((handle == NULL) || (config == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hd = calloc(1, sizeof(httpd_data_t));
+    if (hd == NULL) {
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    hd->config = *config;
+    hd->sd_list = calloc(config->max_open_sockets, sizeof(sock_db_t *));
+    hd->uri_list = calloc(config->max_uri_handlers, sizeof(httpd_uri_t));
+    hd->aux.resp_hdrs = calloc(config->max_resp_headers, sizeof(resp_hdr_t));
+    hd->exit_sem = xSemaphoreCreateBinary();
+    if ((hd->sd_list == NULL) || (hd->uri_list == NULL) || (hd->aux.resp_hdrs == NULL) ||
+        (hd->exit_sem == NULL)) {
+        httpd_data_free(hd);
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    if (pipe2(hd->ctrl_fd, O_NONBLOCK | O_CLOEXEC) != 0) {
+        httpd_data_free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    if (listen_start(hd) != ESP_OK) {
+        close(hd->ctrl_fd[0]);
+        close(hd->ctrl_fd[1]);
+        httpd_data_free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    if (xTaskCreatePinnedToCore(httpd_server, "httpd", config->stack_size, hd, config->task_priority,
+                                NULL, config->core_id) != pdPASS) {
+        close(hd->listen_fd);
+        close(hd->ctrl_fd[0]);
+        close(hd->ctrl_fd[1]);
+        httpd_data_free(hd);
+        return ESP_ERR_HTTPD_TASK;
+    }
+    *handle = hd;
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle)
+{
+    httpd_data_t *hd = handle;
+    httpd_work_t work = { NULL, NULL };
+
+    if (hd == NULL) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (write(hd->ctrl_fd[1], &work, sizeof(work)) != sizeof(work)) {
+        return ESP_FAIL;
+    }
+    xSemaphoreTake(hd->exit_sem, portMAX_DELAY);
+
+    for (uint32_t i = 0; i < hd->config.max_open_sockets; i++) {
+        if (hd->sd_list[i] != NULL) {
+            sess_close(hd, i);
+        }
+    }
+    close(hd->listen_fd);
+    close(hd->ctrl_fd[0]);
+    close(hd->ctrl_fd[1]);
+    if (hd->config.global_user_ctx != NULL) {
+        if (hd->config.global_user_ctx_free_fn != NULL) {
+            hd->config.global_user_ctx_free_fn(hd->config.global_user_ctx);
+        } else {
+            free(hd->config.global_user_ctx);
+        }
+    }
+    httpd_data_free(hd);
+
+    return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle, const httpd_uri_t *uri_handler)
+{
+    httpd_data_t *hd = handle;
+    uint32_t i;
+
+    if ((hd == NULL) || (uri_handler == NULL) || (uri_handler->uri == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (i = 0; i < hd->config.max_uri_handlers; i++) {
+        if (hd->uri_list[i].uri == NULL) {
+            break;
+        }
+        if ((strcmp(hd->uri_list[i].uri, uri_handler->uri) == 0) &&
+            (hd->uri_list[i].method == uri_handler->method)) {
+            return ESP_ERR_HTTPD_HANDLER_EXISTS;
+        }
+    }
+    if (i == hd->config.max_uri_handlers) {
+        ESP_LOGW(TAG, "No slot left for registering handler '%s'.", uri_handler->uri);
+        return ESP_ERR_HTTPD_HANDLERS_FULL;
+    }
+    hd->uri_list[i] = *uri_handler;
+    hd->uri_list[i].uri = strdup(uri_handler->uri);
+    if (hd->uri_list[i].uri == NULL) {
+        memset(&(hd->uri_list[i]), 0, sizeof(httpd_uri_t));
+        return ESP_ERR_HTTPD_ALLOC_MEM;
+    }
+    return ESP_OK;
+}
+
+// NOTE: IDF の httpd_uri_match_wildcard() と同じ規則 (末尾の '*' と '?')
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match, size_t match_upto)
+{
+    const size_t tpl_len = strlen(uri_template);
+    size_t exact_match_chars = tpl_len;
+    const char last = (tpl_len > 0) ? uri_template[tpl_len - 1] : 0;
+    const char prevlast = (tpl_len > 1) ? uri_template[tpl_len - 2] : 0;
+    const bool asterisk = (last == '*') || ((prevlast == '*') && (last == '?'));
+    const bool quest = (last == '?') || ((prevlast == '?') && (last == '*'));
+
+    if (exact_match_chars < (asterisk + quest * 2)) {
+        return false;
+    }
+    exact_match_chars -= asterisk + quest * 2;
+    if (match_upto < exact_match_chars) {
+        return false;
+    }
+    if (!quest) {
+        if (!asterisk && (match_upto != exact_match_chars)) {
+            return false;
+        }
+        return strncmp(uri_template, uri_to_match, exact_match_chars) == 0;
+    }
+    if ((match_upto > exact_match_chars) &&
+        (uri_template[exact_match_chars] != uri_to_match[exact_match_chars])) {
+        return false;
+    }
+    if (strncmp(uri_template, uri_to_match, exact_match_chars) != 0) {
+        return false;
+    }
+    return asterisk || (match_upto <= (exact_match_chars + 1));
+}
+
+//////////////////////////////////////////////////////////////////////
+// リクエスト
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    req_aux_t *ra;
+    int ret;
+
+    if ((r == NULL) || (buf == NULL) || (r->aux == NULL)) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ra = r->aux;
+    if (buf_len > ra->remaining_len) {
+        buf_len = ra->remaining_len;
+    }
+    if (buf_len == 0) {
+        return 0;
+    }
+    if (ra->sd->faulted) {
+        return HTTPD_SOCK_ERR_FAIL;
+    }
+    ret = sess_recv(ra->sd, buf, buf_len);
+    if (ret <= 0) {
+        return ret;
+    }
+    ret = fault_apply(ra->sd, ret);
+    if (ret > 0) {
+        ra->remaining_len -= ret;
+    }
+    return ret;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r)
+{
+    if ((r == NULL) || (r->aux == NULL)) {
+        return -1;
+    }
+    return ((req_aux_t *)r->aux)->sd->fd;
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field)
+{
+    const char *value;
+
+    if ((r == NULL) || (field == NULL) || (r->aux == NULL)) {
+        return 0;
+    }
+    value = req_hdr_find(r->aux, field);
+    return (value != NULL) ? strlen(value) : 0;
+}
+
+static esp_err_t copy_trunc(char *dst, size_t dst_size, const char *src, size_t src_len)
+{
+    size_t len = (src_len < dst_size) ? src_len : dst_size - 1;
+
+    memcpy(dst, src, len);
+    dst[len] = '\0';
+
+    return (len < src_len) ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field, char *val, size_t val_size)
+{
+    const char *value;
+
+    if ((r == NULL) || (field == NULL) || (r->aux == NULL) || (val == NULL) || (val_size == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    value = req_hdr_find(r->aux, field);
+    if (value == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_trunc(val, val_size, value, strlen(value));
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r)
+{
+    const char *query;
+
+    if (r == NULL) {
+        return 0;
+    }
+    query = strchr(r->uri, '?');
+    return (query != NULL) ? strcspn(query + 1, "#") : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len)
+{
+    const char *query;
+
+    if ((r == NULL) || (buf == NULL) || (buf_len == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    query = strchr(r->uri, '?');
+    if (query == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    return copy_trunc(buf, buf_len, query + 1, strcspn(query + 1, "#"));
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val, size_t val_size)
+{
+    const char *qry_ptr = qry;
+    const char *val_ptr;
+    size_t key_len;
+
+    if ((qry == NULL) || (key == NULL) || (val == NULL) || (val_size == 0)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    key_len = strlen(key);
+    while (*qry_ptr != '\0') {
+        val_ptr = strchr(qry_ptr, '=');
+        if (val_ptr == NULL) {
+            break;
+        }
+        if (((size_t)(val_ptr - qry_ptr) != key_len) || (strncasecmp(qry_ptr, key, key_len) != 0)) {
+            qry_ptr = strchr(val_ptr, '&');
+            if (qry_ptr == NULL) {
+                break;
+            }
+            qry_ptr++;
+            continue;
+        }
+        val_ptr++;
+        return copy_trunc(val, val_size, val_ptr, strcspn(val_ptr, "&"));
+    }
+    return ESP_ERR_NOT_FOUND;
+}
+
+//////////////////////////////////////////////////////////////////////
+// 応答
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    if ((r == NULL) || (status == NULL) || (r->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((req_aux_t *)r->aux)->status = status;
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    if ((r == NULL) || (type == NULL) || (r->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ((req_aux_t *)r->aux)->content_type = type;
+    return ESP_OK;
+}
+
+// NOTE: IDF と同じく文字列はコピーしないので，応答を送るまで有効でなければならない
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    httpd_data_t *hd;
+    req_aux_t *ra;
+
+    if ((r == NULL) || (field == NULL) || (value == NULL) || (r->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    hd = r->handle;
+    ra = r->aux;
+    if (ra->resp_hdrs_count >= hd->config.max_resp_headers) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    ra->resp_hdrs[ra->resp_hdrs_count].field = field;
+    ra->resp_hdrs[ra->resp_hdrs_count].value = value;
+    ra->resp_hdrs_count++;
+
+    return ESP_OK;
+}
+
+static esp_err_t resp_send_head(httpd_req_t *r, const char *length_hdr)
+{
+    req_aux_t *ra = r->aux;
+    char head[RESP_HEAD_SIZE];
+    size_t len;
+
+    len = snprintf(head, sizeof(head), "HTTP/1.1 %s\r\nContent-Type: %s\r\n%s\r\n",
+                   ra->status, ra->content_type, length_hdr);
+    for (uint32_t i = 0; (i < ra->resp_hdrs_count) && (len < sizeof(head)); i++) {
+        len += snprintf(head + len, sizeof(head) - len, "%s: %s\r\n",
+                        ra->resp_hdrs[i].field, ra->resp_hdrs[i].value);
+    }
+    if (len < sizeof(head)) {
+        len += snprintf(head + len, sizeof(head) - len, "\r\n");
+    }
+    if (len >= sizeof(head)) {
+        return ESP_ERR_HTTPD_RESP_HDR;
+    }
+    return sock_send_all(ra->sd->fd, head, len);
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    char length_hdr[32];
+    esp_err_t ret;
+
+    if ((r == NULL) || (r->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+    snprintf(length_hdr, sizeof(length_hdr), "Content-Length: %d", (int)buf_len);
+
+    ret = resp_send_head(r, length_hdr);
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    if (buf_len != 0) {
+        return sock_send_all(((req_aux_t *)r->aux)->sd->fd, buf, buf_len);
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    req_aux_t *ra;
+    char size_str[16];
+    int size_len;
+    esp_err_t ret;
+
+    if ((r == NULL) || (r->aux == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ra = r->aux;
+    if (buf == NULL) {
+        buf_len = 0;
+    } else if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+    if (!ra->first_chunk_sent) {
+        ret = resp_send_head(r, "Transfer-Encoding: chunked");
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        ra->first_chunk_sent = true;
+    }
+
+    size_len = snprintf(size_str, sizeof(size_str), "%x\r\n", (unsigned int)buf_len);
+    if ((sock_send_all(ra->sd->fd, size_str, size_len) != ESP_OK) ||
+        ((buf_len != 0) && (sock_send_all(ra->sd->fd, buf, buf_len) != ESP_OK)) ||
+        (sock_send_all(ra->sd->fd, "\r\n", 2) != ESP_OK)) {
+        return ESP_ERR_HTTPD_RESP_SEND;
+    }
+    return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error, const char *usr_msg)
+{
+    const char *status;
+    const char *msg;
+
+    switch (error) {
+    case HTTPD_501_METHOD_NOT_IMPLEMENTED:
+        status = "501 Method Not Implemented";
+        msg = "Request method is not supported by server";
+        break;
+    case HTTPD_505_VERSION_NOT_SUPPORTED:
+        status = "505 Version Not Supported";
+        msg = "HTTP version not supported by server";
+        break;
+    case HTTPD_400_BAD_REQUEST:
+        status = "400 Bad Request";
+        msg = "Server unable to understand request due to invalid syntax";
+        break;
+    case HTTPD_404_NOT_FOUND:
+        status = "404 Not Found";
+        msg = "This URI does not exist";
+        break;
+    case HTTPD_405_METHOD_NOT_ALLOWED:
+        status = "405 Method Not Allowed";
+        msg = "Request method for this URI is not handled by server";
+        break;
+    case HTTPD_408_REQ_TIMEOUT:
+        status = "408 Request Timeout";
+        msg = "Server closed this connection";
+        break;
+    case HTTPD_414_URI_TOO_LONG:
+        status = "414 URI Too Long";
+        msg = "URI is too long for server to interpret";
+        break;
+    case HTTPD_411_LENGTH_REQUIRED:
+        status = "411 Length Required";
+        msg = "Chunked encoding not supported by server";
+        break;
+    case HTTPD_431_REQ_HDR_FIELDS_TOO_LARGE:
+        status = "431 Request Header Fields Too Large";
+        msg = "Header fields are too long for server to interpret";
+        break;
+    case HTTPD_500_INTERNAL_SERVER_ERROR:
+    default:
+        status = "500 Internal Server Error";
+        msg = "Server has encountered an unexpected error";
+        break;
+    }
+    if (usr_msg != NULL) {
+        msg = usr_msg;
+    }
+    httpd_resp_set_status(req, status);
+    httpd_resp_set_type(req, "text/html");
+
+    return httpd_resp_send(req, msg, strlen(msg));
+}
+
+//////////////////////////////////////////////////////////////////////
+// その他
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg)
+{
+    httpd_data_t *hd = handle;
+    httpd_work_t msg = { work, arg };
+
+    if ((hd == NULL) || (work == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    // NOTE: パイプへの PIPE_BUF 以下の書き込みは不可分なので，どのタスクから呼んでもよい
+    if (write(hd->ctrl_fd[1], &msg, sizeof(msg)) != sizeof(msg)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+void *httpd_get_global_user_ctx(httpd_handle_t handle)
+{
+    return ((httpd_data_t *)handle)->config.global_user_ctx;
+}
+
+static void sess_close_work(void *arg)
+{
+    sess_close_arg_t *close_arg = arg;
+    httpd_data_t *hd = close_arg->hd;
+
+    // NOTE: キューに積んでから実行されるまでの間に閉じられていることがある
+    for (uint32_t i = 0; i < hd->config.max_open_sockets; i++) {
+        if ((hd->sd_list[i] != NULL) && (hd->sd_list[i]->id == close_arg->id)) {
+            sess_close(hd, i);
+            break;
+        }
+    }
+    free(close_arg);
+}
+
+esp_err_t httpd_sess_trigger_close(httpd_handle_t handle, int sockfd)
+{
+    sock_db_t *sd = sess_get(handle, sockfd);
+    sess_close_arg_t *close_arg;
+
+    if (sd == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    close_arg = malloc(sizeof(sess_close_arg_t));
+    if (close_arg == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    close_arg->hd = handle;
+    close_arg->id = sd->id;
+    if (httpd_queue_work(handle, sess_close_work, close_arg) != ESP_OK) {
+        free(close_arg);
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+int httpd_socket_send(httpd_handle_t hd, int sockfd, const char *buf, size_t buf_len, int flags)
+{
+    ssize_t ret;
+
+    if ((hd == NULL) || (sess_get(hd, sockfd) == NULL)) {
+        return HTTPD_SOCK_ERR_INVALID;
+    }
+    ret = send(sockfd, buf, buf_len, flags | MSG_NOSIGNAL);
+    if (ret < 0) {
+        return sock_err();
+    }
+    return ret;
+}
@@ -0,0 +1,288 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_ota_ops.h"
+#include "esp_log.h"
+#include "freertos/FreeRTOS.h"
+
+// NOTE: partitions.csv と同じ並びのパーティションを，それぞれファイルとして置く．
+// otadata には起動するパーティションの名前を書く．
+// 実機と同じく，esp_ota_set_boot_partition() の結果は次の起動 (プロセス) から効く．
+// ESP_HOST_FLASH_KBPS を指定すると，書き込みに実機のフラッシュ程度の時間をかける
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define APP_SIZE            (1024 * 1024)
+#define APP_DESC_OFFSET     32      // esp_image_header_t + esp_image_segment_header_t
+#define APP_DESC_MAGIC_WORD 0xABCD5432
+#define HANDLE_FIRST        1
+
+#ifndef PROJECT_VER
+#define PROJECT_VER "host"
+#endif
+
+typedef struct ota_write {
+    esp_ota_handle_t handle;
+    const esp_partition_t *part;
+    FILE *fp;
+    size_t size;
+    uint8_t first_byte;
+    bool failed;
+} ota_write_t;
+
+static const esp_partition_t part_list[] = {
+    { NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_NVS, 0x9000, 0x4000, "nvs", false },
+    { NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_OTA, 0xd000, 0x2000, "otadata", false },
+    { NULL, ESP_PARTITION_TYPE_DATA, ESP_PARTITION_SUBTYPE_DATA_PHY, 0xf000, 0x1000, "phy_init", false },
+    { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_FACTORY, 0x10000, APP_SIZE, "factory", false },
+    { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_0, 0x110000, APP_SIZE, "ota_0", false },
+    { NULL, ESP_PARTITION_TYPE_APP, ESP_PARTITION_SUBTYPE_APP_OTA_1, 0x210000, APP_SIZE, "ota_1", false },
+};
+
+static const esp_app_desc_t app_desc = {
+    .magic_word = APP_DESC_MAGIC_WORD,
+    .version = PROJECT_VER,
+    .project_name = "esp32_wifi_io",
+    .time = __TIME__,
+    .date = __DATE__,
+    .idf_ver = "host",
+};
+
+static pthread_mutex_t ota_lock = PTHREAD_MUTEX_INITIALIZER;
+static const esp_partition_t *running_part = NULL;
+static ota_write_t ota_write;
+static esp_ota_handle_t ota_handle_next = HANDLE_FIRST;
+
+static void ota_path(const char *label, char *path, size_t size)
+{
+    const char *dir = getenv("ESP_HOST_OTA_DIR");
+
+    snprintf(path, size, "%s/%s.bin", (dir != NULL) ? dir : ".", label);
+}
+
+static const esp_partition_t *part_find(const char *label)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(part_list); i++) {
+        if (strcmp(part_list[i].label, label) == 0) {
+            return &(part_list[i]);
+        }
+    }
+    return NULL;
+}
+
+const esp_app_desc_t *esp_ota_get_app_description(void)
+{
+    return &app_desc;
+}
+
+const esp_partition_t *esp_ota_get_boot_partition(void)
+{
+    const esp_partition_t *part = NULL;
+    char path[256];
+    char label[17];
+    FILE *fp;
+
+    ota_path("otadata", path, sizeof(path));
+    fp = fopen(path, "r");
+    if (fp != NULL) {
+        if (fscanf(fp, "%16s", label) == 1) {
+            part = part_find(label);
+        }
+        fclose(fp);
+    }
+    return (part != NULL) ? part : part_find("factory");
+}
+
+const esp_partition_t *esp_ota_get_running_partition(void)
+{
+    pthread_mutex_lock(&ota_lock);
+    if (running_part == NULL) {
+        running_part = esp_ota_get_boot_partition();
+    }
+    pthread_mutex_unlock(&ota_lock);
+
+    return running_part;
+}
+
+const esp_partition_t *esp_ota_get_next_update_partition(const esp_partition_t *start_from)
+{
+    if (start_from == NULL) {
+        start_from = esp_ota_get_running_partition();
+    }
+    if (start_from->subtype == ESP_PARTITION_SUBTYPE_APP_OTA_0) {
+        return part_find("ota_1");
+    }
+    return part_find("ota_0");
+}
+
+esp_err_t esp_ota_begin(const esp_partition_t *partition, size_t image_size, esp_ota_handle_t *out_handle)
+{
+    char path[256];
+
+    if ((partition == NULL) || (out_handle == NULL) || (partition->type != ESP_PARTITION_TYPE_APP)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition == esp_ota_get_running_partition()) {
+        return ESP_ERR_OTA_PARTITION_CONFLICT;
+    }
+    if ((image_size != OTA_SIZE_UNKNOWN) && (image_size != OTA_WITH_SEQUENTIAL_WRITES) &&
+        (image_size > partition->size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+
+    pthread_mutex_lock(&ota_lock);
+    // NOTE: ホストでは同時に 1 つだけ書き込める．前のものは中断する
+    if (ota_write.fp != NULL) {
+        fclose(ota_write.fp);
+    }
+    memset(&ota_write, 0, sizeof(ota_write));
+    ota_path(partition->label, path, sizeof(path));
+    ota_write.fp = fopen(path, "wb");
+    if (ota_write.fp == NULL) {
+        pthread_mutex_unlock(&ota_lock);
+        return ESP_FAIL;
+    }
+    ota_write.handle = ota_handle_next++;
+    ota_write.part = partition;
+    *out_handle = ota_write.handle;
+    pthread_mutex_unlock(&ota_lock);
+
+    return ESP_OK;
+}
+
+// NOTE: ロックを放した後で呼び，書き込み中も他のタスクを止めない
+static void flash_delay(size_t size)
+{
+    const char *kbps_str = getenv("ESP_HOST_FLASH_KBPS");
+    uint32_t kbps = (kbps_str != NULL) ? strtoul(kbps_str, NULL, 10) : 0;
+
+    if (kbps != 0) {
+        usleep((uint64_t)size * 1000000 / (kbps * 1024));
+    }
+}
+
+esp_err_t esp_ota_write(esp_ota_handle_t handle, const void *data, size_t size)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&ota_lock);
+    if ((ota_write.fp == NULL) || (ota_write.handle != handle)) {
+        ret = ESP_ERR_INVALID_ARG;
+    } else if ((ota_write.size == 0) && (size != 0) &&
+               (((const uint8_t *)data)[0] != ESP_IMAGE_HEADER_MAGIC)) {
+        // NOTE: 実機と同じく，先頭のマジックバイトだけは書き込み時に確かめる
+        ESP_LOGE("host", "OTA image has invalid magic byte (expected 0xE9, saw 0x%02x)",
+                 ((const uint8_t *)data)[0]);
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+    } else if ((ota_write.size + size) > ota_write.part->size) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else if (fwrite(data, 1, size, ota_write.fp) != size) {
+        ret = ESP_FAIL;
+    } else {
+        ota_write.size += size;
+    }
+    if (ret != ESP_OK) {
+        ota_write.failed = true;
+    }
+    pthread_mutex_unlock(&ota_lock);
+
+    if (ret == ESP_OK) {
+        flash_delay(size);
+    }
+    return ret;
+}
+
+static esp_err_t ota_close(esp_ota_handle_t handle, bool validate)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&ota_lock);
+    if ((ota_write.fp == NULL) || (ota_write.handle != handle)) {
+        pthread_mutex_unlock(&ota_lock);
+        return ESP_ERR_NOT_FOUND;
+    }
+    if (fclose(ota_write.fp) != 0) {
+        ret = ESP_FAIL;
+    }
+    if (validate && ((ota_write.size == 0) || ota_write.failed)) {
+        ret = ESP_ERR_OTA_VALIDATE_FAILED;
+    }
+    memset(&ota_write, 0, sizeof(ota_write));
+    pthread_mutex_unlock(&ota_lock);
+
+    return ret;
+}
+
+esp_err_t esp_ota_end(esp_ota_handle_t handle)
+{
+    return ota_close(handle, true);
+}
+
+esp_err_t esp_ota_abort(esp_ota_handle_t handle)
+{
+    return ota_close(handle, false);
+}
+
+esp_err_t esp_ota_set_boot_partition(const esp_partition_t *partition)
+{
+    char path[256];
+    FILE *fp;
+
+    if ((partition == NULL) || (partition->type != ESP_PARTITION_TYPE_APP)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    ota_path("otadata", path, sizeof(path));
+    fp = fopen(path, "w");
+    if (fp == NULL) {
+        return ESP_FAIL;
+    }
+    fprintf(fp, "%s\n", partition->label);
+    fclose(fp);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_partition_description(const esp_partition_t *partition, esp_app_desc_t *desc)
+{
+    char path[256];
+    FILE *fp;
+    bool found;
+
+    if ((partition == NULL) || (desc == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition == esp_ota_get_running_partition()) {
+        *desc = app_desc;
+        return ESP_OK;
+    }
+    ota_path(partition->label, path, sizeof(path));
+    fp = fopen(path, "rb");
+    if (fp == NULL) {
+        return ESP_ERR_NOT_FOUND;
+    }
+    found = (fseek(fp, APP_DESC_OFFSET, SEEK_SET) == 0) &&
+        (fread(desc, sizeof(esp_app_desc_t), 1, fp) == 1) &&
+        (desc->magic_word == APP_DESC_MAGIC_WORD);
+    fclose(fp);
+
+    return found ? ESP_OK : ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_ota_mark_app_valid_cancel_rollback(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_ota_get_state_partition(const esp_partition_t *partition, esp_ota_img_states_t *ota_state)
+{
+    if ((partition == NULL) || (ota_state == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (partition->subtype == ESP_PARTITION_SUBTYPE_APP_FACTORY) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    *ota_state = ESP_OTA_IMG_VALID;
+    return ESP_OK;
+}
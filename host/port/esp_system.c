@@ -0,0 +1,164 @@
+#include <malloc.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+
+#include "esp_err.h"
+#include "esp_log.h"
+#include "esp_system.h"
+#include "esp_task_wdt.h"
+#include "freertos/FreeRTOS.h"
+
+#include "host_port.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+// NOTE: ホストにはヒープの上限がないので，ESP32 の DRAM 相当の大きさから
+// 使用中の量を引いたものを空き容量とする
+#define HOST_HEAP_SIZE  (320 * 1024)
+
+typedef struct err_name {
+    esp_err_t code;
+    const char *name;
+} err_name_t;
+
+#define ERR_NAME(code) { code, #code }
+
+static const err_name_t err_name_list[] = {
+    ERR_NAME(ESP_OK),
+    ERR_NAME(ESP_FAIL),
+    ERR_NAME(ESP_ERR_NO_MEM),
+    ERR_NAME(ESP_ERR_INVALID_ARG),
+    ERR_NAME(ESP_ERR_INVALID_STATE),
+    ERR_NAME(ESP_ERR_INVALID_SIZE),
+    ERR_NAME(ESP_ERR_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NOT_SUPPORTED),
+    ERR_NAME(ESP_ERR_TIMEOUT),
+    ERR_NAME(ESP_ERR_INVALID_RESPONSE),
+    ERR_NAME(ESP_ERR_INVALID_CRC),
+    ERR_NAME(ESP_ERR_INVALID_VERSION),
+    ERR_NAME(ESP_ERR_INVALID_MAC),
+    ERR_NAME(ESP_ERR_NVS_NOT_FOUND),
+    ERR_NAME(ESP_ERR_NVS_NO_FREE_PAGES),
+    ERR_NAME(ESP_ERR_OTA_PARTITION_CONFLICT),
+    ERR_NAME(ESP_ERR_OTA_SELECT_INFO_INVALID),
+    ERR_NAME(ESP_ERR_OTA_VALIDATE_FAILED),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLERS_FULL),
+    ERR_NAME(ESP_ERR_HTTPD_HANDLER_EXISTS),
+    ERR_NAME(ESP_ERR_HTTPD_INVALID_REQ),
+    ERR_NAME(ESP_ERR_HTTPD_RESULT_TRUNC),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_HDR),
+    ERR_NAME(ESP_ERR_HTTPD_RESP_SEND),
+    ERR_NAME(ESP_ERR_HTTPD_ALLOC_MEM),
+    ERR_NAME(ESP_ERR_HTTPD_TASK),
+};
+
+static uint32_t restart_count = 0;
+static uint32_t heap_min_free = HOST_HEAP_SIZE;
+static pthread_mutex_t log_lock = PTHREAD_MUTEX_INITIALIZER;
+
+const char *esp_err_to_name(esp_err_t code)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(err_name_list); i++) {
+        if (err_name_list[i].code == code) {
+            return err_name_list[i].name;
+        }
+    }
+    return "UNKNOWN ERROR";
+}
+
+void _esp_error_check_failed(esp_err_t rc, const char *file, int line, const char *function,
+                             const char *expression)
+{
+    fprintf(stderr, "ESP_ERROR_CHECK failed: esp_err_t 0x%x (%s) at %s:%d\n",
+            rc, esp_err_to_name(rc), file, line);
+    fprintf(stderr, "func: %s\nexpression: %s\n", function, expression);
+    abort();
+}
+
+// NOTE: ホストでは再起動せず，回数を数えてログに残すだけにする．
+// OTA の完了後もベンチマークやテストを続けられるようにするため
+void esp_restart(void)
+{
+    __atomic_fetch_add(&restart_count, 1, __ATOMIC_RELAXED);
+    ESP_LOGW("host", "esp_restart() called, keep running.");
+}
+
+uint32_t esp_host_restart_count(void)
+{
+    return __atomic_load_n(&restart_count, __ATOMIC_RELAXED);
+}
+
+uint32_t esp_random(void)
+{
+    uint32_t value;
+
+    if (getrandom(&value, sizeof(value), 0) != sizeof(value)) {
+        value = (uint32_t)random();
+    }
+    return value;
+}
+
+uint32_t esp_get_free_heap_size(void)
+{
+    struct mallinfo2 info = mallinfo2();
+    uint32_t free_size = (info.uordblks < HOST_HEAP_SIZE) ? (HOST_HEAP_SIZE - info.uordblks) : 0;
+    uint32_t min_free = __atomic_load_n(&heap_min_free, __ATOMIC_RELAXED);
+
+    while ((free_size < min_free) &&
+           !__atomic_compare_exchange_n(&heap_min_free, &min_free, free_size, false,
+                                        __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ;
+    }
+    return free_size;
+}
+
+uint32_t esp_get_minimum_free_heap_size(void)
+{
+    esp_get_free_heap_size();
+    return __atomic_load_n(&heap_min_free, __ATOMIC_RELAXED);
+}
+
+esp_err_t esp_read_mac(uint8_t *mac, esp_mac_type_t type)
+{
+    static const uint8_t host_mac[6] = { 0x02, 0x00, 0x00, 0x12, 0x34, 0x56 };
+
+    memcpy(mac, host_mac, sizeof(host_mac));
+    mac[5] += type;
+
+    return ESP_OK;
+}
+
+uint32_t esp_log_timestamp(void)
+{
+    return (uint32_t)(host_time_us() / 1000);
+}
+
+void esp_log_write(esp_log_level_t level, const char *tag, const char *format, ...)
+{
+    va_list ap;
+
+    pthread_mutex_lock(&log_lock);
+    va_start(ap, format);
+    vprintf(format, ap);
+    va_end(ap);
+    fflush(stdout);
+    pthread_mutex_unlock(&log_lock);
+}
+
+esp_err_t esp_task_wdt_init(uint32_t timeout, bool panic)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_add(TaskHandle_t handle)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_task_wdt_reset(void)
+{
+    return ESP_OK;
+}
@@ -0,0 +1,183 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "esp_timer.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#include "host_port.h"
+
+// NOTE: IDF と同じく，1 つの "esp_timer" タスクが期限の早い順にコールバックを呼ぶ．
+// コールバックの実行中はロックを持たないので，その中から start/stop を呼べる
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    const char *name;
+    int64_t alarm;          // 期限 (esp_timer_get_time() の時刻)
+    uint64_t period;        // 0 なら一度だけ
+    bool armed;
+    struct esp_timer *next;
+};
+
+static pthread_mutex_t timer_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t timer_cond;
+static struct esp_timer *timer_list = NULL;    // NOTE: 期限の早い順
+static bool timer_task_started = false;
+
+static void timer_list_remove(struct esp_timer *timer)
+{
+    for (struct esp_timer **p = &timer_list; *p != NULL; p = &((*p)->next)) {
+        if (*p == timer) {
+            *p = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->armed = false;
+}
+
+static void timer_list_insert(struct esp_timer *timer)
+{
+    struct esp_timer **p = &timer_list;
+
+    while ((*p != NULL) && ((*p)->alarm <= timer->alarm)) {
+        p = &((*p)->next);
+    }
+    timer->next = *p;
+    *p = timer;
+    timer->armed = true;
+}
+
+static void timer_task(void *param)
+{
+    struct esp_timer *timer;
+    struct timespec ts;
+    int64_t now, wait_us;
+    esp_timer_cb_t callback;
+    void *arg;
+
+    pthread_mutex_lock(&timer_lock);
+    while (true) {
+        timer = timer_list;
+        now = esp_timer_get_time();
+        if (timer == NULL) {
+            pthread_cond_wait(&timer_cond, &timer_lock);
+            continue;
+        }
+        if (timer->alarm > now) {
+            wait_us = timer->alarm - now;
+            clock_gettime(CLOCK_MONOTONIC, &ts);
+            ts.tv_sec += wait_us / 1000000;
+            ts.tv_nsec += (wait_us % 1000000) * 1000;
+            if (ts.tv_nsec >= 1000000000) {
+                ts.tv_sec++;
+                ts.tv_nsec -= 1000000000;
+            }
+            pthread_cond_timedwait(&timer_cond, &timer_lock, &ts);
+            continue;
+        }
+
+        timer_list_remove(timer);
+        if (timer->period != 0) {
+            timer->alarm += timer->period;
+            timer_list_insert(timer);
+        }
+        callback = timer->callback;
+        arg = timer->arg;
+
+        pthread_mutex_unlock(&timer_lock);
+        callback(arg);
+        pthread_mutex_lock(&timer_lock);
+    }
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *timer;
+
+    if ((create_args == NULL) || (create_args->callback == NULL) || (out_handle == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+    timer->name = create_args->name;
+
+    pthread_mutex_lock(&timer_lock);
+    if (!timer_task_started) {
+        host_cond_init(&timer_cond);
+        xTaskCreatePinnedToCore(timer_task, "esp_timer", 4096, NULL, 22, NULL, 0);
+        timer_task_started = true;
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer_lock);
+    if (timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->alarm = esp_timer_get_time() + timeout_us;
+        timer->period = period;
+        timer_list_insert(timer);
+        pthread_cond_signal(&timer_cond);
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&timer_lock);
+    if (!timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer_list_remove(timer);
+    }
+    pthread_mutex_unlock(&timer_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&timer_lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&timer_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    pthread_mutex_unlock(&timer_lock);
+    free(timer);
+
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    return host_time_us();
+}
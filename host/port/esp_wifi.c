@@ -0,0 +1,491 @@
+#include <arpa/inet.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+#include "nvs_flash.h"
+#include "ping/ping_sock.h"
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+
+// NOTE: WiFi ドライバ，イベントループ，NVS と ping をホスト上で模擬する．
+// AP は常に居て，接続するとすぐに 127.0.0.1 が割り当てられる
+
+#define EVENT_QUEUE_SIZE    16
+#define EVENT_DATA_MAX      64
+#define EVENT_HANDLER_MAX   8
+#define NVS_ENTRY_MAX       16
+#define NVS_KEY_SIZE        16
+#define NVS_VALUE_MAX       64
+
+typedef struct event_handler {
+    esp_event_base_t base;
+    int32_t id;
+    esp_event_handler_t handler;
+    void *arg;
+} event_handler_t;
+
+typedef struct event {
+    esp_event_base_t base;
+    int32_t id;
+    uint8_t data[EVENT_DATA_MAX];
+} event_t;
+
+typedef struct nvs_entry {
+    char name[NVS_KEY_SIZE];
+    char key[NVS_KEY_SIZE];
+    uint8_t value[NVS_VALUE_MAX];
+    size_t size;
+    bool used;
+} nvs_entry_t;
+
+typedef struct ping_session {
+    esp_ping_config_t config;
+    esp_ping_callbacks_t cbs;
+    uint32_t reply;
+} ping_session_t;
+
+esp_event_base_t const WIFI_EVENT = "WIFI_EVENT";
+esp_event_base_t const IP_EVENT = "IP_EVENT";
+
+static const uint8_t host_ap_bssid[6] = { 0x02, 0x00, 0x00, 0xaa, 0xbb, 0xcc };
+static const uint8_t host_ap_channel = 6;
+
+static QueueHandle_t event_queue = NULL;
+static event_handler_t handler_list[EVENT_HANDLER_MAX];
+static uint32_t handler_count = 0;
+static wifi_config_t sta_config;
+static bool wifi_started = false;
+static bool wifi_connected = false;
+static esp_netif_ip_info_t sta_ip_info;
+
+static nvs_entry_t nvs_list[NVS_ENTRY_MAX];
+static char nvs_name_list[NVS_ENTRY_MAX][NVS_KEY_SIZE];
+static uint32_t nvs_name_count = 0;
+static portMUX_TYPE nvs_lock = portMUX_INITIALIZER_UNLOCKED;
+
+//////////////////////////////////////////////////////////////////////
+// Event Loop
+static void event_task(void *param)
+{
+    event_t event;
+
+    while (1) {
+        xQueueReceive(event_queue, &event, portMAX_DELAY);
+        for (uint32_t i = 0; i < handler_count; i++) {
+            event_handler_t *entry = &(handler_list[i]);
+            if ((entry->base == event.base) &&
+                ((entry->id == ESP_EVENT_ANY_ID) || (entry->id == event.id))) {
+                entry->handler(entry->arg, event.base, event.id, event.data);
+            }
+        }
+    }
+}
+
+esp_err_t esp_event_loop_create_default(void)
+{
+    if (event_queue != NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    event_queue = xQueueCreate(EVENT_QUEUE_SIZE, sizeof(event_t));
+    xTaskCreate(event_task, "sys_evt", 2304, NULL, 20, NULL);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base, int32_t event_id,
+                                     esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    if (handler_count == EVENT_HANDLER_MAX) {
+        return ESP_ERR_NO_MEM;
+    }
+    handler_list[handler_count].base = event_base;
+    handler_list[handler_count].id = event_id;
+    handler_list[handler_count].handler = event_handler;
+    handler_list[handler_count].arg = event_handler_arg;
+    handler_count++;
+
+    return ESP_OK;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         void *event_data, size_t event_data_size, TickType_t ticks_to_wait)
+{
+    event_t event;
+
+    if (event_queue == NULL) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (event_data_size > sizeof(event.data)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    memset(&event, 0, sizeof(event));
+    event.base = event_base;
+    event.id = event_id;
+    if (event_data != NULL) {
+        memcpy(event.data, event_data, event_data_size);
+    }
+    return (xQueueSend(event_queue, &event, ticks_to_wait) == pdTRUE) ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Netif
+esp_err_t esp_netif_init(void)
+{
+    return ESP_OK;
+}
+
+esp_netif_t *esp_netif_create_default_wifi_sta(void)
+{
+    static int netif;
+
+    return (esp_netif_t *)&netif;
+}
+
+esp_err_t esp_netif_set_hostname(esp_netif_t *esp_netif, const char *hostname)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif, esp_netif_ip_info_t *ip_info)
+{
+    *ip_info = sta_ip_info;
+    return ESP_OK;
+}
+
+esp_err_t tcpip_adapter_get_ip_info(tcpip_adapter_if_t tcpip_if, tcpip_adapter_ip_info_t *ip_info)
+{
+    if (tcpip_if != TCPIP_ADAPTER_IF_STA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *ip_info = sta_ip_info;
+    return ESP_OK;
+}
+
+//////////////////////////////////////////////////////////////////////
+// WiFi
+esp_err_t esp_wifi_init(const wifi_init_config_t *config)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_mode(wifi_mode_t mode)
+{
+    return (mode == WIFI_MODE_STA) ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_wifi_set_storage(wifi_storage_t storage)
+{
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_get_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *conf = sta_config;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_set_config(wifi_interface_t interface, wifi_config_t *conf)
+{
+    if (interface != WIFI_IF_STA) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    sta_config = *conf;
+    return ESP_OK;
+}
+
+esp_err_t esp_wifi_start(void)
+{
+    if (wifi_started) {
+        return ESP_OK;
+    }
+    wifi_started = true;
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_START, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_stop(void)
+{
+    if (!wifi_started) {
+        return ESP_OK;
+    }
+    esp_wifi_disconnect();
+    wifi_started = false;
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_STOP, NULL, 0, portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_connect(void)
+{
+    wifi_event_sta_connected_t connected;
+    ip_event_got_ip_t got_ip;
+
+    if (!wifi_started) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (sta_config.sta.bssid_set &&
+        (memcmp(sta_config.sta.bssid, host_ap_bssid, sizeof(host_ap_bssid)) != 0)) {
+        // NOTE: 覚えていた AP が居なければ，実機と同じく切断として通知する
+        wifi_event_sta_disconnected_t disconnected = { .reason = 201 };
+        return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED,
+                              &disconnected, sizeof(disconnected), portMAX_DELAY);
+    }
+
+    memset(&connected, 0, sizeof(connected));
+    memcpy(connected.bssid, host_ap_bssid, sizeof(host_ap_bssid));
+    connected.channel = host_ap_channel;
+    wifi_connected = true;
+    ESP_ERROR_CHECK(esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED,
+                                   &connected, sizeof(connected), portMAX_DELAY));
+
+    sta_ip_info.ip.addr = htonl(0x7f000001);
+    sta_ip_info.netmask.addr = htonl(0xff000000);
+    sta_ip_info.gw.addr = htonl(0x7f000001);
+    memset(&got_ip, 0, sizeof(got_ip));
+    got_ip.ip_info = sta_ip_info;
+    return esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, &got_ip, sizeof(got_ip), portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_disconnect(void)
+{
+    wifi_event_sta_disconnected_t disconnected = { .reason = 8 }; // ASSOC_LEAVE
+
+    if (!wifi_connected) {
+        return ESP_OK;
+    }
+    wifi_connected = false;
+    memset(&sta_ip_info, 0, sizeof(sta_ip_info));
+    return esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED,
+                          &disconnected, sizeof(disconnected), portMAX_DELAY);
+}
+
+esp_err_t esp_wifi_sta_get_ap_info(wifi_ap_record_t *ap_info)
+{
+    if (!wifi_connected) {
+        return ESP_FAIL;
+    }
+    memset(ap_info, 0, sizeof(wifi_ap_record_t));
+    memcpy(ap_info->bssid, host_ap_bssid, sizeof(host_ap_bssid));
+    strcpy((char *)ap_info->ssid, "host");
+    ap_info->primary = host_ap_channel;
+    ap_info->rssi = -40;
+    ap_info->authmode = WIFI_AUTH_WPA2_PSK;
+    ap_info->pairwise_cipher = WIFI_CIPHER_TYPE_CCMP;
+    ap_info->group_cipher = WIFI_CIPHER_TYPE_CCMP;
+
+    return ESP_OK;
+}
+
+//////////////////////////////////////////////////////////////////////
+// NVS
+esp_err_t nvs_flash_init(void)
+{
+    return ESP_OK;
+}
+
+esp_err_t nvs_flash_erase(void)
+{
+    portENTER_CRITICAL(&nvs_lock);
+    memset(nvs_list, 0, sizeof(nvs_list));
+    portEXIT_CRITICAL(&nvs_lock);
+
+    return ESP_OK;
+}
+
+// NOTE: ハンドルは名前空間の番号 + 1
+esp_err_t nvs_open(const char *name, nvs_open_mode_t open_mode, nvs_handle_t *out_handle)
+{
+    uint32_t i;
+
+    if (strlen(name) >= NVS_KEY_SIZE) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&nvs_lock);
+    for (i = 0; i < nvs_name_count; i++) {
+        if (strcmp(nvs_name_list[i], name) == 0) {
+            break;
+        }
+    }
+    if (i == nvs_name_count) {
+        if ((open_mode == NVS_READONLY) || (nvs_name_count == NVS_ENTRY_MAX)) {
+            portEXIT_CRITICAL(&nvs_lock);
+            return ESP_ERR_NVS_NOT_FOUND;
+        }
+        strcpy(nvs_name_list[nvs_name_count++], name);
+    }
+    portEXIT_CRITICAL(&nvs_lock);
+
+    *out_handle = i + 1;
+    return ESP_OK;
+}
+
+void nvs_close(nvs_handle_t handle)
+{
+}
+
+static nvs_entry_t *nvs_find(nvs_handle_t handle, const char *key)
+{
+    for (uint32_t i = 0; i < NVS_ENTRY_MAX; i++) {
+        if (nvs_list[i].used && (strcmp(nvs_list[i].name, nvs_name_list[handle - 1]) == 0) &&
+            (strcmp(nvs_list[i].key, key) == 0)) {
+            return &(nvs_list[i]);
+        }
+    }
+    return NULL;
+}
+
+esp_err_t nvs_get_blob(nvs_handle_t handle, const char *key, void *out_value, size_t *length)
+{
+    nvs_entry_t *entry;
+    esp_err_t ret = ESP_OK;
+
+    portENTER_CRITICAL(&nvs_lock);
+    entry = nvs_find(handle, key);
+    if (entry == NULL) {
+        ret = ESP_ERR_NVS_NOT_FOUND;
+    } else if (out_value == NULL) {
+        *length = entry->size;
+    } else if (*length < entry->size) {
+        ret = ESP_ERR_INVALID_SIZE;
+    } else {
+        memcpy(out_value, entry->value, entry->size);
+        *length = entry->size;
+    }
+    portEXIT_CRITICAL(&nvs_lock);
+
+    return ret;
+}
+
+esp_err_t nvs_set_blob(nvs_handle_t handle, const char *key, const void *value, size_t length)
+{
+    nvs_entry_t *entry;
+
+    if ((strlen(key) >= NVS_KEY_SIZE) || (length > NVS_VALUE_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&nvs_lock);
+    entry = nvs_find(handle, key);
+    for (uint32_t i = 0; (entry == NULL) && (i < NVS_ENTRY_MAX); i++) {
+        if (!nvs_list[i].used) {
+            entry = &(nvs_list[i]);
+            strcpy(entry->name, nvs_name_list[handle - 1]);
+            strcpy(entry->key, key);
+            entry->used = true;
+        }
+    }
+    if (entry != NULL) {
+        memcpy(entry->value, value, length);
+        entry->size = length;
+    }
+    portEXIT_CRITICAL(&nvs_lock);
+
+    return (entry != NULL) ? ESP_OK : ESP_ERR_NVS_NO_FREE_PAGES;
+}
+
+esp_err_t nvs_erase_key(nvs_handle_t handle, const char *key)
+{
+    nvs_entry_t *entry;
+
+    portENTER_CRITICAL(&nvs_lock);
+    entry = nvs_find(handle, key);
+    if (entry != NULL) {
+        entry->used = false;
+    }
+    portEXIT_CRITICAL(&nvs_lock);
+
+    return (entry != NULL) ? ESP_OK : ESP_ERR_NVS_NOT_FOUND;
+}
+
+esp_err_t nvs_commit(nvs_handle_t handle)
+{
+    return ESP_OK;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Ping
+static void ping_task(void *param)
+{
+    ping_session_t *session = param;
+
+    for (uint32_t i = 0; i < session->config.count; i++) {
+        if (i != 0) {
+            vTaskDelay(session->config.interval_ms / portTICK_PERIOD_MS);
+        }
+        if (wifi_connected) {
+            session->reply++;
+            if (session->cbs.on_ping_success != NULL) {
+                session->cbs.on_ping_success(session, session->cbs.cb_args);
+            }
+        } else if (session->cbs.on_ping_timeout != NULL) {
+            session->cbs.on_ping_timeout(session, session->cbs.cb_args);
+        }
+    }
+    if (session->cbs.on_ping_end != NULL) {
+        session->cbs.on_ping_end(session, session->cbs.cb_args);
+    }
+    vTaskDelete(NULL);
+}
+
+esp_err_t esp_ping_new_session(const esp_ping_config_t *config, const esp_ping_callbacks_t *cbs,
+                               esp_ping_handle_t *hdl_out)
+{
+    ping_session_t *session = calloc(1, sizeof(ping_session_t));
+
+    if (session == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    session->config = *config;
+    session->cbs = *cbs;
+    *hdl_out = session;
+
+    return ESP_OK;
+}
+
+// NOTE: on_ping_end の中から呼ばれる．ping_task は on_ping_end を呼んだ後は
+// セッションに触らないので，すぐに解放してよい
+esp_err_t esp_ping_delete_session(esp_ping_handle_t hdl)
+{
+    free(hdl);
+    return ESP_OK;
+}
+
+esp_err_t esp_ping_start(esp_ping_handle_t hdl)
+{
+    return (xTaskCreate(ping_task, "ping", 2048, hdl, 2, NULL) == pdPASS) ? ESP_OK : ESP_ERR_NO_MEM;
+}
+
+esp_err_t esp_ping_stop(esp_ping_handle_t hdl)
+{
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+esp_err_t esp_ping_get_profile(esp_ping_handle_t hdl, esp_ping_profile_t profile, void *data, uint32_t size)
+{
+    ping_session_t *session = hdl;
+    uint32_t value;
+
+    if (size != sizeof(uint32_t)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    switch (profile) {
+    case ESP_PING_PROF_REQUEST:
+        value = session->config.count;
+        break;
+    case ESP_PING_PROF_REPLY:
+        value = session->reply;
+        break;
+    case ESP_PING_PROF_TIMEGAP:
+        value = 1;  // NOTE: ループバックなので 1 ms とする
+        break;
+    default:
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    memcpy(data, &value, sizeof(value));
+
+    return ESP_OK;
+}
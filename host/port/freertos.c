@@ -0,0 +1,536 @@
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+
+#include "host_port.h"
+
+// NOTE: タスクは pthread，キューとセマフォは mutex と条件変数で実現する．
+// 待ち時間はティック単位で受け取り，CLOCK_MONOTONIC の絶対時刻に直して待つ
+
+struct host_task {
+    pthread_t thread;
+    char name[configMAX_TASK_NAME_LEN];
+    UBaseType_t number;
+    UBaseType_t priority;
+    BaseType_t core;
+    uint32_t stack_size;
+    TaskFunction_t func;
+    void *param;
+    clockid_t cpu_clock;
+    bool deleted;
+
+    pthread_mutex_t notify_lock;
+    pthread_cond_t notify_cond;
+    uint32_t notify;
+
+    struct host_task *next;
+};
+
+struct host_queue {
+    pthread_mutex_t lock;
+    pthread_cond_t not_empty;
+    pthread_cond_t not_full;
+    UBaseType_t length;
+    UBaseType_t item_size;
+    UBaseType_t count;
+    UBaseType_t head;
+    uint8_t *buf;
+};
+
+static pthread_mutex_t task_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct host_task *task_list = NULL;
+static UBaseType_t task_count = 0;
+static UBaseType_t task_number = 0;
+static __thread struct host_task *current_task = NULL;
+
+//////////////////////////////////////////////////////////////////////
+// Time
+int64_t host_time_us(void)
+{
+    static int64_t boot_us = 0;
+    struct timespec ts;
+    int64_t now;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    now = (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+
+    // NOTE: 最初に呼ばれた時刻を起動時刻とみなす
+    if (__atomic_load_n(&boot_us, __ATOMIC_ACQUIRE) == 0) {
+        int64_t expected = 0;
+        __atomic_compare_exchange_n(&boot_us, &expected, now - 1, false,
+                                    __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE);
+    }
+    return now - __atomic_load_n(&boot_us, __ATOMIC_ACQUIRE);
+}
+
+// NOTE: ticks 後の絶対時刻．portMAX_DELAY なら false を返し，期限なしで待つ
+static bool host_deadline(TickType_t ticks, struct timespec *ts)
+{
+    uint64_t ns;
+
+    if (ticks == portMAX_DELAY) {
+        return false;
+    }
+    clock_gettime(CLOCK_MONOTONIC, ts);
+    ns = (uint64_t)ts->tv_nsec + (uint64_t)ticks * portTICK_PERIOD_MS * 1000000;
+    ts->tv_sec += ns / 1000000000;
+    ts->tv_nsec = ns % 1000000000;
+
+    return true;
+}
+
+void host_cond_init(pthread_cond_t *cond)
+{
+    pthread_condattr_t attr;
+
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(cond, &attr);
+    pthread_condattr_destroy(&attr);
+}
+
+//////////////////////////////////////////////////////////////////////
+// Critical Section
+void vPortCPUInitializeMutex(portMUX_TYPE *mux)
+{
+    pthread_mutexattr_t attr;
+
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&(mux->mutex), &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+void vPortEnterCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_lock(&(mux->mutex));
+}
+
+void vPortExitCritical(portMUX_TYPE *mux)
+{
+    pthread_mutex_unlock(&(mux->mutex));
+}
+
+BaseType_t xPortGetCoreID(void)
+{
+    return (sched_getcpu() > 0) ? 1 : 0;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Task
+static struct host_task *task_new(const char *name, uint32_t stack_size, UBaseType_t priority,
+                                  BaseType_t core)
+{
+    struct host_task *task = calloc(1, sizeof(struct host_task));
+
+    if (task == NULL) {
+        return NULL;
+    }
+    strncpy(task->name, name, sizeof(task->name) - 1);
+    task->stack_size = stack_size;
+    task->priority = priority;
+    task->core = core;
+    pthread_mutex_init(&(task->notify_lock), NULL);
+    host_cond_init(&(task->notify_cond));
+
+    pthread_mutex_lock(&task_list_lock);
+    task->number = ++task_number;
+    task->next = task_list;
+    task_list = task;
+    task_count++;
+    pthread_mutex_unlock(&task_list_lock);
+
+    return task;
+}
+
+// NOTE: xTaskCreate で作られていないスレッド (main やテスト) も，初めて使われた時に登録する
+static struct host_task *task_current(void)
+{
+    if (current_task == NULL) {
+        current_task = task_new("main", 0, 1, tskNO_AFFINITY);
+        current_task->thread = pthread_self();
+        pthread_getcpuclockid(current_task->thread, &(current_task->cpu_clock));
+    }
+    return current_task;
+}
+
+static void *task_entry(void *arg)
+{
+    struct host_task *task = arg;
+
+    current_task = task;
+    pthread_getcpuclockid(pthread_self(), &(task->cpu_clock));
+    pthread_setname_np(pthread_self(), task->name);
+
+    task->func(task->param);
+
+    // NOTE: FreeRTOS ではタスク関数から戻ってはいけないが，ホストでは削除扱いにする
+    vTaskDelete(NULL);
+    return NULL;
+}
+
+BaseType_t xTaskCreatePinnedToCore(TaskFunction_t pvTaskCode, const char *const pcName,
+                                   const uint32_t usStackDepth, void *const pvParameters,
+                                   UBaseType_t uxPriority, TaskHandle_t *const pvCreatedTask,
+                                   const BaseType_t xCoreID)
+{
+    struct host_task *task = task_new(pcName, usStackDepth, uxPriority, xCoreID);
+    pthread_attr_t attr;
+
+    if (task == NULL) {
+        return pdFAIL;
+    }
+    task->func = pvTaskCode;
+    task->param = pvParameters;
+    if (pvCreatedTask != NULL) {
+        *pvCreatedTask = task;
+    }
+
+    // NOTE: ホストの libc はスタックを多く使うので，指定されたサイズは使わず既定のままにする
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&(task->thread), &attr, task_entry, task) != 0) {
+        pthread_attr_destroy(&attr);
+        return pdFAIL;
+    }
+    pthread_attr_destroy(&attr);
+
+    return pdPASS;
+}
+
+void vTaskDelete(TaskHandle_t xTaskToDelete)
+{
+    struct host_task *task = (xTaskToDelete == NULL) ? task_current() : xTaskToDelete;
+
+    // NOTE: 自タスク以外の削除は使っていないので対応しない
+    if (task != current_task) {
+        abort();
+    }
+
+    // NOTE: ハンドルを持ち続けている呼び出し元があるので，構造体は解放しない
+    pthread_mutex_lock(&task_list_lock);
+    task->deleted = true;
+    task_count--;
+    pthread_mutex_unlock(&task_list_lock);
+
+    pthread_exit(NULL);
+}
+
+void vTaskDelay(const TickType_t xTicksToDelay)
+{
+    struct timespec ts = {
+        .tv_sec = (xTicksToDelay * portTICK_PERIOD_MS) / 1000,
+        .tv_nsec = ((xTicksToDelay * portTICK_PERIOD_MS) % 1000) * 1000000,
+    };
+
+    while ((nanosleep(&ts, &ts) != 0) && (errno == EINTR)) {
+        ;
+    }
+}
+
+void vTaskDelayUntil(TickType_t *const pxPreviousWakeTime, const TickType_t xTimeIncrement)
+{
+    TickType_t wake = *pxPreviousWakeTime + xTimeIncrement;
+    TickType_t now = xTaskGetTickCount();
+
+    if ((int32_t)(wake - now) > 0) {
+        vTaskDelay(wake - now);
+    }
+    *pxPreviousWakeTime = wake;
+}
+
+TickType_t xTaskGetTickCount(void)
+{
+    return (TickType_t)(host_time_us() / 1000 / portTICK_PERIOD_MS);
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle(void)
+{
+    return task_current();
+}
+
+UBaseType_t uxTaskGetNumberOfTasks(void)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&task_list_lock);
+    count = task_count;
+    pthread_mutex_unlock(&task_list_lock);
+
+    return count;
+}
+
+// NOTE: 実行時間はスレッドごとの CPU 時間 (us) で，FreeRTOS と同じく 32 bit で一周する
+UBaseType_t uxTaskGetSystemState(TaskStatus_t *const pxTaskStatusArray, const UBaseType_t uxArraySize,
+                                 uint32_t *const pulTotalRunTime)
+{
+    UBaseType_t count = 0;
+    struct timespec ts;
+
+    pthread_mutex_lock(&task_list_lock);
+    if (uxArraySize < task_count) {
+        pthread_mutex_unlock(&task_list_lock);
+        return 0;
+    }
+    for (struct host_task *task = task_list; task != NULL; task = task->next) {
+        TaskStatus_t *status = &(pxTaskStatusArray[count]);
+
+        if (task->deleted) {
+            continue;
+        }
+        memset(status, 0, sizeof(TaskStatus_t));
+        status->xHandle = task;
+        status->pcTaskName = task->name;
+        status->xTaskNumber = task->number;
+        status->eCurrentState = (task == current_task) ? eRunning : eBlocked;
+        status->uxCurrentPriority = task->priority;
+        status->uxBasePriority = task->priority;
+        if (clock_gettime(task->cpu_clock, &ts) == 0) {
+            status->ulRunTimeCounter = (uint32_t)((uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000);
+        }
+        // NOTE: ホストではスタックの使用量を測らないので，確保を指定されたサイズを返す
+        status->usStackHighWaterMark = task->stack_size;
+        status->xCoreID = task->core;
+        count++;
+    }
+    pthread_mutex_unlock(&task_list_lock);
+
+    if (pulTotalRunTime != NULL) {
+        *pulTotalRunTime = (uint32_t)host_time_us();
+    }
+    return count;
+}
+
+UBaseType_t uxTaskGetStackHighWaterMark(TaskHandle_t xTask)
+{
+    struct host_task *task = (xTask == NULL) ? task_current() : xTask;
+
+    return task->stack_size;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t xTaskToNotify)
+{
+    struct host_task *task = xTaskToNotify;
+
+    pthread_mutex_lock(&(task->notify_lock));
+    task->notify++;
+    pthread_cond_signal(&(task->notify_cond));
+    pthread_mutex_unlock(&(task->notify_lock));
+
+    return pdPASS;
+}
+
+void vTaskNotifyGiveFromISR(TaskHandle_t xTaskToNotify, BaseType_t *pxHigherPriorityTaskWoken)
+{
+    xTaskNotifyGive(xTaskToNotify);
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t xClearCountOnExit, TickType_t xTicksToWait)
+{
+    struct host_task *task = task_current();
+    struct timespec deadline;
+    bool timed = host_deadline(xTicksToWait, &deadline);
+    uint32_t value;
+
+    pthread_mutex_lock(&(task->notify_lock));
+    while (task->notify == 0) {
+        if (!timed) {
+            pthread_cond_wait(&(task->notify_cond), &(task->notify_lock));
+        } else if (pthread_cond_timedwait(&(task->notify_cond), &(task->notify_lock),
+                                          &deadline) == ETIMEDOUT) {
+            break;
+        }
+    }
+    value = task->notify;
+    if (value != 0) {
+        task->notify = xClearCountOnExit ? 0 : (value - 1);
+    }
+    pthread_mutex_unlock(&(task->notify_lock));
+
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Queue
+QueueHandle_t xQueueCreate(UBaseType_t uxQueueLength, UBaseType_t uxItemSize)
+{
+    struct host_queue *queue = calloc(1, sizeof(struct host_queue));
+
+    if (queue == NULL) {
+        return NULL;
+    }
+    if (uxItemSize != 0) {
+        queue->buf = malloc(uxQueueLength * uxItemSize);
+        if (queue->buf == NULL) {
+            free(queue);
+            return NULL;
+        }
+    }
+    queue->length = uxQueueLength;
+    queue->item_size = uxItemSize;
+    pthread_mutex_init(&(queue->lock), NULL);
+    host_cond_init(&(queue->not_empty));
+    host_cond_init(&(queue->not_full));
+
+    return queue;
+}
+
+void vQueueDelete(QueueHandle_t xQueue)
+{
+    pthread_cond_destroy(&(xQueue->not_empty));
+    pthread_cond_destroy(&(xQueue->not_full));
+    pthread_mutex_destroy(&(xQueue->lock));
+    free(xQueue->buf);
+    free(xQueue);
+}
+
+static BaseType_t queue_send(QueueHandle_t queue, const void *item, TickType_t wait, bool front)
+{
+    struct timespec deadline;
+    bool timed = host_deadline(wait, &deadline);
+    UBaseType_t pos;
+
+    pthread_mutex_lock(&(queue->lock));
+    while (queue->count == queue->length) {
+        if ((wait == 0) ||
+            (timed && (pthread_cond_timedwait(&(queue->not_full), &(queue->lock),
+                                              &deadline) == ETIMEDOUT))) {
+            pthread_mutex_unlock(&(queue->lock));
+            return errQUEUE_FULL;
+        }
+        if (!timed) {
+            pthread_cond_wait(&(queue->not_full), &(queue->lock));
+        }
+    }
+    if (queue->item_size != 0) {
+        if (front) {
+            queue->head = (queue->head + queue->length - 1) % queue->length;
+            pos = queue->head;
+        } else {
+            pos = (queue->head + queue->count) % queue->length;
+        }
+        memcpy(queue->buf + pos * queue->item_size, item, queue->item_size);
+    }
+    queue->count++;
+    pthread_cond_signal(&(queue->not_empty));
+    pthread_mutex_unlock(&(queue->lock));
+
+    return pdPASS;
+}
+
+BaseType_t xQueueSend(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, false);
+}
+
+BaseType_t xQueueSendToFront(QueueHandle_t xQueue, const void *pvItemToQueue, TickType_t xTicksToWait)
+{
+    return queue_send(xQueue, pvItemToQueue, xTicksToWait, true);
+}
+
+BaseType_t xQueueSendFromISR(QueueHandle_t xQueue, const void *pvItemToQueue,
+                             BaseType_t *pxHigherPriorityTaskWoken)
+{
+    if (pxHigherPriorityTaskWoken != NULL) {
+        *pxHigherPriorityTaskWoken = pdFALSE;
+    }
+    return queue_send(xQueue, pvItemToQueue, 0, false);
+}
+
+BaseType_t xQueueReceive(QueueHandle_t xQueue, void *pvBuffer, TickType_t xTicksToWait)
+{
+    struct timespec deadline;
+    bool timed = host_deadline(xTicksToWait, &deadline);
+
+    pthread_mutex_lock(&(xQueue->lock));
+    while (xQueue->count == 0) {
+        if ((xTicksToWait == 0) ||
+            (timed && (pthread_cond_timedwait(&(xQueue->not_empty), &(xQueue->lock),
+                                              &deadline) == ETIMEDOUT))) {
+            pthread_mutex_unlock(&(xQueue->lock));
+            return errQUEUE_EMPTY;
+        }
+        if (!timed) {
+            pthread_cond_wait(&(xQueue->not_empty), &(xQueue->lock));
+        }
+    }
+    if (xQueue->item_size != 0) {
+        memcpy(pvBuffer, xQueue->buf + xQueue->head * xQueue->item_size, xQueue->item_size);
+        xQueue->head = (xQueue->head + 1) % xQueue->length;
+    }
+    xQueue->count--;
+    pthread_cond_signal(&(xQueue->not_full));
+    pthread_mutex_unlock(&(xQueue->lock));
+
+    return pdPASS;
+}
+
+BaseType_t xQueueReset(QueueHandle_t xQueue)
+{
+    pthread_mutex_lock(&(xQueue->lock));
+    xQueue->count = 0;
+    xQueue->head = 0;
+    pthread_cond_broadcast(&(xQueue->not_full));
+    pthread_mutex_unlock(&(xQueue->lock));
+
+    return pdPASS;
+}
+
+UBaseType_t uxQueueMessagesWaiting(const QueueHandle_t xQueue)
+{
+    UBaseType_t count;
+
+    pthread_mutex_lock(&(xQueue->lock));
+    count = xQueue->count;
+    pthread_mutex_unlock(&(xQueue->lock));
+
+    return count;
+}
+
+UBaseType_t uxQueueSpacesAvailable(const QueueHandle_t xQueue)
+{
+    UBaseType_t space;
+
+    pthread_mutex_lock(&(xQueue->lock));
+    space = xQueue->length - xQueue->count;
+    pthread_mutex_unlock(&(xQueue->lock));
+
+    return space;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Semaphore
+SemaphoreHandle_t xSemaphoreCreateBinary(void)
+{
+    return xQueueCreate(1, 0);
+}
+
+// NOTE: 優先度継承はしない (ホストでは優先度を扱わない)
+SemaphoreHandle_t xSemaphoreCreateMutex(void)
+{
+    SemaphoreHandle_t sem = xQueueCreate(1, 0);
+
+    if (sem != NULL) {
+        xSemaphoreGive(sem);
+    }
+    return sem;
+}
+
+SemaphoreHandle_t xSemaphoreCreateCounting(UBaseType_t uxMaxCount, UBaseType_t uxInitialCount)
+{
+    SemaphoreHandle_t sem = xQueueCreate(uxMaxCount, 0);
+
+    if (sem != NULL) {
+        sem->count = uxInitialCount;
+    }
+    return sem;
+}
@@ -0,0 +1,176 @@
+#include <string.h>
+
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "freertos/FreeRTOS.h"
+
+// NOTE: GPIO のレジスタはただのメモリとして置く．入力は gpio_host_set_input() で与える
+
+typedef struct gpio_pin {
+    gpio_mode_t mode;
+    gpio_int_type_t intr_type;
+    gpio_isr_t isr;
+    void *isr_arg;
+} gpio_pin_t;
+
+gpio_dev_t GPIO;
+
+static gpio_pin_t pin_list[GPIO_NUM_MAX];
+static bool isr_service_installed = false;
+static portMUX_TYPE gpio_lock = portMUX_INITIALIZER_UNLOCKED;
+
+esp_err_t gpio_config(const gpio_config_t *pGPIOConfig)
+{
+    uint64_t mask = pGPIOConfig->pin_bit_mask;
+
+    if ((mask == 0) || (mask >= (1ULL << GPIO_NUM_MAX))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&gpio_lock);
+    for (int i = 0; i < GPIO_NUM_MAX; i++) {
+        if (!(mask & (1ULL << i))) {
+            continue;
+        }
+        if (!GPIO_IS_VALID_GPIO(i) ||
+            ((pGPIOConfig->mode & GPIO_MODE_OUTPUT) && !GPIO_IS_VALID_OUTPUT_GPIO(i))) {
+            portEXIT_CRITICAL(&gpio_lock);
+            return ESP_ERR_INVALID_ARG;
+        }
+        pin_list[i].mode = pGPIOConfig->mode;
+        pin_list[i].intr_type = pGPIOConfig->intr_type;
+    }
+    portEXIT_CRITICAL(&gpio_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_set_level(gpio_num_t gpio_num, uint32_t level)
+{
+    if (!GPIO_IS_VALID_OUTPUT_GPIO(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (gpio_num < 32) {
+        if (level) {
+            GPIO.out |= 1U << gpio_num;
+        } else {
+            GPIO.out &= ~(1U << gpio_num);
+        }
+    } else {
+        if (level) {
+            GPIO.out1.val |= 1U << (gpio_num - 32);
+        } else {
+            GPIO.out1.val &= ~(1U << (gpio_num - 32));
+        }
+    }
+    return ESP_OK;
+}
+
+int gpio_get_level(gpio_num_t gpio_num)
+{
+    if (gpio_num < 32) {
+        return (GPIO.in >> gpio_num) & 1;
+    } else {
+        return (GPIO.in1.data >> (gpio_num - 32)) & 1;
+    }
+}
+
+esp_err_t gpio_set_intr_type(gpio_num_t gpio_num, gpio_int_type_t intr_type)
+{
+    if (!GPIO_IS_VALID_GPIO(gpio_num) || (intr_type >= GPIO_INTR_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&gpio_lock);
+    pin_list[gpio_num].intr_type = intr_type;
+    portEXIT_CRITICAL(&gpio_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_install_isr_service(int intr_alloc_flags)
+{
+    if (isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    isr_service_installed = true;
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_add(gpio_num_t gpio_num, gpio_isr_t isr_handler, void *args)
+{
+    if (!isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&gpio_lock);
+    pin_list[gpio_num].isr = isr_handler;
+    pin_list[gpio_num].isr_arg = args;
+    portEXIT_CRITICAL(&gpio_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_isr_handler_remove(gpio_num_t gpio_num)
+{
+    if (!isr_service_installed) {
+        return ESP_ERR_INVALID_STATE;
+    }
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    portENTER_CRITICAL(&gpio_lock);
+    pin_list[gpio_num].isr = NULL;
+    pin_list[gpio_num].isr_arg = NULL;
+    portEXIT_CRITICAL(&gpio_lock);
+
+    return ESP_OK;
+}
+
+// NOTE: 割り込みの代わりに，呼び出したスレッドで ISR を実行する
+void gpio_host_set_input(gpio_num_t gpio_num, uint32_t level)
+{
+    gpio_pin_t pin;
+    uint32_t prev;
+    bool fire;
+
+    if (!GPIO_IS_VALID_GPIO(gpio_num)) {
+        return;
+    }
+    portENTER_CRITICAL(&gpio_lock);
+    prev = gpio_get_level(gpio_num);
+    if (gpio_num < 32) {
+        GPIO.in = (GPIO.in & ~(1U << gpio_num)) | ((level ? 1U : 0U) << gpio_num);
+    } else {
+        GPIO.in1.data = (GPIO.in1.data & ~(1U << (gpio_num - 32))) |
+            ((level ? 1U : 0U) << (gpio_num - 32));
+    }
+    pin = pin_list[gpio_num];
+    portEXIT_CRITICAL(&gpio_lock);
+
+    level = level ? 1 : 0;
+    switch (pin.intr_type) {
+    case GPIO_INTR_POSEDGE:
+        fire = (prev == 0) && (level == 1);
+        break;
+    case GPIO_INTR_NEGEDGE:
+        fire = (prev == 1) && (level == 0);
+        break;
+    case GPIO_INTR_ANYEDGE:
+        fire = (prev != level);
+        break;
+    case GPIO_INTR_LOW_LEVEL:
+        fire = (level == 0);
+        break;
+    case GPIO_INTR_HIGH_LEVEL:
+        fire = (level == 1);
+        break;
+    default:
+        fire = false;
+        break;
+    }
+    if (fire && (pin.isr != NULL)) {
+        pin.isr(pin.isr_arg);
+    }
+}
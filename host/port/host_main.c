@@ -0,0 +1,19 @@
+#include <signal.h>
+#include <unistd.h>
+
+// NOTE: 実機の起動処理の代わりに app_main() を呼び，あとはタスクに任せる
+
+void app_main();
+
+int main(int argc, char *argv[])
+{
+    // NOTE: 切断されたソケットへの送信はエラーとして扱い，プロセスは止めない (lwIP と同じ)
+    signal(SIGPIPE, SIG_IGN);
+
+    app_main();
+
+    while (1) {
+        pause();
+    }
+    return 0;
+}
@@ -0,0 +1,11 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdint.h>
+
+// NOTE: ホスト用の実装の間で共有する関数
+
+// 最初に呼ばれてからの経過時間 (us)．esp_timer_get_time() と同じ時計
+int64_t host_time_us(void);
+// CLOCK_MONOTONIC で待つ条件変数を初期化する
+void host_cond_init(pthread_cond_t *cond);
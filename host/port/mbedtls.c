@@ -0,0 +1,55 @@
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+
+#include "mbedtls/md.h"
+#include "mbedtls/sha256.h"
+
+// NOTE: mbedTLS の SHA-256 と HMAC を OpenSSL (libcrypto) で計算する
+
+struct mbedtls_md_info_t {
+    mbedtls_md_type_t type;
+};
+
+static const mbedtls_md_info_t sha256_info = { MBEDTLS_MD_SHA256 };
+
+void mbedtls_sha256_init(mbedtls_sha256_context *ctx)
+{
+    ctx->md_ctx = EVP_MD_CTX_new();
+}
+
+void mbedtls_sha256_free(mbedtls_sha256_context *ctx)
+{
+    if (ctx->md_ctx != NULL) {
+        EVP_MD_CTX_free(ctx->md_ctx);
+        ctx->md_ctx = NULL;
+    }
+}
+
+int mbedtls_sha256_starts_ret(mbedtls_sha256_context *ctx, int is224)
+{
+    return (EVP_DigestInit_ex(ctx->md_ctx, is224 ? EVP_sha224() : EVP_sha256(), NULL) == 1) ? 0 : -1;
+}
+
+int mbedtls_sha256_update_ret(mbedtls_sha256_context *ctx, const unsigned char *input, size_t ilen)
+{
+    return (EVP_DigestUpdate(ctx->md_ctx, input, ilen) == 1) ? 0 : -1;
+}
+
+int mbedtls_sha256_finish_ret(mbedtls_sha256_context *ctx, unsigned char output[32])
+{
+    return (EVP_DigestFinal_ex(ctx->md_ctx, output, NULL) == 1) ? 0 : -1;
+}
+
+const mbedtls_md_info_t *mbedtls_md_info_from_type(mbedtls_md_type_t md_type)
+{
+    return (md_type == MBEDTLS_MD_SHA256) ? &sha256_info : NULL;
+}
+
+int mbedtls_md_hmac(const mbedtls_md_info_t *md_info, const unsigned char *key, size_t keylen,
+                    const unsigned char *input, size_t ilen, unsigned char *output)
+{
+    if (md_info != &sha256_info) {
+        return -1;
+    }
+    return (HMAC(EVP_sha256(), key, (int)keylen, input, ilen, output, NULL) != NULL) ? 0 : -1;
+}
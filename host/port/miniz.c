@@ -0,0 +1,94 @@
+#include <string.h>
+#include <zlib.h>
+
+#include "esp32/rom/miniz.h"
+
+// NOTE: tinfl_decompress() を zlib の inflate() で置き換える．
+// tinfl と同じく，出力は呼び出し元の 32KB のリングバッファに書くが，
+// 過去の出力の参照は zlib が自分の窓で行うので，その内容には依存しない
+
+_Static_assert(sizeof(z_stream) <= sizeof(((tinfl_decompressor *)0)->m_stream),
+               "m_stream is too small for z_stream");
+
+#define STATE_INIT  0
+#define STATE_RUN   1
+#define STATE_DONE  2
+#define STATE_FAIL  3
+
+// NOTE: 作業領域は構造体の中から切り出し，解放しない (tinfl_init() で初めから使い直す)
+static voidpf arena_alloc(voidpf opaque, uInt items, uInt size)
+{
+    tinfl_decompressor *r = opaque;
+    size_t bytes = ((size_t)items * size + 15) & ~(size_t)15;
+    void *p;
+
+    if ((r->m_arena_used + bytes) > sizeof(r->m_arena)) {
+        return Z_NULL;
+    }
+    p = r->m_arena + r->m_arena_used;
+    r->m_arena_used += bytes;
+
+    return p;
+}
+
+static void arena_free(voidpf opaque, voidpf address)
+{
+}
+
+tinfl_status tinfl_decompress(tinfl_decompressor *r, const mz_uint8 *pIn_buf_next, size_t *pIn_buf_size,
+                              mz_uint8 *pOut_buf_start, mz_uint8 *pOut_buf_next, size_t *pOut_buf_size,
+                              const mz_uint32 decomp_flags)
+{
+    z_stream *strm = (z_stream *)r->m_stream;
+    size_t in_size = *pIn_buf_size;
+    size_t out_size = *pOut_buf_size;
+    int ret;
+
+    *pIn_buf_size = 0;
+    *pOut_buf_size = 0;
+
+    if (r->m_state == STATE_INIT) {
+        memset(strm, 0, sizeof(z_stream));
+        r->m_arena_used = 0;
+        strm->zalloc = arena_alloc;
+        strm->zfree = arena_free;
+        strm->opaque = r;
+        if (inflateInit2(strm, (decomp_flags & TINFL_FLAG_PARSE_ZLIB_HEADER) ? MAX_WBITS : -MAX_WBITS) != Z_OK) {
+            r->m_state = STATE_FAIL;
+            return TINFL_STATUS_FAILED;
+        }
+        r->m_state = STATE_RUN;
+    }
+    if (r->m_state == STATE_DONE) {
+        return TINFL_STATUS_DONE;
+    }
+    if (r->m_state == STATE_FAIL) {
+        return TINFL_STATUS_FAILED;
+    }
+
+    strm->next_in = (Bytef *)pIn_buf_next;
+    strm->avail_in = in_size;
+    strm->next_out = pOut_buf_next;
+    strm->avail_out = out_size;
+
+    ret = inflate(strm, Z_SYNC_FLUSH);
+
+    *pIn_buf_size = in_size - strm->avail_in;
+    *pOut_buf_size = out_size - strm->avail_out;
+
+    if (ret == Z_STREAM_END) {
+        r->m_state = STATE_DONE;
+        return TINFL_STATUS_DONE;
+    }
+    if ((ret != Z_OK) && (ret != Z_BUF_ERROR)) {
+        r->m_state = STATE_FAIL;
+        return TINFL_STATUS_FAILED;
+    }
+    if (strm->avail_out == 0) {
+        return TINFL_STATUS_HAS_MORE_OUTPUT;
+    }
+    if (!(decomp_flags & TINFL_FLAG_HAS_MORE_INPUT)) {
+        return TINFL_STATUS_FAILED;
+    }
+    return TINFL_STATUS_NEEDS_MORE_INPUT;
+}
@@ -0,0 +1,62 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_log.h"
+#include "mqtt_client.h"
+
+// NOTE: ホストにはブローカーへの接続がないので，クライアントは設定を覚えるだけで接続しない．
+// 接続していないので，購読と送信は実機の esp-mqtt と同じく -1 を返す．
+// 受信やイベントを確かめるテストは，-Wl,--wrap で esp_mqtt_client_* を差し替える
+
+struct esp_mqtt_client {
+    esp_mqtt_client_config_t config;
+    esp_event_handler_t handler;
+    void *handler_arg;
+    bool started;
+};
+
+esp_mqtt_client_handle_t esp_mqtt_client_init(const esp_mqtt_client_config_t *config)
+{
+    esp_mqtt_client_handle_t client = calloc(1, sizeof(struct esp_mqtt_client));
+
+    if (client != NULL) {
+        client->config = *config;
+    }
+    return client;
+}
+
+esp_err_t esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    if (client->started) {
+        return ESP_FAIL;
+    }
+    client->started = true;
+    ESP_LOGI("host", "MQTT client does not connect to %s on the host.", client->config.uri);
+
+    return ESP_OK;
+}
+
+esp_err_t esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    return client->started ? ESP_OK : ESP_FAIL;
+}
+
+esp_err_t esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                         esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    client->handler = event_handler;
+    client->handler_arg = event_handler_arg;
+
+    return ESP_OK;
+}
+
+int esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    return -1;
+}
+
+int esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                            int len, int qos, int retain)
+{
+    return -1;
+}
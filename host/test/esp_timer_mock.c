@@ -0,0 +1,214 @@
+#include <stdlib.h>
+#include <time.h>
+
+#include "esp_timer.h"
+
+#include "esp_timer_mock.h"
+#include "host_port.h"
+
+struct esp_timer {
+    esp_timer_cb_t callback;
+    void *arg;
+    int64_t alarm;          // 期限 (仮想時刻)
+    uint64_t period;        // 0 なら一度だけ
+    bool armed;
+};
+
+#define TIMER_MAX   32
+
+static pthread_mutex_t mock_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t mock_cond;
+static bool mock_cond_ready = false;
+static struct esp_timer *timer_list[TIMER_MAX];
+static uint32_t timer_count = 0;
+static int64_t mock_now = 0;
+
+static void mock_init()
+{
+    if (!mock_cond_ready) {
+        host_cond_init(&mock_cond);
+        mock_cond_ready = true;
+    }
+}
+
+static uint32_t armed_count()
+{
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < timer_count; i++) {
+        if (timer_list[i]->armed) {
+            count++;
+        }
+    }
+    return count;
+}
+
+// NOTE: 期限が until 以前で最も早いタイマー．同じ期限なら先に作られたもの
+static struct esp_timer *timer_next(int64_t until)
+{
+    struct esp_timer *next = NULL;
+
+    for (uint32_t i = 0; i < timer_count; i++) {
+        struct esp_timer *timer = timer_list[i];
+
+        if (timer->armed && (timer->alarm <= until) &&
+            ((next == NULL) || (timer->alarm < next->alarm))) {
+            next = timer;
+        }
+    }
+    return next;
+}
+
+void esp_timer_mock_advance(int64_t us)
+{
+    struct esp_timer *timer;
+    int64_t until;
+    esp_timer_cb_t callback;
+    void *arg;
+
+    pthread_mutex_lock(&mock_lock);
+    until = mock_now + us;
+    while ((timer = timer_next(until)) != NULL) {
+        mock_now = timer->alarm;
+        if (timer->period != 0) {
+            timer->alarm += timer->period;
+        } else {
+            timer->armed = false;
+        }
+        callback = timer->callback;
+        arg = timer->arg;
+
+        pthread_mutex_unlock(&mock_lock);
+        callback(arg);
+        pthread_mutex_lock(&mock_lock);
+    }
+    mock_now = until;
+    pthread_mutex_unlock(&mock_lock);
+}
+
+bool esp_timer_mock_wait_armed(uint32_t count, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    bool done = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+
+    pthread_mutex_lock(&mock_lock);
+    mock_init();
+    while (armed_count() < count) {
+        if (pthread_cond_timedwait(&mock_cond, &mock_lock, &deadline) != 0) {
+            done = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    return done;
+}
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t *create_args, esp_timer_handle_t *out_handle)
+{
+    struct esp_timer *timer;
+
+    if ((create_args == NULL) || (create_args->callback == NULL) || (out_handle == NULL)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    timer = calloc(1, sizeof(struct esp_timer));
+    if (timer == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    timer->callback = create_args->callback;
+    timer->arg = create_args->arg;
+
+    pthread_mutex_lock(&mock_lock);
+    mock_init();
+    if (timer_count == TIMER_MAX) {
+        pthread_mutex_unlock(&mock_lock);
+        free(timer);
+        return ESP_ERR_NO_MEM;
+    }
+    timer_list[timer_count++] = timer;
+    pthread_mutex_unlock(&mock_lock);
+
+    *out_handle = timer;
+    return ESP_OK;
+}
+
+static esp_err_t timer_start(esp_timer_handle_t timer, uint64_t timeout_us, uint64_t period)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&mock_lock);
+    if (timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->alarm = mock_now + timeout_us;
+        timer->period = period;
+        timer->armed = true;
+        pthread_cond_broadcast(&mock_cond);
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeout_us)
+{
+    return timer_start(timer, timeout_us, 0);
+}
+
+esp_err_t esp_timer_start_periodic(esp_timer_handle_t timer, uint64_t period)
+{
+    return timer_start(timer, period, period);
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+    esp_err_t ret = ESP_OK;
+
+    pthread_mutex_lock(&mock_lock);
+    if (!timer->armed) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        timer->armed = false;
+    }
+    pthread_mutex_unlock(&mock_lock);
+
+    return ret;
+}
+
+esp_err_t esp_timer_delete(esp_timer_handle_t timer)
+{
+    pthread_mutex_lock(&mock_lock);
+    if (timer->armed) {
+        pthread_mutex_unlock(&mock_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    for (uint32_t i = 0; i < timer_count; i++) {
+        if (timer_list[i] == timer) {
+            timer_list[i] = timer_list[--timer_count];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&mock_lock);
+    free(timer);
+
+    return ESP_OK;
+}
+
+int64_t esp_timer_get_time(void)
+{
+    int64_t now;
+
+    pthread_mutex_lock(&mock_lock);
+    now = mock_now;
+    pthread_mutex_unlock(&mock_lock);
+
+    return now;
+}
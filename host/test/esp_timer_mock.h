@@ -0,0 +1,13 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE: port/esp_timer.c の代わりにリンクする仮想時間の esp_timer．
+// 時刻は esp_timer_mock_advance() でしか進まず，期限の来たコールバックは
+// それを呼んだスレッドで期限の早い順に呼ばれる
+
+// 仮想時刻を us だけ進め，その間に期限の来たタイマーを呼ぶ
+void esp_timer_mock_advance(int64_t us);
+// 動作中のタイマーが count 個以上になるまで (実時間で) 待つ．来なければ false
+bool esp_timer_mock_wait_armed(uint32_t count, uint32_t timeout_ms);
@@ -0,0 +1,319 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "soc/gpio_struct.h"
+#include "esp_timer.h"
+
+#include "gpio_task.h"
+#include "esp_timer_mock.h"
+#include "host_port.h"
+
+// NOTE: esp_timer を仮想時間のもの (esp_timer_mock.c) に差し替えて，
+// 指定したパルス幅 (?width_us=) と実際にエッジを作った間隔が一致することを確かめる．
+// 時刻は esp_timer_mock_advance() でしか進まないので，結果は実行環境の負荷によらない
+//
+// Usage: gpio_task_test
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define EVENT_MAX           16
+#define EVENT_TIMEOUT_MS    1000
+#define RATE_INTERVAL_US    100000  // gpio_task.c の 10/s
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static pthread_mutex_t event_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t event_cond;
+static gpio_task_event_t event_list[EVENT_MAX];
+static uint32_t event_head = 0;
+static uint32_t event_count = 0;
+static uint32_t fail_count = 0;
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+// NOTE: START は gpio_ctrl_task から，END は esp_timer_mock_advance() を呼んだスレッドから呼ばれる
+static void test_listener(const gpio_task_event_t *event)
+{
+    pthread_mutex_lock(&event_lock);
+    if (event_count < EVENT_MAX) {
+        event_list[(event_head + event_count) % EVENT_MAX] = *event;
+        event_count++;
+    }
+    pthread_cond_broadcast(&event_cond);
+    pthread_mutex_unlock(&event_lock);
+}
+
+static bool event_wait(gpio_task_event_t *event)
+{
+    struct timespec deadline;
+    bool done = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += EVENT_TIMEOUT_MS / 1000;
+
+    pthread_mutex_lock(&event_lock);
+    while (event_count == 0) {
+        if (pthread_cond_timedwait(&event_cond, &event_lock, &deadline) != 0) {
+            done = false;
+            break;
+        }
+    }
+    if (done) {
+        *event = event_list[event_head];
+        event_head = (event_head + 1) % EVENT_MAX;
+        event_count--;
+    }
+    pthread_mutex_unlock(&event_lock);
+
+    return done;
+}
+
+static uint32_t event_pending()
+{
+    uint32_t count;
+
+    pthread_mutex_lock(&event_lock);
+    count = event_count;
+    pthread_mutex_unlock(&event_lock);
+
+    return count;
+}
+
+static uint64_t enable_set_mask()
+{
+    return GPIO.enable_w1ts | ((uint64_t)GPIO.enable1_w1ts.val << 32);
+}
+
+static uint64_t enable_clear_mask()
+{
+    return GPIO.enable_w1tc | ((uint64_t)GPIO.enable1_w1tc.val << 32);
+}
+
+static void register_clear()
+{
+    GPIO.enable_w1ts = 0;
+    GPIO.enable1_w1ts.val = 0;
+    GPIO.enable_w1tc = 0;
+    GPIO.enable1_w1tc.val = 0;
+}
+
+// NOTE: gpio_ctrl_task はパルスの開始を通知した後でキューに積まれている印を消すので，
+// 終了の直後に投入すると実行中のパルスにまとめられてしまう．確保できるまで待って手放す
+static bool pin_wait_idle(uint64_t mask)
+{
+    for (uint32_t i = 0; i < EVENT_TIMEOUT_MS; i++) {
+        if (gpio_task_claim(mask) == ESP_OK) {
+            gpio_task_unclaim(mask);
+            return true;
+        }
+        vTaskDelay(1);
+    }
+    return false;
+}
+
+// NOTE: 前のパルスのトークンを使い切っても次が通るよう，レート制限の分だけ時間を進める
+static void rate_refill()
+{
+    esp_timer_mock_advance(RATE_INTERVAL_US * 5);
+}
+
+// NOTE: パルスを 1 つ投入して開始を待ち，width_us - 1 では終わらず width_us ちょうどで
+// 終わることを確かめる
+static void test_width(uint8_t gpio_num, uint32_t width_us)
+{
+    uint64_t bit = 1ULL << gpio_num;
+    uint32_t retry_after_ms;
+    gpio_task_event_t event;
+    int64_t edge_time;
+
+    CHECK(pin_wait_idle(bit));
+    register_clear();
+    CHECK(gpio_task_push(gpio_num, width_us, &retry_after_ms) == ESP_OK);
+
+    CHECK(event_wait(&event));
+    CHECK(event.type == GPIO_TASK_EVENT_START);
+    CHECK(event.mask == bit);
+    CHECK(event.width_us == width_us);
+    CHECK(enable_set_mask() == bit);
+    CHECK(esp_timer_mock_wait_armed(1, EVENT_TIMEOUT_MS));
+    edge_time = esp_timer_get_time();
+
+    esp_timer_mock_advance(width_us - 1);
+    CHECK(event_pending() == 0);
+    CHECK(enable_clear_mask() == 0);
+
+    esp_timer_mock_advance(1);
+    CHECK(event_wait(&event));
+    CHECK(event.type == GPIO_TASK_EVENT_END);
+    CHECK(event.mask == bit);
+    CHECK(event.width_us == width_us);
+    CHECK(esp_timer_get_time() - edge_time == width_us);
+    CHECK(enable_clear_mask() == bit);
+
+    printf("gpio %u width %u us: ok\n", gpio_num, width_us);
+    rate_refill();
+}
+
+// NOTE: 幅の違うパルスを同時に投入すると，それぞれの幅で独立に終わる
+static void test_batch()
+{
+    gpio_task_pulse_t list[] = {
+        { .gpio_num = 25, .level = 0, .width_us = 1000 },
+        { .gpio_num = 32, .level = 1, .width_us = 500 },
+    };
+    uint32_t retry_after_ms;
+    gpio_task_event_t event;
+    uint64_t start_mask = 0;
+
+    CHECK(pin_wait_idle((1ULL << 25) | (1ULL << 32)));
+    register_clear();
+    CHECK(gpio_task_push_batch(list, ARRAY_SIZE_OF(list), &retry_after_ms) == ESP_OK);
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(list); i++) {
+        CHECK(event_wait(&event));
+        CHECK(event.type == GPIO_TASK_EVENT_START);
+        start_mask |= event.mask;
+    }
+    CHECK(start_mask == ((1ULL << 25) | (1ULL << 32)));
+    CHECK(GPIO.out1_w1ts.val == (1UL << (32 - 32)));
+    CHECK(esp_timer_mock_wait_armed(2, EVENT_TIMEOUT_MS));
+
+    esp_timer_mock_advance(500);
+    CHECK(event_wait(&event));
+    CHECK((event.type == GPIO_TASK_EVENT_END) && (event.mask == (1ULL << 32)) && (event.width_us == 500));
+    CHECK(enable_clear_mask() == (1ULL << 32));
+
+    esp_timer_mock_advance(500);
+    CHECK(event_wait(&event));
+    CHECK((event.type == GPIO_TASK_EVENT_END) && (event.mask == (1ULL << 25)) && (event.width_us == 1000));
+
+    printf("batch 1000/500 us: ok\n");
+    rate_refill();
+}
+
+// NOTE: COALESCE のピンはパルス中の指示を実行中のパルスにまとめ，幅は変えない
+static void test_coalesce()
+{
+    uint32_t retry_after_ms;
+    gpio_task_event_t event;
+    gpio_task_stat_t stat;
+    uint32_t coalesced;
+
+    gpio_task_get_stat(&stat);
+    coalesced = stat.coalesced;
+
+    CHECK(pin_wait_idle(1ULL << 26));
+    CHECK(gpio_task_push(26, 1000, &retry_after_ms) == ESP_OK);
+    CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_START));
+    CHECK(esp_timer_mock_wait_armed(1, EVENT_TIMEOUT_MS));
+
+    esp_timer_mock_advance(400);
+    CHECK(gpio_task_push(26, 1000, &retry_after_ms) == ESP_OK);
+    gpio_task_get_stat(&stat);
+    CHECK(stat.coalesced == coalesced + 1);
+
+    esp_timer_mock_advance(600);
+    CHECK(event_wait(&event));
+    CHECK((event.type == GPIO_TASK_EVENT_END) && (event.width_us == 1000));
+    CHECK(event_pending() == 0);
+
+    printf("coalesce: ok\n");
+    rate_refill();
+}
+
+// NOTE: 10/s・バースト 5 のレート制限は仮想時刻で判定される
+static void test_throttle()
+{
+    uint32_t retry_after_ms;
+    gpio_task_event_t event;
+
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(pin_wait_idle(1ULL << 33));
+        CHECK(gpio_task_push(33, 1, &retry_after_ms) == ESP_OK);
+        CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_START));
+        CHECK(esp_timer_mock_wait_armed(1, EVENT_TIMEOUT_MS));
+        esp_timer_mock_advance(1);
+        CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_END) && (event.width_us == 1));
+    }
+    CHECK(pin_wait_idle(1ULL << 33));
+    CHECK(gpio_task_push(33, 1, &retry_after_ms) == ESP_ERR_NO_MEM);
+    CHECK(retry_after_ms == RATE_INTERVAL_US / 1000);
+
+    esp_timer_mock_advance(RATE_INTERVAL_US);
+    CHECK(gpio_task_push(33, 1, &retry_after_ms) == ESP_OK);
+    CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_START));
+    CHECK(esp_timer_mock_wait_armed(1, EVENT_TIMEOUT_MS));
+    esp_timer_mock_advance(1);
+    CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_END));
+
+    printf("throttle: ok\n");
+    rate_refill();
+}
+
+// NOTE: 断った要求ではトークンを消費しない．同じピンに幅の違うパルスを 9 個並べると
+// スロットの数 (8) を超えて ESP_ERR_INVALID_SIZE になるが，その後もバースト 5 回分は通る
+static void test_reject_keeps_token()
+{
+    gpio_task_pulse_t list[9];
+    uint32_t retry_after_ms;
+    gpio_task_event_t event;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(list); i++) {
+        list[i].gpio_num = 32;
+        list[i].level = 0;
+        list[i].width_us = i + 1;
+    }
+    CHECK(pin_wait_idle(1ULL << 32));
+    CHECK(gpio_task_push_batch(list, ARRAY_SIZE_OF(list), &retry_after_ms) == ESP_ERR_INVALID_SIZE);
+    CHECK(event_pending() == 0);
+
+    for (uint32_t i = 0; i < 5; i++) {
+        CHECK(pin_wait_idle(1ULL << 32));
+        CHECK(gpio_task_push(32, 1, &retry_after_ms) == ESP_OK);
+        CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_START));
+        CHECK(esp_timer_mock_wait_armed(1, EVENT_TIMEOUT_MS));
+        esp_timer_mock_advance(1);
+        CHECK(event_wait(&event) && (event.type == GPIO_TASK_EVENT_END) && (event.width_us == 1));
+    }
+    CHECK(pin_wait_idle(1ULL << 32));
+    CHECK(gpio_task_push(32, 1, &retry_after_ms) == ESP_ERR_NO_MEM);
+
+    printf("reject keeps token: ok\n");
+    rate_refill();
+}
+
+int main(int argc, char *argv[])
+{
+    static const uint32_t width_list[] = { 1, 100, 12345, GPIO_TASK_DEFAULT_WIDTH_US, GPIO_TASK_MAX_WIDTH_US };
+    gpio_task_stat_t stat;
+
+    host_cond_init(&event_cond);
+
+    gpio_task_start();
+    ESP_ERROR_CHECK(gpio_task_add_listener(test_listener));
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(width_list); i++) {
+        test_width(25, width_list[i]);
+    }
+    test_width(33, 100);
+    test_batch();
+    test_coalesce();
+    test_throttle();
+    test_reject_keeps_token();
+
+    gpio_task_get_stat(&stat);
+    CHECK(stat.pulse_error_max_us == 0);
+    CHECK(stat.pulse_count == ARRAY_SIZE_OF(width_list) + 1 + 2 + 1 + 6 + 5);
+
+    printf("gpio_task_test: %s (pulse_count %u, pulse_error_max_us %u)\n",
+           (fail_count == 0) ? "PASS" : "FAIL", stat.pulse_count, stat.pulse_error_max_us);
+    return (fail_count == 0) ? 0 : 1;
+}
@@ -0,0 +1,146 @@
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cJSON.h"
+
+// NOTE: static なハンドラをそのまま呼ぶため，http_task.c を取り込む
+#include "http_task.c"
+
+// NOTE: /status と /api の応答を json_writer で 100 万回書き出し，ヒープの使用量が
+// 増えないことを確かめる．httpd_resp_* は -Wl,--wrap で差し替え，ソケットを介さずに
+// 送信されたバイト数だけを数える．最初の応答は cJSON で解釈できることも確かめる
+//
+// Usage: json_writer_soak_test [COUNT]
+
+#define DEFAULT_COUNT   1000000
+#define WARMUP_COUNT    1000
+#define SAMPLE_COUNT    10
+#define CAPTURE_SIZE    4096
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+static char capture_buf[CAPTURE_SIZE];
+static size_t capture_len = 0;
+static bool capture = false;
+static uint64_t sent_bytes = 0;
+static uint32_t fail_count = 0;
+
+esp_err_t __wrap_httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if ((buf == NULL) || (buf_len == 0)) {
+        return ESP_OK;
+    }
+    if (buf_len == HTTPD_RESP_USE_STRLEN) {
+        buf_len = strlen(buf);
+    }
+    if (capture && ((capture_len + buf_len) < sizeof(capture_buf))) {
+        memcpy(capture_buf + capture_len, buf, buf_len);
+        capture_len += buf_len;
+        capture_buf[capture_len] = '\0';
+    }
+    sent_bytes += buf_len;
+
+    return ESP_OK;
+}
+
+esp_err_t __wrap_httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    return ESP_OK;
+}
+
+esp_err_t __wrap_httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    return ESP_OK;
+}
+
+esp_err_t __wrap_httpd_resp_set_status(httpd_req_t *r, const char *status)
+{
+    return ESP_OK;
+}
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+// NOTE: ポーリングされる応答をひとまとまり書き出す
+static void respond(httpd_req_t *req, uint32_t i)
+{
+    CHECK(http_handle_status(req) == ESP_OK);
+    CHECK(http_resp_api_result(req, ESP_OK, 0) == ESP_OK);
+    // NOTE: 429 の応答 (エラー名と retry_after_ms を含む) も混ぜる
+    CHECK(http_resp_api_result(req, ESP_ERR_NO_MEM, i % 1000 + 1) == ESP_OK);
+}
+
+static void response_verify(httpd_req_t *req)
+{
+    cJSON *root;
+
+    capture = true;
+    capture_len = 0;
+    CHECK(http_handle_status(req) == ESP_OK);
+    capture = false;
+
+    root = cJSON_Parse(capture_buf);
+    CHECK(root != NULL);
+    if (root == NULL) {
+        printf("%s\n", capture_buf);
+        return;
+    }
+    CHECK(cJSON_GetObjectItem(root, "version") != NULL);
+    CHECK(cJSON_GetObjectItem(root, "gpio") != NULL);
+    CHECK(cJSON_GetObjectItem(root, "boot") != NULL);
+    cJSON_Delete(root);
+}
+
+static size_t heap_used()
+{
+    return mallinfo2().uordblks;
+}
+
+int main(int argc, char *argv[])
+{
+    uint32_t count = (argc > 1) ? strtoul(argv[1], NULL, 10) : DEFAULT_COUNT;
+    uint32_t interval = (count >= SAMPLE_COUNT) ? (count / SAMPLE_COUNT) : 1;
+    httpd_req_t req;
+    size_t base, used, used_max;
+    int64_t start, elapsed;
+
+    memset(&req, 0, sizeof(req));
+    strcpy((char *)req.uri, "/status");
+
+    gpio_task_start();
+    response_verify(&req);
+
+    for (uint32_t i = 0; i < WARMUP_COUNT; i++) {
+        respond(&req, i);
+    }
+    // NOTE: stdout のバッファは最初の出力で確保されるので，その後で基準を取る
+    printf("%u responses x 3 (/status, /api, /api 429)\n", count);
+    base = heap_used();
+    used_max = base;
+    sent_bytes = 0;
+
+    start = esp_timer_get_time();
+    for (uint32_t i = 0; i < count; i++) {
+        respond(&req, i);
+        if (((i + 1) % interval) == 0) {
+            used = heap_used();
+            if (used > used_max) {
+                used_max = used;
+            }
+            printf("%10u responses: heap %zu bytes (%+ld)\n", i + 1, used, (long)(used - base));
+        }
+    }
+    elapsed = esp_timer_get_time() - start;
+
+    CHECK(used_max == base);
+    printf("json_writer_soak_test: %s (%.1f MB sent in %.1f s, heap growth %zu bytes)\n",
+           (fail_count == 0) ? "PASS" : "FAIL", sent_bytes / 1e6, elapsed / 1e6, used_max - base);
+    return (fail_count == 0) ? 0 : 1;
+}
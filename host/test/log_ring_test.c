@@ -0,0 +1,367 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_netif.h"
+
+// NOTE: リングバッファの static 変数と /log のハンドラに触れるため，両方を取り込む
+#include "log_ring.c"
+#include "http_log_handler.c"
+
+// NOTE: log_ring のリングバッファと /log のハンドラを確かめる．
+// - LOG_RING_NARG が IP2STR のような複数の引数に展開されるマクロを数えること
+// - 一周して上書きされた記録は読めず，シリアル出力では失われた件数を出すこと
+// - 書き込み途中や上書きされた記録の読み出しが失敗すること (書き手と並行に読んでも壊れた記録を返さないこと)
+// - ?since= の差分取得と X-Log-Next
+// - 再起動後に前回の記録が残り，マジックやイメージが合わない，または壊れた記録は捨てられること
+// httpd_resp_* は -Wl,--wrap で差し替え，応答をバッファに受ける
+//
+// Usage: log_ring_test
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+#define RESP_SIZE       (LOG_RING_SIZE * LINE_SIZE)
+#define STRESS_MS       300
+
+static char resp_buf[RESP_SIZE];
+static size_t resp_len = 0;
+static char resp_next[12];
+static uint32_t fail_count = 0;
+
+esp_err_t __wrap_httpd_resp_send_chunk(httpd_req_t *r, const char *buf, ssize_t buf_len)
+{
+    if ((buf == NULL) || (buf_len == 0)) {
+        return ESP_OK;
+    }
+    if ((resp_len + buf_len) < sizeof(resp_buf)) {
+        memcpy(resp_buf + resp_len, buf, buf_len);
+        resp_len += buf_len;
+        resp_buf[resp_len] = '\0';
+    }
+    return ESP_OK;
+}
+
+esp_err_t __wrap_httpd_resp_set_type(httpd_req_t *r, const char *type)
+{
+    return ESP_OK;
+}
+
+esp_err_t __wrap_httpd_resp_set_hdr(httpd_req_t *r, const char *field, const char *value)
+{
+    if (strcmp(field, "X-Log-Next") == 0) {
+        snprintf(resp_next, sizeof(resp_next), "%s", value);
+    }
+    return ESP_OK;
+}
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+static uint32_t line_count(const char *str)
+{
+    uint32_t count = 0;
+
+    for (; *str != '\0'; str++) {
+        if (*str == '\n') {
+            count++;
+        }
+    }
+    return count;
+}
+
+// NOTE: path を GET /log したときの本文を resp_buf に，X-Log-Next の値を返す
+static uint32_t log_get(const char *path)
+{
+    httpd_req_t req;
+
+    memset(&req, 0, sizeof(req));
+    snprintf((char *)req.uri, sizeof(req.uri), "%s", path);
+    resp_len = 0;
+    resp_buf[0] = '\0';
+    resp_next[0] = '\0';
+
+    CHECK(http_handle_log(&req) == ESP_OK);
+
+    return strtoul(resp_next, NULL, 10);
+}
+
+// NOTE: 電源投入直後と同じく，RTC メモリの中身を不定にする
+static void ring_power_on()
+{
+    memset(ring, 0xa5, sizeof(ring));
+    write_seq = 0xa5a5a5a5;
+    ring_magic = 0xa5a5a5a5;
+    memset(ring_image, 0xa5, sizeof(ring_image));
+    log_ring_restore();
+}
+
+static void test_narg()
+{
+    esp_ip4_addr_t ip = { .addr = 0x0a00a8c0 };    // 192.168.0.10
+    log_ring_record_t record;
+    char buf[LINE_SIZE];
+    uint32_t seq;
+
+    CHECK(LOG_RING_NARG() == 0);
+    CHECK(LOG_RING_NARG(1) == 1);
+    CHECK(LOG_RING_NARG(1, 2, 3, 4, 5, 6) == 6);
+    CHECK(LOG_RING_NARG(IP2STR(&ip)) == 4);
+    CHECK(LOG_RING_NARG(IP2STR(&ip), 80) == 5);
+
+    ring_power_on();
+    seq = log_ring_head();
+    LOG_RING_I("Address " IPSTR ":%d.", IP2STR(&ip), 80);
+    CHECK(log_ring_read(seq, &record));
+    CHECK(record.argc == 5);
+    log_ring_format(&record, buf, sizeof(buf));
+    CHECK(strstr(buf, "Address 192.168.0.10:80.\n") != NULL);
+}
+
+static void test_wrap()
+{
+    log_ring_record_t record;
+    char *out_buf = NULL;
+    size_t out_size = 0;
+    FILE *out;
+    uint32_t head, seq;
+
+    ring_power_on();
+    CHECK(log_ring_head() == 0);
+    for (uint32_t i = 0; i < (LOG_RING_SIZE * 2 + 5); i++) {
+        LOG_RING_I("Record %u.", i);
+    }
+    head = log_ring_head();
+    CHECK(head == (LOG_RING_SIZE * 2 + 5));
+
+    // NOTE: 一周前の記録は上書きされている
+    CHECK(!log_ring_read(0, &record));
+    CHECK(!log_ring_read(head - LOG_RING_SIZE - 1, &record));
+    CHECK(!log_ring_read(head, &record));
+    CHECK(log_ring_read(head - LOG_RING_SIZE, &record));
+    CHECK(record.arg_list[0] == (head - LOG_RING_SIZE));
+    CHECK(log_ring_read(head - 1, &record));
+    CHECK(record.arg_list[0] == (head - 1));
+
+    // NOTE: シリアル出力が追い付かなかった分は件数だけを出す
+    out = open_memstream(&out_buf, &out_size);
+    seq = log_console_drain(0, out);
+    fclose(out);
+    CHECK(seq == head);
+    CHECK(strstr(out_buf, "W WIFI-IO: 133 log records lost.\n") == out_buf);
+    CHECK(line_count(out_buf) == (LOG_RING_SIZE + 1));
+    CHECK(strstr(out_buf, "Record 132.") == NULL);
+    CHECK(strstr(out_buf, "Record 133.") != NULL);
+    CHECK(strstr(out_buf, "Record 260.") != NULL);
+    free(out_buf);
+
+    // NOTE: 追い付いていれば何も出さない
+    out = open_memstream(&out_buf, &out_size);
+    seq = log_console_drain(head, out);
+    fclose(out);
+    CHECK(seq == head);
+    CHECK(out_size == 0);
+    free(out_buf);
+}
+
+static void test_torn()
+{
+    log_ring_record_t record;
+    uint32_t seq;
+
+    ring_power_on();
+    seq = log_ring_head();
+    LOG_RING_I("Record %u.", 1);
+    LOG_RING_I("Record %u.", 2);
+
+    // NOTE: 書き込み途中 (seq が SEQ_INVALID)
+    ring[seq % LOG_RING_SIZE].seq = SEQ_INVALID;
+    CHECK(!log_ring_read(seq, &record));
+    // NOTE: 一周後の記録で上書きされた
+    ring[(seq + 1) % LOG_RING_SIZE].seq = seq + 1 + LOG_RING_SIZE;
+    CHECK(!log_ring_read(seq + 1, &record));
+    // NOTE: 起動直後に一周前から読もうとすると，書き込み途中の印と同じ番号になる
+    CHECK(!log_ring_read(SEQ_INVALID, &record));
+}
+
+typedef struct stress_stat {
+    volatile bool stop;
+    uint32_t read;
+    uint32_t torn;
+    uint32_t broken;
+} stress_stat_t;
+
+static void *stress_writer(void *param)
+{
+    stress_stat_t *stat = param;
+
+    for (uint32_t i = 0; !stat->stop; i++) {
+        LOG_RING_I("Pair %u %u.", i, ~i);
+    }
+    return NULL;
+}
+
+// NOTE: 書き手と並行して直近の記録を読み，読めたものは必ず組が揃っていることを確かめる
+static void test_stress()
+{
+    stress_stat_t stat;
+    log_ring_record_t record;
+    pthread_t writer;
+    int64_t end;
+    uint32_t head;
+
+    ring_power_on();
+    memset(&stat, 0, sizeof(stat));
+    pthread_create(&writer, NULL, stress_writer, &stat);
+
+    end = esp_timer_get_time() + STRESS_MS * 1000;
+    while (esp_timer_get_time() < end) {
+        head = log_ring_head();
+        for (uint32_t seq = head - LOG_RING_SIZE; seq != head; seq++) {
+            if (!log_ring_read(seq, &record)) {
+                stat.torn++;
+                continue;
+            }
+            stat.read++;
+            if ((record.seq != seq) || (record.argc != 2) ||
+                ((uint32_t)record.arg_list[1] != ~(uint32_t)record.arg_list[0])) {
+                stat.broken++;
+            }
+        }
+    }
+    stat.stop = true;
+    pthread_join(writer, NULL);
+
+    printf("stress: %u records read, %u rejected\n", stat.read, stat.torn);
+    CHECK(stat.read != 0);
+    CHECK(stat.broken == 0);
+}
+
+static void test_since()
+{
+    char path[32];
+    uint32_t head, next;
+
+    ring_power_on();
+    for (uint32_t i = 0; i < 10; i++) {
+        LOG_RING_I("Record %u.", i);
+    }
+    head = log_ring_head();
+
+    next = log_get("/log");
+    CHECK(next == head);
+    CHECK(line_count(resp_buf) == 10);
+    CHECK(strstr(resp_buf, "Record 0.") != NULL);
+
+    // NOTE: 差分だけを取りに来る
+    LOG_RING_I("Record %u.", 10);
+    LOG_RING_I("Record %u.", 11);
+    snprintf(path, sizeof(path), "/log?since=%u", next);
+    next = log_get(path);
+    CHECK(next == (head + 2));
+    CHECK(line_count(resp_buf) == 2);
+    CHECK(strstr(resp_buf, "Record 9.") == NULL);
+    CHECK(strstr(resp_buf, "Record 10.") != NULL);
+
+    snprintf(path, sizeof(path), "/log?since=%u", next);
+    CHECK(log_get(path) == next);
+    CHECK(resp_len == 0);
+
+    // NOTE: 先の番号や数でない値は無視して全部を返す
+    snprintf(path, sizeof(path), "/log?since=%u", next + 5);
+    CHECK(log_get(path) == next);
+    CHECK(line_count(resp_buf) == 12);
+    CHECK(log_get("/log?since=abc") == next);
+    CHECK(line_count(resp_buf) == 12);
+
+    // NOTE: 上書きされた分は飛ばし，残っている一周分を返す
+    for (uint32_t i = 0; i < (LOG_RING_SIZE * 2); i++) {
+        LOG_RING_I("Record %u.", i + 12);
+    }
+    snprintf(path, sizeof(path), "/log?since=%u", next);
+    next = log_get(path);
+    CHECK(next == log_ring_head());
+    CHECK(line_count(resp_buf) == LOG_RING_SIZE);
+    snprintf(path, sizeof(path), "Record %u.", next - LOG_RING_SIZE - 1);
+    CHECK(strstr(resp_buf, path) == NULL);
+    snprintf(path, sizeof(path), "Record %u.", next - LOG_RING_SIZE);
+    CHECK(strstr(resp_buf, path) != NULL);
+}
+
+static void test_restore()
+{
+    log_ring_record_t record;
+    uint32_t head;
+
+    ring_power_on();
+    CHECK(log_ring_head() == 0);
+    // NOTE: 何も残っていなければ，前回の記録についての記録も残さない
+    log_ring_restore();
+    CHECK(log_ring_head() == 0);
+
+    for (uint32_t i = 0; i < 5; i++) {
+        LOG_RING_I("Record %u.", i);
+    }
+    // NOTE: リセットで 3 番目の書き込みが途切れ，4 番目は壊れた
+    ring[2].seq = SEQ_INVALID;
+    ring[3].argc = 0xa5;
+    head = log_ring_head();
+
+    log_ring_restore();
+    CHECK(boot_seq == head);
+    CHECK(log_ring_read(0, &record));
+    CHECK(record.arg_list[0] == 0);
+    CHECK(log_ring_read(1, &record));
+    CHECK(!log_ring_read(2, &record));
+    CHECK(!log_ring_read(3, &record));
+    CHECK(log_ring_read(4, &record));
+    CHECK(record.arg_list[0] == 4);
+    // NOTE: 前回の記録の件数と境目を記録する
+    CHECK(log_ring_head() == (head + 1));
+    CHECK(log_ring_read(head, &record));
+    CHECK(record.level == LOG_RING_WARN);
+    CHECK((record.arg_list[0] == 3) && (record.arg_list[1] == head));
+
+    // NOTE: 書き込み番号が壊れていれば，その前の一周分に入らない記録は捨てる
+    write_seq = 1;
+    log_ring_restore();
+    CHECK(log_ring_read(0, &record));
+    CHECK(!log_ring_read(4, &record));
+    CHECK(log_ring_read(1, &record));
+    CHECK((record.level == LOG_RING_WARN) && (record.arg_list[0] == 1));
+
+    // NOTE: イメージが変わると fmt が指す先も変わるので，全て捨てる
+    ring_image[0] ^= 0xff;
+    log_ring_restore();
+    CHECK(log_ring_head() == 0);
+    CHECK(!log_ring_read(0, &record));
+
+    ring_magic = 0;
+    LOG_RING_I("Record %u.", 0);
+    log_ring_restore();
+    CHECK(log_ring_head() == 0);
+    CHECK(!log_ring_read(0, &record));
+}
+
+int main(int argc, char *argv[])
+{
+    test_narg();
+    test_wrap();
+    test_torn();
+    test_stress();
+    test_since();
+    test_restore();
+
+    if (fail_count != 0) {
+        printf("log_ring_test: FAIL (%u)\n", fail_count);
+        return 1;
+    }
+    printf("log_ring_test: PASS\n");
+    return 0;
+}
@@ -0,0 +1,357 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "mqtt_client.h"
+#include "cJSON.h"
+
+#include "gpio_task.h"
+#include "gpio_seq.h"
+#include "mqtt_task.h"
+#include "wifi_task.h"
+#include "host_port.h"
+
+// NOTE: esp_mqtt_client_* を -Wl,--wrap で差し替え，mqtt_task.c に MQTT_EVENT_DATA などの
+// イベントを直接渡して，送信されたメッセージ (result・pulse_done など) を確かめる．
+// WiFi の通知も wifi_task_set_listener() を差し替えて受け取り，テストから呼ぶ
+//
+// Usage: mqtt_task_test
+
+#define PUB_MAX             64
+#define TOPIC_SIZE          64
+#define WAIT_TIMEOUT_MS     1000
+#define QUIET_MS            200     // 送信されないことを確かめる待ち時間
+#define CMD_BUF_SIZE        1024    // mqtt_task.c の MQTT_CMD_BUF_SIZE
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+typedef struct pub {
+    char *topic;
+    char *data;
+    bool retain;
+} pub_t;
+
+static pthread_mutex_t pub_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t pub_cond;
+static pub_t pub_list[PUB_MAX];
+static uint32_t pub_count = 0;
+static uint32_t pub_read = 0;
+
+static esp_event_handler_t mqtt_handler = NULL;
+static void *mqtt_handler_arg = NULL;
+static wifi_task_listener_t wifi_listener = NULL;
+static char subscribe_topic[TOPIC_SIZE];
+static char topic_prefix[TOPIC_SIZE];
+static uint32_t start_count = 0;
+static uint32_t reconnect_count = 0;
+static uint32_t fail_count = 0;
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// esp_mqtt_client_* と wifi_task_set_listener の差し替え
+esp_err_t __real_esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                                esp_event_handler_t event_handler, void *event_handler_arg);
+
+esp_err_t __wrap_esp_mqtt_client_register_event(esp_mqtt_client_handle_t client, esp_mqtt_event_id_t event,
+                                                esp_event_handler_t event_handler, void *event_handler_arg)
+{
+    mqtt_handler = event_handler;
+    mqtt_handler_arg = event_handler_arg;
+    return __real_esp_mqtt_client_register_event(client, event, event_handler, event_handler_arg);
+}
+
+esp_err_t __wrap_esp_mqtt_client_start(esp_mqtt_client_handle_t client)
+{
+    start_count++;
+    return ESP_OK;
+}
+
+esp_err_t __wrap_esp_mqtt_client_reconnect(esp_mqtt_client_handle_t client)
+{
+    reconnect_count++;
+    return ESP_OK;
+}
+
+int __wrap_esp_mqtt_client_subscribe(esp_mqtt_client_handle_t client, const char *topic, int qos)
+{
+    snprintf(subscribe_topic, sizeof(subscribe_topic), "%s", topic);
+    return 0;
+}
+
+// NOTE: mqtt_pub_task と，イベントを渡したテストのスレッドから呼ばれる
+int __wrap_esp_mqtt_client_publish(esp_mqtt_client_handle_t client, const char *topic, const char *data,
+                                   int len, int qos, int retain)
+{
+    int msg_id = -1;
+
+    pthread_mutex_lock(&pub_lock);
+    if (pub_count < PUB_MAX) {
+        pub_list[pub_count].topic = strdup(topic);
+        pub_list[pub_count].data = (len == 0) ? strdup(data) : strndup(data, len);
+        pub_list[pub_count].retain = retain;
+        msg_id = pub_count++;
+    }
+    pthread_cond_broadcast(&pub_cond);
+    pthread_mutex_unlock(&pub_lock);
+
+    return msg_id;
+}
+
+void __wrap_wifi_task_set_listener(wifi_task_listener_t listener)
+{
+    wifi_listener = listener;
+}
+
+//////////////////////////////////////////////////////////////////////
+// NOTE: <prefix>/<name> への送信を待って，まだ読んでいないものの中から取り出す．
+// 他の名前 (定期的な link など) の送信は読み飛ばさずに残す．来なければ pub は空のまま
+static bool pub_wait(const char *name, pub_t *pub, uint32_t timeout_ms)
+{
+    struct timespec deadline;
+    char topic[TOPIC_SIZE * 2];
+    bool done = false;
+
+    memset(pub, 0, sizeof(pub_t));
+    snprintf(topic, sizeof(topic), "%s/%s", topic_prefix, name);
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += timeout_ms / 1000;
+    deadline.tv_nsec += (timeout_ms % 1000) * 1000000L;
+    if (deadline.tv_nsec >= 1000000000L) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&pub_lock);
+    while (!done) {
+        for (uint32_t i = pub_read; i < pub_count; i++) {
+            if ((pub_list[i].topic != NULL) && (strcmp(pub_list[i].topic, topic) == 0)) {
+                *pub = pub_list[i];
+                pub_list[i].topic = NULL;   // NOTE: 取り出したら free は呼び出し側
+                done = true;
+                break;
+            }
+        }
+        if (!done && (pthread_cond_timedwait(&pub_cond, &pub_lock, &deadline) != 0)) {
+            break;
+        }
+    }
+    // NOTE: 先頭から取り出し済みのものは読み飛ばす
+    while ((pub_read < pub_count) && (pub_list[pub_read].topic == NULL)) {
+        pub_read++;
+    }
+    pthread_mutex_unlock(&pub_lock);
+
+    return done;
+}
+
+static void pub_free(pub_t *pub)
+{
+    free(pub->topic);
+    free(pub->data);
+}
+
+static void event_inject(esp_mqtt_event_id_t event_id, esp_mqtt_event_t *event)
+{
+    mqtt_handler(mqtt_handler_arg, "MQTT_EVENTS", event_id, event);
+}
+
+// NOTE: cmd_name には <prefix>/cmd/ より後を渡す．data_len と total_data_len は分割の再現用
+static void data_inject(const char *cmd_name, const char *data, int data_len, int total_data_len)
+{
+    esp_mqtt_event_t event;
+    char topic[TOPIC_SIZE * 2];
+
+    snprintf(topic, sizeof(topic), "%s/cmd/%s", topic_prefix, cmd_name);
+    memset(&event, 0, sizeof(event));
+    event.event_id = MQTT_EVENT_DATA;
+    event.topic = topic;
+    event.topic_len = strlen(topic);
+    event.data = (char *)data;
+    event.data_len = data_len;
+    event.total_data_len = total_data_len;
+    event_inject(MQTT_EVENT_DATA, &event);
+}
+
+// NOTE: コマンドを 1 つ渡して，その result の status と error を確かめる
+static void cmd_check(const char *cmd_name, const char *data, const char *status, const char *error)
+{
+    pub_t pub;
+    cJSON *root;
+    cJSON *item;
+
+    data_inject(cmd_name, data, strlen(data), strlen(data));
+    CHECK(pub_wait("result", &pub, WAIT_TIMEOUT_MS));
+    if (pub.topic == NULL) {
+        return;
+    }
+    CHECK(!pub.retain);
+    root = cJSON_Parse(pub.data);
+    CHECK(root != NULL);
+    if (root != NULL) {
+        item = cJSON_GetObjectItem(root, "cmd");
+        CHECK(cJSON_IsString(item) && (strcmp(item->valuestring, cmd_name) == 0));
+        item = cJSON_GetObjectItem(root, "status");
+        CHECK(cJSON_IsString(item) && (strcmp(item->valuestring, status) == 0));
+        item = cJSON_GetObjectItem(root, "error");
+        if (error == NULL) {
+            CHECK(item == NULL);
+        } else {
+            CHECK(cJSON_IsString(item) && (strcmp(item->valuestring, error) == 0));
+        }
+        cJSON_Delete(root);
+    }
+    printf("cmd/%s: %s\n", cmd_name, pub.data);
+    pub_free(&pub);
+}
+
+//////////////////////////////////////////////////////////////////////
+// NOTE: 最初の WiFi 接続でクライアントを開始し，以降は再接続を促すだけ
+static void test_wifi()
+{
+    CHECK(wifi_listener != NULL);
+
+    wifi_listener(true);
+    CHECK((start_count == 1) && (reconnect_count == 0));
+    wifi_listener(false);
+    CHECK((start_count == 1) && (reconnect_count == 0));
+    wifi_listener(true);
+    CHECK((start_count == 1) && (reconnect_count == 1));
+
+    printf("wifi: start x%u, reconnect x%u\n", start_count, reconnect_count);
+}
+
+// NOTE: 接続したら cmd/# を購読し，online と status を retain で送る
+static void test_connect()
+{
+    esp_mqtt_event_t event;
+    mqtt_task_stat_t stat;
+    pub_t pub;
+    size_t len;
+    cJSON *root;
+
+    memset(&event, 0, sizeof(event));
+    event.event_id = MQTT_EVENT_CONNECTED;
+    event_inject(MQTT_EVENT_CONNECTED, &event);
+
+    len = strlen(subscribe_topic);
+    CHECK((len > 6) && (strcmp(subscribe_topic + len - 6, "/cmd/#") == 0));
+    snprintf(topic_prefix, sizeof(topic_prefix), "%.*s", (int)(len - 6), subscribe_topic);
+    CHECK(strncmp(topic_prefix, "esp32-wifi-io/", 14) == 0);
+
+    CHECK(pub_wait("online", &pub, WAIT_TIMEOUT_MS));
+    CHECK((pub.topic != NULL) && pub.retain && (strcmp(pub.data, "1") == 0));
+    pub_free(&pub);
+
+    CHECK(pub_wait("status", &pub, WAIT_TIMEOUT_MS));
+    CHECK((pub.topic != NULL) && pub.retain);
+    root = cJSON_Parse(pub.data);
+    CHECK((root != NULL) && (cJSON_GetObjectItem(root, "gpio") != NULL));
+    cJSON_Delete(root);
+    pub_free(&pub);
+
+    mqtt_task_get_stat(&stat);
+    CHECK(stat.enabled && stat.connected && (stat.connect_count == 1));
+
+    printf("connect: %s\n", subscribe_topic);
+}
+
+// NOTE: 同時に終わったパルスの完了は pulse_done 1 つにまとめて送る
+static void test_pulse_done()
+{
+    pub_t pub;
+    cJSON *root, *item, *gpio;
+    uint64_t mask = 0;
+
+    cmd_check("batch", "[{\"gpio\":25,\"width_us\":1000},{\"gpio\":26,\"width_us\":1000}]", "OK", NULL);
+
+    CHECK(pub_wait("pulse_done", &pub, WAIT_TIMEOUT_MS));
+    if (pub.topic == NULL) {
+        return;
+    }
+    root = cJSON_Parse(pub.data);
+    CHECK(cJSON_IsArray(root));
+    cJSON_ArrayForEach(item, root) {
+        // NOTE: END の width_us は実際の幅 (ホストでは実時間なので指定より長くなりうる)
+        CHECK(cJSON_GetObjectItem(item, "width_us")->valueint >= 1000);
+        cJSON_ArrayForEach(gpio, cJSON_GetObjectItem(item, "gpio")) {
+            mask |= 1ULL << gpio->valueint;
+        }
+    }
+    CHECK(mask == ((1ULL << 25) | (1ULL << 26)));
+    cJSON_Delete(root);
+
+    printf("pulse_done: %s\n", pub.data);
+    pub_free(&pub);
+}
+
+static void test_cmd()
+{
+    cmd_check("gpio/25", "1000", "OK", NULL);
+    cmd_check("gpio/25x", "", "NG", "ESP_ERR_INVALID_ARG");
+    cmd_check("batch", "{", "NG", "ESP_ERR_INVALID_ARG");
+    cmd_check("seq", "[{\"gpio\":33,\"width_us\":100000,\"repeat\":10}]", "OK", NULL);
+    cmd_check("seq/abort", "", "OK", NULL);
+    cmd_check("unknown", "", "NG", "ESP_ERR_NOT_FOUND");
+}
+
+// NOTE: 分割されたメッセージとバッファに収まらないメッセージは，処理せずに捨てる
+static void test_drop()
+{
+    mqtt_task_stat_t stat;
+    uint32_t received;
+    char *large;
+    pub_t pub;
+
+    mqtt_task_get_stat(&stat);
+    received = stat.received;
+
+    data_inject("gpio/25", "10", 2, 4);
+    CHECK(!pub_wait("result", &pub, QUIET_MS));
+
+    large = malloc(CMD_BUF_SIZE + 1);
+    memset(large, ' ', CMD_BUF_SIZE);
+    large[0] = '[';
+    large[CMD_BUF_SIZE - 1] = ']';
+    large[CMD_BUF_SIZE] = '\0';
+    data_inject("batch", large, CMD_BUF_SIZE, CMD_BUF_SIZE);
+    CHECK(!pub_wait("result", &pub, QUIET_MS));
+    free(large);
+
+    mqtt_task_get_stat(&stat);
+    CHECK(stat.received == received);
+
+    printf("drop: fragmented and oversized messages ignored\n");
+}
+
+int main(int argc, char *argv[])
+{
+    mqtt_task_stat_t stat;
+
+    host_cond_init(&pub_cond);
+
+    gpio_task_start();
+    gpio_seq_start();
+    mqtt_task_start();
+    CHECK(mqtt_handler != NULL);
+
+    test_wifi();
+    test_connect();
+    test_pulse_done();
+    test_cmd();
+    test_drop();
+
+    mqtt_task_get_stat(&stat);
+    printf("mqtt_task_test: %s (received %u, published %u)\n",
+           (fail_count == 0) ? "PASS" : "FAIL", stat.received, stat.published);
+    return (fail_count == 0) ? 0 : 1;
+}
@@ -0,0 +1,394 @@
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_http_server.h"
+#include "mbedtls/sha256.h"
+
+#include "http_ota_handler.h"
+
+// NOTE: http_ota_handler を実際のサーバに載せ，esp_http_server の受信に障害を入れて
+// (ボディの途中で接続を切る)，分割アップロードが途切れた所から再開して完了することを確かめる．
+// クライアントの手順は tools/ota_upload.py と同じ．
+// 先頭の断片で切れたときだけ最初から送り直し，それ以外は X-OTA-Offset / GET /ota/ の
+// offset から続ける
+//
+// Usage: ota_resume_test
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define OTA_DIR         "build/test/ota"
+#define PORT_OFFSET     "20000"
+#define OTA_PORT        (8080 + 20000)
+#define IMAGE_SIZE      (300 * 1024 + 123)
+#define CHUNK_SIZE      (64 * 1024)
+#define RESP_SIZE       2048
+#define RETRY_MAX       10
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+typedef struct upload_stat {
+    uint32_t attempts;
+    uint32_t restarts;  // 先頭から送り直した回数
+    size_t sent;        // 送ったボディの合計
+} upload_stat_t;
+
+// NOTE: 何回目の POST で，ボディの何バイト目で切るか
+typedef struct fault {
+    uint32_t attempt;
+    size_t after_bytes;
+} fault_t;
+
+static const fault_t fault_list[] = {
+    { 0, 10000 },           // 先頭の断片 (セッションが返る前) で切れる
+    { 2, 30000 },
+    { 3, 1 },
+    { 5, CHUNK_SIZE - 1 },  // 断片の最後の 1 バイト手前
+    { 6, 4096 },            // 書き込みバッファ (BUF_SIZE) 1 つ分
+};
+
+static uint32_t fail_count = 0;
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+static uint8_t *image_make(size_t size)
+{
+    uint8_t *image = malloc(size);
+
+    srand(1);
+    for (size_t i = 0; i < size; i++) {
+        image[i] = (i < 32) ? 0 : (uint8_t)(rand() >> 8);
+    }
+    image[0] = 0xE9;    // NOTE: esp_ota_write() が確かめるマジックバイト
+
+    return image;
+}
+
+static void digest_str(const uint8_t *data, size_t size, char *str)
+{
+    mbedtls_sha256_context ctx;
+    uint8_t digest[32];
+
+    mbedtls_sha256_init(&ctx);
+    mbedtls_sha256_starts_ret(&ctx, 0);
+    mbedtls_sha256_update_ret(&ctx, data, size);
+    mbedtls_sha256_finish_ret(&ctx, digest);
+    mbedtls_sha256_free(&ctx);
+
+    for (uint32_t i = 0; i < sizeof(digest); i++) {
+        sprintf(str + i * 2, "%02x", digest[i]);
+    }
+}
+
+static uint8_t *gzip_make(const uint8_t *data, size_t size, size_t *gzip_size)
+{
+    z_stream stream;
+    uint8_t *out = malloc(size + 1024);
+
+    memset(&stream, 0, sizeof(stream));
+    deflateInit2(&stream, 9, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY);
+    stream.next_in = (uint8_t *)data;
+    stream.avail_in = size;
+    stream.next_out = out;
+    stream.avail_out = size + 1024;
+    deflate(&stream, Z_FINISH);
+    *gzip_size = stream.total_out;
+    deflateEnd(&stream);
+
+    return out;
+}
+
+// NOTE: 1 リクエストを送り，サーバが閉じるまで応答を読む．送信後に書き込み側を閉じるので，
+// サーバは応答を返した後に接続を閉じる．受信できた長さを返す
+static int http_request(const char *head, const uint8_t *body, size_t body_size, char *resp, size_t resp_size)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(OTA_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    size_t pos = 0;
+    ssize_t len;
+    int fd;
+
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        close(fd);
+        return -1;
+    }
+    if (send(fd, head, strlen(head), MSG_NOSIGNAL) == (ssize_t)strlen(head)) {
+        while (pos < body_size) {
+            len = send(fd, body + pos, body_size - pos, MSG_NOSIGNAL);
+            if (len <= 0) {
+                break;
+            }
+            pos += len;
+        }
+        shutdown(fd, SHUT_WR);
+    }
+
+    pos = 0;
+    while ((pos + 1) < resp_size) {
+        len = recv(fd, resp + pos, resp_size - pos - 1, 0);
+        if (len <= 0) {
+            break;
+        }
+        pos += len;
+    }
+    resp[pos] = '\0';
+    close(fd);
+
+    return pos;
+}
+
+static bool resp_header(const char *resp, const char *name, char *value, size_t size)
+{
+    const char *end = strstr(resp, "\r\n\r\n");
+    size_t name_len = strlen(name);
+    size_t len;
+
+    for (const char *line = strstr(resp, "\r\n"); (line != NULL) && (line < end);
+         line = strstr(line + 2, "\r\n")) {
+        line += 2;
+        if ((strncasecmp(line, name, name_len) == 0) && (line[name_len] == ':')) {
+            line += name_len + 1;
+            line += strspn(line, " ");
+            len = strcspn(line, "\r");
+            if (len >= size) {
+                return false;
+            }
+            memcpy(value, line, len);
+            value[len] = '\0';
+            return true;
+        }
+        line -= 2;
+    }
+    return false;
+}
+
+// NOTE: チャンクの終端まで届いた応答だけを成功とみなす
+static int resp_status(const char *resp)
+{
+    int status;
+
+    if (sscanf(resp, "HTTP/1.1 %d", &status) != 1) {
+        return 0;
+    }
+    if ((status == 200) && (strstr(resp, "\r\n0\r\n\r\n") == NULL)) {
+        return 0;
+    }
+    return status;
+}
+
+static bool query_session(const char *session, size_t *offset)
+{
+    char resp[RESP_SIZE];
+    char pattern[64];
+    const char *pos;
+
+    if (http_request("GET /ota/ HTTP/1.1\r\nHost: test\r\n\r\n", NULL, 0, resp, sizeof(resp)) <= 0) {
+        return false;
+    }
+    snprintf(pattern, sizeof(pattern), "\"session\":\"%s\"", session);
+    if ((session[0] == '\0') || (strstr(resp, pattern) == NULL)) {
+        return false;
+    }
+    pos = strstr(resp, "\"offset\":");
+    if (pos == NULL) {
+        return false;
+    }
+    *offset = strtoul(pos + strlen("\"offset\":"), NULL, 10);
+    return true;
+}
+
+static bool upload(const uint8_t *body, size_t size, const char *digest, bool use_gzip, upload_stat_t *stat)
+{
+    char head[512];
+    char resp[RESP_SIZE];
+    char session[64] = "";
+    char value[64];
+    size_t offset = 0;
+    size_t end;
+    uint32_t retry = 0;
+    int status;
+
+    memset(stat, 0, sizeof(upload_stat_t));
+    while (offset < size) {
+        end = ((offset + CHUNK_SIZE) < size) ? (offset + CHUNK_SIZE - 1) : (size - 1);
+        snprintf(head, sizeof(head),
+                 "POST /ota/ HTTP/1.1\r\n"
+                 "Host: test\r\n"
+                 "Content-Type: application/octet-stream\r\n"
+                 "Content-Length: %zu\r\n"
+                 "Content-Range: bytes %zu-%zu/%zu\r\n"
+                 "X-OTA-SHA256: %s\r\n"
+                 "%s%s%s"
+                 "%s"
+                 "\r\n",
+                 end - offset + 1, offset, end, size, digest,
+                 (session[0] != '\0') ? "X-OTA-Session: " : "", session,
+                 (session[0] != '\0') ? "\r\n" : "",
+                 use_gzip ? "Content-Encoding: gzip\r\n" : "");
+
+        for (uint32_t i = 0; i < ARRAY_SIZE_OF(fault_list); i++) {
+            if (fault_list[i].attempt == stat->attempts) {
+                httpd_host_set_recv_fault(fault_list[i].after_bytes);
+            }
+        }
+        if (offset == 0) {
+            stat->restarts++;
+        }
+        stat->attempts++;
+        stat->sent += end - offset + 1;
+
+        http_request(head, body + offset, end - offset + 1, resp, sizeof(resp));
+        httpd_host_set_recv_fault(0);
+        status = resp_status(resp);
+
+        if ((status == 416) && resp_header(resp, "X-OTA-Offset", value, sizeof(value))) {
+            offset = strtoul(value, NULL, 10);
+        } else if (status == 404) {
+            session[0] = '\0';
+            offset = 0;
+        } else if (status == 200) {
+            if (!resp_header(resp, "X-OTA-Session", session, sizeof(session))) {
+                session[0] = '\0';
+            }
+            offset = end + 1;
+            retry = 0;
+        } else if (status != 0) {
+            printf("ERROR: %s\n", resp);
+            return false;
+        } else {
+            if (++retry > RETRY_MAX) {
+                return false;
+            }
+            if (!query_session(session, &offset)) {
+                session[0] = '\0';
+                offset = 0;
+            }
+        }
+    }
+    return strstr(resp, "Complete") != NULL;
+}
+
+static uint8_t *file_read(const char *path, size_t *size)
+{
+    FILE *fp = fopen(path, "rb");
+    uint8_t *data;
+    long len;
+
+    if (fp == NULL) {
+        return NULL;
+    }
+    fseek(fp, 0, SEEK_END);
+    len = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    data = malloc(len + 1);
+    *size = fread(data, 1, len, fp);
+    data[*size] = '\0';
+    fclose(fp);
+
+    return data;
+}
+
+// NOTE: otadata が指すパーティションにイメージが書かれていること
+static void image_verify(const uint8_t *image, size_t size)
+{
+    char path[256];
+    char label[32] = "";
+    uint8_t *data;
+    size_t data_size;
+
+    data = file_read(OTA_DIR "/otadata.bin", &data_size);
+    CHECK(data != NULL);
+    if (data == NULL) {
+        return;
+    }
+    sscanf((char *)data, "%31s", label);
+    free(data);
+
+    snprintf(path, sizeof(path), OTA_DIR "/%s.bin", label);
+    data = file_read(path, &data_size);
+    CHECK(data != NULL);
+    if (data == NULL) {
+        return;
+    }
+    CHECK(data_size == size);
+    CHECK((data_size >= size) && (memcmp(data, image, size) == 0));
+    free(data);
+}
+
+static void test_upload(const char *name, const uint8_t *image, const uint8_t *body, size_t body_size,
+                        bool use_gzip)
+{
+    char digest[65];
+    upload_stat_t stat;
+    bool done;
+
+    remove(OTA_DIR "/otadata.bin");
+    digest_str(image, IMAGE_SIZE, digest);
+
+    done = upload(body, body_size, digest, use_gzip, &stat);
+    CHECK(done);
+    // NOTE: 先頭の断片で切れた 1 回だけ最初から送り直し，残りは差分だけを送る．
+    // 送り直しは障害 1 回につき断片 1 つ分より少ない
+    CHECK(stat.restarts == 2);
+    CHECK(stat.sent < body_size + CHUNK_SIZE * ARRAY_SIZE_OF(fault_list));
+    image_verify(image, IMAGE_SIZE);
+
+    printf("%s: %zu bytes in %u requests, %zu bytes sent (%.2fx), %u restarts: %s\n",
+           name, body_size, stat.attempts, stat.sent, (double)stat.sent / body_size, stat.restarts,
+           done ? "ok" : "failed");
+}
+
+int main(int argc, char *argv[])
+{
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    uint8_t *image, *gzip_body;
+    size_t gzip_size;
+
+    signal(SIGPIPE, SIG_IGN);
+    mkdir("build/test", 0755);
+    mkdir(OTA_DIR, 0755);
+    setenv("ESP_HOST_OTA_DIR", OTA_DIR, 1);
+    setenv("ESP_HOST_PORT_OFFSET", PORT_OFFSET, 1);
+
+    // NOTE: http_task.c の bulk_server_start() と同じ設定
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.server_port = 8080;
+    config.ctrl_port = 32770;
+    config.max_open_sockets = 3;
+    config.max_uri_handlers = 4;
+    config.lru_purge_enable = true;
+    ESP_ERROR_CHECK(httpd_start(&server, &config));
+    http_ota_handler_install(server);
+
+    image = image_make(IMAGE_SIZE);
+    gzip_body = gzip_make(image, IMAGE_SIZE, &gzip_size);
+
+    test_upload("identity", image, image, IMAGE_SIZE, false);
+    test_upload("gzip", image, gzip_body, gzip_size, true);
+
+    httpd_stop(server);
+    free(gzip_body);
+    free(image);
+
+    printf("ota_resume_test: %s\n", (fail_count == 0) ? "PASS" : "FAIL");
+    return (fail_count == 0) ? 0 : 1;
+}
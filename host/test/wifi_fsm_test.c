@@ -0,0 +1,426 @@
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "nvs.h"
+
+#include "wifi_task.h"
+#include "host_port.h"
+
+// NOTE: WiFi の接続管理を確かめる．
+// - wifi_fsm 単体: 仮想時刻で動かし，模擬した esp_wifi (AP の有無だけを持つ) に操作を
+//   適用して，バックオフの幅と揺らぎ，再アソシエーション → ドライバ再起動 → 再起動の
+//   段階的な対処，回復後のリセットを確かめる
+// - wifi_task: esp_wifi_* を -Wl,--wrap で差し替えて呼び出しを記録し，覚えていた AP が
+//   居ないときに高速接続からフルスキャンへ切り替えて接続できることを確かめる
+//
+// Usage: wifi_fsm_test
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define CONNECT_TIMEOUT_MS  10000
+#define BACKOFF_BASE_MS     500
+#define BACKOFF_MAX_MS      30000
+#define SEED_COUNT          1000
+#define WAIT_TIMEOUT_MS     5000
+#define CALL_MAX            16
+#define TICK_SLACK_MS       100     // 実時間で測るバックオフの誤差 (tick の丸めとスケジューリング)
+
+#define CHECK(cond) check((cond), #cond, __LINE__)
+
+typedef enum {
+    CALL_START,
+    CALL_STOP,
+    CALL_CONNECT,
+    CALL_DISCONNECT,
+} call_type_t;
+
+typedef struct call {
+    call_type_t type;
+    bool bssid_set;     // 呼ばれた時点の設定 (高速接続なら true)
+    int64_t time;
+} call_t;
+
+// NOTE: wifi_fsm を動かす側の模擬．AP が居なければ接続はすべて失敗する
+typedef struct mock_wifi {
+    bool ap_up;
+    uint32_t start_count;
+    uint32_t stop_count;
+    uint32_t connect_count;
+    uint32_t disconnect_count;
+    uint32_t restart_count;
+    uint64_t now_ms;    // 仮想時刻
+} mock_wifi_t;
+
+static pthread_mutex_t call_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t call_cond;
+static call_t call_list[CALL_MAX];
+static uint32_t call_count = 0;
+static bool wifi_connected = false;
+static uint32_t fail_count = 0;
+
+static void check(bool cond, const char *expr, int line)
+{
+    if (!cond) {
+        printf("FAIL: %s:%d: %s\n", __FILE__, line, expr);
+        fail_count++;
+    }
+}
+
+//////////////////////////////////////////////////////////////////////
+// wifi_fsm
+static uint32_t backoff_base_ms(uint32_t failure)
+{
+    uint32_t backoff_ms = BACKOFF_BASE_MS;
+
+    for (uint32_t i = 1; (i < failure) && (backoff_ms < BACKOFF_MAX_MS); i++) {
+        backoff_ms *= 2;
+    }
+    return (backoff_ms < BACKOFF_MAX_MS) ? backoff_ms : BACKOFF_MAX_MS;
+}
+
+// NOTE: wifi_task.c の wifi_do_action() と同じ対応で，模擬した esp_wifi を操作する．
+// 接続の結果として起きるイベントを返す (タイムアウトなら WIFI_EV_TIMER)
+static wifi_ev_t mock_apply(mock_wifi_t *mock, wifi_action_t action)
+{
+    switch (action) {
+    case WIFI_ACTION_START:
+        mock->start_count++;
+        break;
+    case WIFI_ACTION_REASSOCIATE:
+        mock->connect_count++;
+        break;
+    case WIFI_ACTION_DISCONNECT:
+        mock->disconnect_count++;
+        return WIFI_EV_DISCONNECTED;
+    case WIFI_ACTION_RESTART_DRIVER:
+        mock->stop_count++;
+        mock->start_count++;
+        break;
+    case WIFI_ACTION_REBOOT:
+        mock->restart_count++;
+        return WIFI_EV_START;
+    default:
+        return WIFI_EV_PING_OK;
+    }
+    // NOTE: 失敗は切断の通知とタイムアウトを交互に起こす
+    if (mock->ap_up) {
+        return WIFI_EV_GOT_IP;
+    }
+    return ((mock->start_count + mock->connect_count) % 2) ? WIFI_EV_DISCONNECTED : WIFI_EV_TIMER;
+}
+
+static void test_backoff()
+{
+    wifi_fsm_t fsm;
+    wifi_fsm_output_t output;
+    uint32_t min_ms[8], max_ms[8];
+    uint32_t first_ms[SEED_COUNT];
+    uint32_t distinct = 0;
+
+    for (uint32_t failure = 1; failure <= ARRAY_SIZE_OF(min_ms); failure++) {
+        min_ms[failure - 1] = UINT32_MAX;
+        max_ms[failure - 1] = 0;
+    }
+
+    for (uint32_t seed = 1; seed <= SEED_COUNT; seed++) {
+        wifi_fsm_init(&fsm, seed);
+        output = wifi_fsm_handle(&fsm, WIFI_EV_START);
+        CHECK((output.action == WIFI_ACTION_START) && output.timer_set &&
+              (output.timer_ms == CONNECT_TIMEOUT_MS));
+
+        for (uint32_t failure = 1; failure <= ARRAY_SIZE_OF(min_ms); failure++) {
+            uint32_t base_ms = backoff_base_ms(failure);
+
+            output = wifi_fsm_handle(&fsm, WIFI_EV_DISCONNECTED);
+            CHECK(fsm.state == WIFI_STATE_BACKOFF);
+            CHECK(fsm.failure == failure);
+            CHECK((output.action == WIFI_ACTION_NONE) && output.timer_set);
+            // NOTE: ±25% の揺らぎ
+            CHECK((output.timer_ms >= base_ms - base_ms / 4) && (output.timer_ms <= base_ms + base_ms / 4));
+
+            if (output.timer_ms < min_ms[failure - 1]) {
+                min_ms[failure - 1] = output.timer_ms;
+            }
+            if (output.timer_ms > max_ms[failure - 1]) {
+                max_ms[failure - 1] = output.timer_ms;
+            }
+            if (failure == 1) {
+                first_ms[seed - 1] = output.timer_ms;
+            }
+
+            wifi_fsm_handle(&fsm, WIFI_EV_TIMER);
+            CHECK(fsm.state == WIFI_STATE_CONNECTING);
+        }
+    }
+
+    // NOTE: 揺らぎは幅全体に広がり，機器ごと (種ごと) に再試行の時期がばらける
+    for (uint32_t failure = 1; failure <= ARRAY_SIZE_OF(min_ms); failure++) {
+        uint32_t base_ms = backoff_base_ms(failure);
+
+        CHECK(min_ms[failure - 1] < base_ms - base_ms / 5);
+        CHECK(max_ms[failure - 1] > base_ms + base_ms / 5);
+        printf("failure %u: backoff %u..%u ms (base %u ms)\n",
+               failure, min_ms[failure - 1], max_ms[failure - 1], base_ms);
+    }
+    for (uint32_t i = 0; i < SEED_COUNT; i++) {
+        bool seen = false;
+
+        for (uint32_t j = 0; (j < i) && !seen; j++) {
+            seen = (first_ms[j] == first_ms[i]);
+        }
+        distinct += seen ? 0 : 1;
+    }
+    CHECK(distinct > 100);
+}
+
+// NOTE: AP が居ない間，対処は再アソシエーション 3 回 → ドライバ再起動 3 回 → 再起動と重くなる
+static void test_escalation()
+{
+    static const wifi_action_t expect_list[] = {
+        WIFI_ACTION_START,
+        WIFI_ACTION_REASSOCIATE, WIFI_ACTION_REASSOCIATE, WIFI_ACTION_REASSOCIATE,
+        WIFI_ACTION_RESTART_DRIVER, WIFI_ACTION_RESTART_DRIVER, WIFI_ACTION_RESTART_DRIVER,
+        WIFI_ACTION_REBOOT,
+    };
+    mock_wifi_t mock;
+    wifi_fsm_t fsm;
+    wifi_fsm_output_t output;
+    wifi_ev_t ev = WIFI_EV_START;
+    uint32_t i = 0;
+
+    memset(&mock, 0, sizeof(mock));
+    wifi_fsm_init(&fsm, 12345);
+
+    while (i < ARRAY_SIZE_OF(expect_list)) {
+        output = wifi_fsm_handle(&fsm, ev);
+        if (output.action == WIFI_ACTION_NONE) {
+            // NOTE: バックオフの満了を待つ
+            CHECK(fsm.state == WIFI_STATE_BACKOFF);
+            mock.now_ms += output.timer_ms;
+            ev = WIFI_EV_TIMER;
+            continue;
+        }
+        CHECK(output.action == expect_list[i]);
+        i++;
+        ev = mock_apply(&mock, output.action);
+        if (ev == WIFI_EV_TIMER) {
+            mock.now_ms += output.timer_ms;     // NOTE: 接続のタイムアウトを待つ
+        }
+        if (output.action == WIFI_ACTION_REBOOT) {
+            break;
+        }
+    }
+    CHECK(i == ARRAY_SIZE_OF(expect_list));
+    CHECK(mock.connect_count == 3);
+    CHECK((mock.stop_count == 3) && (mock.start_count == 4));
+    CHECK(mock.restart_count == 1);
+    CHECK(fsm.failure == 7);
+
+    printf("escalation: reassociate x%u, restart driver x%u, reboot after %.1f s\n",
+           mock.connect_count, mock.stop_count, mock.now_ms / 1000.0);
+}
+
+// NOTE: 回復したら (ping が通ったら) 失敗の回数は 0 に戻り，次の切断は再アソシエーションから
+static void test_recover()
+{
+    wifi_fsm_t fsm;
+    wifi_fsm_output_t output;
+
+    wifi_fsm_init(&fsm, 1);
+    wifi_fsm_handle(&fsm, WIFI_EV_START);
+    for (uint32_t i = 0; i < 4; i++) {
+        wifi_fsm_handle(&fsm, WIFI_EV_DISCONNECTED);
+        output = wifi_fsm_handle(&fsm, WIFI_EV_TIMER);
+    }
+    CHECK(output.action == WIFI_ACTION_RESTART_DRIVER);
+
+    output = wifi_fsm_handle(&fsm, WIFI_EV_GOT_IP);
+    CHECK(fsm.state == WIFI_STATE_CONNECTED);
+    CHECK(output.timer_set && (output.timer_ms == 0));
+    // NOTE: IP を取得しただけでは回復とみなさない
+    CHECK(fsm.failure == 4);
+
+    output = wifi_fsm_handle(&fsm, WIFI_EV_LINK_LOST);
+    CHECK((output.action == WIFI_ACTION_DISCONNECT) && (fsm.state == WIFI_STATE_CONNECTED));
+
+    wifi_fsm_handle(&fsm, WIFI_EV_PING_OK);
+    CHECK(fsm.failure == 0);
+
+    output = wifi_fsm_handle(&fsm, WIFI_EV_DISCONNECTED);
+    CHECK((fsm.failure == 1) && (output.timer_ms <= BACKOFF_BASE_MS + BACKOFF_BASE_MS / 4));
+    // NOTE: バックオフ中に自力で再接続できたら，タイマーを止めてそのまま使う
+    output = wifi_fsm_handle(&fsm, WIFI_EV_GOT_IP);
+    CHECK((fsm.state == WIFI_STATE_CONNECTED) && output.timer_set && (output.timer_ms == 0));
+    CHECK(output.action == WIFI_ACTION_NONE);
+
+    printf("recover: ok\n");
+}
+
+//////////////////////////////////////////////////////////////////////
+// wifi_task
+esp_err_t __real_esp_wifi_start(void);
+esp_err_t __real_esp_wifi_stop(void);
+esp_err_t __real_esp_wifi_connect(void);
+esp_err_t __real_esp_wifi_disconnect(void);
+
+static void call_record(call_type_t type)
+{
+    wifi_config_t config;
+
+    esp_wifi_get_config(WIFI_IF_STA, &config);
+
+    pthread_mutex_lock(&call_lock);
+    if (call_count < CALL_MAX) {
+        call_list[call_count].type = type;
+        call_list[call_count].bssid_set = config.sta.bssid_set;
+        call_list[call_count].time = esp_timer_get_time();
+        call_count++;
+    }
+    pthread_mutex_unlock(&call_lock);
+}
+
+esp_err_t __wrap_esp_wifi_start(void)
+{
+    call_record(CALL_START);
+    return __real_esp_wifi_start();
+}
+
+esp_err_t __wrap_esp_wifi_stop(void)
+{
+    call_record(CALL_STOP);
+    return __real_esp_wifi_stop();
+}
+
+esp_err_t __wrap_esp_wifi_connect(void)
+{
+    call_record(CALL_CONNECT);
+    return __real_esp_wifi_connect();
+}
+
+esp_err_t __wrap_esp_wifi_disconnect(void)
+{
+    call_record(CALL_DISCONNECT);
+    return __real_esp_wifi_disconnect();
+}
+
+static void wifi_listener(bool connected)
+{
+    pthread_mutex_lock(&call_lock);
+    wifi_connected = connected;
+    pthread_cond_broadcast(&call_cond);
+    pthread_mutex_unlock(&call_lock);
+}
+
+static bool wait_connected(bool connected)
+{
+    struct timespec deadline;
+    bool done = true;
+
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += WAIT_TIMEOUT_MS / 1000;
+
+    pthread_mutex_lock(&call_lock);
+    while (wifi_connected != connected) {
+        if (pthread_cond_timedwait(&call_cond, &call_lock, &deadline) != 0) {
+            done = false;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&call_lock);
+
+    return done;
+}
+
+static bool ap_cache_read(uint8_t *bssid, uint8_t *channel)
+{
+    nvs_handle_t handle;
+    uint8_t cache[7];
+    size_t size = sizeof(cache);
+    esp_err_t ret;
+
+    if (nvs_open("wifi", NVS_READONLY, &handle) != ESP_OK) {
+        return false;
+    }
+    ret = nvs_get_blob(handle, "last_ap", cache, &size);
+    nvs_close(handle);
+    if ((ret != ESP_OK) || (size != sizeof(cache))) {
+        return false;
+    }
+    memcpy(bssid, cache, 6);
+    *channel = cache[6];
+
+    return true;
+}
+
+// NOTE: 覚えていた AP (wifi_task.c の ap_cache_t と同じ並び) が居ない場合
+static void test_fast_connect_fallback()
+{
+    static const uint8_t stale_cache[7] = { 0x02, 0x00, 0x00, 0x11, 0x22, 0x33, 11 };
+    static const uint8_t host_bssid[6] = { 0x02, 0x00, 0x00, 0xaa, 0xbb, 0xcc };
+    nvs_handle_t handle;
+    wifi_task_stat_t stat;
+    uint8_t bssid[6];
+    uint8_t channel = 0;
+    uint32_t backoff_ms;
+
+    ESP_ERROR_CHECK(nvs_open("wifi", NVS_READWRITE, &handle));
+    ESP_ERROR_CHECK(nvs_set_blob(handle, "last_ap", stale_cache, sizeof(stale_cache)));
+    nvs_close(handle);
+
+    wifi_task_set_listener(wifi_listener);
+    wifi_task_start();
+    CHECK(wait_connected(true));
+
+    // NOTE: start → 高速接続 (失敗) → バックオフ → フルスキャンで再アソシエーション
+    pthread_mutex_lock(&call_lock);
+    CHECK(call_count == 3);
+    CHECK((call_list[0].type == CALL_START) && call_list[0].bssid_set);
+    CHECK((call_list[1].type == CALL_CONNECT) && call_list[1].bssid_set);
+    CHECK((call_list[2].type == CALL_CONNECT) && !call_list[2].bssid_set);
+    backoff_ms = (call_list[2].time - call_list[1].time) / 1000;
+    pthread_mutex_unlock(&call_lock);
+    CHECK((backoff_ms + TICK_SLACK_MS >= BACKOFF_BASE_MS - BACKOFF_BASE_MS / 4) &&
+          (backoff_ms <= BACKOFF_BASE_MS + BACKOFF_BASE_MS / 4 + TICK_SLACK_MS));
+
+    wifi_task_get_stat(&stat);
+    CHECK(stat.state == WIFI_STATE_CONNECTED);
+    CHECK(!stat.fast);
+    CHECK(ap_cache_read(bssid, &channel));
+    CHECK((memcmp(bssid, host_bssid, sizeof(bssid)) == 0) && (channel == 6));
+    printf("fast connect fallback: full scan after %u ms backoff: ok\n", backoff_ms);
+
+    // NOTE: 切断されたら，今度は覚え直した AP へ高速接続する
+    pthread_mutex_lock(&call_lock);
+    call_count = 0;
+    pthread_mutex_unlock(&call_lock);
+    __real_esp_wifi_disconnect();
+    CHECK(wait_connected(false));
+    CHECK(wait_connected(true));
+
+    pthread_mutex_lock(&call_lock);
+    CHECK(call_count == 1);
+    CHECK((call_list[0].type == CALL_CONNECT) && call_list[0].bssid_set);
+    pthread_mutex_unlock(&call_lock);
+    wifi_task_get_stat(&stat);
+    CHECK(stat.fast);
+    printf("fast connect to the cached AP: ok\n");
+}
+
+int main(int argc, char *argv[])
+{
+    host_cond_init(&call_cond);
+
+    test_backoff();
+    test_escalation();
+    test_recover();
+    test_fast_connect_fallback();
+
+    printf("wifi_fsm_test: %s\n", (fail_count == 0) ? "PASS" : "FAIL");
+    return (fail_count == 0) ? 0 : 1;
+}
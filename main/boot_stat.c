@@ -0,0 +1,52 @@
+#include "esp_timer.h"
+
+#include "app.h"
+#include "boot_stat.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+static const char *phase_str_list[] = {
+    "app_main",
+    "netif",
+    "gpio",
+    "http",
+    "nvs",
+    "wifi",
+    "got_ip",
+    "first_request",
+};
+
+// NOTE: 各フェーズに最初に到達した時刻 (ms)．複数のタスクから書かれる
+static uint32_t phase_time_list[BOOT_PHASE_MAX];
+
+void boot_stat_mark(boot_phase_t phase)
+{
+    uint32_t expected = 0;
+    uint32_t now;
+
+    // NOTE: リクエストごとに呼ばれるので，記録済みなら時刻も取らずに戻る
+    if (__atomic_load_n(&(phase_time_list[phase]), __ATOMIC_RELAXED) != 0) {
+        return;
+    }
+    now = (uint32_t)(esp_timer_get_time() / 1000);
+    if (now == 0) {
+        now = 1; // NOTE: 0 は未到達を表す
+    }
+    if (__atomic_compare_exchange_n(&(phase_time_list[phase]), &expected, now, false,
+                                    __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        ESP_LOGI(TAG, "Boot phase %s: %d ms.", phase_str_list[phase], now);
+    }
+}
+
+uint32_t boot_stat_get_ms(boot_phase_t phase)
+{
+    return __atomic_load_n(&(phase_time_list[phase]), __ATOMIC_RELAXED);
+}
+
+const char *boot_stat_phase_str(boot_phase_t phase)
+{
+    if (phase >= ARRAY_SIZE_OF(phase_str_list)) {
+        return "?";
+    }
+    return phase_str_list[phase];
+}
@@ -0,0 +1,18 @@
+#include <stdint.h>
+
+typedef enum {
+    BOOT_PHASE_APP_MAIN = 0,    // app_main の開始
+    BOOT_PHASE_NETIF,           // TCP/IP スタックの初期化完了
+    BOOT_PHASE_GPIO,            // GPIO タスクの起動完了
+    BOOT_PHASE_HTTP,            // HTTP サーバの起動完了
+    BOOT_PHASE_NVS,             // NVS の初期化完了
+    BOOT_PHASE_WIFI,            // WiFi ドライバの初期化完了
+    BOOT_PHASE_GOT_IP,          // 最初に IP アドレスを取得
+    BOOT_PHASE_FIRST_REQUEST,   // 最初のリクエストに応答
+    BOOT_PHASE_MAX,
+} boot_phase_t;
+
+void boot_stat_mark(boot_phase_t phase);
+// NOTE: 起動からの経過時間 (ms)．まだ到達していなければ 0
+uint32_t boot_stat_get_ms(boot_phase_t phase);
+const char *boot_stat_phase_str(boot_phase_t phase);
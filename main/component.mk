@@ -1,7 +1,13 @@
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/index.html
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/runtime.js.gz
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/main.js.gz
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/polyfills.js.gz
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/scripts.js.gz
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/styles.css.gz
-COMPONENT_EMBED_FILES += ../angular/dist/esp32-wifi-io/favicon.ico.gz
+# NOTE: angular/Makefile が各ファイルの Brotli 版と gzip 版を生成する
+CONTENT_DIST  := ../angular/dist/esp32-wifi-io
+CONTENT_NAMES := index.html runtime.js main.js polyfills.js scripts.js styles.css favicon.ico
+
+COMPONENT_EMBED_FILES += $(foreach name,$(CONTENT_NAMES),$(CONTENT_DIST)/$(name).br $(CONTENT_DIST)/$(name).gz)
+
+# NOTE: 埋め込むファイルの一覧と ETag をビルド時に生成する
+COMPONENT_EXTRA_CLEAN := content_list.h
+
+http_task.o: content_list.h
+
+content_list.h: $(COMPONENT_PATH)/gen_content.py $(addprefix $(COMPONENT_PATH)/,$(COMPONENT_EMBED_FILES))
+	$(PYTHON) $< $@ $(addprefix $(COMPONENT_PATH)/,$(COMPONENT_EMBED_FILES))
@@ -1,25 +1,40 @@
-#include "freertos/FreeRTOS.h"
-#include "freertos/semphr.h"
-
+#include "esp_netif.h"
 #include "esp_ota_ops.h"
 
 #include "app.h"
 
+#include "boot_stat.h"
+#include "log_ring.h"
 #include "http_task.h"
+#include "gpio_task.h"
+#include "gpio_seq.h"
+#include "udp_task.h"
+#include "mqtt_task.h"
 #include "wifi_task.h"
 #include "part_info.h"
 
-SemaphoreHandle_t wifi_start = NULL;
-
 void app_main()
 {
+    boot_stat_mark(BOOT_PHASE_APP_MAIN);
+    log_ring_start();
     part_info_show("Running", esp_ota_get_running_partition());
 
-    vSemaphoreCreateBinary(wifi_start);
-    xSemaphoreTake(wifi_start, portMAX_DELAY);
+    // NOTE: TCP/IP スタックだけは HTTP サーバと WiFi の両方が使うので先に初期化する
+    ESP_ERROR_CHECK(esp_netif_init());
+    boot_stat_mark(BOOT_PHASE_NETIF);
+
+    // NOTE: NVS と WiFi ドライバの初期化は時間がかかるので，WiFi タスクの中で
+    // 並行して進め，その間に GPIO と HTTP サーバを立ち上げる．
+    // HTTP サーバは INADDR_ANY で待ち受けるので，アドレスが付いた時点で応答できる
+    // MQTT は WiFi の接続を契機に繋ぐので，WiFi タスクより先に準備しておく
+    mqtt_task_start();
+    wifi_task_start();
 
-    wifi_task_start(wifi_start);
+    gpio_task_start();
+    gpio_seq_start();
+    boot_stat_mark(BOOT_PHASE_GPIO);
 
-    xSemaphoreTake(wifi_start, portMAX_DELAY);
+    udp_task_start();
     http_task_start();
+    boot_stat_mark(BOOT_PHASE_HTTP);
 }
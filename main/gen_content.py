@@ -0,0 +1,111 @@
+#!/usr/bin/env python
+#
+# Generate a header which defines the table of embedded contents.
+# Files compressed with different encodings (FILE.br, FILE.gz) are
+# grouped as variants of the same path, ordered from the smallest one.
+# The table is sorted by path so that it can be searched with bsearch().
+#
+# Usage: gen_content.py OUTPUT FILE...
+
+import hashlib
+import os
+import re
+import sys
+
+CONTENT_TYPE = {
+    '.html': 'text/html',
+    '.js': 'text/javascript',
+    '.css': 'text/css',
+    '.ico': 'image/x-icon',
+    '.png': 'image/png',
+    '.svg': 'image/svg+xml',
+    '.json': 'application/json',
+}
+
+ENCODING = {
+    '.br': 'br',
+    '.gz': 'gzip',
+}
+
+
+def symbol_name(path):
+    # NOTE: ESP-IDF の EMBED_FILES が生成するシンボル名に合わせる
+    return '_binary_' + re.sub(r'[^0-9A-Za-z]', '_', os.path.basename(path))
+
+
+def etag(path):
+    with open(path, 'rb') as f:
+        return hashlib.sha256(f.read()).hexdigest()[:16]
+
+
+def variant_info(path):
+    name = os.path.basename(path)
+    base, ext = os.path.splitext(name)
+    encoding = ENCODING.get(ext)
+    if encoding is not None:
+        name = base
+
+    return name, {
+        'symbol': symbol_name(path),
+        'encoding': encoding,
+        'etag': etag(path),
+        'size': os.path.getsize(path),
+    }
+
+
+def c_str(value):
+    return 'NULL' if value is None else '"%s"' % value
+
+
+def main(argv):
+    if len(argv) < 2:
+        sys.stderr.write('Usage: gen_content.py OUTPUT FILE...\n')
+        return 1
+
+    content_map = {}
+    for path in argv[1:]:
+        name, variant = variant_info(path)
+        content_map.setdefault(name, []).append(variant)
+
+    lines = [
+        '// Generated by gen_content.py. DO NOT EDIT.',
+        '',
+    ]
+    for name in sorted(content_map.keys(), key=lambda name: name.encode()):
+        for variant in content_map[name]:
+            lines.append('extern const unsigned char %s_start[] asm("%s_start");' %
+                         (variant['symbol'][1:], variant['symbol']))
+            lines.append('extern const unsigned char %s_end[]   asm("%s_end");' %
+                         (variant['symbol'][1:], variant['symbol']))
+    lines.append('')
+
+    for index, name in enumerate(sorted(content_map.keys(), key=lambda name: name.encode())):
+        variant_list = sorted(content_map[name], key=lambda variant: variant['size'])
+        lines.append('// %s: %s' % (name, ', '.join(
+            '%s %d bytes' % (variant['encoding'] or 'identity', variant['size'])
+            for variant in variant_list)))
+        lines.append('static const static_content_variant_t content_variant_%d[] = {' % index)
+        for variant in variant_list:
+            lines.append('    { %s, %s_start, %s_end, "\\"%s\\"", },' %
+                         (c_str(variant['encoding']),
+                          variant['symbol'][1:], variant['symbol'][1:], variant['etag']))
+        lines.append('};')
+    lines.append('')
+
+    lines.append('// NOTE: path でソート済み．バリアントはサイズの小さい順')
+    lines.append('static const static_content_t content_list[] = {')
+    for index, name in enumerate(sorted(content_map.keys(), key=lambda name: name.encode())):
+        ext = os.path.splitext(name)[1]
+        lines.append('    { "%s", "%s", content_variant_%d, %d, },' %
+                     (name, CONTENT_TYPE.get(ext, 'application/octet-stream'),
+                      index, len(content_map[name])))
+    lines.append('};')
+
+    with open(argv[0], 'w') as f:
+        f.write('\n'.join(lines) + '\n')
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main(sys.argv[1:]))
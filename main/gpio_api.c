@@ -0,0 +1,164 @@
+#include <stdlib.h>
+
+#include "cJSON.h"
+
+#include "app.h"
+#include "gpio_api.h"
+#include "gpio_task.h"
+#include "gpio_seq.h"
+
+#define BATCH_MAX_PULSE 16
+
+esp_err_t gpio_api_uint(double value, uint32_t max, uint32_t *result)
+{
+    // NOTE: NaN はどの比較も偽になるので，範囲内であることを確かめる形で書く
+    if (!((value >= 0) && (value <= max))) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((uint32_t)value != value) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    *result = (uint32_t)value;
+
+    return ESP_OK;
+}
+
+uint32_t gpio_api_width(const char *width_str)
+{
+    char *end;
+    unsigned long width_us;
+
+    width_us = strtoul(width_str, &end, 10);
+    if ((end == width_str) || (*end != '\0') || (width_us > GPIO_TASK_MAX_WIDTH_US)) {
+        return 0;
+    }
+    return width_us;
+}
+
+// NOTE: key が無ければ default_value を使う
+static esp_err_t json_get_uint(cJSON *json, const char *key, uint32_t max,
+                               uint32_t default_value, uint32_t *result)
+{
+    cJSON *value = cJSON_GetObjectItem(json, key);
+
+    if (value == NULL) {
+        *result = default_value;
+        return ESP_OK;
+    }
+    if (!cJSON_IsNumber(value)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return gpio_api_uint(value->valuedouble, max, result);
+}
+
+esp_err_t gpio_api_pulse(const char *gpio_str, uint32_t width_us, uint32_t *retry_after_ms)
+{
+    char *end;
+    unsigned long gpio_num;
+
+    *retry_after_ms = 0;
+
+    gpio_num = strtoul(gpio_str, &end, 10);
+    if ((end == gpio_str) || ((*end != '\0') && (*end != '?')) || (gpio_num > UINT8_MAX)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    return gpio_task_push(gpio_num, width_us, retry_after_ms);
+}
+
+esp_err_t gpio_api_batch(const char *json_str, uint32_t *retry_after_ms)
+{
+    gpio_task_pulse_t pulse_list[BATCH_MAX_PULSE];
+    uint32_t pulse_count = 0;
+    uint32_t gpio_num;
+    uint32_t level;
+    uint32_t width_us;
+    cJSON *json, *item, *value;
+
+    *retry_after_ms = 0;
+
+    json = cJSON_Parse(json_str);
+    if (!cJSON_IsArray(json)) {
+        cJSON_Delete(json);
+        return ESP_ERR_INVALID_ARG;
+    }
+    cJSON_ArrayForEach(item, json) {
+        if (pulse_count == BATCH_MAX_PULSE) {
+            cJSON_Delete(json);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        value = cJSON_GetObjectItem(item, "gpio");
+        if (!cJSON_IsNumber(value) || (gpio_api_uint(value->valuedouble, UINT8_MAX, &gpio_num) != ESP_OK) ||
+            (json_get_uint(item, "level", 1, 0, &level) != ESP_OK) ||
+            (json_get_uint(item, "width_us", GPIO_TASK_MAX_WIDTH_US,
+                           GPIO_TASK_DEFAULT_WIDTH_US, &width_us) != ESP_OK)) {
+            cJSON_Delete(json);
+            return ESP_ERR_INVALID_ARG;
+        }
+        pulse_list[pulse_count].gpio_num = gpio_num;
+        pulse_list[pulse_count].level = level;
+        pulse_list[pulse_count].width_us = width_us;
+
+        pulse_count++;
+    }
+    cJSON_Delete(json);
+
+    return gpio_task_push_batch(pulse_list, pulse_count, retry_after_ms);
+}
+
+esp_err_t gpio_api_seq(const char *json_str)
+{
+    gpio_seq_step_t step_list[GPIO_SEQ_STEP_MAX];
+    gpio_seq_step_t *step;
+    uint32_t step_count = 0;
+    uint32_t gpio_num;
+    uint32_t level;
+    esp_err_t ret;
+    cJSON *json, *item, *value;
+
+    json = cJSON_Parse(json_str);
+    if (!cJSON_IsArray(json)) {
+        cJSON_Delete(json);
+        return ESP_ERR_INVALID_ARG;
+    }
+    cJSON_ArrayForEach(item, json) {
+        if (step_count == GPIO_SEQ_STEP_MAX) {
+            cJSON_Delete(json);
+            return ESP_ERR_INVALID_SIZE;
+        }
+        step = &(step_list[step_count++]);
+
+        value = cJSON_GetObjectItem(item, "gpio");
+        if (cJSON_IsNumber(value)) {
+            ret = gpio_api_uint(value->valuedouble, GPIO_SEQ_WAIT - 1, &gpio_num);
+            if (ret == ESP_OK) {
+                ret = json_get_uint(item, "width_us", GPIO_TASK_MAX_WIDTH_US,
+                                    GPIO_TASK_DEFAULT_WIDTH_US, &(step->width_us));
+            }
+        } else if (cJSON_IsNumber(cJSON_GetObjectItem(item, "wait_us"))) {
+            gpio_num = GPIO_SEQ_WAIT;
+            ret = json_get_uint(item, "wait_us", GPIO_TASK_MAX_WIDTH_US, 0, &(step->width_us));
+        } else {
+            ret = ESP_ERR_INVALID_ARG;
+        }
+        if (ret == ESP_OK) {
+            ret = json_get_uint(item, "level", 1, 0, &level);
+        }
+        if (ret == ESP_OK) {
+            ret = json_get_uint(item, "gap_us", GPIO_TASK_MAX_WIDTH_US, step->width_us, &(step->gap_us));
+        }
+        if (ret == ESP_OK) {
+            ret = json_get_uint(item, "repeat", GPIO_SEQ_REPEAT_MAX, 1, &(step->repeat));
+        }
+        if (ret != ESP_OK) {
+            cJSON_Delete(json);
+            return ret;
+        }
+        step->gpio_num = gpio_num;
+        step->level = level;
+    }
+    cJSON_Delete(json);
+
+    // NOTE: 検証は gpio_seq_run で行い，不正なら何も出力しない
+    return gpio_seq_run(step_list, step_count);
+}
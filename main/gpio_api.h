@@ -0,0 +1,16 @@
+#include "esp_err.h"
+
+// NOTE: HTTP・MQTT など複数の入口から同じ形式で GPIO を操作するための処理
+
+// NOTE: 範囲外の値を縮小変換すると別のピンや幅になってしまうので，変換前に確かめる．
+// 整数でないものや max を超えるものは ESP_ERR_INVALID_ARG
+esp_err_t gpio_api_uint(double value, uint32_t max, uint32_t *result);
+// width_str はパルス幅の文字列．不正なら 0 (gpio_task が受け付けない幅) を返す
+uint32_t gpio_api_width(const char *width_str);
+
+// gpio_str は GPIO 番号の文字列 ('\0' か '?' で終わる)
+esp_err_t gpio_api_pulse(const char *gpio_str, uint32_t width_us, uint32_t *retry_after_ms);
+// [ { "gpio": 32, "level": 0, "width_us": 1000 }, ... ]
+esp_err_t gpio_api_batch(const char *json_str, uint32_t *retry_after_ms);
+// [ { "gpio": 32, "width_us": 1000 }, { "wait_us": 50000 }, ... ]
+esp_err_t gpio_api_seq(const char *json_str);
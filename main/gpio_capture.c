@@ -0,0 +1,182 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "gpio_capture.h"
+#include "gpio_task.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define RING_SIZE           1024    // 2 のべき乗
+#define BATCH_SIZE          64
+#define BATCH_INTERVAL_MS   20
+#define NOTIFY_DEPTH        (RING_SIZE / 4) // これだけ溜まったら周期を待たずに取り出す
+
+// NOTE: キャプチャを許可するピンの一覧．フラッシュ (6-11) や UART0 (1, 3)，
+// gpio_task が出力に使うピンを入力に設定し直すと，動作が止まったりパルスが途切れたりする
+static const uint8_t capture_pin_list[] = {
+    4, 5, 13, 14, 27, 34, 35, 36, 39,
+};
+
+// NOTE: ISR サービスは 1 つのコアでピンごとの ISR を順に呼ぶので，書き込み側は
+// 常に 1 つ．head は ISR だけが，tail はタスクだけが更新するのでロックは不要．
+static gpio_capture_event_t ring[RING_SIZE];
+static volatile uint32_t ring_head = 0;
+static volatile uint32_t ring_tail = 0;
+
+static TaskHandle_t capture_task = NULL;
+static gpio_capture_sink_t capture_sink = NULL;
+static uint64_t enable_mask = 0;
+static bool isr_installed = false;
+
+static uint32_t captured_count = 0;
+static uint32_t overflow_count = 0;
+static uint32_t ring_max_depth = 0;
+
+static void IRAM_ATTR gpio_capture_isr(void *param)
+{
+    uint32_t gpio_num = (uint32_t)param;
+    uint32_t head = ring_head;
+    uint32_t depth = head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE);
+    gpio_capture_event_t *event;
+    BaseType_t woken = pdFALSE;
+
+    if (depth == RING_SIZE) {
+        overflow_count++;
+        return;
+    }
+
+    event = &(ring[head & (RING_SIZE - 1)]);
+    event->time_us = (uint32_t)esp_timer_get_time();
+    event->gpio_num = gpio_num;
+    event->level = (gpio_num < 32) ?
+        ((GPIO.in >> gpio_num) & 1) : ((GPIO.in1.data >> (gpio_num - 32)) & 1);
+
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+    captured_count++;
+
+    depth++;
+    if (depth > ring_max_depth) {
+        ring_max_depth = depth;
+    }
+    if (depth == NOTIFY_DEPTH) {
+        vTaskNotifyGiveFromISR(capture_task, &woken);
+        if (woken == pdTRUE) {
+            portYIELD_FROM_ISR();
+        }
+    }
+}
+
+static uint32_t gpio_capture_read(gpio_capture_event_t *list, uint32_t size)
+{
+    uint32_t tail = ring_tail;
+    uint32_t count = __atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) - tail;
+
+    if (count > size) {
+        count = size;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        list[i] = ring[(tail + i) & (RING_SIZE - 1)];
+    }
+    __atomic_store_n(&ring_tail, tail + count, __ATOMIC_RELEASE);
+
+    return count;
+}
+
+static void gpio_capture_task(void *param)
+{
+    gpio_capture_event_t list[BATCH_SIZE];
+    uint32_t count;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, BATCH_INTERVAL_MS / portTICK_RATE_MS);
+
+        // NOTE: 1 回に溜まった分はすべて取り出す
+        while ((count = gpio_capture_read(list, BATCH_SIZE)) != 0) {
+            if (capture_sink != NULL) {
+                capture_sink(list, count);
+            }
+        }
+    }
+}
+
+void gpio_capture_start(gpio_capture_sink_t sink)
+{
+    capture_sink = sink;
+    xTaskCreate(gpio_capture_task, "gpio_capture_task", 3072, NULL, 10, &capture_task);
+}
+
+// NOTE: 一覧を書き換えても出力用のピンと重ならないよう，gpio_task の許可も確かめる
+bool gpio_capture_pin_allowed(uint8_t gpio_num)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(capture_pin_list); i++) {
+        if (capture_pin_list[i] == gpio_num) {
+            return GPIO_IS_VALID_GPIO(gpio_num) && !gpio_task_pin_allowed(gpio_num);
+        }
+    }
+    return false;
+}
+
+esp_err_t gpio_capture_enable(uint8_t gpio_num)
+{
+    gpio_config_t io_conf;
+
+    if (!gpio_capture_pin_allowed(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (enable_mask & (1ULL << gpio_num)) {
+        return ESP_OK;
+    }
+
+    if (!isr_installed) {
+        // NOTE: フラッシュ書き込み中 (OTA) でもエッジを取りこぼさないよう IRAM に置く
+        ESP_ERROR_CHECK(gpio_install_isr_service(ESP_INTR_FLAG_IRAM));
+        isr_installed = true;
+    }
+
+    io_conf.intr_type = GPIO_INTR_ANYEDGE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = 1ULL << gpio_num;
+    io_conf.pull_down_en = 0;
+    io_conf.pull_up_en = 0;
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+    ESP_ERROR_CHECK(gpio_isr_handler_add(gpio_num, gpio_capture_isr, (void *)(uint32_t)gpio_num));
+
+    enable_mask |= 1ULL << gpio_num;
+    ESP_LOGI(TAG, "Start capturing GPIO%d.", gpio_num);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_capture_disable(uint8_t gpio_num)
+{
+    if (!gpio_capture_pin_allowed(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (!(enable_mask & (1ULL << gpio_num))) {
+        return ESP_OK;
+    }
+
+    ESP_ERROR_CHECK(gpio_isr_handler_remove(gpio_num));
+    ESP_ERROR_CHECK(gpio_set_intr_type(gpio_num, GPIO_INTR_DISABLE));
+
+    enable_mask &= ~(1ULL << gpio_num);
+    ESP_LOGI(TAG, "Stop capturing GPIO%d.", gpio_num);
+
+    return ESP_OK;
+}
+
+void gpio_capture_get_stat(gpio_capture_stat_t *stat)
+{
+    stat->enable_mask = enable_mask;
+    stat->captured = captured_count;
+    stat->overflow = overflow_count;
+    stat->ring_size = RING_SIZE;
+    stat->ring_max_depth = ring_max_depth;
+}
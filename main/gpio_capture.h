@@ -0,0 +1,24 @@
+#include "esp_err.h"
+
+typedef struct gpio_capture_event {
+    uint32_t time_us;   // esp_timer_get_time() の下位 32 bit
+    uint8_t gpio_num;
+    uint8_t level;      // エッジ後のレベル
+} gpio_capture_event_t;
+
+typedef struct gpio_capture_stat {
+    uint64_t enable_mask;
+    uint32_t captured;
+    uint32_t overflow;  // リングバッファが一杯で捨てたエッジの数
+    uint32_t ring_size;
+    uint32_t ring_max_depth;
+} gpio_capture_stat_t;
+
+// NOTE: gpio_capture のタスクから，溜まったエッジをまとめて渡す
+typedef void (*gpio_capture_sink_t)(const gpio_capture_event_t *list, uint32_t count);
+
+void gpio_capture_start(gpio_capture_sink_t sink);
+bool gpio_capture_pin_allowed(uint8_t gpio_num);
+esp_err_t gpio_capture_enable(uint8_t gpio_num);
+esp_err_t gpio_capture_disable(uint8_t gpio_num);
+void gpio_capture_get_stat(gpio_capture_stat_t *stat);
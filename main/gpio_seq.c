@@ -0,0 +1,232 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "gpio_task.h"
+#include "gpio_seq.h"
+
+typedef enum {
+    SEQ_PHASE_DRIVE,
+    SEQ_PHASE_RELEASE,
+} seq_phase_t;
+
+// NOTE: ステップをピンのマスクに変換したもの
+typedef struct seq_op {
+    uint64_t mask;          // 0 なら待つだけ
+    uint64_t level_mask;
+    uint32_t width_us;
+    uint32_t gap_us;
+    uint32_t repeat;
+} seq_op_t;
+
+static esp_timer_handle_t seq_timer = NULL;
+static portMUX_TYPE seq_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static seq_op_t op_list[GPIO_SEQ_STEP_MAX];
+static uint32_t op_count = 0;
+static uint64_t seq_mask = 0;   // プログラムで使うピン全体
+
+// NOTE: loaded は op_list を書き換えてから実行を終えるまでの間 true．
+// HTTP・MQTT から同時に実行を指示されても，プログラムを書き換えるのは 1 つだけにする
+static bool loaded = false;
+static bool running = false;
+static bool aborted = false;
+static uint32_t op_index = 0;
+static uint32_t op_repeat = 0;
+static seq_phase_t phase = SEQ_PHASE_DRIVE;
+static int64_t start_time = 0;
+static int64_t next_time = 0;
+static int64_t end_time = 0;
+static uint32_t late_max_us = 0;
+static uint32_t run_count = 0;
+
+// NOTE: 次のエッジを出力して，その次のエッジの時刻を next_time に設定する．
+// 終了したら false を返す．
+static bool gpio_seq_step()
+{
+    seq_op_t *op;
+
+    while (op_index < op_count) {
+        op = &(op_list[op_index]);
+
+        if (phase == SEQ_PHASE_DRIVE) {
+            if (op->mask == 0) {
+                next_time += op->width_us;
+                op_index++;
+            } else {
+                gpio_task_drive(op->mask, op->level_mask);
+                next_time += op->width_us;
+                phase = SEQ_PHASE_RELEASE;
+            }
+            return true;
+        }
+
+        gpio_task_release(op->mask);
+        phase = SEQ_PHASE_DRIVE;
+        op_repeat++;
+        if (op_repeat < op->repeat) {
+            next_time += op->gap_us;
+            return true;
+        }
+        // NOTE: 繰り返しが終わったら，待たずに次のステップへ進む
+        op_index++;
+        op_repeat = 0;
+    }
+    return false;
+}
+
+// NOTE: esp_timer のタスクから呼ばれる．遅れが積み重ならないよう，
+// 次の時刻は前回の予定時刻を基準に決める．
+static void gpio_seq_next(void *param)
+{
+    int64_t now;
+    int64_t delay_us;
+
+    portENTER_CRITICAL(&seq_lock);
+    if (!running) {
+        portEXIT_CRITICAL(&seq_lock);
+        return;
+    }
+    now = esp_timer_get_time();
+    if ((now - next_time) > late_max_us) {
+        late_max_us = (uint32_t)(now - next_time);
+    }
+    if (gpio_seq_step()) {
+        // NOTE: 中断や再実行と競合しないよう，ロックしたままタイマーを設定する
+        delay_us = next_time - esp_timer_get_time();
+        esp_timer_start_once(seq_timer, (delay_us > 0) ? delay_us : 0);
+    } else {
+        running = false;
+        loaded = false;
+        end_time = now;
+        gpio_task_unclaim(seq_mask);
+    }
+    portEXIT_CRITICAL(&seq_lock);
+}
+
+void gpio_seq_start(void)
+{
+    esp_timer_create_args_t timer_args = {
+        .callback = gpio_seq_next,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "gpio_seq",
+    };
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &seq_timer));
+}
+
+// NOTE: loaded を確保してから呼ぶ．実行中でなければタイマーから参照されないので，ロックは不要
+static esp_err_t gpio_seq_compile(const gpio_seq_step_t *list, uint32_t count)
+{
+    seq_op_t *op;
+
+    if ((count == 0) || (count > GPIO_SEQ_STEP_MAX)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        if ((list[i].gpio_num != GPIO_SEQ_WAIT) && !gpio_task_pin_allowed(list[i].gpio_num)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if ((list[i].width_us == 0) || (list[i].width_us > GPIO_TASK_MAX_WIDTH_US) ||
+            (list[i].gap_us > GPIO_TASK_MAX_WIDTH_US) ||
+            (list[i].repeat == 0) || (list[i].repeat > GPIO_SEQ_REPEAT_MAX)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    seq_mask = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        op = &(op_list[i]);
+        if (list[i].gpio_num == GPIO_SEQ_WAIT) {
+            op->mask = 0;
+            op->level_mask = 0;
+        } else {
+            op->mask = 1ULL << list[i].gpio_num;
+            op->level_mask = list[i].level ? op->mask : 0;
+        }
+        op->width_us = list[i].width_us;
+        op->gap_us = list[i].gap_us;
+        op->repeat = list[i].repeat;
+        seq_mask |= op->mask;
+    }
+    op_count = count;
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_seq_run(const gpio_seq_step_t *list, uint32_t count)
+{
+    esp_err_t ret;
+
+    portENTER_CRITICAL(&seq_lock);
+    if (loaded) {
+        portEXIT_CRITICAL(&seq_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    loaded = true;
+    portEXIT_CRITICAL(&seq_lock);
+
+    ret = gpio_seq_compile(list, count);
+    if (ret == ESP_OK) {
+        // NOTE: gpio_task のパルスと同じピンを奪い合わないよう，使うピンを確保する
+        ret = gpio_task_claim(seq_mask);
+    }
+    if (ret != ESP_OK) {
+        __atomic_store_n(&loaded, false, __ATOMIC_RELEASE);
+        return ret;
+    }
+    gpio_task_pin_init(seq_mask);
+
+    portENTER_CRITICAL(&seq_lock);
+    op_index = 0;
+    op_repeat = 0;
+    phase = SEQ_PHASE_DRIVE;
+    late_max_us = 0;
+    aborted = false;
+    running = true;
+    run_count++;
+    start_time = esp_timer_get_time();
+    next_time = start_time;
+    // NOTE: 最初のエッジもタイマーから出力し，すべてのエッジを同じ経路で扱う
+    esp_timer_start_once(seq_timer, 0);
+    portEXIT_CRITICAL(&seq_lock);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_seq_abort(void)
+{
+    portENTER_CRITICAL(&seq_lock);
+    if (!running) {
+        portEXIT_CRITICAL(&seq_lock);
+        return ESP_ERR_INVALID_STATE;
+    }
+    esp_timer_stop(seq_timer);
+    running = false;
+    loaded = false;
+    aborted = true;
+    end_time = esp_timer_get_time();
+    gpio_task_release(seq_mask);
+    gpio_task_unclaim(seq_mask);
+    portEXIT_CRITICAL(&seq_lock);
+
+    ESP_LOGI(TAG, "GPIO sequence aborted at step %d.", op_index);
+
+    return ESP_OK;
+}
+
+void gpio_seq_get_stat(gpio_seq_stat_t *stat)
+{
+    portENTER_CRITICAL(&seq_lock);
+    stat->running = running;
+    stat->aborted = aborted;
+    stat->step = op_index;
+    stat->step_count = op_count;
+    stat->repeat = op_repeat;
+    stat->elapsed_us = (uint32_t)((running ? esp_timer_get_time() : end_time) - start_time);
+    stat->late_max_us = late_max_us;
+    stat->run_count = run_count;
+    portEXIT_CRITICAL(&seq_lock);
+}
@@ -0,0 +1,29 @@
+#include "esp_err.h"
+
+#define GPIO_SEQ_STEP_MAX   32
+#define GPIO_SEQ_REPEAT_MAX 1000
+#define GPIO_SEQ_WAIT       0xFF    // gpio_num にこれを指定すると width_us だけ待つ
+
+typedef struct gpio_seq_step {
+    uint8_t gpio_num;
+    uint8_t level;      // パルス中の出力レベル
+    uint32_t width_us;
+    uint32_t gap_us;    // 繰り返す際のパルスの間隔
+    uint32_t repeat;
+} gpio_seq_step_t;
+
+typedef struct gpio_seq_stat {
+    bool running;
+    bool aborted;
+    uint32_t step;          // 実行中のステップ
+    uint32_t step_count;
+    uint32_t repeat;        // 実行中のステップで終えた回数
+    uint32_t elapsed_us;
+    uint32_t late_max_us;   // 予定時刻からのエッジの遅れの最大値
+    uint32_t run_count;
+} gpio_seq_stat_t;
+
+void gpio_seq_start(void);
+esp_err_t gpio_seq_run(const gpio_seq_step_t *list, uint32_t count);
+esp_err_t gpio_seq_abort(void);
+void gpio_seq_get_stat(gpio_seq_stat_t *stat);
@@ -0,0 +1,560 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "driver/gpio.h"
+#include "soc/gpio_struct.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "gpio_task.h"
+#include "rate_limit.h"
+#include "log_ring.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define QUEUE_SIZE      16
+#define SLOT_SIZE       8  // 同時に実行できるパルスの数
+#define LATENCY_BUCKETS 24 // 2^n us 単位のヒストグラム
+#define QUEUE_RETRY_AFTER_MS    1000 // キューが一杯の場合に再送を促すまでの時間
+#define LISTENER_MAX    4
+
+typedef struct gpio_cmd {
+    uint64_t mask;
+    uint64_t level_mask; // パルス中に H を出力するピン
+    uint32_t width_us;
+    int64_t enqueue_time; // us
+} gpio_cmd_t;
+
+// NOTE: エッジのタイミングが同じピンはひとつのスロットでまとめて扱う
+typedef struct gpio_slot {
+    esp_timer_handle_t timer;
+    uint64_t mask;
+    uint32_t width_us;
+    int64_t edge_time; // us
+} gpio_slot_t;
+
+typedef struct gpio_pin_def {
+    uint8_t gpio_num;
+    gpio_task_policy_t policy;
+    uint32_t rate_per_sec;
+    uint32_t burst;
+} gpio_pin_def_t;
+
+// NOTE: 制御を許可するピンの一覧．これ以外のピンへの指示は受け付けない
+static const gpio_pin_def_t pin_def_list[] = {
+    { 25, GPIO_TASK_POLICY_COALESCE, 10, 5 },
+    { 26, GPIO_TASK_POLICY_COALESCE, 10, 5 },
+    { 32, GPIO_TASK_POLICY_COALESCE, 10, 5 },
+    { 33, GPIO_TASK_POLICY_COALESCE, 10, 5 },
+};
+
+// NOTE: push 系の関数は httpd・UDP・MQTT のタスクから同時に呼ばれるので，
+// レート制限や統計の更新，キューの空き確認から投入までを push_lock で一続きにする
+static rate_limit_t pin_rate_list[ARRAY_SIZE_OF(pin_def_list)];
+static SemaphoreHandle_t push_lock = NULL;
+
+static QueueHandle_t gpio_queue = NULL;
+static gpio_slot_t slot_list[SLOT_SIZE];
+static uint64_t init_mask = 0;
+static uint64_t pending_mask = 0; // キューに積まれているピン
+static uint64_t claim_mask = 0;   // gpio_seq などがスロットを介さずに制御しているピン
+static portMUX_TYPE slot_lock = portMUX_INITIALIZER_UNLOCKED;
+static gpio_task_listener_t listener_list[LISTENER_MAX];
+static uint32_t listener_count = 0;
+
+static uint32_t accepted_count = 0;
+static uint32_t rejected_count = 0;
+static uint32_t coalesced_count = 0;
+static uint32_t throttled_count = 0;
+static uint32_t pulse_count = 0;
+static uint32_t pulse_error_max_us = 0;
+static uint32_t latency_hist[LATENCY_BUCKETS];
+static uint32_t latency_max_us = 0;
+
+static void gpio_notify(gpio_task_event_type_t type, uint64_t mask, uint32_t width_us)
+{
+    uint32_t count = __atomic_load_n(&listener_count, __ATOMIC_ACQUIRE);
+    gpio_task_event_t event = {
+        .type = type,
+        .mask = mask,
+        .width_us = width_us,
+    };
+
+    for (uint32_t i = 0; i < count; i++) {
+        listener_list[i](&event);
+    }
+}
+
+static void latency_record(uint32_t latency_us)
+{
+    uint32_t bucket = 0;
+
+    while ((bucket < (LATENCY_BUCKETS - 1)) && ((1UL << bucket) < latency_us)) {
+        bucket++;
+    }
+    latency_hist[bucket]++;
+
+    if (latency_us > latency_max_us) {
+        latency_max_us = latency_us;
+    }
+}
+
+static uint32_t latency_p99()
+{
+    uint32_t total = 0;
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(latency_hist); i++) {
+        total += latency_hist[i];
+    }
+    if (total == 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(latency_hist); i++) {
+        count += latency_hist[i];
+        if (count * 100 >= total * 99) {
+            return 1UL << i;
+        }
+    }
+    return latency_max_us;
+}
+
+static uint32_t pin_count(uint64_t mask)
+{
+    return __builtin_popcountll(mask);
+}
+
+// NOTE: 出力レベルはあらかじめ設定しておき，出力有効レジスタへの
+// 1 回の書き込みでエッジを作る．GPIO32 以降は別レジスタなので 2 回になる．
+static void gpio_edge_start(uint64_t mask, uint64_t level_mask)
+{
+    GPIO.out_w1ts = (uint32_t)(mask & level_mask);
+    GPIO.out_w1tc = (uint32_t)(mask & ~level_mask);
+    GPIO.out1_w1ts.val = (uint32_t)((mask & level_mask) >> 32);
+    GPIO.out1_w1tc.val = (uint32_t)((mask & ~level_mask) >> 32);
+
+    GPIO.enable_w1ts = (uint32_t)mask;
+    GPIO.enable1_w1ts.val = (uint32_t)(mask >> 32);
+}
+
+static void gpio_edge_end(uint64_t mask)
+{
+    GPIO.enable_w1tc = (uint32_t)mask;
+    GPIO.enable1_w1tc.val = (uint32_t)(mask >> 32);
+}
+
+// NOTE: esp_timer のタスクから呼ばれる
+static void gpio_pulse_end(void *param)
+{
+    gpio_slot_t *slot = (gpio_slot_t *)param;
+    int64_t width_us;
+    uint32_t error_us;
+    uint64_t mask;
+
+    portENTER_CRITICAL(&slot_lock);
+    width_us = esp_timer_get_time() - slot->edge_time;
+    // NOTE: 停止が間に合わず，再利用されたスロットに対して呼ばれた場合は無視する
+    if (width_us < slot->width_us) {
+        mask = 0;
+    } else {
+        mask = slot->mask;
+        gpio_edge_end(mask);
+        slot->mask = 0;
+    }
+    portEXIT_CRITICAL(&slot_lock);
+
+    if (mask == 0) {
+        return;
+    }
+
+    error_us = (width_us > slot->width_us) ?
+        (uint32_t)(width_us - slot->width_us) : (uint32_t)(slot->width_us - width_us);
+    if (error_us > pulse_error_max_us) {
+        pulse_error_max_us = error_us;
+    }
+    pulse_count += pin_count(mask);
+
+    gpio_notify(GPIO_TASK_EVENT_END, mask, (uint32_t)width_us);
+}
+
+// NOTE: gpio_ctrl_task と gpio_seq (httpd・MQTT のタスク) から呼ばれる．
+// 先に init_mask へ印を付けて，同じピンを二重に初期化しないようにする
+static void gpio_pin_init(uint64_t mask)
+{
+    gpio_config_t io_conf;
+
+    mask &= ~__atomic_fetch_or(&init_mask, mask, __ATOMIC_ACQ_REL);
+    if (mask == 0) {
+        return;
+    }
+
+    // NOTE: 入力モードで初期化すると GPIO マトリクスの出力は GPIO
+    // レジスタに接続されるので，以降は出力有効レジスタだけで制御できる
+    io_conf.intr_type = GPIO_PIN_INTR_DISABLE;
+    io_conf.mode = GPIO_MODE_INPUT;
+    io_conf.pin_bit_mask = mask;
+    io_conf.pull_down_en = 0;
+    io_conf.pull_up_en = 0;
+    ESP_ERROR_CHECK(gpio_config(&io_conf));
+}
+
+static gpio_slot_t *gpio_pulse_start(const gpio_cmd_t *cmd)
+{
+    gpio_slot_t *slot = NULL;
+    uint64_t released = 0;
+
+    gpio_pin_init(cmd->mask);
+
+    portENTER_CRITICAL(&slot_lock);
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(slot_list); i++) {
+        // NOTE: パルス中のピンに再度指示されたら，新しい指示で上書きする
+        if (slot_list[i].mask & cmd->mask) {
+            slot_list[i].mask &= ~cmd->mask;
+            if (slot_list[i].mask == 0) {
+                released |= 1UL << i;
+            }
+        }
+        if ((slot == NULL) && (slot_list[i].mask == 0)) {
+            slot = &(slot_list[i]);
+        }
+    }
+    if (slot != NULL) {
+        gpio_edge_start(cmd->mask, cmd->level_mask);
+        slot->edge_time = esp_timer_get_time();
+        slot->width_us = cmd->width_us;
+        slot->mask = cmd->mask;
+    }
+    portEXIT_CRITICAL(&slot_lock);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(slot_list); i++) {
+        if ((released & (1UL << i)) && (&(slot_list[i]) != slot)) {
+            esp_timer_stop(slot_list[i].timer);
+        }
+    }
+    if (slot == NULL) {
+        LOG_RING_W("No free pulse slot.");
+        return NULL;
+    }
+
+    // NOTE: 短いパルスで終了の通知が先にならないよう，タイマーより前に通知する
+    gpio_notify(GPIO_TASK_EVENT_START, cmd->mask, cmd->width_us);
+
+    esp_timer_stop(slot->timer);
+    ESP_ERROR_CHECK(esp_timer_start_once(slot->timer, slot->width_us));
+
+    return slot;
+}
+
+static void gpio_ctrl_task(void *param)
+{
+    gpio_cmd_t cmd;
+    gpio_slot_t *slot;
+
+    while (1) {
+        if (xQueueReceive(gpio_queue, &cmd, portMAX_DELAY) != pdTRUE) {
+            continue;
+        }
+        // NOTE: パルスの終了はタイマーで行うので，このタスクはブロックしない
+        slot = gpio_pulse_start(&cmd);
+        __atomic_and_fetch(&pending_mask, ~cmd.mask, __ATOMIC_RELAXED);
+        if (slot != NULL) {
+            latency_record((uint32_t)(slot->edge_time - cmd.enqueue_time));
+        }
+    }
+}
+
+void gpio_task_start(void)
+{
+    memset(latency_hist, 0, sizeof(latency_hist));
+    memset(slot_list, 0, sizeof(slot_list));
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(slot_list); i++) {
+        esp_timer_create_args_t timer_args = {
+            .callback = gpio_pulse_end,
+            .arg = &(slot_list[i]),
+            .dispatch_method = ESP_TIMER_TASK,
+            .name = "gpio_pulse",
+        };
+        ESP_ERROR_CHECK(esp_timer_create(&timer_args, &(slot_list[i].timer)));
+    }
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(pin_def_list); i++) {
+        rate_limit_init(&(pin_rate_list[i]), pin_def_list[i].rate_per_sec, pin_def_list[i].burst);
+    }
+
+    push_lock = xSemaphoreCreateMutex();
+    gpio_queue = xQueueCreate(QUEUE_SIZE, sizeof(gpio_cmd_t));
+    xTaskCreate(gpio_ctrl_task, "gpio_ctrl_task", 2048, NULL, 10, NULL);
+}
+
+// NOTE: 以下は gpio_seq のように自前でタイミングを管理する側から使う．スロットを介さない
+void gpio_task_pin_init(uint64_t mask)
+{
+    gpio_pin_init(mask);
+}
+
+// NOTE: 確保したピン以外には出力しない
+void gpio_task_drive(uint64_t mask, uint64_t level_mask)
+{
+    gpio_edge_start(mask & __atomic_load_n(&claim_mask, __ATOMIC_ACQUIRE), level_mask);
+}
+
+void gpio_task_release(uint64_t mask)
+{
+    gpio_edge_end(mask & __atomic_load_n(&claim_mask, __ATOMIC_ACQUIRE));
+}
+
+// NOTE: 起動時に登録するだけで，解除はしない
+esp_err_t gpio_task_add_listener(gpio_task_listener_t listener)
+{
+    uint32_t count = listener_count;
+
+    if (count == ARRAY_SIZE_OF(listener_list)) {
+        return ESP_ERR_NO_MEM;
+    }
+    listener_list[count] = listener;
+    __atomic_store_n(&listener_count, count + 1, __ATOMIC_RELEASE);
+
+    return ESP_OK;
+}
+
+static int gpio_pin_find(uint8_t gpio_num)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(pin_def_list); i++) {
+        if (pin_def_list[i].gpio_num == gpio_num) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+bool gpio_task_pin_allowed(uint8_t gpio_num)
+{
+    return (gpio_pin_find(gpio_num) >= 0) && GPIO_IS_VALID_OUTPUT_GPIO(gpio_num);
+}
+
+// NOTE: パルス中またはキューに積まれているピン
+static uint64_t gpio_busy_mask()
+{
+    uint64_t mask = __atomic_load_n(&pending_mask, __ATOMIC_RELAXED);
+
+    portENTER_CRITICAL(&slot_lock);
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(slot_list); i++) {
+        mask |= slot_list[i].mask;
+    }
+    portEXIT_CRITICAL(&slot_lock);
+
+    return mask;
+}
+
+// NOTE: パルス中やキューに積まれているピン，他で確保済みのピンは確保できない．
+// 確保している間，そのピンへのパルスの指示は受け付けない
+esp_err_t gpio_task_claim(uint64_t mask)
+{
+    esp_err_t ret = ESP_OK;
+
+    xSemaphoreTake(push_lock, portMAX_DELAY);
+    if ((gpio_busy_mask() | claim_mask) & mask) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        __atomic_or_fetch(&claim_mask, mask, __ATOMIC_RELEASE);
+    }
+    xSemaphoreGive(push_lock);
+
+    return ret;
+}
+
+// NOTE: esp_timer のタスクからも呼ばれるので，ロックは取らない
+void gpio_task_unclaim(uint64_t mask)
+{
+    __atomic_and_fetch(&claim_mask, ~mask, __ATOMIC_RELEASE);
+}
+
+static esp_err_t gpio_cmd_check(uint8_t gpio_num, uint32_t width_us)
+{
+    if (!gpio_task_pin_allowed(gpio_num)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((width_us == 0) || (width_us > GPIO_TASK_MAX_WIDTH_US)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static esp_err_t gpio_cmd_send(gpio_cmd_t *cmd)
+{
+    cmd->enqueue_time = esp_timer_get_time();
+
+    // NOTE: HTTP の応答を遅らせないよう，キューが一杯なら待たずに捨てる
+    __atomic_or_fetch(&pending_mask, cmd->mask, __ATOMIC_RELAXED);
+    if (xQueueSend(gpio_queue, cmd, 0) != pdTRUE) {
+        __atomic_and_fetch(&pending_mask, ~cmd->mask, __ATOMIC_RELAXED);
+        rejected_count += pin_count(cmd->mask);
+        LOG_RING_W("GPIO command queue is full.");
+        return ESP_ERR_NO_MEM;
+    }
+    accepted_count += pin_count(cmd->mask);
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_task_push(uint8_t gpio_num, uint32_t width_us, uint32_t *retry_after_ms)
+{
+    gpio_task_pulse_t pulse = {
+        .gpio_num = gpio_num,
+        .level = 0,
+        .width_us = width_us,
+    };
+
+    return gpio_task_push_batch(&pulse, 1, retry_after_ms);
+}
+
+// NOTE: 受け付けられなければ，待つべき時間を返す．トークンはまだ消費しない．
+// パルス中のピンは，ポリシーに従って coalesce_mask に加える．
+static uint32_t gpio_admit_check(const gpio_task_pulse_t *list, uint32_t count, int64_t now,
+                                 uint64_t *coalesce_mask)
+{
+    uint64_t busy_mask = gpio_busy_mask();
+    uint32_t wait_ms = 0;
+    uint32_t i, pin_wait_ms;
+    int pin;
+
+    *coalesce_mask = 0;
+    for (i = 0; i < count; i++) {
+        pin = gpio_pin_find(list[i].gpio_num);
+        if ((pin_def_list[pin].policy == GPIO_TASK_POLICY_COALESCE) &&
+            (busy_mask & (1ULL << list[i].gpio_num))) {
+            *coalesce_mask |= 1ULL << list[i].gpio_num;
+            continue;
+        }
+        pin_wait_ms = rate_limit_wait_ms(&(pin_rate_list[pin]), now);
+        if (pin_wait_ms > wait_ms) {
+            wait_ms = pin_wait_ms;
+        }
+    }
+    return wait_ms;
+}
+
+// NOTE: キューに積めることが確定してから，まとめなかったピンのトークンを消費する
+static void gpio_admit_take(const gpio_task_pulse_t *list, uint32_t count, int64_t now,
+                            uint64_t coalesce_mask)
+{
+    for (uint32_t i = 0; i < count; i++) {
+        if (!(coalesce_mask & (1ULL << list[i].gpio_num))) {
+            rate_limit_take(&(pin_rate_list[gpio_pin_find(list[i].gpio_num)]), now);
+        }
+    }
+}
+
+static esp_err_t gpio_push_batch(const gpio_task_pulse_t *list, uint32_t count, uint32_t *retry_after_ms)
+{
+    gpio_cmd_t cmd_list[SLOT_SIZE];
+    uint32_t cmd_count = 0;
+    int64_t now = esp_timer_get_time();
+    uint64_t coalesce_mask;
+    uint32_t wait_ms;
+    uint32_t i, j;
+
+    for (i = 0; i < count; i++) {
+        if (claim_mask & (1ULL << list[i].gpio_num)) {
+            return ESP_ERR_INVALID_STATE;
+        }
+    }
+
+    wait_ms = gpio_admit_check(list, count, now, &coalesce_mask);
+    if (wait_ms != 0) {
+        throttled_count += count;
+        *retry_after_ms = wait_ms;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // NOTE: パルス幅が同じピンはひとつのコマンドにまとめ，同時にエッジを作る
+    for (i = 0; i < count; i++) {
+        uint64_t bit = 1ULL << list[i].gpio_num;
+
+        if (coalesce_mask & bit) {
+            coalesced_count++;
+            continue;
+        }
+
+        for (j = 0; j < cmd_count; j++) {
+            if (cmd_list[j].width_us == list[i].width_us) {
+                break;
+            }
+        }
+        if (j == cmd_count) {
+            if (cmd_count == ARRAY_SIZE_OF(cmd_list)) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            cmd_list[j].mask = 0;
+            cmd_list[j].level_mask = 0;
+            cmd_list[j].width_us = list[i].width_us;
+            cmd_count++;
+        }
+        cmd_list[j].mask |= bit;
+        if (list[i].level) {
+            cmd_list[j].level_mask |= bit;
+        } else {
+            cmd_list[j].level_mask &= ~bit;
+        }
+    }
+
+    if (uxQueueSpacesAvailable(gpio_queue) < cmd_count) {
+        for (j = 0; j < cmd_count; j++) {
+            rejected_count += pin_count(cmd_list[j].mask);
+        }
+        LOG_RING_W("GPIO command queue is full.");
+        *retry_after_ms = QUEUE_RETRY_AFTER_MS;
+        return ESP_ERR_NO_MEM;
+    }
+
+    // NOTE: 429 や 400 で断った要求ではトークンを消費しない．push_lock を持っているので，
+    // 確認から消費までの間に他の要求が割り込むことはない
+    gpio_admit_take(list, count, now, coalesce_mask);
+    for (j = 0; j < cmd_count; j++) {
+        esp_err_t ret = gpio_cmd_send(&(cmd_list[j]));
+        if (ret != ESP_OK) {
+            *retry_after_ms = QUEUE_RETRY_AFTER_MS;
+            return ret;
+        }
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t gpio_task_push_batch(const gpio_task_pulse_t *list, uint32_t count, uint32_t *retry_after_ms)
+{
+    esp_err_t ret;
+
+    *retry_after_ms = 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        if (gpio_cmd_check(list[i].gpio_num, list[i].width_us) != ESP_OK) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+
+    // NOTE: 中では待たないので，ロックを持つ時間は短い
+    xSemaphoreTake(push_lock, portMAX_DELAY);
+    ret = gpio_push_batch(list, count, retry_after_ms);
+    xSemaphoreGive(push_lock);
+
+    return ret;
+}
+
+void gpio_task_get_stat(gpio_task_stat_t *stat)
+{
+    stat->queue_depth = uxQueueMessagesWaiting(gpio_queue);
+    stat->queue_size = QUEUE_SIZE;
+    stat->accepted = accepted_count;
+    stat->rejected = rejected_count;
+    stat->coalesced = coalesced_count;
+    stat->throttled = throttled_count;
+    stat->latency_p99_us = latency_p99();
+    stat->latency_max_us = latency_max_us;
+    stat->pulse_count = pulse_count;
+    stat->pulse_error_max_us = pulse_error_max_us;
+}
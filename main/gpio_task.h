@@ -0,0 +1,54 @@
+#include "esp_err.h"
+
+#define GPIO_TASK_DEFAULT_WIDTH_US  300000      // 300ms
+#define GPIO_TASK_MAX_WIDTH_US      60000000    // 60s
+
+typedef enum {
+    GPIO_TASK_POLICY_COALESCE,  // パルス中の同じピンへの指示は，実行中のパルスにまとめる
+    GPIO_TASK_POLICY_EXTEND,    // パルス中の同じピンへの指示は，その時点からパルスを延長する
+} gpio_task_policy_t;
+
+typedef struct gpio_task_stat {
+    uint32_t queue_depth;       // 現在キューに積まれているコマンド数
+    uint32_t queue_size;
+    uint32_t accepted;
+    uint32_t rejected;          // キューが一杯で受け付けられなかったコマンド数
+    uint32_t coalesced;         // 実行中のパルスにまとめたコマンド数
+    uint32_t throttled;         // ピンごとのレート制限で受け付けられなかったコマンド数
+    uint32_t latency_p99_us;    // キュー投入からエッジまでの遅延 (99 パーセンタイル)
+    uint32_t latency_max_us;
+    uint32_t pulse_count;
+    uint32_t pulse_error_max_us; // 指定パルス幅と実際のパルス幅の差の最大値
+} gpio_task_stat_t;
+
+typedef struct gpio_task_pulse {
+    uint8_t gpio_num;
+    uint8_t level;      // パルス中の出力レベル
+    uint32_t width_us;
+} gpio_task_pulse_t;
+
+typedef enum {
+    GPIO_TASK_EVENT_START,      // パルス開始
+    GPIO_TASK_EVENT_END,        // パルス終了
+} gpio_task_event_type_t;
+
+typedef struct gpio_task_event {
+    gpio_task_event_type_t type;
+    uint64_t mask;
+    uint32_t width_us;  // START は指定幅，END は実際の幅
+} gpio_task_event_t;
+
+// NOTE: gpio_ctrl_task と esp_timer のタスクから呼ばれるので，ブロックしてはいけない
+typedef void (*gpio_task_listener_t)(const gpio_task_event_t *event);
+
+void gpio_task_start(void);
+esp_err_t gpio_task_add_listener(gpio_task_listener_t listener);
+esp_err_t gpio_task_push(uint8_t gpio_num, uint32_t width_us, uint32_t *retry_after_ms);
+esp_err_t gpio_task_push_batch(const gpio_task_pulse_t *list, uint32_t count, uint32_t *retry_after_ms);
+bool gpio_task_pin_allowed(uint8_t gpio_num);
+void gpio_task_get_stat(gpio_task_stat_t *stat);
+esp_err_t gpio_task_claim(uint64_t mask);
+void gpio_task_unclaim(uint64_t mask);
+void gpio_task_pin_init(uint64_t mask);
+void gpio_task_drive(uint64_t mask, uint64_t level_mask);
+void gpio_task_release(uint64_t mask);
@@ -0,0 +1,229 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "app.h"
+#include "http_capture_handler.h"
+#include "gpio_capture.h"
+#include "json_writer.h"
+#include "metrics.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define STREAM_MAX      4
+#define MESSAGE_SIZE    2048
+#define SSE_PREFIX      "data: "
+#define SSE_SUFFIX      "\n\n"
+
+// NOTE: HTTP のセッションが閉じられたら httpd が free_ctx を呼ぶので，そこで登録を外す
+typedef struct capture_stream {
+    int fd;
+} capture_stream_t;
+
+// NOTE: stream_list は httpd のタスク (ハンドラ，httpd_queue_work の関数，
+// free_ctx) からしか変更しないので，ロックは不要
+static httpd_handle_t capture_server = NULL;
+static capture_stream_t *stream_list[STREAM_MAX];
+static uint32_t stream_count = 0;
+static uint32_t drop_count = 0;
+
+static void capture_stream_free(void *ctx)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(stream_list); i++) {
+        if (stream_list[i] == ctx) {
+            stream_list[i] = NULL;
+            stream_count--;
+        }
+    }
+    free(ctx);
+}
+
+static esp_err_t capture_stream_send(int fd, const char *data, size_t len)
+{
+    char size_str[12];
+    int size_len = snprintf(size_str, sizeof(size_str), "%x\r\n", len);
+
+    // NOTE: ハンドラは応答を終えずに戻っているので，chunked の枠は自分で付ける
+    if ((httpd_socket_send(capture_server, fd, size_str, size_len, 0) != size_len) ||
+        (httpd_socket_send(capture_server, fd, data, len, 0) != len) ||
+        (httpd_socket_send(capture_server, fd, "\r\n", 2, 0) != 2)) {
+        return ESP_FAIL;
+    }
+    return ESP_OK;
+}
+
+// NOTE: httpd のタスクで実行される．message は malloc したもので，ここで解放する
+static void capture_broadcast(void *arg)
+{
+    char *message = (char *)arg;
+    size_t len = strlen(message);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(stream_list); i++) {
+        if (stream_list[i] == NULL) {
+            continue;
+        }
+        if (capture_stream_send(stream_list[i]->fd, message, len) != ESP_OK) {
+            // NOTE: 登録は free_ctx で外れる
+            httpd_sess_trigger_close(capture_server, stream_list[i]->fd);
+        }
+    }
+    free(message);
+}
+
+// NOTE: gpio_capture のタスクから呼ばれる
+static void capture_sink(const gpio_capture_event_t *list, uint32_t count)
+{
+    gpio_capture_stat_t stat;
+    json_writer_t writer;
+    char *message;
+
+    if (stream_count == 0) {
+        return;
+    }
+    message = malloc(MESSAGE_SIZE);
+    if (message == NULL) {
+        drop_count++;
+        return;
+    }
+
+    gpio_capture_get_stat(&stat);
+
+    strcpy(message, SSE_PREFIX);
+    json_writer_init(&writer, NULL, message + strlen(SSE_PREFIX),
+                     MESSAGE_SIZE - strlen(SSE_PREFIX) - strlen(SSE_SUFFIX));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_uint(&writer, "overflow", stat.overflow);
+    json_writer_uint(&writer, "dropped", drop_count);
+    json_writer_begin_array(&writer, "edges");
+    for (uint32_t i = 0; i < count; i++) {
+        json_writer_begin_array(&writer, NULL);
+        json_writer_uint(&writer, NULL, list[i].time_us);
+        json_writer_uint(&writer, NULL, list[i].gpio_num);
+        json_writer_uint(&writer, NULL, list[i].level);
+        json_writer_end_array(&writer);
+    }
+    json_writer_end_array(&writer);
+    json_writer_end_object(&writer);
+    if (json_writer_finish(&writer) != ESP_OK) {
+        free(message);
+        drop_count++;
+        return;
+    }
+    strcat(message, SSE_SUFFIX);
+
+    if (httpd_queue_work(capture_server, capture_broadcast, message) != ESP_OK) {
+        free(message);
+        drop_count++;
+    }
+}
+
+// NOTE: クエリの gpio=4,5 を順に処理する．一部だけ適用されないよう，先にすべて検証する
+static esp_err_t capture_apply_query(httpd_req_t *req, esp_err_t (*func)(uint8_t))
+{
+    char query[64];
+    char gpio_str[32];
+    char *p, *end;
+    unsigned long gpio_num;
+    esp_err_t ret;
+
+    if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+        (httpd_query_key_value(query, "gpio", gpio_str, sizeof(gpio_str)) != ESP_OK)) {
+        return ESP_OK;
+    }
+    for (p = gpio_str; *p != '\0'; p = end) {
+        gpio_num = strtoul(p, &end, 10);
+        if ((end == p) || (gpio_num > UINT8_MAX) || !gpio_capture_pin_allowed(gpio_num)) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if (*end == ',') {
+            end++;
+        }
+    }
+    for (p = gpio_str; *p != '\0'; p = end) {
+        gpio_num = strtoul(p, &end, 10);
+        ret = func(gpio_num);
+        if (ret != ESP_OK) {
+            return ret;
+        }
+        if (*end == ',') {
+            end++;
+        }
+    }
+    return ESP_OK;
+}
+
+static esp_err_t http_handle_capture(httpd_req_t *req)
+{
+    capture_stream_t *stream;
+    uint32_t i;
+
+    if (capture_apply_query(req, gpio_capture_enable) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid GPIO.");
+    }
+
+    for (i = 0; i < ARRAY_SIZE_OF(stream_list); i++) {
+        if (stream_list[i] == NULL) {
+            break;
+        }
+    }
+    if ((i == ARRAY_SIZE_OF(stream_list)) || (req->sess_ctx != NULL)) {
+        ESP_ERROR_CHECK(httpd_resp_set_status(req, "503 Service Unavailable"));
+        httpd_resp_sendstr(req, "Too many capture streams.");
+        return ESP_OK;
+    }
+    stream = malloc(sizeof(capture_stream_t));
+    if (stream == NULL) {
+        return httpd_resp_send_500(req);
+    }
+
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/event-stream"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*"));
+    // NOTE: ヘッダだけ送り，以降は capture_broadcast が同じソケットに書き込む
+    if (httpd_resp_send_chunk(req, ": capture\n\n", strlen(": capture\n\n")) != ESP_OK) {
+        free(stream);
+        return ESP_FAIL;
+    }
+
+    stream->fd = httpd_req_to_sockfd(req);
+    req->sess_ctx = stream;
+    req->free_ctx = capture_stream_free;
+    stream_list[i] = stream;
+    stream_count++;
+
+    return ESP_OK;
+}
+
+static esp_err_t http_handle_capture_stop(httpd_req_t *req)
+{
+    if (capture_apply_query(req, gpio_capture_disable) != ESP_OK) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid GPIO.");
+    }
+    httpd_resp_sendstr(req, "OK");
+
+    return ESP_OK;
+}
+
+static httpd_uri_t http_uri_capture = {
+    .uri       = "/capture*",
+    .method    = HTTP_GET,
+    .handler   = http_handle_capture,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_capture_stop = {
+    .uri       = "/capture*",
+    .method    = HTTP_DELETE,
+    .handler   = http_handle_capture_stop,
+    .user_ctx  = NULL
+};
+
+void http_capture_handler_install(httpd_handle_t server)
+{
+    capture_server = server;
+
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_capture));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_capture_stop));
+
+    gpio_capture_start(capture_sink);
+}
@@ -0,0 +1,197 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app.h"
+#include "http_debug_handler.h"
+#include "task_stat.h"
+#include "json_writer.h"
+#include "metrics.h"
+
+#define SAMPLE_DEFAULT_WINDOW_MS    1000
+
+static const char *task_state_str(uint8_t state)
+{
+    switch (state) {
+    case eRunning:
+        return "running";
+    case eReady:
+        return "ready";
+    case eBlocked:
+        return "blocked";
+    case eSuspended:
+        return "suspended";
+    case eDeleted:
+        return "deleted";
+    default:
+        return "?";
+    }
+}
+
+// NOTE: with_cpu が false なら，CPU 時間 (window_us, runtime_us, cpu_permille) を含めない
+static void task_result_write(json_writer_t *writer, const task_stat_result_t *result, bool with_cpu)
+{
+    const task_stat_entry_t *entry;
+    // NOTE: vTaskGetRunTimeStats と同じく，全コアの合計を 100% とする
+    uint64_t capacity = (uint64_t)result->window_us * portNUM_PROCESSORS;
+
+    json_writer_uint(writer, "cores", portNUM_PROCESSORS);
+    if (with_cpu) {
+        json_writer_uint(writer, "window_us", result->window_us);
+    }
+    json_writer_uint(writer, "end_ms", result->end_ms);
+    json_writer_begin_array(writer, "tasks");
+    for (uint32_t i = 0; i < result->count; i++) {
+        entry = &(result->entry_list[i]);
+
+        json_writer_begin_object(writer, NULL);
+        json_writer_str(writer, "name", entry->name);
+        json_writer_uint(writer, "priority", entry->priority);
+        json_writer_int(writer, "core", entry->core);
+        json_writer_str(writer, "state", task_state_str(entry->state));
+        if (with_cpu) {
+            json_writer_uint(writer, "runtime_us", entry->runtime_us);
+            json_writer_uint(writer, "cpu_permille",
+                             (capacity == 0) ? 0 : (uint32_t)((uint64_t)entry->runtime_us * 1000 / capacity));
+        }
+        json_writer_uint(writer, "stack_free", entry->stack_free);
+        json_writer_end_object(writer);
+    }
+    json_writer_end_array(writer);
+}
+
+static esp_err_t http_resp_task_result(httpd_req_t *req, const task_stat_result_t *result,
+                                       const char *state, bool with_cpu)
+{
+    json_writer_t writer;
+    char buf[256];
+
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/json"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
+
+    json_writer_init(&writer, req, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "state", state);
+    task_result_write(&writer, result, with_cpu);
+    json_writer_end_object(&writer);
+
+    return json_writer_finish(&writer);
+}
+
+static esp_err_t http_resp_not_supported(httpd_req_t *req)
+{
+    ESP_ERROR_CHECK(httpd_resp_set_status(req, "501 Not Implemented"));
+    httpd_resp_sendstr(req, "Enable CONFIG_FREERTOS_USE_TRACE_FACILITY and "
+                       "CONFIG_FREERTOS_GENERATE_RUN_TIME_STATS.\n");
+    return ESP_OK;
+}
+
+// NOTE: タスクの一覧とスタックの残量を返す．起動からの CPU 時間は 32 bit (us) の
+// カウンタが約 71 分で一周して使用率が狂うので返さない (計測期間を指定して取る)
+static esp_err_t http_handle_debug_tasks(httpd_req_t *req)
+{
+    task_stat_result_t *result;
+    esp_err_t ret;
+
+    if (!task_stat_available()) {
+        return http_resp_not_supported(req);
+    }
+    // NOTE: httpd のスタックを圧迫しないよう，ヒープに取る
+    result = malloc(sizeof(task_stat_result_t));
+    if (result == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    if (task_stat_snapshot(result) != ESP_OK) {
+        free(result);
+        return httpd_resp_send_500(req);
+    }
+    ret = http_resp_task_result(req, result, "boot", false);
+    free(result);
+
+    return ret;
+}
+
+// NOTE: ?window_ms=N の間の CPU 使用率の計測を始める．待たずに 202 を返す
+static esp_err_t http_handle_debug_sample_begin(httpd_req_t *req)
+{
+    char query[32];
+    char window_str[16];
+    char *end;
+    uint32_t window_ms = SAMPLE_DEFAULT_WINDOW_MS;
+    esp_err_t ret;
+
+    if (!task_stat_available()) {
+        return http_resp_not_supported(req);
+    }
+    if ((httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) &&
+        (httpd_query_key_value(query, "window_ms", window_str, sizeof(window_str)) == ESP_OK)) {
+        window_ms = strtoul(window_str, &end, 10);
+        if ((end == window_str) || (*end != '\0')) {
+            window_ms = 0;
+        }
+    }
+
+    ret = task_stat_sample_begin(window_ms);
+    if (ret == ESP_ERR_INVALID_ARG) {
+        return httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid window_ms.");
+    } else if (ret == ESP_ERR_INVALID_STATE) {
+        ESP_ERROR_CHECK(httpd_resp_set_status(req, "409 Conflict"));
+        httpd_resp_sendstr(req, "Sampling is already running.\n");
+        return ESP_OK;
+    }
+
+    ESP_ERROR_CHECK(httpd_resp_set_status(req, "202 Accepted"));
+    httpd_resp_sendstr(req, "Sampling started.\n");
+
+    return ESP_OK;
+}
+
+static esp_err_t http_handle_debug_sample(httpd_req_t *req)
+{
+    task_stat_result_t *result;
+    esp_err_t ret;
+
+    if (!task_stat_available()) {
+        return http_resp_not_supported(req);
+    }
+    result = malloc(sizeof(task_stat_result_t));
+    if (result == NULL) {
+        return httpd_resp_send_500(req);
+    }
+    task_stat_sample_get(result);
+    ret = http_resp_task_result(req, result,
+                                (result->state == TASK_STAT_SAMPLE_DONE) ? "done" :
+                                (result->state == TASK_STAT_SAMPLE_RUNNING) ? "running" : "none", true);
+    free(result);
+
+    return ret;
+}
+
+static httpd_uri_t http_uri_debug_tasks = {
+    .uri       = "/debug/tasks",
+    .method    = HTTP_GET,
+    .handler   = http_handle_debug_tasks,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_debug_sample_begin = {
+    .uri       = "/debug/tasks/sample",
+    .method    = HTTP_POST,
+    .handler   = http_handle_debug_sample_begin,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_debug_sample = {
+    .uri       = "/debug/tasks/sample",
+    .method    = HTTP_GET,
+    .handler   = http_handle_debug_sample,
+    .user_ctx  = NULL
+};
+
+void http_debug_handler_install(httpd_handle_t server)
+{
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_debug_tasks));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_debug_sample_begin));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_debug_sample));
+
+    task_stat_start();
+}
@@ -0,0 +1,3 @@
+#include "esp_http_server.h"
+
+void http_debug_handler_install(httpd_handle_t server);
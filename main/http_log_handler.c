@@ -0,0 +1,87 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "app.h"
+#include "http_log_handler.h"
+#include "log_ring.h"
+#include "metrics.h"
+
+#define LINE_SIZE   192
+#define CHUNK_SIZE  1024
+
+// NOTE: ?since=N を指定すると，番号 N 以降の記録だけを返す．
+// 次に指定すべき番号は X-Log-Next で返すので，差分だけを取りに来られる
+static uint32_t query_since(httpd_req_t *req, uint32_t head)
+{
+    char query[32];
+    char since_str[16];
+    char *end;
+    uint32_t since;
+
+    if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+        (httpd_query_key_value(query, "since", since_str, sizeof(since_str)) != ESP_OK)) {
+        return 0;
+    }
+    since = strtoul(since_str, &end, 10);
+    if ((end == since_str) || (*end != '\0') || ((int32_t)(head - since) < 0)) {
+        return 0;
+    }
+    return since;
+}
+
+static esp_err_t http_handle_log(httpd_req_t *req)
+{
+    log_ring_record_t record;
+    char next_str[12];
+    char *chunk;
+    uint32_t chunk_len = 0;
+    uint32_t head = log_ring_head();
+    uint32_t seq = query_since(req, head);
+    int len;
+
+    if ((head - seq) > LOG_RING_SIZE) {
+        seq = head - LOG_RING_SIZE;
+    }
+
+    chunk = malloc(CHUNK_SIZE);
+    if (chunk == NULL) {
+        return httpd_resp_send_500(req);
+    }
+
+    // NOTE: 書き込み途中の記録は読み飛ばすので，取りこぼしは番号の飛びで分かる
+    snprintf(next_str, sizeof(next_str), "%u", head);
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "X-Log-Next", next_str));
+
+    for (; seq != head; seq++) {
+        if (!log_ring_read(seq, &record)) {
+            continue;
+        }
+        if ((CHUNK_SIZE - chunk_len) < LINE_SIZE) {
+            httpd_resp_send_chunk(req, chunk, chunk_len);
+            chunk_len = 0;
+        }
+        len = log_ring_format(&record, chunk + chunk_len, LINE_SIZE);
+        chunk_len += len;
+    }
+    if (chunk_len != 0) {
+        httpd_resp_send_chunk(req, chunk, chunk_len);
+    }
+    httpd_resp_send_chunk(req, NULL, 0);
+    free(chunk);
+
+    return ESP_OK;
+}
+
+static httpd_uri_t http_uri_log = {
+    .uri       = "/log*",
+    .method    = HTTP_GET,
+    .handler   = http_handle_log,
+    .user_ctx  = NULL
+};
+
+void http_log_handler_install(httpd_handle_t server)
+{
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_log));
+}
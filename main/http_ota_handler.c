@@ -1,10 +1,81 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "esp_system.h"
 #include "esp_ota_ops.h"
+#include "esp_timer.h"
+#include "esp32/rom/miniz.h"
+#include "mbedtls/sha256.h"
 
 #include "app.h"
 #include "http_ota_handler.h"
+#include "json_writer.h"
+#include "metrics.h"
 #include "part_info.h"
+#include "log_ring.h"
+
+#define BUF_SIZE    4096
+#define BUF_COUNT   4
+#define WRITER_CORE 1   // NOTE: 受信 (httpd, WiFi) と別のコアで書き込む
+
+#define SHA256_SIZE 32
+
+#define GZIP_FEXTRA     0x04
+#define GZIP_FNAME      0x08
+#define GZIP_FCOMMENT   0x10
+#define GZIP_FHCRC      0x02
+
+typedef enum {
+    OTA_ENCODING_IDENTITY,
+    OTA_ENCODING_GZIP,
+    OTA_ENCODING_DEFLATE,
+} ota_encoding_t;
+
+typedef struct ota_buf {
+    char *data;
+    int size;
+} ota_buf_t;
+
+typedef struct ota_inflate {
+    tinfl_decompressor decomp;
+    uint8_t dict[TINFL_LZ_DICT_SIZE];
+    uint8_t in[BUF_SIZE];
+    size_t in_size;
+    size_t dict_ofs;
+    bool header_done;
+    tinfl_status status;
+} ota_inflate_t;
 
-#define BUF_SIZE  1024
+// NOTE: 通信が途切れても続きから再開できるよう，アップロードの状態はセッションとして保持する
+typedef struct ota_ctx {
+    uint32_t id;
+    char id_str[12];
+    const esp_partition_t *part;
+    int total_size;     // アップロードするデータ全体のサイズ (圧縮時は圧縮後)
+    int received;
+    uint8_t percent;
+    bool has_digest;
+    uint8_t digest[SHA256_SIZE];
+    mbedtls_sha256_context sha256;
+    TaskHandle_t writer;
+    esp_ota_handle_t handle;
+    char *pool;
+    ota_buf_t cur;
+    QueueHandle_t free_queue;
+    QueueHandle_t write_queue;
+    SemaphoreHandle_t done;
+    esp_err_t write_err;
+    ota_encoding_t encoding;
+    ota_inflate_t *inflate;
+    uint32_t image_size;
+} ota_ctx_t;
+
+static ota_ctx_t *ota_session = NULL;
 
 static void restart_task(void *param) {
     ESP_LOGI(TAG, "Restart...");
@@ -12,65 +83,595 @@ static void restart_task(void *param) {
     esp_restart();
 }
 
+//////////////////////////////////////////////////////////////////////
+// Write pipeline
+
+// NOTE: 受信したバッファを順に Flash に書き込む．size が 0 のバッファで終了．
+static void ota_writer_task(void *param)
+{
+    ota_ctx_t *ctx = (ota_ctx_t *)param;
+    ota_buf_t buf;
+
+    while (1) {
+        xQueueReceive(ctx->write_queue, &buf, portMAX_DELAY);
+        if (buf.size == 0) {
+            break;
+        }
+        if (ctx->write_err == ESP_OK) {
+            ctx->write_err = esp_ota_write(ctx->handle, buf.data, buf.size);
+            metrics_count(METRICS_OTA_WRITE_BYTES, buf.size);
+            if (ctx->write_err != ESP_OK) {
+                LOG_RING_E("Failed to write firmware (%s).", esp_err_to_name(ctx->write_err));
+            }
+        }
+        xQueueSend(ctx->free_queue, &buf, portMAX_DELAY);
+    }
+
+    xSemaphoreGive(ctx->done);
+    vTaskDelete(NULL);
+}
+
+static esp_err_t ota_ctx_init(ota_ctx_t *ctx, ota_encoding_t encoding)
+{
+    ota_buf_t buf;
+
+    ctx->write_err = ESP_OK;
+    ctx->encoding = encoding;
+    mbedtls_sha256_init(&(ctx->sha256));
+    mbedtls_sha256_starts_ret(&(ctx->sha256), 0);
+    ctx->pool = malloc(BUF_SIZE * BUF_COUNT);
+    ctx->free_queue = xQueueCreate(BUF_COUNT, sizeof(ota_buf_t));
+    ctx->write_queue = xQueueCreate(BUF_COUNT + 1, sizeof(ota_buf_t));
+    ctx->done = xSemaphoreCreateBinary();
+
+    if ((ctx->pool == NULL) || (ctx->free_queue == NULL) ||
+        (ctx->write_queue == NULL) || (ctx->done == NULL)) {
+        return ESP_ERR_NO_MEM;
+    }
+
+    if (encoding != OTA_ENCODING_IDENTITY) {
+        // NOTE: 展開に必要なメモリは辞書を含めて固定サイズ
+        ctx->inflate = malloc(sizeof(ota_inflate_t));
+        if (ctx->inflate == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        tinfl_init(&(ctx->inflate->decomp));
+        ctx->inflate->in_size = 0;
+        ctx->inflate->dict_ofs = 0;
+        ctx->inflate->header_done = (encoding != OTA_ENCODING_GZIP);
+        ctx->inflate->status = TINFL_STATUS_NEEDS_MORE_INPUT;
+    }
+
+    for (uint32_t i = 0; i < BUF_COUNT; i++) {
+        buf.data = ctx->pool + (BUF_SIZE * i);
+        buf.size = 0;
+        xQueueSend(ctx->free_queue, &buf, 0);
+    }
+
+    return ESP_OK;
+}
+
+static void ota_ctx_free(ota_ctx_t *ctx)
+{
+    if (ctx->done != NULL) {
+        vSemaphoreDelete(ctx->done);
+    }
+    if (ctx->write_queue != NULL) {
+        vQueueDelete(ctx->write_queue);
+    }
+    if (ctx->free_queue != NULL) {
+        vQueueDelete(ctx->free_queue);
+    }
+    mbedtls_sha256_free(&(ctx->sha256));
+    free(ctx->inflate);
+    free(ctx->pool);
+}
+
+static ota_buf_t *ota_buf_get(ota_ctx_t *ctx)
+{
+    if (ctx->cur.data == NULL) {
+        xQueueReceive(ctx->free_queue, &(ctx->cur), portMAX_DELAY);
+        ctx->cur.size = 0;
+    }
+    return &(ctx->cur);
+}
+
+// NOTE: 書き込みタスクに渡し，次のバッファで受信を続ける
+static void ota_buf_flush(ota_ctx_t *ctx)
+{
+    if ((ctx->cur.data == NULL) || (ctx->cur.size == 0)) {
+        return;
+    }
+    ctx->image_size += ctx->cur.size;
+    mbedtls_sha256_update_ret(&(ctx->sha256), (const unsigned char *)ctx->cur.data, ctx->cur.size);
+    xQueueSend(ctx->write_queue, &(ctx->cur), portMAX_DELAY);
+    ctx->cur.data = NULL;
+}
+
+static void ota_buf_append(ota_ctx_t *ctx, const uint8_t *data, size_t size)
+{
+    ota_buf_t *buf;
+    size_t copy_size;
+
+    while (size > 0) {
+        buf = ota_buf_get(ctx);
+        copy_size = BUF_SIZE - buf->size;
+        if (size < copy_size) {
+            copy_size = size;
+        }
+        memcpy(buf->data + buf->size, data, copy_size);
+        buf->size += copy_size;
+        data += copy_size;
+        size -= copy_size;
+
+        if (buf->size == BUF_SIZE) {
+            ota_buf_flush(ctx);
+        }
+    }
+}
+
+static esp_err_t ota_writer_finish(ota_ctx_t *ctx)
+{
+    ota_buf_t buf = { NULL, 0 };
+
+    ota_buf_flush(ctx);
+    if (ctx->cur.data != NULL) {
+        xQueueSend(ctx->free_queue, &(ctx->cur), 0);
+        ctx->cur.data = NULL;
+    }
+
+    xQueueSend(ctx->write_queue, &buf, portMAX_DELAY);
+    xSemaphoreTake(ctx->done, portMAX_DELAY);
+
+    return ctx->write_err;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Inflate
+
+// NOTE: gzip のヘッダサイズを返す．データが足りなければ 0, 不正なら -1．
+static int gzip_header_size(const uint8_t *data, size_t size)
+{
+    size_t pos = 10;
+    uint8_t flag;
+
+    if (size < pos) {
+        return 0;
+    }
+    if ((data[0] != 0x1F) || (data[1] != 0x8B) || (data[2] != 8)) {
+        return -1;
+    }
+    flag = data[3];
+
+    if (flag & GZIP_FEXTRA) {
+        if (size < pos + 2) {
+            return 0;
+        }
+        pos += 2 + (data[pos] | (data[pos + 1] << 8));
+    }
+    if (flag & GZIP_FNAME) {
+        while ((pos < size) && (data[pos] != '\0')) {
+            pos++;
+        }
+        pos++;
+    }
+    if (flag & GZIP_FCOMMENT) {
+        while ((pos < size) && (data[pos] != '\0')) {
+            pos++;
+        }
+        pos++;
+    }
+    if (flag & GZIP_FHCRC) {
+        pos += 2;
+    }
+
+    return (pos <= size) ? pos : 0;
+}
+
+// NOTE: 受信済みのデータを展開して書き込みバッファに積む．
+// gzip のトレーラ (CRC32, ISIZE) は読み捨てる．イメージ自体の検証は esp_ota_end で行う．
+static esp_err_t ota_inflate(ota_ctx_t *ctx)
+{
+    ota_inflate_t *inflate = ctx->inflate;
+    const uint8_t *in = inflate->in;
+    size_t in_size;
+    size_t out_size;
+    int header_size;
+    uint32_t flags;
+
+    if (!inflate->header_done) {
+        header_size = gzip_header_size(inflate->in, inflate->in_size);
+        if (header_size < 0) {
+            return ESP_ERR_INVALID_ARG;
+        } else if (header_size == 0) {
+            if (inflate->in_size == sizeof(inflate->in)) {
+                return ESP_ERR_INVALID_SIZE;
+            }
+            return ESP_OK; // NOTE: ヘッダが揃うまで受信を続ける
+        }
+        in += header_size;
+        inflate->in_size -= header_size;
+        inflate->header_done = true;
+    }
+
+    flags = TINFL_FLAG_HAS_MORE_INPUT;
+    if (ctx->encoding == OTA_ENCODING_DEFLATE) {
+        flags |= TINFL_FLAG_PARSE_ZLIB_HEADER;
+    }
+
+    while (inflate->status != TINFL_STATUS_DONE) {
+        in_size = inflate->in_size;
+        out_size = TINFL_LZ_DICT_SIZE - inflate->dict_ofs;
+
+        inflate->status = tinfl_decompress(&(inflate->decomp), in, &in_size,
+                                           inflate->dict, inflate->dict + inflate->dict_ofs,
+                                           &out_size, flags);
+        in += in_size;
+        inflate->in_size -= in_size;
+
+        ota_buf_append(ctx, inflate->dict + inflate->dict_ofs, out_size);
+        inflate->dict_ofs = (inflate->dict_ofs + out_size) & (TINFL_LZ_DICT_SIZE - 1);
+
+        if (inflate->status < 0) {
+            return ESP_ERR_INVALID_ARG;
+        }
+        if ((inflate->status == TINFL_STATUS_NEEDS_MORE_INPUT) && (inflate->in_size == 0)) {
+            break;
+        }
+    }
+    inflate->in_size = 0;
+
+    return ESP_OK;
+}
+
+//////////////////////////////////////////////////////////////////////
+// Session
+static void ota_session_close(void)
+{
+    if (ota_session == NULL) {
+        return;
+    }
+    if (ota_session->writer != NULL) {
+        ota_writer_finish(ota_session);
+        esp_ota_end(ota_session->handle);
+    }
+    ota_ctx_free(ota_session);
+    free(ota_session);
+    ota_session = NULL;
+}
+
+// NOTE: digest は NULL なら検証しない
+static esp_err_t ota_session_open(ota_encoding_t encoding, int total_size, const uint8_t *digest)
+{
+    ota_ctx_t *ctx;
+
+    // NOTE: 新しいアップロードが始まったら，途中のセッションは破棄する
+    ota_session_close();
+
+    ctx = calloc(1, sizeof(ota_ctx_t));
+    if (ctx == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    ota_session = ctx;
+
+    if (ota_ctx_init(ctx, encoding) != ESP_OK) {
+        ota_session_close();
+        return ESP_ERR_NO_MEM;
+    }
+
+    ctx->id = esp_random();
+    snprintf(ctx->id_str, sizeof(ctx->id_str), "%08x", ctx->id);
+    ctx->total_size = total_size;
+    ctx->percent = 2;
+
+    if (digest != NULL) {
+        memcpy(ctx->digest, digest, SHA256_SIZE);
+        ctx->has_digest = true;
+    }
+
+    ctx->part = esp_ota_get_next_update_partition(NULL);
+    part_info_show("Target", ctx->part);
+
+    // NOTE: OTA_WITH_SEQUENTIAL_WRITES があれば，パーティション全体を最初に消去せず，
+    // 書き込む直前にセクタ単位で消去させる．無い IDF では esp_ota_begin が最初に消去する．
+    // 非圧縮なら送られてくるサイズ分だけで済むが，圧縮時は展開後のサイズが分からないので
+    // OTA_SIZE_UNKNOWN を渡し，パーティション全体を消去する (その間，最初の断片の応答が遅れる)
+#ifdef OTA_WITH_SEQUENTIAL_WRITES
+    ESP_ERROR_CHECK(esp_ota_begin(ctx->part, OTA_WITH_SEQUENTIAL_WRITES, &(ctx->handle)));
+#else
+    ESP_ERROR_CHECK(esp_ota_begin(ctx->part, (encoding == OTA_ENCODING_IDENTITY) ?
+                                  total_size : OTA_SIZE_UNKNOWN, &(ctx->handle)));
+#endif
+    xTaskCreatePinnedToCore(ota_writer_task, "ota_writer_task", 3072, ctx, 5,
+                            &(ctx->writer), WRITER_CORE);
+
+    ESP_LOGI(TAG, "Open OTA session %s.", ctx->id_str);
+
+    return ESP_OK;
+}
+
+static esp_err_t ota_session_finish(void)
+{
+    ota_ctx_t *ctx = ota_session;
+    uint8_t digest[SHA256_SIZE];
+    esp_err_t ret;
+
+    ret = ota_writer_finish(ctx);
+    ctx->writer = NULL;
+    mbedtls_sha256_finish_ret(&(ctx->sha256), digest);
+
+    if ((ctx->inflate != NULL) && (ctx->inflate->status != TINFL_STATUS_DONE)) {
+        LOG_RING_E("Compressed firmware is truncated.");
+        ret = ESP_ERR_INVALID_SIZE;
+    }
+    if ((ret == ESP_OK) && ctx->has_digest && (memcmp(digest, ctx->digest, SHA256_SIZE) != 0)) {
+        LOG_RING_E("SHA-256 of firmware does not match.");
+        ret = ESP_ERR_INVALID_CRC;
+    }
+
+    if (ret == ESP_OK) {
+        ret = esp_ota_end(ctx->handle);
+    } else {
+        esp_ota_end(ctx->handle);
+    }
+    if (ret == ESP_OK) {
+        ret = esp_ota_set_boot_partition(ctx->part);
+    }
+
+    return ret;
+}
+
+//////////////////////////////////////////////////////////////////////
+// HTTP Handler
+static esp_err_t ota_encoding(httpd_req_t *req, ota_encoding_t *encoding)
+{
+    char value[32];
+
+    *encoding = OTA_ENCODING_IDENTITY;
+    if (httpd_req_get_hdr_value_str(req, "Content-Encoding", value, sizeof(value)) != ESP_OK) {
+        return ESP_OK;
+    }
+
+    if ((strcasecmp(value, "gzip") == 0) || (strcasecmp(value, "x-gzip") == 0)) {
+        *encoding = OTA_ENCODING_GZIP;
+    } else if (strcasecmp(value, "deflate") == 0) {
+        *encoding = OTA_ENCODING_DEFLATE;
+    } else if (strcasecmp(value, "identity") != 0) {
+        return ESP_ERR_NOT_SUPPORTED;
+    }
+    return ESP_OK;
+}
+
+// NOTE: X-OTA-SHA256 はちょうど 64 桁の 16 進数．無ければ *has_digest を false にする．
+// 短い・長い・16 進数でない値を黙って無視すると検証が抜けるので，エラーにする
+static esp_err_t ota_digest(httpd_req_t *req, uint8_t *digest, bool *has_digest)
+{
+    char digest_str[SHA256_SIZE * 2 + 1];
+
+    *has_digest = false;
+    if (httpd_req_get_hdr_value_len(req, "X-OTA-SHA256") == 0) {
+        return ESP_OK;
+    }
+    // NOTE: 長すぎる値は ESP_ERR_HTTPD_RESULT_TRUNC になる
+    if (httpd_req_get_hdr_value_str(req, "X-OTA-SHA256", digest_str, sizeof(digest_str)) != ESP_OK) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if (strlen(digest_str) != (SHA256_SIZE * 2)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    for (uint32_t i = 0; i < SHA256_SIZE * 2; i++) {
+        if (!isxdigit((unsigned char)digest_str[i])) {
+            return ESP_ERR_INVALID_ARG;
+        }
+    }
+    for (uint32_t i = 0; i < SHA256_SIZE; i++) {
+        char hex[3] = { digest_str[i * 2], digest_str[i * 2 + 1], '\0' };
+        digest[i] = strtoul(hex, NULL, 16);
+    }
+    *has_digest = true;
+
+    return ESP_OK;
+}
+
+// NOTE: "Content-Range: bytes START-END/TOTAL" を解釈する．無ければ全体を送ったものとみなす．
+static esp_err_t ota_range(httpd_req_t *req, int *start, int *total)
+{
+    char value[64];
+    int end;
+
+    if (httpd_req_get_hdr_value_str(req, "Content-Range", value, sizeof(value)) != ESP_OK) {
+        *start = 0;
+        *total = req->content_len;
+        return ESP_OK;
+    }
+    if (sscanf(value, "bytes %d-%d/%d", start, &end, total) != 3) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    if ((*start < 0) || (end < *start) || (end >= *total) ||
+        ((end - *start + 1) != req->content_len)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+    return ESP_OK;
+}
+
+static int ota_recv(httpd_req_t *req, ota_ctx_t *ctx, int remain)
+{
+    char *recv_buf;
+    int recv_size;
+
+    if (ctx->encoding == OTA_ENCODING_IDENTITY) {
+        ota_buf_t *buf = ota_buf_get(ctx);
+        recv_buf = buf->data + buf->size;
+        recv_size = BUF_SIZE - buf->size;
+    } else {
+        recv_buf = (char *)ctx->inflate->in + ctx->inflate->in_size;
+        recv_size = sizeof(ctx->inflate->in) - ctx->inflate->in_size;
+    }
+    if (remain < recv_size) {
+        recv_size = remain;
+    }
+
+    recv_size = httpd_req_recv(req, recv_buf, recv_size);
+    if (recv_size <= 0) {
+        return recv_size;
+    }
+
+    if (ctx->encoding == OTA_ENCODING_IDENTITY) {
+        ctx->cur.size += recv_size;
+        if (ctx->cur.size == BUF_SIZE) {
+            ota_buf_flush(ctx);
+        }
+    } else {
+        ctx->inflate->in_size += recv_size;
+        if (ota_inflate(ctx) != ESP_OK) {
+            LOG_RING_E("Failed to inflate firmware.");
+            ctx->write_err = ESP_ERR_INVALID_ARG;
+        }
+    }
+    return recv_size;
+}
+
+static void ota_resp_offset(httpd_req_t *req, char *offset_str, size_t size)
+{
+    if (ota_session == NULL) {
+        return;
+    }
+    snprintf(offset_str, size, "%d", ota_session->received);
+    httpd_resp_set_hdr(req, "X-OTA-Session", ota_session->id_str);
+    httpd_resp_set_hdr(req, "X-OTA-Offset", offset_str);
+}
+
 static esp_err_t http_handle_ota(httpd_req_t *req)
 {
-    const esp_partition_t *part;
-    esp_ota_handle_t handle;
-    char buf[BUF_SIZE];
+    ota_ctx_t *ctx;
+    ota_encoding_t encoding;
+    uint8_t digest[SHA256_SIZE];
+    bool has_digest;
+    char msg[96];
+    char offset_str[16];
+    char session_str[16];
+    int start;
     int total_size;
     int recv_size;
     int remain;
-    uint8_t percent;
+    int64_t start_time;
+    uint32_t elapsed_ms;
+    esp_err_t ret;
 
-    ESP_LOGI(TAG, "Start to update firmware.");
-
-    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain"));
-    ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "Start to update firmware.\n"));
+    if (ota_encoding(req, &encoding) != ESP_OK) {
+        httpd_resp_set_status(req, "415 Unsupported Media Type");
+        httpd_resp_sendstr(req, "Unsupported Content-Encoding.\n");
+        return ESP_OK;
+    }
+    if (ota_range(req, &start, &total_size) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid Content-Range.");
+        return ESP_OK;
+    }
 
-    part = esp_ota_get_next_update_partition(NULL);
-    part_info_show("Target", part);
+    if (start == 0) {
+        if (ota_digest(req, digest, &has_digest) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid X-OTA-SHA256.");
+            return ESP_OK;
+        }
+        LOG_RING_I("Start to update firmware.");
+        LOG_RING_I("Sent size: %d KB%s.", total_size / 1024,
+                   (encoding == OTA_ENCODING_IDENTITY) ? "" : " (compressed)");
 
-    total_size = req->content_len;
+        if (ota_session_open(encoding, total_size, has_digest ? digest : NULL) != ESP_OK) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                                "Failed to allocate buffer.");
+            return ESP_OK;
+        }
+    } else if ((ota_session == NULL) ||
+               (httpd_req_get_hdr_value_str(req, "X-OTA-Session",
+                                            session_str, sizeof(session_str)) != ESP_OK) ||
+               (strcmp(session_str, ota_session->id_str) != 0)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "Unknown OTA session.");
+        return ESP_OK;
+    } else if ((start != ota_session->received) ||
+               (total_size != ota_session->total_size) ||
+               (encoding != ota_session->encoding)) {
+        // NOTE: クライアントは X-OTA-Offset から送り直す
+        ota_resp_offset(req, offset_str, sizeof(offset_str));
+        httpd_resp_set_status(req, "416 Range Not Satisfiable");
+        httpd_resp_sendstr(req, "Range does not match the OTA session.\n");
+        return ESP_OK;
+    } else {
+        ESP_LOGI(TAG, "Resume OTA session %s from %d KB.", ota_session->id_str, start / 1024);
+    }
+    ctx = ota_session;
 
-    ESP_LOGI(TAG, "Sent size: %d KB.", total_size / 1024);
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "X-OTA-Session", ctx->id_str));
+    if (start == 0) {
+        ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "Start to update firmware.\n"));
+        ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "0        20        40        60        80       100%\n"));
+        ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "|---------+---------+---------+---------+---------+\n"));
+        ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "*"));
+    }
 
-    ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "0        20        40        60        80       100%\n"));
-    ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "|---------+---------+---------+---------+---------+\n"));
-    ESP_ERROR_CHECK(httpd_resp_sendstr_chunk(req, "*"));
+    start_time = esp_timer_get_time();
 
-    ESP_ERROR_CHECK(esp_ota_begin(part, total_size, &handle));
-    remain = total_size;
-    percent = 2;
+    remain = req->content_len;
     while (remain > 0) {
-        if (remain < sizeof(buf)) {
-            recv_size = remain;
-        } else {
-            recv_size = sizeof(buf);
-        }
-
-        recv_size = httpd_req_recv(req, buf, recv_size);
+        recv_size = ota_recv(req, ctx, remain);
         if (recv_size <= 0) {
             if (recv_size == HTTPD_SOCK_ERR_TIMEOUT) {
                 continue;
             }
-            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR,
-                                "Failed to receive firmware.");
-            return ESP_FAIL;
+            break;
         }
+        remain -= recv_size;
+        ctx->received += recv_size;
+        metrics_count(METRICS_OTA_RECV_BYTES, recv_size);
 
-        ESP_ERROR_CHECK(esp_ota_write(handle, buf, recv_size));
+        if (ctx->write_err != ESP_OK) {
+            break;
+        }
 
-        remain -= recv_size;
-        if (remain < (total_size * (100-percent) / 100)) {
+        if ((ctx->total_size - ctx->received) < (ctx->total_size * (100-ctx->percent) / 100)) {
             httpd_resp_sendstr_chunk(req, "*");
-            percent += 2;
+            ctx->percent += 2;
         }
     }
-    ESP_ERROR_CHECK(esp_ota_end(handle));
-    ESP_ERROR_CHECK(esp_ota_set_boot_partition(part));
-    ESP_LOGI(TAG, "Finished writing firmware.");
 
-    httpd_resp_sendstr_chunk(req, "*\nComplete.\n");
+    if (ctx->write_err != ESP_OK) {
+        ota_session_close();
+        httpd_resp_sendstr_chunk(req, "\nFailed to write firmware.\n");
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_FAIL;
+    }
+    if (remain != 0) {
+        // NOTE: セッションは残しておき，続きから再開できるようにする
+        LOG_RING_W("Failed to receive firmware (%d / %d bytes).",
+                   ctx->received, ctx->total_size);
+        return ESP_FAIL;
+    }
+    if (ctx->received != ctx->total_size) {
+        snprintf(msg, sizeof(msg), "\nReceived %d / %d bytes.\n", ctx->received, ctx->total_size);
+        httpd_resp_sendstr_chunk(req, msg);
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_OK;
+    }
+
+    ret = ota_session_finish();
+    elapsed_ms = (uint32_t)((esp_timer_get_time() - start_time) / 1000);
+
+    if (ret != ESP_OK) {
+        ota_session_close();
+        snprintf(msg, sizeof(msg), "\nFailed to verify firmware (%s).\n", esp_err_to_name(ret));
+        httpd_resp_sendstr_chunk(req, msg);
+        httpd_resp_sendstr_chunk(req, NULL);
+        return ESP_FAIL;
+    }
+    LOG_RING_I("Finished writing firmware (%d ms).", elapsed_ms);
+
+    snprintf(msg, sizeof(msg), "*\nComplete (%d KB -> %d KB in %d ms, %d KB/s).\n",
+             req->content_len / 1024, ctx->image_size / 1024, elapsed_ms,
+             (elapsed_ms == 0) ? 0 : (uint32_t)((uint64_t)req->content_len * 1000 / 1024 / elapsed_ms));
+    ota_session_close();
+
+    httpd_resp_sendstr_chunk(req, msg);
     httpd_resp_sendstr_chunk(req, NULL);
 
     xTaskCreate(restart_task, "restart_task", 1024, NULL, 10, NULL);
@@ -78,6 +679,27 @@ static esp_err_t http_handle_ota(httpd_req_t *req)
     return ESP_OK;
 }
 
+static esp_err_t http_handle_ota_status(httpd_req_t *req)
+{
+    json_writer_t writer;
+    char buf[96];
+
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/json"));
+
+    json_writer_init(&writer, req, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    if (ota_session == NULL) {
+        json_writer_null(&writer, "session");
+    } else {
+        json_writer_str(&writer, "session", ota_session->id_str);
+        json_writer_int(&writer, "offset", ota_session->received);
+        json_writer_int(&writer, "total", ota_session->total_size);
+    }
+    json_writer_end_object(&writer);
+
+    return json_writer_finish(&writer);
+}
+
 static httpd_uri_t http_uri_ota = {
     .uri       = "/ota*",
     .method    = HTTP_POST,
@@ -85,9 +707,17 @@ static httpd_uri_t http_uri_ota = {
     .user_ctx  = NULL
 };
 
+static httpd_uri_t http_uri_ota_status = {
+    .uri       = "/ota*",
+    .method    = HTTP_GET,
+    .handler   = http_handle_ota_status,
+    .user_ctx  = NULL
+};
+
 void http_ota_handler_install(httpd_handle_t server)
 {
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_ota));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_ota));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_ota_status));
 
 #ifdef CONFIG_APP_ROLLBACK_ENABLE
     esp_ota_img_states_t ota_state;
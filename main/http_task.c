@@ -1,72 +1,217 @@
 #include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
 #include "esp_ota_ops.h"
-#include "driver/gpio.h"
+#include "esp_timer.h"
+#include "lwip/sockets.h"
 #include "cJSON.h"
 
 #include "app.h"
 #include "http_task.h"
 #include "http_ota_handler.h"
+#include "http_capture_handler.h"
+#include "gpio_task.h"
+#include "gpio_capture.h"
+#include "gpio_seq.h"
+#include "gpio_api.h"
+#include "json_writer.h"
+#include "metrics.h"
+#include "link_stat.h"
+#include "wifi_task.h"
+#include "rate_limit.h"
+#include "boot_stat.h"
+#include "udp_task.h"
+#include "mqtt_task.h"
+#include "http_log_handler.h"
+#include "http_debug_handler.h"
 
 #define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
 
 #define APP_PATH "/app"
-#define DRIVE_PERIOD_MS 300
-
-extern const unsigned char index_html_start[] asm("_binary_index_html_start");
-extern const unsigned char index_html_end[]   asm("_binary_index_html_end");
-extern const unsigned char runtime_js_start[] asm("_binary_runtime_js_gz_start");
-extern const unsigned char runtime_js_end[]   asm("_binary_runtime_js_gz_end");
-extern const unsigned char main_js_start[] asm("_binary_main_js_gz_start");
-extern const unsigned char main_js_end[]   asm("_binary_main_js_gz_end");
-extern const unsigned char polyfills_js_start[] asm("_binary_polyfills_js_gz_start");
-extern const unsigned char polyfills_js_end[]   asm("_binary_polyfills_js_gz_end");
-extern const unsigned char scripts_js_start[] asm("_binary_scripts_js_gz_start");
-extern const unsigned char scripts_js_end[]   asm("_binary_scripts_js_gz_end");
-extern const unsigned char styles_css_start[] asm("_binary_styles_css_gz_start");
-extern const unsigned char styles_css_end[]   asm("_binary_styles_css_gz_end");
-extern const unsigned char favicon_ico_start[] asm("_binary_favicon_ico_gz_start");
-extern const unsigned char favicon_ico_end[]   asm("_binary_favicon_ico_gz_end");
+#define BATCH_BUF_SIZE  1024
+
+#define CLIENT_MAX              8
+#define CLIENT_RATE_PER_SEC     20
+#define CLIENT_BURST            10
+
+#define WS_CLIENT_MAX           4
+#define WS_FRAME_MAX            256
+#define WS_STATUS_BUF_SIZE      2048
+#define WS_EVENT_QUEUE_SIZE     16
+#define WS_STATUS_INTERVAL_MS   5000
+
+// NOTE: OTA や SSE など長く居座るリクエストは別のサーバで受ける
+#define BULK_PORT               8080
+#define BULK_CTRL_PORT          32769
+#define BULK_TASK_PRIORITY      (tskIDLE_PRIORITY + 4)
+#define BULK_SOCKET_MAX         5
+#define BULK_LOCATION_SIZE      128
+
+typedef struct client_limit {
+    uint8_t addr[16];
+    rate_limit_t limit;
+    int64_t last_time;
+} client_limit_t;
+
+typedef struct static_content_variant {
+    const char *encoding;   // Content-Encoding (NULL なら無圧縮)
+    const unsigned char *data_start;
+    const unsigned char *data_end;
+    const char *etag;
+} static_content_variant_t;
 
 typedef struct static_content {
     const char *path;
-    const unsigned char *data_start;
-    const unsigned char *data_end;
     const char *content_type;
-    bool is_gzip;
+    const static_content_variant_t *variant_list; // サイズの小さい順
+    uint32_t variant_count;
 } static_content_t;
 
-static static_content_t content_list[] = {
-    { "index.htm", index_html_start, index_html_end, "text/html", false, },
-    { "runtime.js", runtime_js_start, runtime_js_end, "text/javascript", true, },
-    { "main.js", main_js_start, main_js_end, "text/javascript", true, },
-    { "polyfills.js", polyfills_js_start, polyfills_js_end, "text/javascript", true, },
-    { "scripts.js", scripts_js_start, scripts_js_end, "text/javascript", true, },
-    { "styles.css", styles_css_start, styles_css_end, "text/css", true, },
-    { "favicon.ico", favicon_ico_start, favicon_ico_end, "image/x-icon", true, },
-};
+// NOTE: content_list はビルド時に gen_content.py で生成する
+#include "content_list.h"
 
-static esp_err_t http_handle_app(httpd_req_t *req)
+// NOTE: client_list は httpd のタスクからしか参照しないので，ロックは不要
+static client_limit_t client_list[CLIENT_MAX];
+
+static int content_cmp(const void *key, const void *elem)
+{
+    return strcmp((const char *)key, ((const static_content_t *)elem)->path);
+}
+
+static const static_content_t *content_find(const char *uri)
 {
-    static_content_t *content = NULL;
+    const static_content_t *content;
+    char path[64];
+    size_t len;
 
-    for (uint32_t i = 0; i < ARRAY_SIZE_OF(content_list); i++) {
-        if (strstr(req->uri, content_list[i].path) != NULL) {
-            content = &(content_list[i]);
+    uri += strlen(APP_PATH);
+    if (*uri == '/') {
+        uri++;
+    }
+    // NOTE: クエリ文字列は無視して完全一致で比較する
+    len = strcspn(uri, "?#");
+    if (len < sizeof(path)) {
+        memcpy(path, uri, len);
+        path[len] = '\0';
+
+        content = bsearch(path, content_list, ARRAY_SIZE_OF(content_list),
+                          sizeof(content_list[0]), content_cmp);
+        if (content != NULL) {
+            return content;
         }
     }
+    return bsearch("index.html", content_list, ARRAY_SIZE_OF(content_list),
+                   sizeof(content_list[0]), content_cmp);
+}
+
+static bool etag_match(httpd_req_t *req, const char *etag)
+{
+    char if_none_match[128];
+
+    if (httpd_req_get_hdr_value_str(req, "If-None-Match",
+                                    if_none_match, sizeof(if_none_match)) != ESP_OK) {
+        return false;
+    }
+    return (strstr(if_none_match, etag) != NULL) || (strcmp(if_none_match, "*") == 0);
+}
+
+// NOTE: Accept-Encoding から name の項目を探す．見つかれば，q=0 でないかを *accepted に返す
+static bool accept_find(const char *accept, const char *name, bool *accepted)
+{
+    size_t len = strlen(name);
+    const char *p = accept;
+    const char *param;
+    size_t token_len;
+
+    while (*p != '\0') {
+        p += strspn(p, " \t,");
+        token_len = strcspn(p, ",");
+
+        if ((strncasecmp(p, name, len) == 0) && (strchr(" \t;,", p[len]) != NULL)) {
+            *accepted = true;
+            param = memchr(p, ';', token_len);
+            if (param != NULL) {
+                param += strspn(param, "; \t");
+                // NOTE: q=0, q=0.0, q=0.00 などは拒否を表す
+                if ((strncmp(param, "q=0", 3) == 0) && (strspn(param + 3, ".0") == strcspn(param + 3, " \t,"))) {
+                    *accepted = false;
+                }
+            }
+            return true;
+        }
+        p += token_len;
+    }
+    return false;
+}
+
+// NOTE: encoding を明示した項目があればそれに従い，無ければ * に従う (RFC 9110)．
+// "gzip;q=0, *" は gzip を拒否している
+static bool accept_encoding(const char *accept, const char *encoding)
+{
+    bool accepted = false;
+
+    if (!accept_find(accept, encoding, &accepted)) {
+        accept_find(accept, "*", &accepted);
+    }
+    return accepted;
+}
+
+// NOTE: クライアントが受け付ける中で最も小さいものを選ぶ．どれも受け付けなければ，
+// 以前と同じく gzip を返す (すべてのブラウザが対応している)．
+static const static_content_variant_t *content_select(httpd_req_t *req, const static_content_t *content)
+{
+    const static_content_variant_t *variant;
+    const static_content_variant_t *fallback = &(content->variant_list[0]);
+    char accept[128];
+
+    if (httpd_req_get_hdr_value_str(req, "Accept-Encoding", accept, sizeof(accept)) != ESP_OK) {
+        accept[0] = '\0';
+    }
+    for (uint32_t i = 0; i < content->variant_count; i++) {
+        variant = &(content->variant_list[i]);
+        if ((variant->encoding == NULL) || accept_encoding(accept, variant->encoding)) {
+            return variant;
+        }
+        if (strcmp(variant->encoding, "gzip") == 0) {
+            fallback = variant;
+        }
+    }
+    return fallback;
+}
+
+static esp_err_t http_handle_app(httpd_req_t *req)
+{
+    const static_content_t *content = content_find(req->uri);
+    const static_content_variant_t *variant;
+
     if (content == NULL) {
-        content = &(content_list[0]);
+        return httpd_resp_send_404(req);
+    }
+    variant = content_select(req, content);
+
+    // NOTE: エンコーディングごとに ETag が異なるので，キャッシュにも区別させる
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Vary", "Accept-Encoding"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "ETag", variant->etag));
+    // NOTE: ファイル名にハッシュが付いていないので，キャッシュは毎回 ETag で検証させる
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Cache-Control", "no-cache"));
+
+    if (etag_match(req, variant->etag)) {
+        ESP_ERROR_CHECK(httpd_resp_set_status(req, "304 Not Modified"));
+        httpd_resp_send(req, NULL, 0);
+        return ESP_OK;
     }
 
     ESP_ERROR_CHECK(httpd_resp_set_type(req, content->content_type));
-    if (content->is_gzip) {
-        ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Content-Encoding", "gzip"));
+    if (variant->encoding != NULL) {
+        ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Content-Encoding", variant->encoding));
     }
     httpd_resp_send(req,
-                    (const char *)content->data_start,
-                    content->data_end - content->data_start);
+                    (const char *)variant->data_start,
+                    variant->data_end - variant->data_start);
 
     return ESP_OK;
 }
@@ -79,61 +224,266 @@ static esp_err_t http_handle_app_redirect(httpd_req_t *req) {
     return ESP_OK;
 }
 
-static void gpio_ctrl_task(void *param) {
-    gpio_config_t io_conf;
-    uint8_t gpio_num = (uint32_t)param;
+// NOTE: 以前のアドレスに来た OTA / キャプチャは，本体を読まずに別ポートへ転送する
+static esp_err_t http_handle_bulk_redirect(httpd_req_t *req)
+{
+    char host[64];
+    char location[BULK_LOCATION_SIZE];
+    char *port;
+
+    if (httpd_req_get_hdr_value_str(req, "Host", host, sizeof(host)) != ESP_OK) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Host header is required.");
+        return ESP_FAIL;
+    }
+    port = strrchr(host, ':');
+    if ((port != NULL) && (strchr(port, ']') == NULL)) {
+        *port = '\0';
+    }
+    snprintf(location, sizeof(location), "http://%s:%d%s", host, BULK_PORT, req->uri);
+
+    ESP_ERROR_CHECK(httpd_resp_set_status(req, "307 Temporary Redirect"));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Location", location));
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Connection", "close"));
+    httpd_resp_sendstr(req, "");
+
+    // NOTE: ESP_OK を返すと残りの本体 (ファームウェア) をこのタスクで読み捨ててしまうので，
+    // 接続ごと閉じる
+    return ESP_FAIL;
+}
+
+// NOTE: 本体が届いている接続を読まずに閉じると lwIP が RST を返し，307 がクライアントに
+// 届かないことがある．Expect: 100-continue を付けたクライアントは応答を待ってから本体を
+// 送るので，その場合だけ転送する．それ以外は 421 を返し，本体は httpd に読み捨てさせる
+static esp_err_t http_handle_ota_redirect(httpd_req_t *req)
+{
+    char expect[32];
+    char msg[48];
 
-    io_conf.intr_type = GPIO_PIN_INTR_DISABLE;
-    io_conf.mode = GPIO_MODE_OUTPUT;
-    io_conf.pin_bit_mask = 1ULL << gpio_num;
-    io_conf.pull_down_en = 0;
-    io_conf.pull_up_en = 0;
+    if ((httpd_req_get_hdr_value_str(req, "Expect", expect, sizeof(expect)) == ESP_OK) &&
+        (strcasecmp(expect, "100-continue") == 0)) {
+        return http_handle_bulk_redirect(req);
+    }
 
-    gpio_config(&io_conf);
+    ESP_ERROR_CHECK(httpd_resp_set_status(req, "421 Misdirected Request"));
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain"));
+    snprintf(msg, sizeof(msg), "Upload firmware to port %d.\n", BULK_PORT);
+    httpd_resp_sendstr(req, msg);
 
-    vTaskDelay(DRIVE_PERIOD_MS / portTICK_PERIOD_MS);
+    return ESP_OK;
+}
 
-    io_conf.mode = GPIO_MODE_INPUT;
-    gpio_config(&io_conf);
+static uint32_t query_width_us(httpd_req_t *req)
+{
+    char query[64];
+    char width_str[16];
 
-    vTaskDelete(NULL); // NOTE: 自分自身を削除
+    if ((httpd_req_get_url_query_str(req, query, sizeof(query)) != ESP_OK) ||
+        (httpd_query_key_value(query, "width_us", width_str, sizeof(width_str)) != ESP_OK)) {
+        return GPIO_TASK_DEFAULT_WIDTH_US;
+    }
+    return gpio_api_width(width_str);
 }
 
-static esp_err_t process_api(const char *uri) {
+static esp_err_t process_api(httpd_req_t *req, uint32_t *retry_after_ms) {
     const char *gpio_str;
-    uint32_t gpio_num;
 
-    gpio_str = strrchr(uri, '/');
+    gpio_str = strrchr(req->uri, '/');
     if (gpio_str == NULL) {
         return ESP_FAIL;
     }
-    gpio_num = atoi(gpio_str + 1);
 
-    // NOTE: 実際の GPIO は別タスクで行い，HTTP の応答は即返せるようにする
-    xTaskCreate(gpio_ctrl_task, "gpio_ctrl_task", 2048, (void *)gpio_num, 10, NULL);
+    // NOTE: 実際の GPIO は常駐タスクで行い，HTTP の応答は即返せるようにする
+    return gpio_api_pulse(gpio_str + 1, query_width_us(req), retry_after_ms);
+}
 
-    return ESP_OK;
+// NOTE: クライアント (IP アドレス) ごとのレート制限．受け付けられなければ，待つべき時間を返す
+static uint32_t client_admit(httpd_req_t *req)
+{
+    struct sockaddr_in6 addr;
+    socklen_t addr_len = sizeof(addr);
+    client_limit_t *client = NULL;
+    client_limit_t *oldest = NULL;
+    int64_t now = esp_timer_get_time();
+    uint32_t wait_ms;
+
+    if (getpeername(httpd_req_to_sockfd(req), (struct sockaddr *)&addr, &addr_len) != 0) {
+        return 0;
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(client_list); i++) {
+        if (memcmp(client_list[i].addr, addr.sin6_addr.s6_addr, sizeof(client_list[i].addr)) == 0) {
+            client = &(client_list[i]);
+            break;
+        }
+        if ((oldest == NULL) || (client_list[i].last_time < oldest->last_time)) {
+            oldest = &(client_list[i]);
+        }
+    }
+    if (client == NULL) {
+        // NOTE: 表が一杯なら，最も長く使われていないクライアントと入れ替える
+        client = oldest;
+        memcpy(client->addr, addr.sin6_addr.s6_addr, sizeof(client->addr));
+        rate_limit_init(&(client->limit), CLIENT_RATE_PER_SEC, CLIENT_BURST);
+    }
+    client->last_time = now;
+
+    wait_ms = rate_limit_wait_ms(&(client->limit), now);
+    if (wait_ms == 0) {
+        rate_limit_take(&(client->limit), now);
+    }
+    return wait_ms;
 }
 
-static esp_err_t http_handle_api(httpd_req_t *req)
+static esp_err_t http_resp_api_result(httpd_req_t *req, esp_err_t result, uint32_t retry_after_ms)
 {
-    esp_err_t api_result = process_api(req->uri);
+    json_writer_t writer;
+    char buf[64];
+    char retry_after_str[12];
 
     ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*"));
     ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/json"));
-    if (api_result == ESP_OK) {
-        httpd_resp_sendstr(req, "{ \"status\": \"OK\" }");
-    } else {
-        httpd_resp_sendstr(req, "{ \"status\": \"NG\" }");
+
+    // NOTE: 混雑している場合は，いつ再送すればよいかを返す
+    if (retry_after_ms != 0) {
+        snprintf(retry_after_str, sizeof(retry_after_str), "%u", (retry_after_ms + 999) / 1000);
+        ESP_ERROR_CHECK(httpd_resp_set_status(req, "429 Too Many Requests"));
+        ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Retry-After", retry_after_str));
+        metrics_count(METRICS_HTTP_THROTTLED, 1);
     }
 
+    json_writer_init(&writer, req, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "status", (result == ESP_OK) ? "OK" : "NG");
+    if (result != ESP_OK) {
+        json_writer_str(&writer, "error", esp_err_to_name(result));
+    }
+    if (retry_after_ms != 0) {
+        json_writer_uint(&writer, "retry_after_ms", retry_after_ms);
+    }
+    json_writer_end_object(&writer);
+
+    return json_writer_finish(&writer);
+}
+
+static esp_err_t http_handle_api(httpd_req_t *req)
+{
+    uint32_t retry_after_ms = client_admit(req);
+    esp_err_t result = (retry_after_ms == 0) ? process_api(req, &retry_after_ms) : ESP_ERR_NO_MEM;
+
+    http_resp_api_result(req, result, retry_after_ms);
+
     return ESP_OK;
 }
 
-static esp_err_t http_handle_status(httpd_req_t *req)
+// NOTE: リクエストボディを NUL 終端して buf に読み込む
+static esp_err_t recv_body(httpd_req_t *req, char *buf, size_t size)
+{
+    int recv_size = 0;
+    int ret;
+
+    if ((req->content_len == 0) || (req->content_len >= size)) {
+        return ESP_ERR_INVALID_SIZE;
+    }
+    while (recv_size < req->content_len) {
+        ret = httpd_req_recv(req, buf + recv_size, req->content_len - recv_size);
+        if (ret <= 0) {
+            if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+                continue;
+            }
+            return ESP_FAIL;
+        }
+        recv_size += ret;
+    }
+    buf[recv_size] = '\0';
+
+    return ESP_OK;
+}
+
+static esp_err_t process_api_batch(httpd_req_t *req, uint32_t *retry_after_ms) {
+    char buf[BATCH_BUF_SIZE];
+    esp_err_t ret;
+
+    ret = recv_body(req, buf, sizeof(buf));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return gpio_api_batch(buf, retry_after_ms);
+}
+
+static esp_err_t http_handle_api_batch(httpd_req_t *req)
+{
+    uint32_t retry_after_ms = client_admit(req);
+    esp_err_t result = (retry_after_ms == 0) ? process_api_batch(req, &retry_after_ms) : ESP_ERR_NO_MEM;
+
+    http_resp_api_result(req, result, retry_after_ms);
+
+    return ESP_OK;
+}
+
+static esp_err_t process_api_seq(httpd_req_t *req) {
+    char buf[BATCH_BUF_SIZE];
+    esp_err_t ret;
+
+    ret = recv_body(req, buf, sizeof(buf));
+    if (ret != ESP_OK) {
+        return ret;
+    }
+    return gpio_api_seq(buf);
+}
+
+static esp_err_t http_handle_api_seq(httpd_req_t *req)
+{
+    uint32_t retry_after_ms = client_admit(req);
+
+    http_resp_api_result(req, (retry_after_ms == 0) ? process_api_seq(req) : ESP_ERR_NO_MEM,
+                         retry_after_ms);
+
+    return ESP_OK;
+}
+
+static esp_err_t http_handle_api_seq_abort(httpd_req_t *req)
+{
+    http_resp_api_result(req, gpio_seq_abort(), 0);
+
+    return ESP_OK;
+}
+
+static esp_err_t http_handle_api_seq_status(httpd_req_t *req)
+{
+    gpio_seq_stat_t stat;
+    json_writer_t writer;
+    char buf[256];
+
+    gpio_seq_get_stat(&stat);
+
+    ESP_ERROR_CHECK(httpd_resp_set_hdr(req, "Access-Control-Allow-Origin", "*"));
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/json"));
+
+    json_writer_init(&writer, req, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_bool(&writer, "running", stat.running);
+    json_writer_bool(&writer, "aborted", stat.aborted);
+    json_writer_uint(&writer, "step", stat.step);
+    json_writer_uint(&writer, "step_count", stat.step_count);
+    json_writer_uint(&writer, "repeat", stat.repeat);
+    json_writer_uint(&writer, "elapsed_us", stat.elapsed_us);
+    json_writer_uint(&writer, "late_max_us", stat.late_max_us);
+    json_writer_uint(&writer, "run_count", stat.run_count);
+    json_writer_end_object(&writer);
+
+    return json_writer_finish(&writer);
+}
+
+// NOTE: /status と WebSocket の status イベントで共通の内容を書き出す
+void http_task_write_status(json_writer_t *writer)
 {
     const esp_partition_t *part_info;
     esp_app_desc_t app_info;
+    gpio_task_stat_t gpio_stat;
+    gpio_capture_stat_t capture_stat;
+    link_stat_t link_stat;
+    wifi_task_stat_t wifi_stat;
+    udp_task_stat_t udp_stat;
+    mqtt_task_stat_t mqtt_stat;
     char elapsed_str[32];
     uint32_t elapsed_sec, day, hour, min, sec;
 
@@ -146,20 +496,356 @@ static esp_err_t http_handle_status(httpd_req_t *req)
     min = (elapsed_sec % 3600) / 60;
     sec = elapsed_sec % 60;
 
-    sprintf(elapsed_str, "%d day(s) %02d:%02d:%02d", day, hour, min, sec);
+    snprintf(elapsed_str, sizeof(elapsed_str), "%d day(s) %02d:%02d:%02d", day, hour, min, sec);
+
+    json_writer_str(writer, "name", app_info.project_name);
+    json_writer_str(writer, "version", app_info.version);
+    json_writer_str(writer, "esp_idf", app_info.idf_ver);
+    json_writer_str(writer, "compile_date", app_info.date);
+    json_writer_str(writer, "compile_time", app_info.time);
+    json_writer_str(writer, "elapsed", elapsed_str);
+
+    gpio_task_get_stat(&gpio_stat);
+    json_writer_begin_object(writer, "gpio");
+    json_writer_uint(writer, "queue_depth", gpio_stat.queue_depth);
+    json_writer_uint(writer, "queue_size", gpio_stat.queue_size);
+    json_writer_uint(writer, "accepted", gpio_stat.accepted);
+    json_writer_uint(writer, "rejected", gpio_stat.rejected);
+    json_writer_uint(writer, "coalesced", gpio_stat.coalesced);
+    json_writer_uint(writer, "throttled", gpio_stat.throttled);
+    json_writer_uint(writer, "latency_p99_us", gpio_stat.latency_p99_us);
+    json_writer_uint(writer, "latency_max_us", gpio_stat.latency_max_us);
+    json_writer_uint(writer, "pulse_count", gpio_stat.pulse_count);
+    json_writer_uint(writer, "pulse_error_max_us", gpio_stat.pulse_error_max_us);
+    json_writer_end_object(writer);
+
+    gpio_capture_get_stat(&capture_stat);
+    json_writer_begin_object(writer, "capture");
+    json_writer_begin_array(writer, "gpio");
+    for (uint32_t i = 0; i < 64; i++) {
+        if (capture_stat.enable_mask & (1ULL << i)) {
+            json_writer_uint(writer, NULL, i);
+        }
+    }
+    json_writer_end_array(writer);
+    json_writer_uint(writer, "captured", capture_stat.captured);
+    json_writer_uint(writer, "overflow", capture_stat.overflow);
+    json_writer_uint(writer, "ring_size", capture_stat.ring_size);
+    json_writer_uint(writer, "ring_max_depth", capture_stat.ring_max_depth);
+    json_writer_end_object(writer);
+
+    link_stat_get(&link_stat);
+    json_writer_begin_object(writer, "link");
+    json_writer_uint(writer, "sample_count", link_stat.sample_count);
+    json_writer_uint(writer, "loss_permille", link_stat.loss_permille);
+    json_writer_uint(writer, "rtt_min_ms", link_stat.rtt_min_ms);
+    json_writer_uint(writer, "rtt_avg_ms", link_stat.rtt_avg_ms);
+    json_writer_uint(writer, "rtt_p95_ms", link_stat.rtt_p95_ms);
+    json_writer_uint(writer, "jitter_ms", link_stat.jitter_ms);
+    json_writer_uint(writer, "probe_interval_ms", link_stat.probe_interval_ms);
+    json_writer_end_object(writer);
+
+    wifi_task_get_stat(&wifi_stat);
+    json_writer_begin_object(writer, "wifi");
+    json_writer_str(writer, "state", wifi_fsm_state_str(wifi_stat.state));
+    json_writer_uint(writer, "failure", wifi_stat.failure);
+    json_writer_bool(writer, "fast_connect", wifi_stat.fast);
+    json_writer_uint(writer, "connect_ms", wifi_stat.total_ms);
+    json_writer_uint(writer, "assoc_ms", wifi_stat.assoc_ms);
+    json_writer_uint(writer, "dhcp_ms", wifi_stat.dhcp_ms);
+    json_writer_end_object(writer);
+
+    udp_task_get_stat(&udp_stat);
+    json_writer_begin_object(writer, "udp");
+    json_writer_bool(writer, "enabled", udp_stat.enabled);
+    json_writer_uint(writer, "port", UDP_TASK_PORT);
+    json_writer_bool(writer, "auth", udp_stat.auth);
+    json_writer_uint(writer, "received", udp_stat.received);
+    json_writer_uint(writer, "accepted", udp_stat.accepted);
+    json_writer_uint(writer, "duplicate", udp_stat.duplicate);
+    json_writer_uint(writer, "rejected", udp_stat.rejected);
+    json_writer_end_object(writer);
+
+    mqtt_task_get_stat(&mqtt_stat);
+    json_writer_begin_object(writer, "mqtt");
+    json_writer_bool(writer, "enabled", mqtt_stat.enabled);
+    json_writer_bool(writer, "connected", mqtt_stat.connected);
+    json_writer_uint(writer, "connect_count", mqtt_stat.connect_count);
+    json_writer_uint(writer, "received", mqtt_stat.received);
+    json_writer_uint(writer, "published", mqtt_stat.published);
+    json_writer_end_object(writer);
+
+    // NOTE: 各フェーズに到達した起動からの時刻 (ms)．未到達なら 0
+    json_writer_begin_object(writer, "boot");
+    for (boot_phase_t phase = 0; phase < BOOT_PHASE_MAX; phase++) {
+        json_writer_uint(writer, boot_stat_phase_str(phase), boot_stat_get_ms(phase));
+    }
+    json_writer_end_object(writer);
+}
+
+static esp_err_t http_handle_status(httpd_req_t *req)
+{
+    json_writer_t writer;
+    char buf[256];
+
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/json"));
+
+    json_writer_init(&writer, req, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    http_task_write_status(&writer);
+    json_writer_end_object(&writer);
+
+    return json_writer_finish(&writer);
+}
 
-    cJSON *json = cJSON_CreateObject();
-    cJSON_AddStringToObject(json, "name", app_info.project_name);
-    cJSON_AddStringToObject(json, "version", app_info.version);
-    cJSON_AddStringToObject(json, "esp_idf", app_info.idf_ver);
-    cJSON_AddStringToObject(json, "compile_date", app_info.date);
-    cJSON_AddStringToObject(json, "compile_time", app_info.time);
-    cJSON_AddStringToObject(json, "elapsed", elapsed_str);
+//////////////////////////////////////////////////////////////////////
+// WebSocket
+// NOTE: ws_client_list は httpd のタスク (ハンドラと httpd_queue_work の
+// 関数) からしか変更しないので，ロックは不要
+static httpd_handle_t ws_server = NULL;
+static int ws_client_list[WS_CLIENT_MAX] = { -1, -1, -1, -1 };
+static uint32_t ws_client_count = 0;
+static QueueHandle_t ws_event_queue = NULL;
 
-    httpd_resp_sendstr(req, cJSON_PrintUnformatted(json));
+static void ws_client_add(int fd)
+{
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(ws_client_list); i++) {
+        if (ws_client_list[i] == fd) {
+            return;
+        }
+    }
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(ws_client_list); i++) {
+        if (ws_client_list[i] == -1) {
+            ws_client_list[i] = fd;
+            ws_client_count++;
+            return;
+        }
+    }
+    ESP_LOGW(TAG, "Too many WebSocket clients, events are not pushed to fd=%d.", fd);
+}
+
+static void ws_client_remove(uint32_t i)
+{
+    ws_client_list[i] = -1;
+    ws_client_count--;
+}
+
+static esp_err_t ws_send(httpd_req_t *req, const char *message)
+{
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)message,
+        .len = strlen(message),
+    };
+
+    return httpd_ws_send_frame(req, &frame);
+}
+
+// NOTE: httpd のタスクで実行される．message は malloc したもので，ここで解放する
+static void ws_broadcast(void *arg)
+{
+    char *message = (char *)arg;
+    httpd_ws_frame_t frame = {
+        .final = true,
+        .type = HTTPD_WS_TYPE_TEXT,
+        .payload = (uint8_t *)message,
+        .len = strlen(message),
+    };
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(ws_client_list); i++) {
+        if (ws_client_list[i] == -1) {
+            continue;
+        }
+        // NOTE: 切断されたクライアントは送信時に取り除く
+        if ((httpd_ws_get_fd_info(ws_server, ws_client_list[i]) != HTTPD_WS_CLIENT_WEBSOCKET) ||
+            (httpd_ws_send_frame_async(ws_server, ws_client_list[i], &frame) != ESP_OK)) {
+            ws_client_remove(i);
+        }
+    }
+    free(message);
+}
+
+static char *ws_status_message()
+{
+    json_writer_t writer;
+    char *buf = malloc(WS_STATUS_BUF_SIZE);
 
+    if (buf == NULL) {
+        return NULL;
+    }
+    json_writer_init(&writer, NULL, buf, WS_STATUS_BUF_SIZE);
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "type", "status");
+    json_writer_begin_object(&writer, "status");
+    http_task_write_status(&writer);
+    json_writer_end_object(&writer);
+    json_writer_end_object(&writer);
+
+    if (json_writer_finish(&writer) != ESP_OK) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+static char *ws_gpio_message(const gpio_task_event_t *event)
+{
+    json_writer_t writer;
+    char *buf = malloc(WS_FRAME_MAX);
+
+    if (buf == NULL) {
+        return NULL;
+    }
+    json_writer_init(&writer, NULL, buf, WS_FRAME_MAX);
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "type", (event->type == GPIO_TASK_EVENT_START) ? "state" : "pulse_done");
+    json_writer_begin_array(&writer, "gpio");
+    for (uint32_t i = 0; i < 64; i++) {
+        if (event->mask & (1ULL << i)) {
+            json_writer_uint(&writer, NULL, i);
+        }
+    }
+    json_writer_end_array(&writer);
+    json_writer_bool(&writer, "active", event->type == GPIO_TASK_EVENT_START);
+    json_writer_uint(&writer, "width_us", event->width_us);
+    json_writer_end_object(&writer);
+
+    if (json_writer_finish(&writer) != ESP_OK) {
+        free(buf);
+        return NULL;
+    }
+    return buf;
+}
+
+// NOTE: gpio_task のタスクから呼ばれるので，キューに積むだけにする
+static void ws_gpio_listener(const gpio_task_event_t *event)
+{
+    if (ws_client_count == 0) {
+        return;
+    }
+    xQueueSend(ws_event_queue, event, 0);
+}
+
+static void ws_push_task(void *param)
+{
+    gpio_task_event_t event;
+    char *message;
+
+    while (1) {
+        if (xQueueReceive(ws_event_queue, &event, WS_STATUS_INTERVAL_MS / portTICK_RATE_MS) == pdTRUE) {
+            message = ws_gpio_message(&event);
+        } else if (ws_client_count != 0) {
+            message = ws_status_message();
+        } else {
+            continue;
+        }
+        if (message == NULL) {
+            continue;
+        }
+        if (httpd_queue_work(ws_server, ws_broadcast, message) != ESP_OK) {
+            free(message);
+        }
+    }
+}
+
+static esp_err_t ws_process_cmd(httpd_req_t *req, const char *cmd_str)
+{
+    json_writer_t writer;
+    char buf[128];
+    char *message;
+    cJSON *json, *type, *gpio, *value;
+    uint32_t id = 0;
+    uint32_t gpio_num, width_us;
+    uint32_t retry_after_ms = 0;
+    esp_err_t result;
+    esp_err_t ret;
+
+    json = cJSON_Parse(cmd_str);
+    type = cJSON_GetObjectItem(json, "type");
+    if (!cJSON_IsString(type)) {
+        cJSON_Delete(json);
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    if (strcmp(type->valuestring, "status") == 0) {
+        cJSON_Delete(json);
+        message = ws_status_message();
+        if (message == NULL) {
+            return ESP_ERR_NO_MEM;
+        }
+        ret = ws_send(req, message);
+        free(message);
+        return ret;
+    }
+
+    value = cJSON_GetObjectItem(json, "id");
+    if (cJSON_IsNumber(value)) {
+        id = value->valueint;
+    }
+    if (strcmp(type->valuestring, "push") == 0) {
+        gpio = cJSON_GetObjectItem(json, "gpio");
+        value = cJSON_GetObjectItem(json, "width_us");
+        width_us = GPIO_TASK_DEFAULT_WIDTH_US;
+
+        retry_after_ms = client_admit(req);
+        if (retry_after_ms != 0) {
+            result = ESP_ERR_NO_MEM;
+        } else if (!cJSON_IsNumber(gpio) ||
+                   (gpio_api_uint(gpio->valuedouble, UINT8_MAX, &gpio_num) != ESP_OK) ||
+                   (cJSON_IsNumber(value) &&
+                    (gpio_api_uint(value->valuedouble, GPIO_TASK_MAX_WIDTH_US, &width_us) != ESP_OK))) {
+            result = ESP_ERR_INVALID_ARG;
+        } else {
+            result = gpio_task_push(gpio_num, width_us, &retry_after_ms);
+        }
+    } else {
+        result = ESP_ERR_NOT_SUPPORTED;
+    }
     cJSON_Delete(json);
 
+    json_writer_init(&writer, NULL, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "type", "result");
+    json_writer_uint(&writer, "id", id);
+    json_writer_str(&writer, "status", (result == ESP_OK) ? "OK" : "NG");
+    if (result != ESP_OK) {
+        json_writer_str(&writer, "error", esp_err_to_name(result));
+    }
+    if (retry_after_ms != 0) {
+        json_writer_uint(&writer, "retry_after_ms", retry_after_ms);
+    }
+    json_writer_end_object(&writer);
+    json_writer_finish(&writer);
+
+    return ws_send(req, buf);
+}
+
+static esp_err_t http_handle_ws(httpd_req_t *req)
+{
+    httpd_ws_frame_t frame;
+    uint8_t buf[WS_FRAME_MAX];
+
+    if (req->method == HTTP_GET) {
+        // NOTE: ハンドシェイクが完了した
+        ws_client_add(httpd_req_to_sockfd(req));
+        return ESP_OK;
+    }
+
+    memset(&frame, 0, sizeof(frame));
+    frame.payload = buf;
+    if (httpd_ws_recv_frame(req, &frame, sizeof(buf) - 1) != ESP_OK) {
+        return ESP_FAIL;
+    }
+    if (frame.type != HTTPD_WS_TYPE_TEXT) {
+        return ESP_OK;
+    }
+    buf[frame.len] = '\0';
+
+    if (ws_process_cmd(req, (const char *)buf) != ESP_OK) {
+        ESP_LOGW(TAG, "Failed to process WebSocket command.");
+    }
+
     return ESP_OK;
 }
 
@@ -185,6 +871,34 @@ static httpd_uri_t http_uri_api = {
     .user_ctx  = NULL
 };
 
+static httpd_uri_t http_uri_api_batch = {
+    .uri       = "/api/gpio/batch",
+    .method    = HTTP_POST,
+    .handler   = http_handle_api_batch,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_api_seq = {
+    .uri       = "/api/seq",
+    .method    = HTTP_POST,
+    .handler   = http_handle_api_seq,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_api_seq_abort = {
+    .uri       = "/api/seq",
+    .method    = HTTP_DELETE,
+    .handler   = http_handle_api_seq_abort,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_api_seq_status = {
+    .uri       = "/api/seq",
+    .method    = HTTP_GET,
+    .handler   = http_handle_api_seq_status,
+    .user_ctx  = NULL
+};
+
 static httpd_uri_t http_uri_status = {
     .uri       = "/status*",
     .method    = HTTP_GET,
@@ -192,6 +906,65 @@ static httpd_uri_t http_uri_status = {
     .user_ctx  = NULL
 };
 
+static httpd_uri_t http_uri_ota_redirect = {
+    .uri       = "/ota*",
+    .method    = HTTP_POST,
+    .handler   = http_handle_ota_redirect,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_ota_status_redirect = {
+    .uri       = "/ota*",
+    .method    = HTTP_GET,
+    .handler   = http_handle_bulk_redirect,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_capture_redirect = {
+    .uri       = "/capture*",
+    .method    = HTTP_GET,
+    .handler   = http_handle_bulk_redirect,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_capture_stop_redirect = {
+    .uri       = "/capture*",
+    .method    = HTTP_DELETE,
+    .handler   = http_handle_bulk_redirect,
+    .user_ctx  = NULL
+};
+
+static httpd_uri_t http_uri_ws = {
+    .uri          = "/ws",
+    .method       = HTTP_GET,
+    .handler      = http_handle_ws,
+    .user_ctx     = NULL,
+    .is_websocket = true
+};
+
+
+// NOTE: esp_http_server は 1 つのタスクで全リクエストを順に処理するので，
+// OTA のように数十秒かかるハンドラは優先度の低い別インスタンスに分けて，
+// API の応答が待たされないようにする
+static httpd_handle_t bulk_server_start(void)
+{
+    httpd_handle_t server = NULL;
+    httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.uri_match_fn = httpd_uri_match_wildcard;
+    config.server_port = BULK_PORT;
+    config.ctrl_port = BULK_CTRL_PORT;
+    config.task_priority = BULK_TASK_PRIORITY;
+    config.max_open_sockets = BULK_SOCKET_MAX;
+    config.max_uri_handlers = 4;
+    config.lru_purge_enable = true;
+
+    ESP_ERROR_CHECK(httpd_start(&server, &config));
+
+    http_ota_handler_install(server);
+    http_capture_handler_install(server);
+
+    return server;
+}
 
 httpd_handle_t http_task_start(void)
 {
@@ -200,14 +973,34 @@ httpd_handle_t http_task_start(void)
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
     config.uri_match_fn = httpd_uri_match_wildcard;
+    config.max_uri_handlers = 24;
 
     ESP_ERROR_CHECK(httpd_start(&server, &config));
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_app));
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_app_redirect));
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_api));
-    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_status));
-
-    http_ota_handler_install(server);
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_app));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_app_redirect));
+    // NOTE: 先に登録したものから照合されるので，/api* より前に登録する
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_api_seq_status));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_api));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_api_seq));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_api_seq_abort));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_api_batch));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_status));
+    ESP_ERROR_CHECK(metrics_register_uri_handler(server, &http_uri_ws));
+    // NOTE: 転送先と同じ URI なので，計測は転送先のサーバ側だけで行う
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_ota_redirect));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_ota_status_redirect));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_capture_redirect));
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_capture_stop_redirect));
+    http_log_handler_install(server);
+    http_debug_handler_install(server);
+    metrics_handler_install(server);
+
+    bulk_server_start();
+
+    ws_server = server;
+    ws_event_queue = xQueueCreate(WS_EVENT_QUEUE_SIZE, sizeof(gpio_task_event_t));
+    xTaskCreate(ws_push_task, "ws_push_task", 3072, NULL, 5, NULL);
+    ESP_ERROR_CHECK(gpio_task_add_listener(ws_gpio_listener));
 
     return server;
 }
@@ -1,4 +1,8 @@
 #include "esp_http_server.h"
 
+struct json_writer;
+
 httpd_handle_t http_task_start(void);
+// NOTE: /status と同じ内容を書き出す (WebSocket・MQTT でも使う)
+void http_task_write_status(struct json_writer *writer);
 void http_task_sop(httpd_handle_t server);
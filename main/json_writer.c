@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "app.h"
+#include "json_writer.h"
+
+static void json_writer_flush(json_writer_t *writer)
+{
+    if ((writer->req == NULL) || (writer->len == 0)) {
+        return;
+    }
+    if (httpd_resp_send_chunk(writer->req, writer->buf, writer->len) != ESP_OK) {
+        writer->overflow = true;
+    }
+    writer->len = 0;
+}
+
+static void json_writer_putc(json_writer_t *writer, char c)
+{
+    if (writer->len == writer->size) {
+        json_writer_flush(writer);
+    }
+    if (writer->len == writer->size) {
+        writer->overflow = true;
+        return;
+    }
+    writer->buf[writer->len++] = c;
+}
+
+static void json_writer_puts(json_writer_t *writer, const char *str)
+{
+    while (*str != '\0') {
+        json_writer_putc(writer, *str++);
+    }
+}
+
+static void json_writer_quote(json_writer_t *writer, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+
+    json_writer_putc(writer, '"');
+    for (; *str != '\0'; str++) {
+        unsigned char c = (unsigned char)*str;
+
+        if ((c == '"') || (c == '\\')) {
+            json_writer_putc(writer, '\\');
+            json_writer_putc(writer, c);
+        } else if (c < 0x20) {
+            json_writer_puts(writer, "\\u00");
+            json_writer_putc(writer, hex[c >> 4]);
+            json_writer_putc(writer, hex[c & 0xF]);
+        } else {
+            json_writer_putc(writer, c);
+        }
+    }
+    json_writer_putc(writer, '"');
+}
+
+static void json_writer_key(json_writer_t *writer, const char *key)
+{
+    if (writer->need_comma) {
+        json_writer_putc(writer, ',');
+    }
+    if (key != NULL) {
+        json_writer_quote(writer, key);
+        json_writer_putc(writer, ':');
+    }
+    writer->need_comma = true;
+}
+
+void json_writer_init(json_writer_t *writer, httpd_req_t *req, char *buf, size_t size)
+{
+    writer->req = req;
+    writer->buf = buf;
+    // NOTE: req が無い場合は最後に NUL 終端できるよう 1 バイト残す
+    writer->size = (req == NULL) ? (size - 1) : size;
+    writer->len = 0;
+    writer->need_comma = false;
+    writer->overflow = false;
+}
+
+void json_writer_begin_object(json_writer_t *writer, const char *key)
+{
+    json_writer_key(writer, key);
+    json_writer_putc(writer, '{');
+    writer->need_comma = false;
+}
+
+void json_writer_end_object(json_writer_t *writer)
+{
+    json_writer_putc(writer, '}');
+    writer->need_comma = true;
+}
+
+void json_writer_begin_array(json_writer_t *writer, const char *key)
+{
+    json_writer_key(writer, key);
+    json_writer_putc(writer, '[');
+    writer->need_comma = false;
+}
+
+void json_writer_end_array(json_writer_t *writer)
+{
+    json_writer_putc(writer, ']');
+    writer->need_comma = true;
+}
+
+void json_writer_str(json_writer_t *writer, const char *key, const char *value)
+{
+    json_writer_key(writer, key);
+    json_writer_quote(writer, value);
+}
+
+void json_writer_int(json_writer_t *writer, const char *key, int32_t value)
+{
+    char buf[12];
+
+    snprintf(buf, sizeof(buf), "%d", value);
+    json_writer_key(writer, key);
+    json_writer_puts(writer, buf);
+}
+
+void json_writer_uint(json_writer_t *writer, const char *key, uint32_t value)
+{
+    char buf[12];
+
+    snprintf(buf, sizeof(buf), "%u", value);
+    json_writer_key(writer, key);
+    json_writer_puts(writer, buf);
+}
+
+void json_writer_bool(json_writer_t *writer, const char *key, bool value)
+{
+    json_writer_key(writer, key);
+    json_writer_puts(writer, value ? "true" : "false");
+}
+
+void json_writer_null(json_writer_t *writer, const char *key)
+{
+    json_writer_key(writer, key);
+    json_writer_puts(writer, "null");
+}
+
+esp_err_t json_writer_finish(json_writer_t *writer)
+{
+    if (writer->req == NULL) {
+        writer->buf[writer->len] = '\0';
+    } else {
+        json_writer_flush(writer);
+        httpd_resp_send_chunk(writer->req, NULL, 0);
+    }
+
+    return writer->overflow ? ESP_ERR_INVALID_SIZE : ESP_OK;
+}
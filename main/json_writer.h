@@ -0,0 +1,24 @@
+#include "esp_http_server.h"
+
+// NOTE: ヒープを使わずに JSON を書き出す．req を指定するとバッファが
+// 一杯になるたびに httpd_resp_send_chunk で送信する．
+typedef struct json_writer {
+    httpd_req_t *req;
+    char *buf;
+    size_t size;
+    size_t len;
+    bool need_comma;
+    bool overflow;
+} json_writer_t;
+
+void json_writer_init(json_writer_t *writer, httpd_req_t *req, char *buf, size_t size);
+void json_writer_begin_object(json_writer_t *writer, const char *key);
+void json_writer_end_object(json_writer_t *writer);
+void json_writer_begin_array(json_writer_t *writer, const char *key);
+void json_writer_end_array(json_writer_t *writer);
+void json_writer_str(json_writer_t *writer, const char *key, const char *value);
+void json_writer_int(json_writer_t *writer, const char *key, int32_t value);
+void json_writer_uint(json_writer_t *writer, const char *key, uint32_t value);
+void json_writer_bool(json_writer_t *writer, const char *key, bool value);
+void json_writer_null(json_writer_t *writer, const char *key);
+esp_err_t json_writer_finish(json_writer_t *writer);
@@ -0,0 +1,105 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+
+#include "app.h"
+#include "link_stat.h"
+
+#define SAMPLE_SIZE     64
+#define RTT_TIMEOUT     0xFFFF
+#define LOSSY_WINDOW    8   // 直近この回数の中に損失があれば不安定とみなす
+
+// NOTE: 直近 SAMPLE_SIZE 回分の RTT をリングバッファに保持する
+static uint16_t sample_list[SAMPLE_SIZE];
+static uint32_t sample_head = 0;
+static uint32_t sample_count = 0;
+static uint32_t probe_interval_ms = 0;
+static portMUX_TYPE sample_lock = portMUX_INITIALIZER_UNLOCKED;
+
+void link_stat_record(uint32_t rtt_ms, bool timeout)
+{
+    portENTER_CRITICAL(&sample_lock);
+    sample_list[sample_head] = timeout ? RTT_TIMEOUT :
+        ((rtt_ms < RTT_TIMEOUT) ? rtt_ms : (RTT_TIMEOUT - 1));
+    sample_head = (sample_head + 1) % SAMPLE_SIZE;
+    if (sample_count < SAMPLE_SIZE) {
+        sample_count++;
+    }
+    portEXIT_CRITICAL(&sample_lock);
+}
+
+void link_stat_set_interval(uint32_t interval_ms)
+{
+    probe_interval_ms = interval_ms;
+}
+
+bool link_stat_is_lossy(void)
+{
+    bool lossy = false;
+
+    portENTER_CRITICAL(&sample_lock);
+    for (uint32_t i = 1; (i <= LOSSY_WINDOW) && (i <= sample_count); i++) {
+        if (sample_list[(sample_head + SAMPLE_SIZE - i) % SAMPLE_SIZE] == RTT_TIMEOUT) {
+            lossy = true;
+            break;
+        }
+    }
+    portEXIT_CRITICAL(&sample_lock);
+
+    return lossy;
+}
+
+void link_stat_get(link_stat_t *stat)
+{
+    uint16_t sample_copy[SAMPLE_SIZE];
+    uint16_t rtt_list[SAMPLE_SIZE];
+    uint32_t count, rtt_count = 0;
+    uint32_t sum = 0, jitter_sum = 0, jitter_count = 0;
+    uint16_t prev = RTT_TIMEOUT;
+
+    portENTER_CRITICAL(&sample_lock);
+    count = sample_count;
+    for (uint32_t i = 0; i < count; i++) {
+        // NOTE: 古い順に並べ替えてコピーする
+        sample_copy[i] = sample_list[(sample_head + SAMPLE_SIZE - count + i) % SAMPLE_SIZE];
+    }
+    portEXIT_CRITICAL(&sample_lock);
+
+    memset(stat, 0, sizeof(link_stat_t));
+    stat->sample_count = count;
+    stat->probe_interval_ms = probe_interval_ms;
+    if (count == 0) {
+        return;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        uint16_t rtt = sample_copy[i];
+
+        if (rtt == RTT_TIMEOUT) {
+            continue;
+        }
+        if (prev != RTT_TIMEOUT) {
+            jitter_sum += (rtt > prev) ? (rtt - prev) : (prev - rtt);
+            jitter_count++;
+        }
+        prev = rtt;
+        sum += rtt;
+
+        // NOTE: パーセンタイルを求めるため，挿入ソートしておく
+        uint32_t j = rtt_count++;
+        while ((j > 0) && (rtt_list[j - 1] > rtt)) {
+            rtt_list[j] = rtt_list[j - 1];
+            j--;
+        }
+        rtt_list[j] = rtt;
+    }
+
+    stat->loss_permille = (count - rtt_count) * 1000 / count;
+    if (rtt_count == 0) {
+        return;
+    }
+    stat->rtt_min_ms = rtt_list[0];
+    stat->rtt_avg_ms = sum / rtt_count;
+    stat->rtt_p95_ms = rtt_list[(rtt_count * 95 - 1) / 100];
+    stat->jitter_ms = (jitter_count == 0) ? 0 : (jitter_sum / jitter_count);
+}
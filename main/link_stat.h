@@ -0,0 +1,17 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct link_stat {
+    uint32_t sample_count;
+    uint32_t loss_permille;     // 損失率 (0.1% 単位)
+    uint32_t rtt_min_ms;
+    uint32_t rtt_avg_ms;
+    uint32_t rtt_p95_ms;
+    uint32_t jitter_ms;         // 連続する RTT の差の平均
+    uint32_t probe_interval_ms;
+} link_stat_t;
+
+void link_stat_record(uint32_t rtt_ms, bool timeout);
+void link_stat_set_interval(uint32_t interval_ms);
+bool link_stat_is_lossy(void);
+void link_stat_get(link_stat_t *stat);
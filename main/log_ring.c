@@ -0,0 +1,174 @@
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_attr.h"
+#include "esp_ota_ops.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "log_ring.h"
+
+#define SEQ_INVALID         0xFFFFFFFF
+#define RING_MAGIC          0x4c524e47  // "LRNG"
+#define RING_IMAGE_SIZE     8           // app_elf_sha256 の先頭
+#define CONSOLE_INTERVAL_MS 100
+#define CONSOLE_BUF_SIZE    192
+
+static const char level_char[] = { 'E', 'W', 'I' };
+
+// NOTE: 書き手は番号を fetch_add で確保してから記録を埋め，最後に seq を書く．
+// 読み手は seq を前後 2 回読み，一致しなければ書き込み途中か上書きされたとみなす．
+// パニックやウォッチドッグ，ブラウンアウトでリセットされても残るよう，起動時に
+// 初期化されない RTC の低速メモリに置く．同じイメージが動いていれば fmt もそのまま使える
+static RTC_NOINIT_ATTR log_ring_record_t ring[LOG_RING_SIZE];
+static RTC_NOINIT_ATTR uint32_t write_seq;
+static RTC_NOINIT_ATTR uint32_t ring_magic;
+static RTC_NOINIT_ATTR uint8_t ring_image[RING_IMAGE_SIZE];
+static uint32_t boot_seq = 0;   // この起動で最初に書いた番号
+
+void log_ring_write(log_ring_level_t level, const char *fmt, uint32_t argc, ...)
+{
+    uint32_t seq = __atomic_fetch_add(&write_seq, 1, __ATOMIC_RELAXED);
+    log_ring_record_t *record = &(ring[seq % LOG_RING_SIZE]);
+    va_list ap;
+
+    __atomic_store_n(&(record->seq), SEQ_INVALID, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+
+    record->time_ms = (uint32_t)(esp_timer_get_time() / 1000);
+    record->fmt = fmt;
+    record->level = level;
+    record->argc = (argc < LOG_RING_ARG_MAX) ? argc : LOG_RING_ARG_MAX;
+
+    va_start(ap, argc);
+    for (uint32_t i = 0; i < record->argc; i++) {
+        record->arg_list[i] = va_arg(ap, uintptr_t);
+    }
+    va_end(ap);
+
+    __atomic_store_n(&(record->seq), seq, __ATOMIC_RELEASE);
+}
+
+uint32_t log_ring_head(void)
+{
+    return __atomic_load_n(&write_seq, __ATOMIC_ACQUIRE);
+}
+
+bool log_ring_read(uint32_t seq, log_ring_record_t *record)
+{
+    const log_ring_record_t *slot = &(ring[seq % LOG_RING_SIZE]);
+
+    // NOTE: 書き込み途中や捨てた記録と区別が付かないので，この番号の記録は読めない
+    if (seq == SEQ_INVALID) {
+        return false;
+    }
+    if (__atomic_load_n(&(slot->seq), __ATOMIC_ACQUIRE) != seq) {
+        return false;
+    }
+    *record = *slot;
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&(slot->seq), __ATOMIC_RELAXED) == seq;
+}
+
+int log_ring_format(const log_ring_record_t *record, char *buf, size_t size)
+{
+    const uintptr_t *arg = record->arg_list;
+    int len;
+
+    len = snprintf(buf, size, "%c (%u) %s: ",
+                   level_char[record->level], record->time_ms, TAG);
+    if ((len < 0) || (len >= size)) {
+        buf[0] = '\0';
+        return 0;
+    }
+    // NOTE: 引数は全てポインタ幅なので，余分に渡しても書式が使う分だけ読まれる
+    len += snprintf(buf + len, size - len, record->fmt,
+                    arg[0], arg[1], arg[2], arg[3], arg[4], arg[5]);
+    if (len >= (size - 1)) {
+        len = size - 2;
+    }
+    buf[len++] = '\n';
+    buf[len] = '\0';
+
+    return len;
+}
+
+// NOTE: seq から head までを out に書き出し，次に書き出す番号を返す．
+// 追い付けずに上書きされた分は件数だけを出力する
+static uint32_t log_console_drain(uint32_t seq, FILE *out)
+{
+    log_ring_record_t record;
+    char buf[CONSOLE_BUF_SIZE];
+    uint32_t head = log_ring_head();
+
+    if ((head - seq) > LOG_RING_SIZE) {
+        fprintf(out, "W %s: %u log records lost.\n", TAG, head - seq - LOG_RING_SIZE);
+        seq = head - LOG_RING_SIZE;
+    }
+    for (; seq != head; seq++) {
+        if (!log_ring_read(seq, &record)) {
+            // NOTE: 書き込み途中なら次の周期でもう一度読む
+            if ((head - seq) < (LOG_RING_SIZE / 2)) {
+                break;
+            }
+            continue;
+        }
+        log_ring_format(&record, buf, sizeof(buf));
+        fputs(buf, out);
+    }
+    return seq;
+}
+
+// NOTE: シリアルケーブルが繋がっていなくても呼び出し元を待たせないよう，
+// 最低優先度のタスクでまとめて出力する
+static void log_console_task(void *param)
+{
+    uint32_t seq = boot_seq;    // NOTE: 前回の起動の記録は出力済み
+
+    while (1) {
+        vTaskDelay(CONSOLE_INTERVAL_MS / portTICK_RATE_MS);
+        seq = log_console_drain(seq, stdout);
+    }
+}
+
+// NOTE: 電源投入直後やイメージが変わった後は中身が不定なので捨てる．残っていても，
+// 位置と番号が合わないものやリセットで書き込みが途切れたものは読めないようにする
+static void log_ring_restore(void)
+{
+    const uint8_t *image = esp_ota_get_app_description()->app_elf_sha256;
+    uint32_t head = write_seq;
+    bool valid = (ring_magic == RING_MAGIC) && (memcmp(ring_image, image, RING_IMAGE_SIZE) == 0);
+    uint32_t count = 0;
+
+    for (uint32_t i = 0; i < LOG_RING_SIZE; i++) {
+        log_ring_record_t *record = &(ring[i]);
+
+        if (valid && (record->seq != SEQ_INVALID) && ((record->seq % LOG_RING_SIZE) == i) &&
+            ((head - record->seq - 1) < LOG_RING_SIZE) &&
+            (record->level <= LOG_RING_INFO) && (record->argc <= LOG_RING_ARG_MAX)) {
+            count++;
+            continue;
+        }
+        record->seq = SEQ_INVALID;
+    }
+    if (!valid) {
+        write_seq = 0;
+        memcpy(ring_image, image, RING_IMAGE_SIZE);
+        ring_magic = RING_MAGIC;
+    }
+    boot_seq = write_seq;
+
+    if (count != 0) {
+        LOG_RING_W("%u log records before #%u are from the previous boot.", count, boot_seq);
+    }
+}
+
+void log_ring_start(void)
+{
+    log_ring_restore();
+    xTaskCreate(log_console_task, "log_console_task", 3072, NULL, tskIDLE_PRIORITY + 1, NULL);
+}
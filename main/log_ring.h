@@ -0,0 +1,53 @@
+#ifndef LOG_RING_H
+#define LOG_RING_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE: 書式化せずに書式文字列のポインタと引数をそのまま RTC メモリのリングバッファに積み，
+// 書式化は低優先度のタスク (シリアル出力) か /log の読み出し時に行う．
+// 引数はポインタ幅 (uintptr_t) の値として保存するので，次の制約がある．
+// - 引数は LOG_RING_ARG_MAX 個まで，いずれも整数かポインタ (int64_t や double は不可)
+// - %s に渡す文字列は，書式化されるまで残っているもの (文字列リテラルなど) に限る
+
+#define LOG_RING_SIZE       128     // 記録数 (2 のべき乗)．ESP32 では 40 バイト x 128 が RTC の低速メモリに載る
+#define LOG_RING_ARG_MAX    6
+
+typedef enum {
+    LOG_RING_ERROR = 0,
+    LOG_RING_WARN,
+    LOG_RING_INFO,
+} log_ring_level_t;
+
+typedef struct log_ring_record {
+    uint32_t seq;
+    uint32_t time_ms;
+    const char *fmt;
+    uint8_t level;
+    uint8_t argc;
+    uintptr_t arg_list[LOG_RING_ARG_MAX];
+} log_ring_record_t;
+
+// NOTE: IP2STR のように複数の引数に展開されるマクロも数えられるよう，一段挟む
+#define LOG_RING_NARG(...)  LOG_RING_NARG_X(0, ##__VA_ARGS__, 6, 5, 4, 3, 2, 1, 0)
+#define LOG_RING_NARG_X(...) LOG_RING_NARG_(__VA_ARGS__)
+#define LOG_RING_NARG_(_0, _1, _2, _3, _4, _5, _6, N, ...) N
+
+#define LOG_RING_E(fmt, ...) \
+    log_ring_write(LOG_RING_ERROR, fmt, LOG_RING_NARG(__VA_ARGS__), ##__VA_ARGS__)
+#define LOG_RING_W(fmt, ...) \
+    log_ring_write(LOG_RING_WARN, fmt, LOG_RING_NARG(__VA_ARGS__), ##__VA_ARGS__)
+#define LOG_RING_I(fmt, ...) \
+    log_ring_write(LOG_RING_INFO, fmt, LOG_RING_NARG(__VA_ARGS__), ##__VA_ARGS__)
+
+void log_ring_start(void);
+void log_ring_write(log_ring_level_t level, const char *fmt, uint32_t argc, ...)
+    __attribute__((format(printf, 2, 4)));
+// NOTE: 次に書き込まれる記録の番号
+uint32_t log_ring_head(void);
+// NOTE: 上書き済みや書き込み途中なら false
+bool log_ring_read(uint32_t seq, log_ring_record_t *record);
+// NOTE: "I (12345) WIFI-IO: message" の形式にする．戻り値は書き込んだ長さ
+int log_ring_format(const log_ring_record_t *record, char *buf, size_t size);
+
+#endif
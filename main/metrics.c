@@ -0,0 +1,198 @@
+#include <stdio.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "metrics.h"
+#include "boot_stat.h"
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define ROUTE_MAX   24
+
+// NOTE: 各ハンドラの処理時間のヒストグラム (上限, us)
+static const uint32_t bucket_le_us[] = {
+    1000, 5000, 10000, 50000, 100000, 500000, 1000000, 5000000,
+};
+
+typedef struct metrics_route {
+    httpd_uri_t uri;
+    esp_err_t (*handler)(httpd_req_t *r);
+    void *user_ctx;
+    uint32_t count;
+    uint64_t sum_us; // NOTE: 32 bit では約 71 分で一周する．route_lock の中で読み書きする
+    uint32_t bucket[ARRAY_SIZE_OF(bucket_le_us) + 1];
+} metrics_route_t;
+
+typedef struct metrics_counter_def {
+    const char *name;
+    const char *help;
+} metrics_counter_def_t;
+
+static const metrics_counter_def_t counter_def[METRICS_COUNTER_MAX] = {
+    [METRICS_OTA_RECV_BYTES] = { "ota_recv_bytes_total", "Bytes received by OTA." },
+    [METRICS_OTA_WRITE_BYTES] = { "ota_write_bytes_total", "Bytes written to flash by OTA." },
+    [METRICS_WIFI_CONNECT] = { "wifi_connect_total", "Number of successful WiFi connections." },
+    [METRICS_WIFI_DISCONNECT] = { "wifi_disconnect_total", "Number of WiFi disconnections." },
+    [METRICS_HTTP_THROTTLED] = { "http_throttled_total", "Number of requests answered with 429." },
+};
+
+static metrics_route_t route_list[ROUTE_MAX];
+static uint32_t route_count = 0;
+static uint32_t counter_list[METRICS_COUNTER_MAX];
+// NOTE: ESP32 には 64 bit のアトミック命令が無いので，sum_us だけはロックで守る
+static portMUX_TYPE route_lock = portMUX_INITIALIZER_UNLOCKED;
+
+// NOTE: 複数のタスクから呼ばれるので，ロックを使わずアトミックに加算する
+void metrics_count(metrics_counter_t counter, uint32_t value)
+{
+    __atomic_add_fetch(&(counter_list[counter]), value, __ATOMIC_RELAXED);
+}
+
+static esp_err_t metrics_handler(httpd_req_t *req)
+{
+    metrics_route_t *route = (metrics_route_t *)req->user_ctx;
+    int64_t start_time = esp_timer_get_time();
+    uint32_t elapsed_us;
+    uint32_t i;
+    esp_err_t ret;
+
+    req->user_ctx = route->user_ctx;
+    ret = route->handler(req);
+    elapsed_us = (uint32_t)(esp_timer_get_time() - start_time);
+    // NOTE: 全ルートがここを通るので，起動後最初の応答もここで記録する
+    boot_stat_mark(BOOT_PHASE_FIRST_REQUEST);
+
+    for (i = 0; i < ARRAY_SIZE_OF(bucket_le_us); i++) {
+        if (elapsed_us <= bucket_le_us[i]) {
+            break;
+        }
+    }
+    __atomic_add_fetch(&(route->bucket[i]), 1, __ATOMIC_RELAXED);
+    portENTER_CRITICAL(&route_lock);
+    route->sum_us += elapsed_us;
+    portEXIT_CRITICAL(&route_lock);
+    __atomic_add_fetch(&(route->count), 1, __ATOMIC_RELAXED);
+
+    return ret;
+}
+
+// NOTE: ハンドラを計測用のハンドラで包んで登録する
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri)
+{
+    metrics_route_t *route;
+
+    if (route_count == ARRAY_SIZE_OF(route_list)) {
+        ESP_LOGW(TAG, "Too many routes for metrics (%s).", uri->uri);
+        return httpd_register_uri_handler(server, uri);
+    }
+    route = &(route_list[route_count++]);
+
+    route->uri = *uri;
+    route->handler = uri->handler;
+    route->user_ctx = uri->user_ctx;
+    route->uri.handler = metrics_handler;
+    route->uri.user_ctx = route;
+
+    return httpd_register_uri_handler(server, &(route->uri));
+}
+
+static const char *method_str(httpd_method_t method)
+{
+    switch (method) {
+    case HTTP_GET:
+        return "GET";
+    case HTTP_POST:
+        return "POST";
+    case HTTP_PUT:
+        return "PUT";
+    case HTTP_DELETE:
+        return "DELETE";
+    default:
+        return "?";
+    }
+}
+
+static void metrics_send_route(httpd_req_t *req, const metrics_route_t *route)
+{
+    char buf[160];
+    char label[64];
+    uint32_t cumulative = 0;
+    uint64_t sum_us;
+
+    snprintf(label, sizeof(label), "uri=\"%s\",method=\"%s\"",
+             route->uri.uri, method_str(route->uri.method));
+
+    snprintf(buf, sizeof(buf), "http_requests_total{%s} %u\n", label, route->count);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    for (uint32_t i = 0; i < ARRAY_SIZE_OF(bucket_le_us); i++) {
+        cumulative += route->bucket[i];
+        snprintf(buf, sizeof(buf), "http_request_duration_seconds_bucket{%s,le=\"%u.%03u\"} %u\n",
+                 label, bucket_le_us[i] / 1000000, (bucket_le_us[i] / 1000) % 1000, cumulative);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+    cumulative += route->bucket[ARRAY_SIZE_OF(bucket_le_us)];
+    snprintf(buf, sizeof(buf), "http_request_duration_seconds_bucket{%s,le=\"+Inf\"} %u\n",
+             label, cumulative);
+    httpd_resp_sendstr_chunk(req, buf);
+
+    portENTER_CRITICAL(&route_lock);
+    sum_us = route->sum_us;
+    portEXIT_CRITICAL(&route_lock);
+    snprintf(buf, sizeof(buf), "http_request_duration_seconds_sum{%s} %u.%06u\n",
+             label, (uint32_t)(sum_us / 1000000), (uint32_t)(sum_us % 1000000));
+    httpd_resp_sendstr_chunk(req, buf);
+    snprintf(buf, sizeof(buf), "http_request_duration_seconds_count{%s} %u\n",
+             label, cumulative);
+    httpd_resp_sendstr_chunk(req, buf);
+}
+
+static esp_err_t http_handle_metrics(httpd_req_t *req)
+{
+    char buf[128];
+
+    ESP_ERROR_CHECK(httpd_resp_set_type(req, "text/plain; version=0.0.4"));
+
+    httpd_resp_sendstr_chunk(req, "# TYPE http_requests_total counter\n");
+    httpd_resp_sendstr_chunk(req, "# TYPE http_request_duration_seconds histogram\n");
+    for (uint32_t i = 0; i < route_count; i++) {
+        metrics_send_route(req, &(route_list[i]));
+    }
+
+    for (uint32_t i = 0; i < METRICS_COUNTER_MAX; i++) {
+        snprintf(buf, sizeof(buf), "# HELP %s %s\n# TYPE %s counter\n%s %u\n",
+                 counter_def[i].name, counter_def[i].help,
+                 counter_def[i].name, counter_def[i].name, counter_list[i]);
+        httpd_resp_sendstr_chunk(req, buf);
+    }
+
+    snprintf(buf, sizeof(buf), "# TYPE heap_free_bytes gauge\nheap_free_bytes %u\n",
+             esp_get_free_heap_size());
+    httpd_resp_sendstr_chunk(req, buf);
+    snprintf(buf, sizeof(buf), "# TYPE heap_min_free_bytes gauge\nheap_min_free_bytes %u\n",
+             esp_get_minimum_free_heap_size());
+    httpd_resp_sendstr_chunk(req, buf);
+    snprintf(buf, sizeof(buf), "# TYPE uptime_seconds counter\nuptime_seconds %u\n",
+             (uint32_t)(esp_timer_get_time() / 1000000));
+    httpd_resp_sendstr_chunk(req, buf);
+
+    httpd_resp_sendstr_chunk(req, NULL);
+
+    return ESP_OK;
+}
+
+static httpd_uri_t http_uri_metrics = {
+    .uri       = "/metrics",
+    .method    = HTTP_GET,
+    .handler   = http_handle_metrics,
+    .user_ctx  = NULL
+};
+
+void metrics_handler_install(httpd_handle_t server)
+{
+    ESP_ERROR_CHECK(httpd_register_uri_handler(server, &http_uri_metrics));
+}
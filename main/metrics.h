@@ -0,0 +1,14 @@
+#include "esp_http_server.h"
+
+typedef enum {
+    METRICS_OTA_RECV_BYTES,
+    METRICS_OTA_WRITE_BYTES,
+    METRICS_WIFI_CONNECT,
+    METRICS_WIFI_DISCONNECT,
+    METRICS_HTTP_THROTTLED,
+    METRICS_COUNTER_MAX,
+} metrics_counter_t;
+
+void metrics_count(metrics_counter_t counter, uint32_t value);
+esp_err_t metrics_register_uri_handler(httpd_handle_t server, const httpd_uri_t *uri);
+void metrics_handler_install(httpd_handle_t server);
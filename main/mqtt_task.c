@@ -0,0 +1,348 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
+#include "mqtt_client.h"
+
+#include "app.h"
+#include "mqtt_task.h"
+#include "gpio_task.h"
+#include "gpio_seq.h"
+#include "gpio_api.h"
+#include "http_task.h"
+#include "json_writer.h"
+#include "link_stat.h"
+#include "wifi_task.h"
+#include "wifi_config.h"
+// wifi_config.h may define followings to enable MQTT.
+// #define MQTT_BROKER_URI "mqtt://192.168.0.10"  // MQTT broker
+
+#define MQTT_TOPIC_ROOT         "esp32-wifi-io"
+#define MQTT_TOPIC_SIZE         64
+#define MQTT_CMD_BUF_SIZE       1024
+#define MQTT_STATUS_BUF_SIZE    2048
+#define MQTT_EVENT_BUF_SIZE     512
+#define MQTT_EVENT_QUEUE_SIZE   16
+#define MQTT_BATCH_MS           100     // パルス完了はこの間まとめてから送る
+#define MQTT_STATUS_INTERVAL_MS 30000
+#define MQTT_LINK_INTERVAL_MS   10000
+#define MQTT_KEEPALIVE_SEC      30
+
+#ifdef MQTT_BROKER_URI
+static esp_mqtt_client_handle_t mqtt_client = NULL;
+static QueueHandle_t mqtt_event_queue = NULL;
+static char topic_prefix[MQTT_TOPIC_SIZE];     // esp32-wifi-io/<ID>
+static char lwt_topic[MQTT_TOPIC_SIZE];
+static bool client_started = false;
+#endif
+static bool mqtt_connected = false;
+static uint32_t connect_count = 0;
+static uint32_t received_count = 0;
+static uint32_t published_count = 0;
+
+#ifdef MQTT_BROKER_URI
+static void mqtt_publish(const char *name, const char *data, bool retain)
+{
+    char topic[MQTT_TOPIC_SIZE];
+
+    if (!mqtt_connected) {
+        return;
+    }
+    snprintf(topic, sizeof(topic), "%s/%s", topic_prefix, name);
+    if (esp_mqtt_client_publish(mqtt_client, topic, data, 0, 0, retain) >= 0) {
+        published_count++;
+    }
+}
+
+static void mqtt_publish_result(const char *cmd, esp_err_t result, uint32_t retry_after_ms)
+{
+    json_writer_t writer;
+    char buf[128];
+
+    json_writer_init(&writer, NULL, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_str(&writer, "cmd", cmd);
+    json_writer_str(&writer, "status", (result == ESP_OK) ? "OK" : "NG");
+    if (result != ESP_OK) {
+        json_writer_str(&writer, "error", esp_err_to_name(result));
+    }
+    if (retry_after_ms != 0) {
+        json_writer_uint(&writer, "retry_after_ms", retry_after_ms);
+    }
+    json_writer_end_object(&writer);
+    json_writer_finish(&writer);
+
+    mqtt_publish("result", buf, false);
+}
+
+static void mqtt_publish_status()
+{
+    json_writer_t writer;
+    char *buf = malloc(MQTT_STATUS_BUF_SIZE);
+
+    if (buf == NULL) {
+        return;
+    }
+    json_writer_init(&writer, NULL, buf, MQTT_STATUS_BUF_SIZE);
+    json_writer_begin_object(&writer, NULL);
+    http_task_write_status(&writer);
+    json_writer_end_object(&writer);
+    if (json_writer_finish(&writer) == ESP_OK) {
+        // NOTE: 後から購読したコントローラにもすぐ状態が分かるよう retain する
+        mqtt_publish("status", buf, true);
+    }
+    free(buf);
+}
+
+static void mqtt_publish_link()
+{
+    json_writer_t writer;
+    link_stat_t link_stat;
+    char buf[256];
+
+    link_stat_get(&link_stat);
+    json_writer_init(&writer, NULL, buf, sizeof(buf));
+    json_writer_begin_object(&writer, NULL);
+    json_writer_uint(&writer, "sample_count", link_stat.sample_count);
+    json_writer_uint(&writer, "loss_permille", link_stat.loss_permille);
+    json_writer_uint(&writer, "rtt_min_ms", link_stat.rtt_min_ms);
+    json_writer_uint(&writer, "rtt_avg_ms", link_stat.rtt_avg_ms);
+    json_writer_uint(&writer, "rtt_p95_ms", link_stat.rtt_p95_ms);
+    json_writer_uint(&writer, "jitter_ms", link_stat.jitter_ms);
+    json_writer_uint(&writer, "probe_interval_ms", link_stat.probe_interval_ms);
+    json_writer_end_object(&writer);
+    json_writer_finish(&writer);
+
+    mqtt_publish("link", buf, false);
+}
+
+// NOTE: <prefix>/cmd/ 以降の名前と本体 (NUL 終端済み) を受け取る
+static void mqtt_process_cmd(const char *cmd, const char *data)
+{
+    uint32_t retry_after_ms = 0;
+    esp_err_t result;
+
+    received_count++;
+
+    if (strncmp(cmd, "gpio/", 5) == 0) {
+        uint32_t width_us = (data[0] == '\0') ? GPIO_TASK_DEFAULT_WIDTH_US : gpio_api_width(data);
+        result = gpio_api_pulse(cmd + 5, width_us, &retry_after_ms);
+    } else if (strcmp(cmd, "batch") == 0) {
+        result = gpio_api_batch(data, &retry_after_ms);
+    } else if (strcmp(cmd, "seq") == 0) {
+        result = gpio_api_seq(data);
+    } else if (strcmp(cmd, "seq/abort") == 0) {
+        gpio_seq_abort();
+        result = ESP_OK;
+    } else if (strcmp(cmd, "status") == 0) {
+        mqtt_publish_status();
+        return;
+    } else {
+        result = ESP_ERR_NOT_FOUND;
+    }
+    mqtt_publish_result(cmd, result, retry_after_ms);
+}
+
+static void mqtt_on_data(esp_mqtt_event_handle_t event)
+{
+    char topic[MQTT_TOPIC_SIZE];
+    char *data;
+    size_t prefix_len = strlen(topic_prefix);
+
+    // NOTE: バッファに収まらず分割されたメッセージは扱わない
+    if ((event->data_len != event->total_data_len) || (event->topic_len >= sizeof(topic)) ||
+        (event->data_len >= MQTT_CMD_BUF_SIZE)) {
+        ESP_LOGW(TAG, "MQTT message is too large.");
+        return;
+    }
+    memcpy(topic, event->topic, event->topic_len);
+    topic[event->topic_len] = '\0';
+    if ((strncmp(topic, topic_prefix, prefix_len) != 0) ||
+        (strncmp(topic + prefix_len, "/cmd/", 5) != 0)) {
+        return;
+    }
+
+    data = malloc(event->data_len + 1);
+    if (data == NULL) {
+        return;
+    }
+    memcpy(data, event->data, event->data_len);
+    data[event->data_len] = '\0';
+
+    mqtt_process_cmd(topic + prefix_len + 5, data);
+    free(data);
+}
+
+static void mqtt_event_handler(void *arg, esp_event_base_t event_base,
+                               int32_t event_id, void *event_data)
+{
+    esp_mqtt_event_handle_t event = (esp_mqtt_event_handle_t)event_data;
+    char topic[MQTT_TOPIC_SIZE];
+
+    switch (event_id) {
+    case MQTT_EVENT_CONNECTED:
+        ESP_LOGI(TAG, "MQTT connected.");
+        mqtt_connected = true;
+        connect_count++;
+
+        snprintf(topic, sizeof(topic), "%s/cmd/#", topic_prefix);
+        esp_mqtt_client_subscribe(mqtt_client, topic, 1);
+        mqtt_publish("online", "1", true);
+        mqtt_publish_status();
+        break;
+    case MQTT_EVENT_DISCONNECTED:
+        ESP_LOGW(TAG, "MQTT disconnected.");
+        mqtt_connected = false;
+        break;
+    case MQTT_EVENT_DATA:
+        mqtt_on_data(event);
+        break;
+    default:
+        break;
+    }
+}
+
+// NOTE: gpio_task のタスクから呼ばれるので，キューに積むだけにする
+static void mqtt_gpio_listener(const gpio_task_event_t *event)
+{
+    if (!mqtt_connected || (event->type != GPIO_TASK_EVENT_END)) {
+        return;
+    }
+    xQueueSend(mqtt_event_queue, event, 0);
+}
+
+// NOTE: WiFi の再接続は wifi_watch_task が管理しているので，それに合わせる
+static void mqtt_wifi_listener(bool connected)
+{
+    if (!connected) {
+        ESP_LOGI(TAG, "WiFi is down, MQTT waits for reconnection.");
+        return;
+    }
+    if (!client_started) {
+        client_started = true;
+        ESP_ERROR_CHECK(esp_mqtt_client_start(mqtt_client));
+    } else {
+        // NOTE: 再接続待ちなら，待ち時間を飛ばしてすぐに接続し直す
+        esp_mqtt_client_reconnect(mqtt_client);
+    }
+}
+
+static void mqtt_event_write(json_writer_t *writer, const gpio_task_event_t *event)
+{
+    json_writer_begin_object(writer, NULL);
+    json_writer_begin_array(writer, "gpio");
+    for (uint32_t i = 0; i < 64; i++) {
+        if (event->mask & (1ULL << i)) {
+            json_writer_uint(writer, NULL, i);
+        }
+    }
+    json_writer_end_array(writer);
+    json_writer_uint(writer, "width_us", event->width_us);
+    json_writer_end_object(writer);
+}
+
+static void mqtt_pub_task(void *param)
+{
+    json_writer_t writer;
+    gpio_task_event_t event;
+    char *buf = malloc(MQTT_EVENT_BUF_SIZE);
+    TickType_t status_time = xTaskGetTickCount();
+    TickType_t link_time = xTaskGetTickCount();
+    TickType_t batch_end;
+    TickType_t now;
+    int32_t remain;
+
+    if (buf == NULL) {
+        ESP_LOGE(TAG, "Failed to allocate MQTT buffer.");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    while (1) {
+        if (xQueueReceive(mqtt_event_queue, &event, MQTT_LINK_INTERVAL_MS / portTICK_RATE_MS) == pdTRUE) {
+            // NOTE: 立て続けに終わったパルスは 1 つのメッセージにまとめる
+            json_writer_init(&writer, NULL, buf, MQTT_EVENT_BUF_SIZE);
+            json_writer_begin_array(&writer, NULL);
+            mqtt_event_write(&writer, &event);
+
+            batch_end = xTaskGetTickCount() + MQTT_BATCH_MS / portTICK_RATE_MS;
+            while (writer.len < (MQTT_EVENT_BUF_SIZE / 2)) {
+                remain = (int32_t)(batch_end - xTaskGetTickCount());
+                if ((remain <= 0) || (xQueueReceive(mqtt_event_queue, &event, remain) != pdTRUE)) {
+                    break;
+                }
+                mqtt_event_write(&writer, &event);
+            }
+            json_writer_end_array(&writer);
+            if (json_writer_finish(&writer) == ESP_OK) {
+                mqtt_publish("pulse_done", buf, false);
+            }
+        }
+
+        now = xTaskGetTickCount();
+        if ((now - link_time) >= (MQTT_LINK_INTERVAL_MS / portTICK_RATE_MS)) {
+            link_time = now;
+            mqtt_publish_link();
+        }
+        if ((now - status_time) >= (MQTT_STATUS_INTERVAL_MS / portTICK_RATE_MS)) {
+            status_time = now;
+            mqtt_publish_status();
+        }
+    }
+}
+#endif
+
+void mqtt_task_start(void)
+{
+#ifdef MQTT_BROKER_URI
+    static char client_id[32];
+    uint8_t mac[6];
+
+    ESP_ERROR_CHECK(esp_read_mac(mac, ESP_MAC_WIFI_STA));
+    snprintf(client_id, sizeof(client_id), "%s-%02x%02x%02x", WIFI_HOSTNAME, mac[3], mac[4], mac[5]);
+    snprintf(topic_prefix, sizeof(topic_prefix), "%s/%s", MQTT_TOPIC_ROOT, client_id);
+    snprintf(lwt_topic, sizeof(lwt_topic), "%s/online", topic_prefix);
+
+    esp_mqtt_client_config_t config = {
+        .uri = MQTT_BROKER_URI,
+        .client_id = client_id,
+        .keepalive = MQTT_KEEPALIVE_SEC,
+        // NOTE: 切断されたら，ブローカーが online を 0 にする
+        .lwt_topic = lwt_topic,
+        .lwt_msg = "0",
+        .lwt_qos = 1,
+        .lwt_retain = 1,
+        .buffer_size = MQTT_CMD_BUF_SIZE,
+    };
+
+    ESP_LOGI(TAG, "MQTT topic: %s", topic_prefix);
+
+    mqtt_client = esp_mqtt_client_init(&config);
+    ESP_ERROR_CHECK(esp_mqtt_client_register_event(mqtt_client, ESP_EVENT_ANY_ID,
+                                                   mqtt_event_handler, NULL));
+
+    mqtt_event_queue = xQueueCreate(MQTT_EVENT_QUEUE_SIZE, sizeof(gpio_task_event_t));
+    xTaskCreate(mqtt_pub_task, "mqtt_pub_task", 3072, NULL, 4, NULL);
+    ESP_ERROR_CHECK(gpio_task_add_listener(mqtt_gpio_listener));
+
+    // NOTE: 接続は WiFi が繋がってから始める
+    wifi_task_set_listener(mqtt_wifi_listener);
+#endif
+}
+
+void mqtt_task_get_stat(mqtt_task_stat_t *stat)
+{
+#ifdef MQTT_BROKER_URI
+    stat->enabled = true;
+#else
+    stat->enabled = false;
+#endif
+    stat->connected = mqtt_connected;
+    stat->connect_count = connect_count;
+    stat->received = received_count;
+    stat->published = published_count;
+}
@@ -0,0 +1,13 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct mqtt_task_stat {
+    bool enabled;           // MQTT_BROKER_URI が定義されているか
+    bool connected;
+    uint32_t connect_count;
+    uint32_t received;      // 受け付けたコマンド数
+    uint32_t published;
+} mqtt_task_stat_t;
+
+void mqtt_task_start(void);
+void mqtt_task_get_stat(mqtt_task_stat_t *stat);
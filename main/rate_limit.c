@@ -0,0 +1,21 @@
+#include "rate_limit.h"
+
+void rate_limit_init(rate_limit_t *limit, uint32_t rate_per_sec, uint32_t burst)
+{
+    limit->interval_us = 1000000 / rate_per_sec;
+    limit->burst_us = (burst > 0) ? ((burst - 1) * limit->interval_us) : 0;
+    limit->tat = 0;
+}
+
+// NOTE: トークンを取れるようになるまでの時間を返す．取れるなら 0
+uint32_t rate_limit_wait_ms(const rate_limit_t *limit, int64_t now)
+{
+    int64_t wait_us = limit->tat - limit->burst_us - now;
+
+    return (wait_us > 0) ? (uint32_t)((wait_us + 999) / 1000) : 0;
+}
+
+void rate_limit_take(rate_limit_t *limit, int64_t now)
+{
+    limit->tat = ((limit->tat > now) ? limit->tat : now) + limit->interval_us;
+}
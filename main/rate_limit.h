@@ -0,0 +1,13 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE: トークンバケットと等価な GCRA で実装する．状態は次に空く時刻だけ
+typedef struct rate_limit {
+    uint32_t interval_us;   // トークン 1 個が貯まる時間
+    uint32_t burst_us;      // 連続して受け付けられる分 ((burst - 1) * interval_us)
+    int64_t tat;            // theoretical arrival time (us)
+} rate_limit_t;
+
+void rate_limit_init(rate_limit_t *limit, uint32_t rate_per_sec, uint32_t burst);
+uint32_t rate_limit_wait_ms(const rate_limit_t *limit, int64_t now);
+void rate_limit_take(rate_limit_t *limit, int64_t now);
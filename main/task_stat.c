@@ -0,0 +1,183 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_timer.h"
+
+#include "app.h"
+#include "task_stat.h"
+
+#if (configUSE_TRACE_FACILITY == 1) && (configGENERATE_RUN_TIME_STATS == 1)
+#define TASK_STAT_ENABLE
+#endif
+
+#ifdef TASK_STAT_ENABLE
+// NOTE: sample_result は計測中は sample_task だけが書き，終わったら state を DONE にする．
+// 読み出し側は sample_lock の中で state を見てコピーするので，計測中の値は返さない
+static TaskHandle_t sample_task_handle = NULL;
+static uint32_t sample_window_ms = 0;
+static task_stat_result_t sample_result;
+static portMUX_TYPE sample_lock = portMUX_INITIALIZER_UNLOCKED;
+
+static void task_stat_fill(task_stat_result_t *result, const TaskStatus_t *status_list, uint32_t count)
+{
+    task_stat_entry_t *entry;
+
+    result->count = 0;
+    for (uint32_t i = 0; (i < count) && (result->count < TASK_STAT_MAX); i++) {
+        entry = &(result->entry_list[result->count++]);
+
+        strncpy(entry->name, status_list[i].pcTaskName, sizeof(entry->name) - 1);
+        entry->name[sizeof(entry->name) - 1] = '\0';
+        entry->task_num = status_list[i].xTaskNumber;
+        entry->priority = status_list[i].uxCurrentPriority;
+#if configTASKLIST_INCLUDE_COREID
+        entry->core = (status_list[i].xCoreID == tskNO_AFFINITY) ? -1 : status_list[i].xCoreID;
+#else
+        entry->core = -1;
+#endif
+        entry->state = status_list[i].eCurrentState;
+        entry->runtime_us = status_list[i].ulRunTimeCounter;
+        entry->stack_free = status_list[i].usStackHighWaterMark;
+    }
+}
+
+// NOTE: 期間の前後でタスク一覧を取り，同じタスク番号どうしの差を取る．
+// 期間中に生まれたタスクは 0 から，消えたタスクは結果に含めない
+static void sample_task(void *param)
+{
+    TaskStatus_t *begin_list;
+    TaskStatus_t *end_list;
+    task_stat_result_t *result = &sample_result;
+    uint32_t begin_count, end_count;
+    uint32_t begin_total, end_total;
+    uint32_t size;
+
+    while (1) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // NOTE: 計測中に増えるタスクの分も余裕を持たせる
+        size = uxTaskGetNumberOfTasks() + 4;
+        begin_list = malloc(sizeof(TaskStatus_t) * size);
+        end_list = malloc(sizeof(TaskStatus_t) * size);
+        if ((begin_list == NULL) || (end_list == NULL)) {
+            free(begin_list);
+            free(end_list);
+            portENTER_CRITICAL(&sample_lock);
+            result->state = TASK_STAT_SAMPLE_NONE;
+            portEXIT_CRITICAL(&sample_lock);
+            continue;
+        }
+
+        begin_count = uxTaskGetSystemState(begin_list, size, &begin_total);
+        vTaskDelay(sample_window_ms / portTICK_RATE_MS);
+        end_count = uxTaskGetSystemState(end_list, size, &end_total);
+
+        task_stat_fill(result, end_list, end_count);
+        for (uint32_t i = 0; i < result->count; i++) {
+            for (uint32_t j = 0; j < begin_count; j++) {
+                if (begin_list[j].xTaskNumber == result->entry_list[i].task_num) {
+                    result->entry_list[i].runtime_us -= begin_list[j].ulRunTimeCounter;
+                    break;
+                }
+            }
+        }
+        result->window_us = end_total - begin_total;
+        result->end_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+        free(begin_list);
+        free(end_list);
+
+        portENTER_CRITICAL(&sample_lock);
+        result->state = TASK_STAT_SAMPLE_DONE;
+        portEXIT_CRITICAL(&sample_lock);
+    }
+}
+#endif
+
+void task_stat_start(void)
+{
+#ifdef TASK_STAT_ENABLE
+    // NOTE: 期間の終わりを遅らせないよう，高めの優先度で動かす (処理自体は短い)
+    xTaskCreate(sample_task, "task_stat_task", 2048, NULL, 15, &sample_task_handle);
+#endif
+}
+
+bool task_stat_available(void)
+{
+#ifdef TASK_STAT_ENABLE
+    return true;
+#else
+    return false;
+#endif
+}
+
+esp_err_t task_stat_snapshot(task_stat_result_t *result)
+{
+#ifdef TASK_STAT_ENABLE
+    TaskStatus_t *status_list;
+    uint32_t size = uxTaskGetNumberOfTasks() + 4;
+    uint32_t count, total;
+
+    status_list = malloc(sizeof(TaskStatus_t) * size);
+    if (status_list == NULL) {
+        return ESP_ERR_NO_MEM;
+    }
+    count = uxTaskGetSystemState(status_list, size, &total);
+    task_stat_fill(result, status_list, count);
+    free(status_list);
+
+    result->state = TASK_STAT_SAMPLE_DONE;
+    result->window_us = total;
+    result->end_ms = (uint32_t)(esp_timer_get_time() / 1000);
+
+    return ESP_OK;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+esp_err_t task_stat_sample_begin(uint32_t window_ms)
+{
+#ifdef TASK_STAT_ENABLE
+    esp_err_t ret = ESP_OK;
+
+    if ((window_ms == 0) || (window_ms > TASK_STAT_WINDOW_MAX_MS)) {
+        return ESP_ERR_INVALID_ARG;
+    }
+
+    portENTER_CRITICAL(&sample_lock);
+    if (sample_result.state == TASK_STAT_SAMPLE_RUNNING) {
+        ret = ESP_ERR_INVALID_STATE;
+    } else {
+        sample_result.state = TASK_STAT_SAMPLE_RUNNING;
+        sample_window_ms = window_ms;
+    }
+    portEXIT_CRITICAL(&sample_lock);
+
+    if (ret == ESP_OK) {
+        xTaskNotifyGive(sample_task_handle);
+    }
+    return ret;
+#else
+    return ESP_ERR_NOT_SUPPORTED;
+#endif
+}
+
+void task_stat_sample_get(task_stat_result_t *result)
+{
+#ifdef TASK_STAT_ENABLE
+    memset(result, 0, sizeof(task_stat_result_t));
+
+    portENTER_CRITICAL(&sample_lock);
+    if (sample_result.state == TASK_STAT_SAMPLE_DONE) {
+        *result = sample_result;
+    } else {
+        result->state = sample_result.state;
+    }
+    portEXIT_CRITICAL(&sample_lock);
+#else
+    memset(result, 0, sizeof(task_stat_result_t));
+#endif
+}
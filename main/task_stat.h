@@ -0,0 +1,42 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+
+#define TASK_STAT_MAX           32
+#define TASK_STAT_WINDOW_MAX_MS 60000
+
+typedef enum {
+    TASK_STAT_SAMPLE_NONE,      // まだ計測していない
+    TASK_STAT_SAMPLE_RUNNING,
+    TASK_STAT_SAMPLE_DONE,
+} task_stat_sample_state_t;
+
+typedef struct task_stat_entry {
+    char name[configMAX_TASK_NAME_LEN];
+    uint32_t task_num;
+    uint8_t priority;
+    int8_t core;                // -1 ならどちらのコアでも動く
+    uint8_t state;              // eTaskState
+    uint32_t runtime_us;        // 計測期間中に CPU を使った時間
+    uint32_t stack_free;        // スタックの残りの最小値 (バイト)
+} task_stat_entry_t;
+
+typedef struct task_stat_result {
+    task_stat_sample_state_t state;
+    uint32_t window_us;         // 計測期間 (サンプリングしていなければ起動から)
+    uint32_t end_ms;            // 計測を終えた時刻 (起動から)
+    uint32_t count;
+    task_stat_entry_t entry_list[TASK_STAT_MAX];
+} task_stat_result_t;
+
+void task_stat_start(void);
+// NOTE: 実行時間の統計が有効なビルドか (sdkconfig)
+bool task_stat_available(void);
+// NOTE: 起動からの累積．実行時間のカウンタは 32 bit (us) なので約 71 分で一周し，
+// runtime_us と window_us は使えない (名前や状態，スタックの残量だけを使う)
+esp_err_t task_stat_snapshot(task_stat_result_t *result);
+// NOTE: window_ms の間の CPU 使用時間を別タスクで計測する．結果は task_stat_sample_get で取る
+esp_err_t task_stat_sample_begin(uint32_t window_ms);
+void task_stat_sample_get(task_stat_result_t *result);
@@ -0,0 +1,319 @@
+#include <string.h>
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "lwip/sockets.h"
+#include "mbedtls/md.h"
+
+#include "app.h"
+#include "udp_task.h"
+#include "gpio_task.h"
+#include "wifi_config.h"
+// wifi_config.h may define followings to enable UDP commands, and to require
+// HMAC-SHA256 on every frame.
+// #define UDP_CMD_ENABLE                   // listen on UDP_TASK_PORT
+// #define UDP_CMD_KEY "XXXXXXXX"          // UDP command key
+
+#define ARRAY_SIZE_OF(a) (sizeof(a) / sizeof(a[0]))
+
+#define UDP_MAGIC_0         'G'
+#define UDP_MAGIC_1         'P'
+#define UDP_VERSION         1
+#define UDP_MAC_SIZE        16      // HMAC-SHA256 の先頭 16 バイト
+#define UDP_RECENT_MAX      8
+#define UDP_PULSE_MAX       16
+
+typedef enum {
+    UDP_ACTION_PING         = 0,    // 何もせず応答だけ返す (RTT 計測用)
+    UDP_ACTION_PULSE_LOW    = 1,    // HTTP API と同じく，パルス中は Low
+    UDP_ACTION_PULSE_HIGH   = 2,
+} udp_action_t;
+
+typedef enum {
+    UDP_STATUS_OK           = 0,
+    UDP_STATUS_BAD_FRAME    = 1,
+    UDP_STATUS_AUTH         = 2,
+    UDP_STATUS_INVALID_ARG  = 3,    // 許可されていないピンやパルス幅
+    UDP_STATUS_BUSY         = 4,    // キューが一杯か，レート制限中，シーケンスが使用中
+} udp_status_t;
+
+// NOTE: どちらもリトルエンディアンの固定長．HMAC を使う場合は末尾に付ける
+typedef struct __attribute__((packed)) udp_cmd_frame {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t action;
+    uint32_t seq;
+    uint64_t mask;
+    uint32_t width_us;
+} udp_cmd_frame_t;
+
+typedef struct __attribute__((packed)) udp_ack_frame {
+    uint8_t magic[2];
+    uint8_t version;
+    uint8_t status;
+    uint32_t seq;
+    uint32_t retry_after_ms;
+} udp_ack_frame_t;
+
+#ifdef UDP_CMD_ENABLE
+// NOTE: 送信元ごとに番号を振るので，送信元のアドレスとポートも合わせて照合する
+typedef struct udp_recent {
+    uint32_t addr;
+    uint16_t port;
+    uint32_t seq;
+    uint8_t status;
+} udp_recent_t;
+
+// NOTE: 再送されたフレームはもう一度実行せず，前回の結果を返す．
+// BUSY は一時的な結果なので覚えず，retry_after_ms 後の再送は改めて実行する
+static udp_recent_t recent_list[UDP_RECENT_MAX];
+static uint32_t recent_head = 0;
+static uint32_t recent_count = 0;
+#ifdef UDP_CMD_KEY
+static bool seq_valid = false;
+static uint32_t seq_last = 0;
+#endif
+#endif
+
+static uint32_t received_count = 0;
+static uint32_t accepted_count = 0;
+static uint32_t duplicate_count = 0;
+static uint32_t rejected_count = 0;
+
+#ifdef UDP_CMD_ENABLE
+#ifdef UDP_CMD_KEY
+static void udp_mac(const uint8_t *data, size_t size, uint8_t *mac)
+{
+    uint8_t digest[32];
+
+    mbedtls_md_hmac(mbedtls_md_info_from_type(MBEDTLS_MD_SHA256),
+                    (const unsigned char *)UDP_CMD_KEY, strlen(UDP_CMD_KEY),
+                    data, size, digest);
+    memcpy(mac, digest, UDP_MAC_SIZE);
+}
+
+static bool udp_mac_verify(const uint8_t *data, size_t size, const uint8_t *mac)
+{
+    uint8_t expected[UDP_MAC_SIZE];
+    uint8_t diff = 0;
+
+    udp_mac(data, size, expected);
+    // NOTE: 一致した長さから鍵を推測されないよう，常に全体を比較する
+    for (uint32_t i = 0; i < UDP_MAC_SIZE; i++) {
+        diff |= expected[i] ^ mac[i];
+    }
+    return diff == 0;
+}
+#endif
+
+static const udp_recent_t *udp_recent_find(const struct sockaddr_in *from, uint32_t seq)
+{
+    for (uint32_t i = 0; i < recent_count; i++) {
+        if ((recent_list[i].seq == seq) && (recent_list[i].addr == from->sin_addr.s_addr) &&
+            (recent_list[i].port == from->sin_port)) {
+            return &(recent_list[i]);
+        }
+    }
+    return NULL;
+}
+
+static void udp_recent_add(const struct sockaddr_in *from, uint32_t seq, uint8_t status)
+{
+    recent_list[recent_head].addr = from->sin_addr.s_addr;
+    recent_list[recent_head].port = from->sin_port;
+    recent_list[recent_head].seq = seq;
+    recent_list[recent_head].status = status;
+    recent_head = (recent_head + 1) % UDP_RECENT_MAX;
+    if (recent_count < UDP_RECENT_MAX) {
+        recent_count++;
+    }
+}
+
+static uint8_t udp_execute(const udp_cmd_frame_t *cmd, uint32_t *retry_after_ms)
+{
+    gpio_task_pulse_t pulse_list[UDP_PULSE_MAX];
+    uint32_t count = 0;
+    esp_err_t ret;
+
+    *retry_after_ms = 0;
+    if (cmd->action == UDP_ACTION_PING) {
+        return UDP_STATUS_OK;
+    }
+    if ((cmd->action != UDP_ACTION_PULSE_LOW) && (cmd->action != UDP_ACTION_PULSE_HIGH)) {
+        return UDP_STATUS_BAD_FRAME;
+    }
+
+    for (uint32_t i = 0; i < 64; i++) {
+        if ((cmd->mask & (1ULL << i)) == 0) {
+            continue;
+        }
+        if ((count == ARRAY_SIZE_OF(pulse_list)) || !gpio_task_pin_allowed(i)) {
+            return UDP_STATUS_INVALID_ARG;
+        }
+        pulse_list[count].gpio_num = i;
+        pulse_list[count].level = (cmd->action == UDP_ACTION_PULSE_HIGH) ? 1 : 0;
+        pulse_list[count].width_us = cmd->width_us;
+        count++;
+    }
+    if (count == 0) {
+        return UDP_STATUS_INVALID_ARG;
+    }
+
+    // NOTE: HTTP API と同じ経路で実行するので，レート制限なども共通
+    ret = gpio_task_push_batch(pulse_list, count, retry_after_ms);
+    if (ret == ESP_OK) {
+        return UDP_STATUS_OK;
+    }
+    // NOTE: ESP_ERR_INVALID_STATE はシーケンスの実行中でピンが使えない
+    return ((ret == ESP_ERR_NO_MEM) || (ret == ESP_ERR_INVALID_STATE)) ?
+        UDP_STATUS_BUSY : UDP_STATUS_INVALID_ARG;
+}
+
+static bool udp_process(const uint8_t *buf, int size, const struct sockaddr_in *from, udp_ack_frame_t *ack)
+{
+    const udp_cmd_frame_t *cmd = (const udp_cmd_frame_t *)buf;
+    const udp_recent_t *recent;
+    uint32_t retry_after_ms;
+    uint8_t status;
+
+#ifdef UDP_CMD_KEY
+    if ((size != (sizeof(udp_cmd_frame_t) + UDP_MAC_SIZE)) ||
+#else
+    if ((size != sizeof(udp_cmd_frame_t)) ||
+#endif
+        (cmd->magic[0] != UDP_MAGIC_0) || (cmd->magic[1] != UDP_MAGIC_1) ||
+        (cmd->version != UDP_VERSION)) {
+        // NOTE: 何が届いたのか分からないので，応答しない
+        return false;
+    }
+
+    ack->magic[0] = UDP_MAGIC_0;
+    ack->magic[1] = UDP_MAGIC_1;
+    ack->version = UDP_VERSION;
+    ack->seq = cmd->seq;
+    ack->retry_after_ms = 0;
+
+#ifdef UDP_CMD_KEY
+    if (!udp_mac_verify(buf, sizeof(udp_cmd_frame_t), buf + sizeof(udp_cmd_frame_t))) {
+        ack->status = UDP_STATUS_AUTH;
+        return true;
+    }
+#endif
+
+    recent = udp_recent_find(from, cmd->seq);
+    if (recent != NULL) {
+        duplicate_count++;
+        ack->status = recent->status;
+        return true;
+    }
+
+#ifdef UDP_CMD_KEY
+    // NOTE: 盗聴したフレームを後から送り直されないよう，番号は増えていく必要がある
+    if (seq_valid && ((int32_t)(cmd->seq - seq_last) <= 0)) {
+        ack->status = UDP_STATUS_AUTH;
+        return true;
+    }
+#endif
+
+    status = udp_execute(cmd, &retry_after_ms);
+    if (status != UDP_STATUS_BUSY) {
+        udp_recent_add(from, cmd->seq, status);
+#ifdef UDP_CMD_KEY
+        // NOTE: BUSY なら実行していないので，同じ番号での再送を受け付ける
+        seq_valid = true;
+        seq_last = cmd->seq;
+#endif
+    }
+
+    ack->status = status;
+    ack->retry_after_ms = retry_after_ms;
+    return true;
+}
+
+static void udp_task(void *param)
+{
+    uint8_t buf[sizeof(udp_cmd_frame_t) + UDP_MAC_SIZE + 1];
+    uint8_t ack_buf[sizeof(udp_ack_frame_t) + UDP_MAC_SIZE];
+    udp_ack_frame_t *ack = (udp_ack_frame_t *)ack_buf;
+    size_t ack_size;
+    struct sockaddr_in addr;
+    struct sockaddr_in6 from;
+    socklen_t from_len;
+    int sock;
+    int size;
+
+    sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+    if (sock < 0) {
+        ESP_LOGE(TAG, "Failed to create UDP socket.");
+        vTaskDelete(NULL);
+        return;
+    }
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(UDP_TASK_PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+        ESP_LOGE(TAG, "Failed to bind UDP port %d.", UDP_TASK_PORT);
+        close(sock);
+        vTaskDelete(NULL);
+        return;
+    }
+    ESP_LOGI(TAG, "Listen UDP commands on port %d.", UDP_TASK_PORT);
+
+    while (1) {
+        from_len = sizeof(from);
+        size = recvfrom(sock, buf, sizeof(buf), 0, (struct sockaddr *)&from, &from_len);
+        if (size < 0) {
+            continue;
+        }
+        received_count++;
+
+        if ((from.sin6_family != AF_INET) ||
+            !udp_process(buf, size, (const struct sockaddr_in *)&from, ack)) {
+            rejected_count++;
+            continue;
+        }
+        if (ack->status == UDP_STATUS_AUTH) {
+            rejected_count++;
+        } else if (ack->status == UDP_STATUS_OK) {
+            accepted_count++;
+        }
+
+        ack_size = sizeof(udp_ack_frame_t);
+#ifdef UDP_CMD_KEY
+        udp_mac(ack_buf, sizeof(udp_ack_frame_t), ack_buf + sizeof(udp_ack_frame_t));
+        ack_size += UDP_MAC_SIZE;
+#endif
+        sendto(sock, ack_buf, ack_size, 0, (struct sockaddr *)&from, from_len);
+    }
+}
+
+#endif
+
+// NOTE: HTTP と違って UDP_CMD_KEY が無ければ認証が無いので，UDP_CMD_ENABLE を定義したときだけ待ち受ける
+void udp_task_start(void)
+{
+#ifdef UDP_CMD_ENABLE
+    // NOTE: HTTP サーバ (優先度 5) より先に処理させる
+    xTaskCreate(udp_task, "udp_task", 3072, NULL, 6, NULL);
+#endif
+}
+
+void udp_task_get_stat(udp_task_stat_t *stat)
+{
+#ifdef UDP_CMD_ENABLE
+    stat->enabled = true;
+#else
+    stat->enabled = false;
+#endif
+    stat->received = received_count;
+    stat->accepted = accepted_count;
+    stat->duplicate = duplicate_count;
+    stat->rejected = rejected_count;
+#ifdef UDP_CMD_KEY
+    stat->auth = true;
+#else
+    stat->auth = false;
+#endif
+}
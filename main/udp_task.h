@@ -0,0 +1,16 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+#define UDP_TASK_PORT       5005
+
+typedef struct udp_task_stat {
+    bool enabled;           // UDP_CMD_ENABLE が定義されているか
+    uint32_t received;
+    uint32_t accepted;
+    uint32_t duplicate;     // 再送されたフレーム (実行せずに応答だけ返す)
+    uint32_t rejected;      // 形式・認証の誤り
+    bool auth;              // HMAC を要求しているか
+} udp_task_stat_t;
+
+void udp_task_start(void);
+void udp_task_get_stat(udp_task_stat_t *stat);
@@ -0,0 +1,129 @@
+#include "wifi_fsm.h"
+
+// NOTE: 失敗が続いたら，再アソシエーション → ドライバ再起動 → 再起動 の順に対処を重くする
+#define REASSOCIATE_LIMIT       3
+#define RESTART_DRIVER_LIMIT    6
+
+#define CONNECT_TIMEOUT_MS      10000
+#define BACKOFF_BASE_MS         500
+#define BACKOFF_MAX_MS          30000
+
+static uint32_t wifi_fsm_random(wifi_fsm_t *fsm)
+{
+    // NOTE: xorshift32
+    fsm->rand ^= fsm->rand << 13;
+    fsm->rand ^= fsm->rand >> 17;
+    fsm->rand ^= fsm->rand << 5;
+
+    return fsm->rand;
+}
+
+// NOTE: 指数バックオフに ±25% の揺らぎを加える
+static uint32_t wifi_fsm_backoff_ms(wifi_fsm_t *fsm)
+{
+    uint32_t backoff_ms = BACKOFF_BASE_MS;
+
+    for (uint32_t i = 1; (i < fsm->failure) && (backoff_ms < BACKOFF_MAX_MS); i++) {
+        backoff_ms *= 2;
+    }
+    if (backoff_ms > BACKOFF_MAX_MS) {
+        backoff_ms = BACKOFF_MAX_MS;
+    }
+
+    return backoff_ms - (backoff_ms / 4) + (wifi_fsm_random(fsm) % (backoff_ms / 2 + 1));
+}
+
+static wifi_action_t wifi_fsm_recover_action(wifi_fsm_t *fsm)
+{
+    if (fsm->failure <= REASSOCIATE_LIMIT) {
+        return WIFI_ACTION_REASSOCIATE;
+    } else if (fsm->failure <= RESTART_DRIVER_LIMIT) {
+        return WIFI_ACTION_RESTART_DRIVER;
+    } else {
+        return WIFI_ACTION_REBOOT;
+    }
+}
+
+static wifi_fsm_output_t wifi_fsm_output(wifi_action_t action, bool timer_set, uint32_t timer_ms)
+{
+    wifi_fsm_output_t output = {
+        .action = action,
+        .timer_set = timer_set,
+        .timer_ms = timer_ms,
+    };
+    return output;
+}
+
+static wifi_fsm_output_t wifi_fsm_backoff(wifi_fsm_t *fsm)
+{
+    fsm->failure++;
+    fsm->state = WIFI_STATE_BACKOFF;
+
+    return wifi_fsm_output(WIFI_ACTION_NONE, true, wifi_fsm_backoff_ms(fsm));
+}
+
+void wifi_fsm_init(wifi_fsm_t *fsm, uint32_t seed)
+{
+    fsm->state = WIFI_STATE_IDLE;
+    fsm->failure = 0;
+    fsm->connect_timeout_ms = CONNECT_TIMEOUT_MS;
+    fsm->rand = (seed == 0) ? 1 : seed;
+}
+
+wifi_fsm_output_t wifi_fsm_handle(wifi_fsm_t *fsm, wifi_ev_t ev)
+{
+    switch (fsm->state) {
+    case WIFI_STATE_IDLE:
+        if (ev == WIFI_EV_START) {
+            fsm->state = WIFI_STATE_CONNECTING;
+            return wifi_fsm_output(WIFI_ACTION_START, true, fsm->connect_timeout_ms);
+        }
+        break;
+    case WIFI_STATE_CONNECTING:
+        if (ev == WIFI_EV_GOT_IP) {
+            fsm->state = WIFI_STATE_CONNECTED;
+            return wifi_fsm_output(WIFI_ACTION_NONE, true, 0);
+        } else if ((ev == WIFI_EV_DISCONNECTED) || (ev == WIFI_EV_TIMER)) {
+            return wifi_fsm_backoff(fsm);
+        }
+        break;
+    case WIFI_STATE_CONNECTED:
+        if (ev == WIFI_EV_PING_OK) {
+            // NOTE: IP を取得しただけでなく，ゲートウェイまで通信できて初めて回復とみなす
+            fsm->failure = 0;
+        } else if (ev == WIFI_EV_LINK_LOST) {
+            // NOTE: 切断イベントを起こし，通常の切断と同じ経路で回復させる
+            return wifi_fsm_output(WIFI_ACTION_DISCONNECT, false, 0);
+        } else if (ev == WIFI_EV_DISCONNECTED) {
+            return wifi_fsm_backoff(fsm);
+        }
+        break;
+    case WIFI_STATE_BACKOFF:
+        if (ev == WIFI_EV_TIMER) {
+            fsm->state = WIFI_STATE_CONNECTING;
+            return wifi_fsm_output(wifi_fsm_recover_action(fsm), true, fsm->connect_timeout_ms);
+        } else if (ev == WIFI_EV_GOT_IP) {
+            fsm->state = WIFI_STATE_CONNECTED;
+            return wifi_fsm_output(WIFI_ACTION_NONE, true, 0);
+        }
+        break;
+    }
+
+    return wifi_fsm_output(WIFI_ACTION_NONE, false, 0);
+}
+
+const char *wifi_fsm_state_str(wifi_state_t state)
+{
+    switch (state) {
+    case WIFI_STATE_IDLE:
+        return "idle";
+    case WIFI_STATE_CONNECTING:
+        return "connecting";
+    case WIFI_STATE_CONNECTED:
+        return "connected";
+    case WIFI_STATE_BACKOFF:
+        return "backoff";
+    default:
+        return "?";
+    }
+}
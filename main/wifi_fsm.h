@@ -0,0 +1,47 @@
+#include <stdbool.h>
+#include <stdint.h>
+
+// NOTE: WiFi の接続状態の遷移だけを扱う．ESP-IDF の API には依存しないので，
+// ホスト上でも動かせる．実際の操作は wifi_task.c が action に従って行う．
+
+typedef enum {
+    WIFI_STATE_IDLE,
+    WIFI_STATE_CONNECTING,
+    WIFI_STATE_CONNECTED,
+    WIFI_STATE_BACKOFF,
+} wifi_state_t;
+
+typedef enum {
+    WIFI_EV_START,
+    WIFI_EV_GOT_IP,
+    WIFI_EV_DISCONNECTED,
+    WIFI_EV_TIMER,          // connect_timeout または backoff の満了
+    WIFI_EV_PING_OK,
+    WIFI_EV_LINK_LOST,      // ゲートウェイに一定時間 ping が通らない
+} wifi_ev_t;
+
+typedef enum {
+    WIFI_ACTION_NONE,
+    WIFI_ACTION_START,          // esp_wifi_start
+    WIFI_ACTION_REASSOCIATE,    // esp_wifi_connect
+    WIFI_ACTION_DISCONNECT,     // esp_wifi_disconnect
+    WIFI_ACTION_RESTART_DRIVER, // esp_wifi_stop + esp_wifi_start
+    WIFI_ACTION_REBOOT,         // esp_restart
+} wifi_action_t;
+
+typedef struct wifi_fsm_output {
+    wifi_action_t action;
+    bool timer_set;     // true ならタイマーを timer_ms で設定し直す (0 なら停止)
+    uint32_t timer_ms;
+} wifi_fsm_output_t;
+
+typedef struct wifi_fsm {
+    wifi_state_t state;
+    uint32_t failure;           // 連続して失敗した回数
+    uint32_t connect_timeout_ms;
+    uint32_t rand;
+} wifi_fsm_t;
+
+void wifi_fsm_init(wifi_fsm_t *fsm, uint32_t seed);
+wifi_fsm_output_t wifi_fsm_handle(wifi_fsm_t *fsm, wifi_ev_t ev);
+const char *wifi_fsm_state_str(wifi_state_t state);
@@ -5,37 +5,120 @@
 #include "esp_spi_flash.h"
 #include "esp_wifi.h"
 #include "esp_task_wdt.h"
+#include "freertos/queue.h"
+#include "esp_system.h"
 
 #include "ping/ping_sock.h"
 
 #include "nvs_flash.h"
+#include "nvs.h"
+#include "esp_timer.h"
 
 #include "app.h"
 #include "wifi_task.h"
+#include "metrics.h"
+#include "link_stat.h"
+#include "boot_stat.h"
+#include "log_ring.h"
 #include "wifi_config.h"
 // wifi_config.h should define followings.
 // #define WIFI_SSID "XXXXXXXX"            // WiFi SSID
 // #define WIFI_PASS "XXXXXXXX"            // WiFi Password
 
-static const uint32_t FATAL_DISCON_COUNT = 5;
-static const uint32_t PING_COUNT = 10;
-static const uint32_t TIMEOUT_THRESHOLD = 5;
+static const uint32_t CONNECT_TIMEOUT_MS = 10000;
+static const uint32_t FAST_CONNECT_TIMEOUT_MS = 3000;
+static const uint32_t TIMEOUT_THRESHOLD_MS = 30000; // ping が通らない状態がこれだけ続いたら再接続
+static const uint32_t WATCH_INTERVAL_MS = 10000;    // 何も起きなくても，これだけ経ったら WDT をリセットする
+
+// NOTE: 回線が安定している間は疎に，損失が出たら密にゲートウェイへの ping を打つ
+static const uint32_t PROBE_SPARSE_COUNT = 1;
+static const uint32_t PROBE_SPARSE_INTERVAL_MS = 10000;
+static const uint32_t PROBE_DENSE_COUNT = 5;
+static const uint32_t PROBE_DENSE_INTERVAL_MS = 2000;
+static const uint32_t PROBE_DENSE_PING_INTERVAL_MS = 200;
+
+#define WIFI_EVENT_QUEUE_SIZE   8
 
-static uint32_t wifi_discon_count = 0;
 static bool all_timeout = false;
-static SemaphoreHandle_t wifi_start = NULL;
-static SemaphoreHandle_t wifi_stop  = NULL;
 static SemaphoreHandle_t ping_end  = NULL;
+static QueueHandle_t wifi_event_queue = NULL;
+static wifi_task_listener_t wifi_listener = NULL;
+
+static wifi_fsm_t wifi_fsm;
+static bool timer_active = false;
+static TickType_t timer_deadline = 0;
+static TickType_t probe_deadline = 0;
+static TickType_t timeout_start = 0;
+
+#define AP_CACHE_NVS_NAMESPACE  "wifi"
+#define AP_CACHE_NVS_KEY        "last_ap"
+
+// NOTE: 最後に接続できた AP を覚えておき，次回はスキャンを省略して接続する
+typedef struct ap_cache {
+    uint8_t bssid[6];
+    uint8_t channel;
+} ap_cache_t;
+
+static ap_cache_t ap_cache;
+static bool ap_cache_valid = false;
+
+static bool connect_fast = false;
+static int64_t connect_start_time = 0;
+static int64_t sta_connected_time = 0;
+static wifi_task_stat_t wifi_stat;
 
 //////////////////////////////////////////////////////////////////////
-// WiFi Function
-static void wifi_disconnect()
+// AP Cache Function
+static void ap_cache_load()
+{
+    nvs_handle_t handle;
+    size_t size = sizeof(ap_cache);
+
+    if (nvs_open(AP_CACHE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK) {
+        return;
+    }
+    ap_cache_valid = (nvs_get_blob(handle, AP_CACHE_NVS_KEY, &ap_cache, &size) == ESP_OK) &&
+        (size == sizeof(ap_cache));
+    nvs_close(handle);
+}
+
+static void ap_cache_save(const uint8_t *bssid, uint8_t channel)
 {
-    ESP_LOGI(TAG, "Disconnect WiFi.");
-    ESP_ERROR_CHECK(esp_wifi_disconnect());
-    ESP_ERROR_CHECK(esp_wifi_stop());
+    nvs_handle_t handle;
+
+    if (ap_cache_valid && (memcmp(ap_cache.bssid, bssid, sizeof(ap_cache.bssid)) == 0) &&
+        (ap_cache.channel == channel)) {
+        return;
+    }
+    memcpy(ap_cache.bssid, bssid, sizeof(ap_cache.bssid));
+    ap_cache.channel = channel;
+    ap_cache_valid = true;
+
+    if (nvs_open(AP_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    if (nvs_set_blob(handle, AP_CACHE_NVS_KEY, &ap_cache, sizeof(ap_cache)) == ESP_OK) {
+        nvs_commit(handle);
+    }
+    nvs_close(handle);
 }
 
+static void ap_cache_clear()
+{
+    nvs_handle_t handle;
+
+    ap_cache_valid = false;
+
+    if (nvs_open(AP_CACHE_NVS_NAMESPACE, NVS_READWRITE, &handle) != ESP_OK) {
+        return;
+    }
+    nvs_erase_key(handle, AP_CACHE_NVS_KEY);
+    nvs_commit(handle);
+    nvs_close(handle);
+}
+
+//////////////////////////////////////////////////////////////////////
+// WiFi Function
 static const char *wifi_authmode_str(wifi_auth_mode_t mode)
 {
     switch (mode) {
@@ -92,22 +175,29 @@ static void wifi_log_rssi()
              ap_info.rssi);
 }
 
+static void wifi_post_event(wifi_ev_t ev)
+{
+    if (xQueueSend(wifi_event_queue, &ev, 0) != pdTRUE) {
+        LOG_RING_W("WiFi event queue is full, event %d dropped.", ev);
+    }
+}
+
 static void event_handler(void* arg, esp_event_base_t event_base,
                           int32_t event_id, void* event_data)
 {
-    static uint32_t retry = 0;
-
     if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_START) {
         ESP_ERROR_CHECK(esp_wifi_connect());
+    } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_CONNECTED) {
+        sta_connected_time = esp_timer_get_time();
     } else if (event_base == WIFI_EVENT && event_id == WIFI_EVENT_STA_DISCONNECTED) {
-        retry++;
-        esp_wifi_connect();
-        ESP_LOGI(TAG, "retry to connect to the AP (n=%d)", retry);
+        // NOTE: ここでは再接続しない．再接続の時期は wifi_watch_task が決める
+        metrics_count(METRICS_WIFI_DISCONNECT, 1);
+        wifi_post_event(WIFI_EV_DISCONNECTED);
     } else if (event_base == IP_EVENT && event_id == IP_EVENT_STA_GOT_IP) {
         ip_event_got_ip_t* event = (ip_event_got_ip_t*) event_data;
-        ESP_LOGI(TAG, "got ip: " IPSTR, IP2STR(&event->ip_info.ip));
-        retry = 0;
-        xSemaphoreGive(wifi_start);
+        LOG_RING_I("got ip: " IPSTR, IP2STR(&event->ip_info.ip));
+        metrics_count(METRICS_WIFI_CONNECT, 1);
+        wifi_post_event(WIFI_EV_GOT_IP);
     }
 }
 
@@ -121,8 +211,9 @@ static void init_wifi()
         ret = nvs_flash_init();
     }
     ESP_ERROR_CHECK(ret);
+    boot_stat_mark(BOOT_PHASE_NVS);
 
-    ESP_ERROR_CHECK(esp_netif_init());
+    // NOTE: esp_netif_init() は HTTP サーバと共用なので app_main で済ませている
     ESP_ERROR_CHECK(esp_event_loop_create_default());
 
     esp_netif_t *esp_netif = esp_netif_create_default_wifi_sta();
@@ -160,38 +251,163 @@ static void init_wifi()
                                                NULL));
 
     ESP_ERROR_CHECK(esp_netif_set_hostname(esp_netif, WIFI_HOSTNAME));
+
+    ap_cache_load();
+    boot_stat_mark(BOOT_PHASE_WIFI);
 }
 
-static esp_err_t wifi_connect()
+static void wifi_apply_config(bool fast)
 {
-    ESP_LOGI(TAG, "Start to connect to WiFi.");
-    xSemaphoreTake(wifi_start, portMAX_DELAY);
-    ESP_ERROR_CHECK(esp_wifi_start());
-    if (xSemaphoreTake(wifi_start, 10000 / portTICK_RATE_MS) == pdTRUE) {
-        ESP_LOGI(TAG, "Succeeded in connecting to WiFi.");
-        wifi_log_rssi();
-        wifi_discon_count = 0;
-        xSemaphoreGive(wifi_start);
-        return ESP_OK;
+    wifi_config_t wifi_config;
+
+    ESP_ERROR_CHECK(esp_wifi_get_config(WIFI_IF_STA, &wifi_config));
+    if (fast) {
+        memcpy(wifi_config.sta.bssid, ap_cache.bssid, sizeof(wifi_config.sta.bssid));
+        wifi_config.sta.bssid_set = true;
+        wifi_config.sta.channel = ap_cache.channel;
+        wifi_config.sta.scan_method = WIFI_FAST_SCAN;
     } else {
-        ESP_LOGE(TAG, "Failed to connect to WiFi.");
-        wifi_discon_count++;
-        xSemaphoreGive(wifi_start);
-        xSemaphoreGive(wifi_stop);
-        return ESP_FAIL;
+        wifi_config.sta.bssid_set = false;
+        wifi_config.sta.channel = 0;
+        wifi_config.sta.scan_method = WIFI_ALL_CHANNEL_SCAN;
+    }
+    ESP_ERROR_CHECK(esp_wifi_set_config(ESP_IF_WIFI_STA, &wifi_config));
+}
+
+// NOTE: 接続を始める直前に呼ぶ．前回の AP 情報があればスキャンを省略する
+static void wifi_connect_begin()
+{
+    connect_fast = ap_cache_valid;
+    wifi_apply_config(connect_fast);
+
+    connect_start_time = esp_timer_get_time();
+    sta_connected_time = 0;
+}
+
+static void wifi_on_connected()
+{
+    wifi_ap_record_t ap_info;
+    int64_t got_ip_time = esp_timer_get_time();
+
+    // NOTE: ドライバはスキャン・認証・アソシエーションを個別に通知しないので，まとめて計測する
+    wifi_stat.fast = connect_fast;
+    wifi_stat.total_ms = (got_ip_time - connect_start_time) / 1000;
+    if (sta_connected_time != 0) {
+        wifi_stat.assoc_ms = (sta_connected_time - connect_start_time) / 1000;
+        wifi_stat.dhcp_ms = (got_ip_time - sta_connected_time) / 1000;
+    }
+    LOG_RING_I("WiFi connect time: total=%dms (scan+auth+assoc=%dms, dhcp=%dms, fast=%s)",
+               wifi_stat.total_ms, wifi_stat.assoc_ms, wifi_stat.dhcp_ms, connect_fast ? "yes" : "no");
+
+    wifi_log_rssi();
+    if (esp_wifi_sta_get_ap_info(&ap_info) == ESP_OK) {
+        ap_cache_save(ap_info.bssid, ap_info.primary);
+    }
+
+    // NOTE: 接続直後に一度 ping を打ち，ゲートウェイまで通じるか確かめる
+    probe_deadline = xTaskGetTickCount();
+    timeout_start = 0;
+
+    boot_stat_mark(BOOT_PHASE_GOT_IP);
+
+    if (wifi_listener != NULL) {
+        wifi_listener(true);
+    }
+}
+
+static void wifi_do_action(wifi_action_t action)
+{
+    switch (action) {
+    case WIFI_ACTION_START:
+        LOG_RING_I("Start to connect to WiFi.");
+        wifi_connect_begin();
+        ESP_ERROR_CHECK(esp_wifi_start());
+        break;
+    case WIFI_ACTION_REASSOCIATE:
+        LOG_RING_I("Reassociate to the AP.");
+        wifi_connect_begin();
+        esp_wifi_connect();
+        break;
+    case WIFI_ACTION_DISCONNECT:
+        LOG_RING_I("Disconnect WiFi.");
+        esp_wifi_disconnect();
+        break;
+    case WIFI_ACTION_RESTART_DRIVER:
+        LOG_RING_I("Restart WiFi driver.");
+        ESP_ERROR_CHECK(esp_wifi_stop());
+        wifi_connect_begin();
+        ESP_ERROR_CHECK(esp_wifi_start());
+        break;
+    case WIFI_ACTION_REBOOT:
+        ESP_LOGI(TAG, "Too many connect failures, restarting...");
+        esp_restart();
+        break;
+    default:
+        break;
+    }
+}
+
+static void wifi_dispatch(wifi_ev_t ev)
+{
+    wifi_state_t prev = wifi_fsm.state;
+    wifi_fsm_output_t output;
+
+    wifi_fsm.connect_timeout_ms = ap_cache_valid ? FAST_CONNECT_TIMEOUT_MS : CONNECT_TIMEOUT_MS;
+    output = wifi_fsm_handle(&wifi_fsm, ev);
+
+    if (output.timer_set) {
+        timer_active = (output.timer_ms != 0);
+        timer_deadline = xTaskGetTickCount() + output.timer_ms / portTICK_RATE_MS;
     }
+
+    if (wifi_fsm.state != prev) {
+        LOG_RING_I("WiFi state: %s -> %s (failure=%d)",
+                   wifi_fsm_state_str(prev), wifi_fsm_state_str(wifi_fsm.state), wifi_fsm.failure);
+
+        if ((prev == WIFI_STATE_CONNECTED) && (wifi_listener != NULL)) {
+            wifi_listener(false);
+        }
+        if (wifi_fsm.state == WIFI_STATE_CONNECTED) {
+            wifi_on_connected();
+        } else if (wifi_fsm.state == WIFI_STATE_BACKOFF) {
+            if ((prev == WIFI_STATE_CONNECTING) && connect_fast) {
+                // NOTE: AP が変わった可能性があるので，次はフルスキャンでやり直す
+                LOG_RING_W("Fast connect failed, fall back to full scan.");
+                ap_cache_clear();
+            }
+            LOG_RING_I("Retry after %dms.", output.timer_ms);
+        }
+    }
+
+    wifi_do_action(output.action);
+}
+
+void wifi_task_set_listener(wifi_task_listener_t listener)
+{
+    wifi_listener = listener;
+}
+
+void wifi_task_get_stat(wifi_task_stat_t *stat)
+{
+    *stat = wifi_stat;
+    stat->state = wifi_fsm.state;
+    stat->failure = wifi_fsm.failure;
 }
 
 //////////////////////////////////////////////////////////////////////
 // Ping Function
 static void ping_on_success(esp_ping_handle_t hdl, void *args)
 {
-    // Do nothing
+    uint32_t elapsed_time;
+
+    ESP_ERROR_CHECK(esp_ping_get_profile(hdl, ESP_PING_PROF_TIMEGAP,
+                                         &elapsed_time, sizeof(elapsed_time)));
+    link_stat_record(elapsed_time, false);
 }
 
 static void ping_on_timeout(esp_ping_handle_t hdl, void *args)
 {
-    // Do nothing
+    link_stat_record(0, true);
 }
 
 static void ping_on_end(esp_ping_handle_t hdl, void *args)
@@ -207,7 +423,8 @@ static void ping_on_end(esp_ping_handle_t hdl, void *args)
     xSemaphoreGive(ping_end);
 }
 
-void ping_gateway()
+// NOTE: 直近の損失の有無に応じて ping の回数を決め，次の ping までの間隔を返す
+uint32_t ping_gateway()
 {
     ip_addr_t target_addr;
     tcpip_adapter_ip_info_t ip_info;
@@ -221,16 +438,26 @@ void ping_gateway()
         .cb_args = NULL
     };
 
+    bool lossy = link_stat_is_lossy();
+    uint32_t interval_ms = lossy ? PROBE_DENSE_INTERVAL_MS : PROBE_SPARSE_INTERVAL_MS;
+
+    link_stat_set_interval(interval_ms);
+
     if (tcpip_adapter_get_ip_info(TCPIP_ADAPTER_IF_STA, &ip_info) != ESP_OK) {
         all_timeout = true;
-        return;
+        return interval_ms;
     }
 
     target_addr.type = 0;
     target_addr.u_addr.ip4.addr = ip_info.gw.addr;
     ping_config.target_addr = target_addr;
 
-    ping_config.count = PING_COUNT;
+    if (lossy) {
+        ping_config.count = PROBE_DENSE_COUNT;
+        ping_config.interval_ms = PROBE_DENSE_PING_INTERVAL_MS;
+    } else {
+        ping_config.count = PROBE_SPARSE_COUNT;
+    }
 
     esp_ping_new_session(&ping_config, &cbs, &ping);
 
@@ -239,56 +466,79 @@ void ping_gateway()
     xSemaphoreTake(ping_end, portMAX_DELAY);
 
     xSemaphoreGive(ping_end);
+
+    return interval_ms;
+}
+
+// NOTE: 期限までの残り時間を返す．期限を過ぎていたら 0
+static TickType_t wifi_ticks_until(TickType_t deadline)
+{
+    TickType_t now = xTaskGetTickCount();
+
+    return ((int32_t)(deadline - now) > 0) ? (deadline - now) : 0;
+}
+
+static void wifi_probe()
+{
+    uint32_t interval_ms = ping_gateway();
+
+    probe_deadline = xTaskGetTickCount() + interval_ms / portTICK_RATE_MS;
+
+    // NOTE: ping の間隔が変わるので，回数ではなく途絶している時間で判断する
+    if (all_timeout) {
+        LOG_RING_W("Ping timeout occurred.");
+        if (timeout_start == 0) {
+            timeout_start = xTaskGetTickCount();
+        } else if ((xTaskGetTickCount() - timeout_start) >= (TIMEOUT_THRESHOLD_MS / portTICK_RATE_MS)) {
+            LOG_RING_W("Too many ping timeout, reconnecting...");
+            timeout_start = 0;
+            wifi_dispatch(WIFI_EV_LINK_LOST);
+        }
+    } else {
+        timeout_start = 0;
+        wifi_dispatch(WIFI_EV_PING_OK);
+    }
 }
 
 static void wifi_watch_task(void *param)
 {
-    SemaphoreHandle_t mutex = (SemaphoreHandle_t)param;
-    uint32_t timeout_repeat = 0;
+    wifi_ev_t ev;
+    TickType_t wait;
 
     ESP_ERROR_CHECK(esp_task_wdt_init(60, true));
     ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
 
-    vSemaphoreCreateBinary(wifi_start);
-    vSemaphoreCreateBinary(wifi_stop);
     vSemaphoreCreateBinary(ping_end);
+    wifi_event_queue = xQueueCreate(WIFI_EVENT_QUEUE_SIZE, sizeof(wifi_ev_t));
+    wifi_fsm_init(&wifi_fsm, esp_random());
 
     init_wifi();
-    xSemaphoreTake(wifi_stop, portMAX_DELAY);
-    if ((wifi_connect() == ESP_OK) && (mutex != NULL)) {
-        xSemaphoreGive(mutex);
-    }
+    wifi_dispatch(WIFI_EV_START);
 
     while (1) {
-        if (xSemaphoreTake(wifi_stop, 10000 / portTICK_RATE_MS) == pdTRUE) {
-            ESP_LOGI(TAG, "WiFi disconnect count: %d",  wifi_discon_count);
-            // NOTE: 接続に一定回数連続して失敗したら，何かがおかしいので再起動する．
-            if (wifi_discon_count >= FATAL_DISCON_COUNT) {
-                ESP_LOGI(TAG, "Too many connect failures, restarting...");
-                esp_restart();
-            }
-            wifi_disconnect();
-            if ((wifi_connect() == ESP_OK) && (mutex != NULL)) {
-                xSemaphoreGive(mutex);
-            }
+        wait = WATCH_INTERVAL_MS / portTICK_RATE_MS;
+        if (timer_active && (wifi_ticks_until(timer_deadline) < wait)) {
+            wait = wifi_ticks_until(timer_deadline);
+        }
+        if ((wifi_fsm.state == WIFI_STATE_CONNECTED) && (wifi_ticks_until(probe_deadline) < wait)) {
+            wait = wifi_ticks_until(probe_deadline);
         }
 
-        ping_gateway();
-
-        if (all_timeout) {
-            ESP_LOGW(TAG, "Ping timeout occurred.");
-            if (++timeout_repeat == TIMEOUT_THRESHOLD) {
-                ESP_LOGI(TAG, "Too many ping timeout, restarting...");
-                esp_restart();
-            }
-        } else {
-            timeout_repeat = 0;
+        if (xQueueReceive(wifi_event_queue, &ev, wait) == pdTRUE) {
+            wifi_dispatch(ev);
+        }
+        if (timer_active && (wifi_ticks_until(timer_deadline) == 0)) {
+            timer_active = false;
+            wifi_dispatch(WIFI_EV_TIMER);
+        }
+        if ((wifi_fsm.state == WIFI_STATE_CONNECTED) && (wifi_ticks_until(probe_deadline) == 0)) {
+            wifi_probe();
         }
         ESP_ERROR_CHECK(esp_task_wdt_reset());
     }
 }
 
-void wifi_task_start(SemaphoreHandle_t mutex)
+void wifi_task_start(void)
 {
-    xTaskCreate(wifi_watch_task, "wifi_watch_task", 4096, mutex, 10, NULL);
+    xTaskCreate(wifi_watch_task, "wifi_watch_task", 4096, NULL, 10, NULL);
 }
@@ -1 +1,20 @@
-void wifi_task_start(SemaphoreHandle_t mutex);
+#include "freertos/FreeRTOS.h"
+#include "freertos/semphr.h"
+
+#include "wifi_fsm.h"
+
+typedef struct wifi_task_stat {
+    bool fast;              // 前回の AP 情報を使って接続したか
+    uint32_t total_ms;      // esp_wifi_start から IP 取得まで
+    uint32_t assoc_ms;      // スキャン・認証・アソシエーション
+    uint32_t dhcp_ms;
+    wifi_state_t state;
+    uint32_t failure;       // 連続して接続に失敗した回数
+} wifi_task_stat_t;
+
+// NOTE: wifi_watch_task から呼ばれるので，ブロックしてはいけない
+typedef void (*wifi_task_listener_t)(bool connected);
+
+void wifi_task_start(void);
+void wifi_task_set_listener(wifi_task_listener_t listener);
+void wifi_task_get_stat(wifi_task_stat_t *stat);
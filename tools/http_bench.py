@@ -0,0 +1,333 @@
+#!/usr/bin/env python3
+#
+# Load test for the HTTP routes of ESP32 WiFi IO.
+#
+# Usage: http_bench.py [--clients N] [--duration SEC] [--route NAME]...
+#                      [--port PORT] [--ota-port PORT] [--ota FIRMWARE]
+#                      [--throttled-ok] [--save FILE] [--compare FILE] IP_ADDR
+#
+# Every route is driven by N concurrent keep-alive clients in turn, and
+# req/s and latency percentiles are reported. The WebSocket route sends
+# a push command and waits for its result on the same connection.
+# Results can be saved as a baseline and compared with later runs.
+#
+# With --ota, a firmware image is uploaded in the background during the
+# whole run to show how much an OTA update slows the other routes. The
+# last piece is never sent, so the image is not activated.
+#
+# With --throttled-ok, rate-limited answers (429 or retry_after_ms) count
+# as served, so that the GPIO routes yield enough samples to show how
+# quickly the server dispatches them.
+
+import argparse
+import base64
+import hashlib
+import http.client
+import json
+import os
+import socket
+import struct
+import sys
+import threading
+import time
+
+ROUTES = {
+    'redirect': ('GET', '/', None, {}),
+    'app':      ('GET', '/app/', None, {}),
+    'app_js':   ('GET', '/app/main.js', None, {'Accept-Encoding': 'gzip'}),
+    'app_304':  ('GET', '/app/', None, {'If-None-Match': '*'}),
+    'status':   ('GET', '/status/', None, {}),
+    'metrics':  ('GET', '/metrics', None, {}),
+    'ota':      ('GET', '/ota/', None, {}),
+    'gpio':     ('GET', '/api/gpio/{gpio}?width_us={width}', None, {}),
+    'batch':    ('POST', '/api/gpio/batch',
+                 '[{{"gpio":{gpio},"level":0,"width_us":{width}}}]',
+                 {'Content-Type': 'application/json'}),
+    'seq':      ('POST', '/api/seq', '[{{"gpio":{gpio},"width_us":{width}}}]',
+                 {'Content-Type': 'application/json'}),
+    'seq_stat': ('GET', '/api/seq', None, {}),
+    'seq_stop': ('DELETE', '/api/seq', None, {}),
+    'log':      ('GET', '/log', None, {}),
+    'tasks':    ('GET', '/debug/tasks', None, {}),
+    'ws':       ('WS', '/ws', '{{"type":"push","id":{{id}},"gpio":{gpio},"width_us":{width}}}', {}),
+}
+
+# Routes served by the second server for long-running requests
+BULK_ROUTES = {'ota'}
+
+OTA_CHUNK_SIZE = 16 * 1024
+
+WS_GUID = '258EAFA5-E914-47DA-95CA-C5AB0DC85B11'
+
+
+def percentile(sorted_list, p):
+    if len(sorted_list) == 0:
+        return 0.0
+    return sorted_list[min(len(sorted_list) - 1, int(len(sorted_list) * p / 100))]
+
+
+class WebSocket:
+    # Minimal client for text frames (RFC 6455), enough to talk to /ws
+
+    def __init__(self, host, path, timeout):
+        addr, port = host.rsplit(':', 1)
+        self.sock = socket.create_connection((addr, int(port)), timeout=timeout)
+        self.sock.setsockopt(socket.IPPROTO_TCP, socket.TCP_NODELAY, 1)
+        self.buf = b''
+
+        key = base64.b64encode(os.urandom(16)).decode()
+        self.sock.sendall(('GET %s HTTP/1.1\r\nHost: %s\r\nUpgrade: websocket\r\n'
+                           'Connection: Upgrade\r\nSec-WebSocket-Key: %s\r\n'
+                           'Sec-WebSocket-Version: 13\r\n\r\n' % (path, host, key)).encode())
+        while b'\r\n\r\n' not in self.buf:
+            self.fill()
+        head, self.buf = self.buf.split(b'\r\n\r\n', 1)
+        accept = base64.b64encode(hashlib.sha1((key + WS_GUID).encode()).digest()).decode()
+        if (not head.startswith(b'HTTP/1.1 101')) or (accept.encode() not in head):
+            self.sock.close()
+            raise http.client.HTTPException('WebSocket handshake failed')
+
+    def fill(self):
+        data = self.sock.recv(4096)
+        if not data:
+            raise ConnectionError('WebSocket closed')
+        self.buf += data
+
+    def read(self, size):
+        while len(self.buf) < size:
+            self.fill()
+        data, self.buf = self.buf[:size], self.buf[size:]
+        return data
+
+    def send_text(self, text):
+        payload = text.encode()
+        mask = os.urandom(4)
+        if len(payload) < 126:
+            head = struct.pack('!BB', 0x81, 0x80 | len(payload))
+        else:
+            head = struct.pack('!BBH', 0x81, 0x80 | 126, len(payload))
+        self.sock.sendall(head + mask + bytes(b ^ mask[i % 4] for i, b in enumerate(payload)))
+
+    def recv_text(self):
+        while True:
+            b0, b1 = self.read(2)
+            size = b1 & 0x7F
+            if size == 126:
+                size = struct.unpack('!H', self.read(2))[0]
+            elif size == 127:
+                size = struct.unpack('!Q', self.read(8))[0]
+            payload = self.read(size)
+            if (b0 & 0x0F) == 0x1:
+                return payload.decode()
+            if (b0 & 0x0F) == 0x8:
+                raise ConnectionError('WebSocket closed')
+
+    def close(self):
+        self.sock.close()
+
+
+def ws_worker(host, route, deadline, latency_list, error_list, throttled_ok):
+    method, path, body, headers = route
+    ws = None
+    cmd_id = 0
+
+    while time.time() < deadline:
+        try:
+            if ws is None:
+                ws = WebSocket(host, path, 10)
+            cmd_id += 1
+            start = time.perf_counter()
+            ws.send_text(body.replace('{id}', str(cmd_id)))
+            # NOTE: Pushed state/status messages may arrive before the result
+            while True:
+                message = json.loads(ws.recv_text())
+                if (message.get('type') == 'result') and (message.get('id') == cmd_id):
+                    break
+            elapsed = time.perf_counter() - start
+
+            if (message.get('status') != 'OK') and \
+               not (throttled_ok and ('retry_after_ms' in message)):
+                error_list.append(message.get('error'))
+            else:
+                latency_list.append(elapsed * 1000)
+        except (OSError, ValueError, http.client.HTTPException) as e:
+            error_list.append(str(e))
+            if ws is not None:
+                ws.close()
+            ws = None
+
+    if ws is not None:
+        ws.close()
+
+
+def worker(host, route, deadline, latency_list, error_list, throttled_ok):
+    method, path, body, headers = route
+    conn = None
+
+    while time.time() < deadline:
+        try:
+            if conn is None:
+                conn = http.client.HTTPConnection(host, timeout=10)
+            start = time.perf_counter()
+            conn.request(method, path, body, headers)
+            res = conn.getresponse()
+            res.read()
+            elapsed = time.perf_counter() - start
+
+            if (res.status >= 400) and not (throttled_ok and (res.status == 429)):
+                error_list.append(res.status)
+            else:
+                latency_list.append(elapsed * 1000)
+            if res.getheader('Connection', '').lower() == 'close':
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException) as e:
+            error_list.append(str(e))
+            if conn is not None:
+                conn.close()
+            conn = None
+
+    if conn is not None:
+        conn.close()
+
+
+def ota_worker(host, image, stop_event, stat):
+    digest = hashlib.sha256(image).hexdigest()
+
+    while not stop_event.is_set():
+        session = None
+        offset = 0
+        # NOTE: Stop before the last piece so that the image is never activated
+        while (not stop_event.is_set()) and (offset + OTA_CHUNK_SIZE < len(image)):
+            end = offset + OTA_CHUNK_SIZE - 1
+            headers = {
+                'Content-Type': 'application/octet-stream',
+                'Content-Range': 'bytes %d-%d/%d' % (offset, end, len(image)),
+                'X-OTA-SHA256': digest,
+            }
+            if session is not None:
+                headers['X-OTA-Session'] = session
+            try:
+                conn = http.client.HTTPConnection(host, timeout=30)
+                conn.request('POST', '/ota/', image[offset:end + 1], headers)
+                res = conn.getresponse()
+                res.read()
+                conn.close()
+            except (OSError, http.client.HTTPException):
+                stat['errors'] += 1
+                time.sleep(1)
+                break
+            if res.status != 200:
+                stat['errors'] += 1
+                time.sleep(1)
+                break
+            session = res.getheader('X-OTA-Session')
+            offset = end + 1
+            stat['bytes'] += OTA_CHUNK_SIZE
+
+
+def bench(host, route, clients, duration, throttled_ok):
+    latency_list = []
+    error_list = []
+    deadline = time.time() + duration
+
+    thread_list = [threading.Thread(target=ws_worker if route[0] == 'WS' else worker,
+                                    args=(host, route, deadline, latency_list, error_list, throttled_ok))
+                   for i in range(clients)]
+    start = time.time()
+    for thread in thread_list:
+        thread.start()
+    for thread in thread_list:
+        thread.join()
+    elapsed = time.time() - start
+
+    latency_list.sort()
+    return {
+        'requests': len(latency_list),
+        'errors': len(error_list),
+        'rps': len(latency_list) / elapsed,
+        'p50_ms': percentile(latency_list, 50),
+        'p95_ms': percentile(latency_list, 95),
+        'p99_ms': percentile(latency_list, 99),
+        'max_ms': latency_list[-1] if latency_list else 0.0,
+    }
+
+
+def show(name, result, base):
+    line = '%-8s %8d %6d %8.1f %8.1f %8.1f %8.1f %8.1f' % (
+        name, result['requests'], result['errors'], result['rps'],
+        result['p50_ms'], result['p95_ms'], result['p99_ms'], result['max_ms'])
+    if base is not None:
+        line += '   (req/s %+.1f%%, p99 %+.1f%%)' % (
+            (result['rps'] / base['rps'] - 1) * 100 if base['rps'] else 0,
+            (result['p99_ms'] / base['p99_ms'] - 1) * 100 if base['p99_ms'] else 0)
+    print(line)
+
+
+def main():
+    parser = argparse.ArgumentParser(description='HTTP load test.')
+    parser.add_argument('--clients', type=int, default=4, help='concurrent clients')
+    parser.add_argument('--duration', type=float, default=10, help='seconds per route')
+    parser.add_argument('--route', action='append', choices=sorted(ROUTES.keys()),
+                        help='route to test (default: all)')
+    parser.add_argument('--gpio', type=int, default=32, help='GPIO used by gpio/batch')
+    parser.add_argument('--width', type=int, default=1000, help='pulse width in us')
+    parser.add_argument('--ota', help='upload this firmware in the background')
+    parser.add_argument('--throttled-ok', action='store_true',
+                        help='count rate-limited answers as served')
+    parser.add_argument('--port', type=int, default=80, help='port of the HTTP server')
+    parser.add_argument('--ota-port', type=int, default=8080, help='port of the OTA server')
+    parser.add_argument('--save', help='save results as JSON')
+    parser.add_argument('--compare', help='compare with saved results')
+    parser.add_argument('host')
+    args = parser.parse_args()
+
+    baseline = {}
+    if args.compare:
+        with open(args.compare) as f:
+            baseline = json.load(f)
+
+    main_host = '%s:%d' % (args.host, args.port)
+    bulk_host = '%s:%d' % (args.host, args.ota_port)
+
+    ota_thread = None
+    ota_stop = threading.Event()
+    ota_stat = {'bytes': 0, 'errors': 0}
+    if args.ota:
+        with open(args.ota, 'rb') as f:
+            image = f.read()
+        ota_thread = threading.Thread(target=ota_worker,
+                                      args=(bulk_host, image, ota_stop, ota_stat))
+        ota_start = time.time()
+        ota_thread.start()
+
+    print('%-8s %8s %6s %8s %8s %8s %8s %8s' % (
+        'route', 'requests', 'errors', 'req/s', 'p50 ms', 'p95 ms', 'p99 ms', 'max ms'))
+
+    result_map = {}
+    for name in (args.route or ROUTES.keys()):
+        method, path, body, headers = ROUTES[name]
+        path = path.format(gpio=args.gpio, width=args.width)
+        if body is not None:
+            body = body.format(gpio=args.gpio, width=args.width)
+
+        host = bulk_host if name in BULK_ROUTES else main_host
+        result_map[name] = bench(host, (method, path, body, headers),
+                                 args.clients, args.duration, args.throttled_ok)
+        show(name, result_map[name], baseline.get(name))
+
+    if ota_thread is not None:
+        ota_stop.set()
+        ota_thread.join()
+        print('OTA upload in background: %.1f KB/s, %d errors' % (
+            ota_stat['bytes'] / 1024 / (time.time() - ota_start), ota_stat['errors']))
+
+    if args.save:
+        with open(args.save, 'w') as f:
+            json.dump(result_map, f, indent=2)
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
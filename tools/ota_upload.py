@@ -0,0 +1,112 @@
+#!/usr/bin/env python3
+#
+# Upload firmware to ESP32 WiFi IO in pieces, resuming after failures.
+#
+# Usage: ota_upload.py [--gzip] [--chunk KB] [--port PORT] IP_ADDR FIRMWARE
+
+import argparse
+import gzip
+import hashlib
+import http.client
+import json
+import sys
+import time
+
+RETRY_MAX = 10
+
+
+def query_session(host):
+    conn = http.client.HTTPConnection(host, timeout=10)
+    conn.request('GET', '/ota/')
+    status = json.loads(conn.getresponse().read())
+    conn.close()
+    return status
+
+
+def upload(host, body, digest, chunk_size, use_gzip):
+    session = None
+    offset = 0
+    retry = 0
+
+    while offset < len(body):
+        end = min(offset + chunk_size, len(body)) - 1
+        headers = {
+            'Content-Type': 'application/octet-stream',
+            'Content-Range': 'bytes %d-%d/%d' % (offset, end, len(body)),
+            'X-OTA-SHA256': digest,
+        }
+        if session is not None:
+            headers['X-OTA-Session'] = session
+        if use_gzip:
+            headers['Content-Encoding'] = 'gzip'
+
+        try:
+            conn = http.client.HTTPConnection(host, timeout=30)
+            conn.request('POST', '/ota/', body[offset:end + 1], headers)
+            res = conn.getresponse()
+            text = res.read().decode(errors='replace')
+            conn.close()
+
+            if res.status == 416:
+                offset = int(res.getheader('X-OTA-Offset'))
+                continue
+            elif res.status == 404:
+                session = None
+                offset = 0
+                continue
+            elif res.status != 200:
+                sys.stderr.write('ERROR: %d %s\n' % (res.status, text))
+                return False
+
+            session = res.getheader('X-OTA-Session')
+            offset = end + 1
+            retry = 0
+            sys.stdout.write(text)
+            sys.stdout.flush()
+        except (OSError, http.client.HTTPException) as e:
+            retry += 1
+            if retry > RETRY_MAX:
+                sys.stderr.write('ERROR: %s\n' % e)
+                return False
+            sys.stderr.write('\nRetry (%s)...\n' % e)
+            time.sleep(1)
+            try:
+                status = query_session(host)
+                if (session is not None) and (status.get('session') == session):
+                    offset = status['offset']
+                else:
+                    session = None
+                    offset = 0
+            except (OSError, http.client.HTTPException, ValueError):
+                pass
+
+    return True
+
+
+def main():
+    parser = argparse.ArgumentParser(description='Resumable OTA upload.')
+    parser.add_argument('--gzip', action='store_true', help='compress firmware')
+    parser.add_argument('--chunk', type=int, default=64, help='piece size in KB')
+    parser.add_argument('--port', type=int, default=8080, help='port of the OTA server')
+    parser.add_argument('host')
+    parser.add_argument('firmware')
+    args = parser.parse_args()
+
+    with open(args.firmware, 'rb') as f:
+        image = f.read()
+
+    digest = hashlib.sha256(image).hexdigest()
+    body = gzip.compress(image, 9) if args.gzip else image
+
+    print('Firmware: %d KB (upload %d KB), SHA-256: %s' % (len(image) / 1024, len(body) / 1024, digest))
+
+    start = time.time()
+    if not upload('%s:%d' % (args.host, args.port), body, digest, args.chunk * 1024, args.gzip):
+        return 1
+    print('Elapsed Time: %.2fs' % (time.time() - start))
+
+    return 0
+
+
+if __name__ == '__main__':
+    sys.exit(main())
@@ -0,0 +1,171 @@
+#!/usr/bin/env python3
+#
+# Client for the binary UDP command port of ESP32 WiFi IO.
+#
+# Usage: udp_cmd.py [--key KEY] [--port PORT] IP_ADDR pulse GPIO... [--width US] [--high]
+#        udp_cmd.py [--key KEY] [--port PORT] IP_ADDR bench [--count N] [--gpio GPIO]
+#
+# "pulse" drives the GPIOs in the same way as /api/gpio/NUM. "bench"
+# measures the round-trip time of commands and reports percentiles;
+# without --gpio it sends pings, which only return an acknowledgement.
+
+import argparse
+import hashlib
+import hmac
+import socket
+import struct
+import sys
+import time
+
+MAGIC = b'GP'
+VERSION = 1
+MAC_SIZE = 16
+
+ACTION_PING = 0
+ACTION_PULSE_LOW = 1
+ACTION_PULSE_HIGH = 2
+
+CMD_FORMAT = '<2sBBIQI'
+ACK_FORMAT = '<2sBBII'
+
+STATUS_STR = {
+    0: 'OK',
+    1: 'BAD_FRAME',
+    2: 'AUTH',
+    3: 'INVALID_ARG',
+    4: 'BUSY',
+}
+
+RETRY_MAX = 3
+TIMEOUT_SEC = 0.5
+
+
+class UdpCmd:
+    def __init__(self, host, port, key):
+        self.addr = (host, port)
+        self.key = key.encode() if key else None
+        self.sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self.sock.settimeout(TIMEOUT_SEC)
+        # NOTE: With a key, the device only accepts increasing sequence numbers,
+        # so start from the current time to stay ahead of earlier runs.
+        self.seq = int(time.time() * 1000) & 0xFFFFFFFF
+
+    def mac(self, data):
+        return hmac.new(self.key, data, hashlib.sha256).digest()[:MAC_SIZE]
+
+    def send(self, action, mask, width_us):
+        self.seq = (self.seq + 1) & 0xFFFFFFFF
+        frame = struct.pack(CMD_FORMAT, MAGIC, VERSION, action, self.seq, mask, width_us)
+        if self.key:
+            frame += self.mac(frame)
+
+        # NOTE: The device answers a resent frame without running it again
+        for retry in range(RETRY_MAX):
+            self.sock.sendto(frame, self.addr)
+            deadline = time.perf_counter() + TIMEOUT_SEC
+            while time.perf_counter() < deadline:
+                try:
+                    data = self.sock.recv(64)
+                except socket.timeout:
+                    break
+                ack = self.parse(data)
+                if (ack is not None) and (ack[0] == self.seq):
+                    return ack
+        return None
+
+    def parse(self, data):
+        size = struct.calcsize(ACK_FORMAT)
+        if len(data) != size + (MAC_SIZE if self.key else 0):
+            return None
+        if self.key and not hmac.compare_digest(self.mac(data[:size]), data[size:]):
+            return None
+        magic, version, status, seq, retry_after_ms = struct.unpack(ACK_FORMAT, data[:size])
+        if (magic != MAGIC) or (version != VERSION):
+            return None
+        return (seq, status, retry_after_ms)
+
+
+def percentile(sorted_list, p):
+    if len(sorted_list) == 0:
+        return 0.0
+    return sorted_list[min(len(sorted_list) - 1, int(len(sorted_list) * p / 100))]
+
+
+def cmd_pulse(client, args):
+    mask = 0
+    for gpio in args.gpio:
+        mask |= 1 << gpio
+    action = ACTION_PULSE_HIGH if args.high else ACTION_PULSE_LOW
+
+    ack = client.send(action, mask, args.width)
+    if ack is None:
+        sys.stderr.write('ERROR: No response.\n')
+        return 1
+    seq, status, retry_after_ms = ack
+    print('%s%s' % (STATUS_STR.get(status, str(status)),
+                    ' (retry after %d ms)' % retry_after_ms if retry_after_ms else ''))
+    return 0 if status == 0 else 1
+
+
+def cmd_bench(client, args):
+    latency_list = []
+    lost = 0
+    error = 0
+
+    if args.gpio is None:
+        action, mask = ACTION_PING, 0
+    else:
+        action, mask = ACTION_PULSE_LOW, 1 << args.gpio
+
+    for i in range(args.count):
+        start = time.perf_counter()
+        ack = client.send(action, mask, args.width)
+        elapsed = time.perf_counter() - start
+        if ack is None:
+            lost += 1
+        elif ack[1] != 0:
+            error += 1
+        else:
+            latency_list.append(elapsed * 1000)
+        if args.interval:
+            time.sleep(args.interval / 1000)
+
+    latency_list.sort()
+    print('%8s %6s %6s %8s %8s %8s %8s %8s' % (
+        'requests', 'lost', 'errors', 'min ms', 'p50 ms', 'p95 ms', 'p99 ms', 'max ms'))
+    print('%8d %6d %6d %8.2f %8.2f %8.2f %8.2f %8.2f' % (
+        args.count, lost, error,
+        latency_list[0] if latency_list else 0.0,
+        percentile(latency_list, 50), percentile(latency_list, 95),
+        percentile(latency_list, 99), latency_list[-1] if latency_list else 0.0))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description='UDP command client.')
+    parser.add_argument('--port', type=int, default=5005, help='UDP port')
+    parser.add_argument('--key', help='HMAC key (UDP_CMD_KEY)')
+    parser.add_argument('host')
+    sub = parser.add_subparsers(dest='command', required=True)
+
+    pulse = sub.add_parser('pulse', help='drive GPIOs')
+    pulse.add_argument('gpio', type=int, nargs='+')
+    pulse.add_argument('--width', type=int, default=300000, help='pulse width in us')
+    pulse.add_argument('--high', action='store_true', help='drive high during the pulse')
+
+    bench = sub.add_parser('bench', help='measure round-trip time')
+    bench.add_argument('--count', type=int, default=1000, help='number of commands')
+    bench.add_argument('--gpio', type=int, help='send pulses to this GPIO instead of pings')
+    bench.add_argument('--width', type=int, default=1000, help='pulse width in us')
+    bench.add_argument('--interval', type=float, default=0, help='wait between commands in ms')
+
+    args = parser.parse_args()
+    client = UdpCmd(args.host, args.port, args.key)
+
+    if args.command == 'pulse':
+        return cmd_pulse(client, args)
+    return cmd_bench(client, args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())